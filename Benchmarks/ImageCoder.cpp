@@ -0,0 +1,165 @@
+//////////////////////////////////////////////////
+//  Copyright (c) 2020 Nara Hiero
+//
+// This file is licensed under GPLv3+
+// Refer to the `License.txt` file included.
+//////////////////////////////////////////////////
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <thread>
+
+#include <CTLib/Image.hpp>
+
+// measures the encode and decode throughput of every GX format, in MB/s of
+// RGBA data, for a few square image sizes, then the speed and PSNR of each
+// CMPR quality, and how CMPR scales with threads
+
+struct Format
+{
+    const char* name;
+    CTLib::ImageFormat format;
+};
+
+const Format FORMATS[] = {
+    {"I4", CTLib::ImageFormat::I4},
+    {"I8", CTLib::ImageFormat::I8},
+    {"IA4", CTLib::ImageFormat::IA4},
+    {"IA8", CTLib::ImageFormat::IA8},
+    {"RGB565", CTLib::ImageFormat::RGB565},
+    {"RGB5A3", CTLib::ImageFormat::RGB5A3},
+    {"RGBA8", CTLib::ImageFormat::RGBA8},
+    {"CMPR", CTLib::ImageFormat::CMPR}
+};
+
+const uint32_t SIZES[] = {256, 1024, 2048};
+
+// creates a noisy gradient, so that CMPR blocks are not trivial
+CTLib::Image makeImage(uint32_t size, bool alpha = true)
+{
+    std::mt19937 rng(size);
+    CTLib::Buffer data(size * size * 4);
+    for (uint32_t y = 0; y < size; ++y)
+    {
+        for (uint32_t x = 0; x < size; ++x)
+        {
+            uint8_t* px = *data + ((y * size) + x) * 4;
+            px[0] = static_cast<uint8_t>((x * 255 / size) ^ (rng() & 0x0F));
+            px[1] = static_cast<uint8_t>((y * 255 / size) ^ (rng() & 0x0F));
+            px[2] = static_cast<uint8_t>(((x + y) * 127 / size) ^ (rng() & 0x0F));
+            px[3] = static_cast<uint8_t>(alpha ? 0xFF - (rng() & 0x3F) : 0xFF);
+        }
+    }
+    return CTLib::Image(size, size, data);
+}
+
+// runs 'func' until at least 'minSeconds' elapsed, returns seconds per run
+template <class F>
+double timeRuns(F func, double minSeconds)
+{
+    using Clock = std::chrono::steady_clock;
+
+    uint32_t runs = 0;
+    Clock::time_point start = Clock::now();
+    double elapsed = 0;
+    do
+    {
+        func();
+        ++runs;
+        elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    }
+    while (elapsed < minSeconds);
+
+    return elapsed / runs;
+}
+
+int main()
+{
+    std::printf("%-8s %6s %14s %14s\n", "Format", "Size", "Encode (MB/s)", "Decode (MB/s)");
+
+    for (uint32_t size : SIZES)
+    {
+        CTLib::Image image = makeImage(size);
+        double megabytes = (size * size * 4) / (1024. * 1024.);
+
+        for (const Format& format : FORMATS)
+        {
+            CTLib::Buffer encoded;
+            double encode = timeRuns([&]() {
+                encoded = CTLib::ImageCoder::encode(image, format.format);
+            }, 0.5);
+
+            double decode = timeRuns([&]() {
+                encoded.rewind();
+                CTLib::ImageCoder::decode(encoded, size, size, format.format);
+            }, 0.5);
+
+            std::printf(
+                "%-8s %6u %14.1f %14.1f\n", format.name, size, megabytes / encode, megabytes / decode
+            );
+        }
+    }
+
+    const struct
+    {
+        const char* name;
+        CTLib::CMPRQuality quality;
+    }
+    QUALITIES[] = {
+        {"Fast", CTLib::CMPRQuality::Fast},
+        {"Normal", CTLib::CMPRQuality::Normal},
+        {"High", CTLib::CMPRQuality::High}
+    };
+
+    constexpr uint32_t QUALITY_SIZE = 1024;
+    // CMPR cannot store partial alpha, which would dominate the PSNR
+    CTLib::Image source = makeImage(QUALITY_SIZE, false);
+    double sourceMegabytes = (QUALITY_SIZE * QUALITY_SIZE * 4) / (1024. * 1024.);
+
+    std::printf("\n%-8s %7s %14s %10s\n", "Format", "Quality", "Encode (MB/s)", "PSNR (dB)");
+
+    for (const auto& quality : QUALITIES)
+    {
+        CTLib::Buffer encoded;
+        double encode = timeRuns([&]() {
+            encoded = CTLib::ImageCoder::encode(source, CTLib::ImageFormat::CMPR, quality.quality);
+        }, 0.5);
+
+        CTLib::Image decoded = CTLib::ImageCoder::decode(
+            encoded, QUALITY_SIZE, QUALITY_SIZE, CTLib::ImageFormat::CMPR
+        );
+        std::printf(
+            "%-8s %7s %14.1f %10.2f\n", "CMPR", quality.name, sourceMegabytes / encode,
+            CTLib::ImageCoder::psnr(decoded, source)
+        );
+    }
+
+    constexpr uint32_t SCALING_SIZE = 2048;
+    CTLib::Image image = makeImage(SCALING_SIZE);
+    double megabytes = (SCALING_SIZE * SCALING_SIZE * 4) / (1024. * 1024.);
+
+    std::printf("\n%-8s %7s %14s %14s\n", "Format", "Threads", "Encode (MB/s)", "Decode (MB/s)");
+
+    uint32_t maxThreads = std::thread::hardware_concurrency();
+    for (uint32_t threads = 1; threads <= maxThreads; threads *= 2)
+    {
+        CTLib::Buffer encoded;
+        double encode = timeRuns([&]() {
+            encoded = CTLib::ImageCoder::encode(image, CTLib::ImageFormat::CMPR, threads);
+        }, 0.5);
+
+        double decode = timeRuns([&]() {
+            encoded.rewind();
+            CTLib::ImageCoder::decode(
+                encoded, SCALING_SIZE, SCALING_SIZE, CTLib::ImageFormat::CMPR, threads
+            );
+        }, 0.5);
+
+        std::printf(
+            "%-8s %7u %14.1f %14.1f\n", "CMPR", threads, megabytes / encode, megabytes / decode
+        );
+    }
+
+    return 0;
+}
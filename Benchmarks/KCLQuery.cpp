@@ -0,0 +1,140 @@
+//////////////////////////////////////////////////
+//  Copyright (c) 2020 Nara Hiero
+//
+// This file is licensed under GPLv3+
+// Refer to the `License.txt` file included.
+//////////////////////////////////////////////////
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <CTLib/KCL.hpp>
+
+// measures the throughput of each kind of KCL query, in queries per second, on
+// a procedural terrain of about 50k triangles, on one thread and on all of them
+
+// count of quads along each side of the terrain
+constexpr uint32_t GRID = 160;
+
+// size of a quad of the terrain
+constexpr float QUAD = 100.f;
+
+// count of queries of each kind
+constexpr uint32_t QUERIES = 200000;
+
+float heightAt(uint32_t x, uint32_t z)
+{
+    return std::sin(x * .11f) * 600.f + std::cos(z * .07f) * 900.f
+        + std::sin((x + z) * .3f) * 80.f;
+}
+
+// creates a KCL of a heightfield, with two triangles per quad
+CTLib::KCL makeTerrain()
+{
+    uint32_t triCount = GRID * GRID * 2;
+    CTLib::Buffer vertices(triCount * 9 * 4);
+    CTLib::Buffer flags(triCount * 2);
+
+    auto putVertex = [&](uint32_t x, uint32_t z) {
+        vertices.putFloat(x * QUAD).putFloat(heightAt(x, z)).putFloat(z * QUAD);
+    };
+    for (uint32_t z = 0; z < GRID; ++z)
+    {
+        for (uint32_t x = 0; x < GRID; ++x)
+        {
+            putVertex(x, z);
+            putVertex(x, z + 1);
+            putVertex(x + 1, z);
+            putVertex(x + 1, z);
+            putVertex(x, z + 1);
+            putVertex(x + 1, z + 1);
+            flags.putShort(0).putShort(1);
+        }
+    }
+    vertices.flip();
+    flags.flip();
+
+    return CTLib::KCL::fromModel(vertices, flags);
+}
+
+// runs 'func' until at least 'minSeconds' elapsed, returns seconds per run
+template <class F>
+double timeRuns(F func, double minSeconds)
+{
+    using Clock = std::chrono::steady_clock;
+
+    uint32_t runs = 0;
+    Clock::time_point start = Clock::now();
+    double elapsed = 0;
+    do
+    {
+        func();
+        ++runs;
+        elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    }
+    while (elapsed < minSeconds);
+
+    return elapsed / runs;
+}
+
+int main()
+{
+    using Clock = std::chrono::steady_clock;
+
+    Clock::time_point start = Clock::now();
+    CTLib::KCL kcl = makeTerrain();
+    double build = std::chrono::duration<double>(Clock::now() - start).count();
+
+    start = Clock::now();
+    CTLib::KCL::Query query(kcl);
+    double setup = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::printf("Terrain: %zu triangles, %zu octree nodes\n",
+        kcl.getTriangles().size(), kcl.getOctree()->getAllNodes().size()
+    );
+    std::printf("Build: %.1f ms, query setup: %.1f ms\n\n", build * 1000, setup * 1000);
+
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> horizontal(0.f, GRID * QUAD);
+    std::uniform_real_distribution<float> vertical(-1500.f, 2500.f);
+    std::uniform_real_distribution<float> unit(-1.f, 1.f);
+
+    std::vector<CTLib::Vector3f> points;
+    std::vector<CTLib::KCL::Query::Ray> rays;
+    for (uint32_t i = 0; i < QUERIES; ++i)
+    {
+        CTLib::Vector3f p(horizontal(rng), vertical(rng), horizontal(rng));
+        points.push_back(p);
+        rays.push_back({p, {unit(rng), unit(rng) - .5f, unit(rng)}, 3000.f});
+    }
+
+    uint32_t hwThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    std::printf("%-12s %16s %16s\n", "Query", "1 thread (q/s)", "All threads (q/s)");
+    auto report = [&](const char* name, auto run) {
+        double single = timeRuns([&]() { run(1); }, .5);
+        double multi = timeRuns([&]() { run(hwThreads); }, .5);
+        std::printf("%-12s %16.0f %16.0f\n", name, QUERIES / single, QUERIES / multi);
+    };
+
+    report("Ground", [&](uint32_t threads) { query.findGround(points, 4000.f, threads); });
+    report("Raycast", [&](uint32_t threads) { query.raycast(rays, threads); });
+    report("Closest", [&](uint32_t threads) { query.findClosest(points, 300.f, threads); });
+    report("Sphere", [&](uint32_t) {
+        size_t found = 0;
+        for (const CTLib::Vector3f& p : points)
+        {
+            found += query.findTriangles(p, 300.f).size();
+        }
+        if (found == 0)
+        {
+            std::printf("(no triangle found)\n");
+        }
+    });
+
+    return 0;
+}
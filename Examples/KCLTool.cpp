@@ -0,0 +1,437 @@
+//////////////////////////////////////////////////
+//  Copyright (c) 2020 Nara Hiero
+//
+// This file is licensed under GPLv3+
+// Refer to the `License.txt` file included.
+//////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <CTLib/KCL.hpp>
+#include <CTLib/KMP.hpp>
+#include <CTLib/SZS.hpp>
+#include <CTLib/U8.hpp>
+#include <CTLib/Utilities.hpp>
+
+int cmdHelp(std::vector<std::string>& args);
+int cmdProfile(std::vector<std::string>& args);
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        std::cout << "Type `KCLTool help` for more info on this tool" << std::endl;
+        return EXIT_SUCCESS;
+    }
+
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i)
+    {
+        args.push_back(argv[i]);
+    }
+
+    if (args[0] == "help")
+    {
+        return cmdHelp(args);
+    }
+    else if (args[0] == "profile")
+    {
+        return cmdProfile(args);
+    }
+    else
+    {
+        std::cout << "Unknown command! Type `KCLTool help` for help" << std::endl;
+        return EXIT_FAILURE;
+    }
+}
+
+int cmdHelp(std::vector<std::string>& args)
+{
+    if (args.size() == 1)
+    {
+        std::cout << "SYNTAX: KCLTool <command> [...]" << std::endl;
+        std::cout << std::endl;
+        std::cout << "Type `KCLTool help <command>` for help on command" << std::endl;
+        std::cout << std::endl;
+        std::cout << "COMMANDS: " << std::endl;
+        std::cout << "  help       Prints help for a specific command" << std::endl;
+        std::cout << "  profile    Reports the octree statistics and query cost of a course" << std::endl;
+        return EXIT_SUCCESS;
+    }
+    else if (args.size() == 2)
+    {
+        if (args[1] == "help")
+        {
+            std::cout << "SYNTAX: KCLTool help <command>" << std::endl;
+            return EXIT_SUCCESS;
+        }
+        else if (args[1] == "profile")
+        {
+            std::cout << "SYNTAX: KCLTool profile <input> [kmp] [options...]" << std::endl;
+            std::cout << std::endl;
+            std::cout << "Reports the octree statistics of the collision of a course, and the" << std::endl;
+            std::cout << "count of triangles tested by queries at points along its enemy routes" << std::endl;
+            std::cout << "or on a grid. Fails if one of the specified maximums is exceeded." << std::endl;
+            std::cout << std::endl;
+            std::cout << "ARGUMENTS: " << std::endl;
+            std::cout << "  input      The course SZS archive, or KCL file" << std::endl;
+            std::cout << "  kmp        OPTIONAL The KMP file, if input is a KCL file" << std::endl;
+            std::cout << std::endl;
+            std::cout << "OPTIONS: " << std::endl;
+            std::cout << "  --step <distance>      The distance between route points (default 50)" << std::endl;
+            std::cout << "  --grid <spacing>       Also adds points on a grid with that spacing" << std::endl;
+            std::cout << "  --cells <count>        The count of worst cells listed (default 10)" << std::endl;
+            std::cout << "  --max-average <tests>  The maximum average of tests per query" << std::endl;
+            std::cout << "  --max-tests <tests>    The maximum tests of a single query" << std::endl;
+            return EXIT_SUCCESS;
+        }
+        else
+        {
+            std::cout << "Unknown command! Type `KCLTool help` for help" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    else
+    {
+        std::cout << "Too many arguments! Type `KCLTool help` for help" << std::endl;
+        return EXIT_FAILURE;
+    }
+}
+
+// reads 'kclData' and 'kmpData' from a course archive, or from a KCL file and
+// an optional KMP file; 'kmpPath' is empty if there is no KMP file
+bool readCourseFiles(
+    std::filesystem::path inPath, std::filesystem::path kmpPath,
+    CTLib::Buffer& kclData, CTLib::Buffer& kmpData, bool& hasKMP
+)
+{
+    if (inPath.extension() != ".szs")
+    {
+        kclData = CTLib::IO::readFile(inPath.generic_string());
+        hasKMP = !kmpPath.empty();
+        if (hasKMP)
+        {
+            kmpData = CTLib::IO::readFile(kmpPath.generic_string());
+        }
+        return true;
+    }
+
+    CTLib::Buffer data = CTLib::IO::readFile(inPath.generic_string());
+    CTLib::U8Arc arc = CTLib::SZS::read(data);
+
+    CTLib::U8Entry* kcl = arc.getEntryAbsolute("./course.kcl");
+    if (kcl == nullptr || kcl->getType() != CTLib::U8EntryType::File)
+    {
+        std::cout << "No `course.kcl` file in the archive!" << std::endl;
+        return false;
+    }
+    kclData = kcl->asFile()->getData();
+
+    CTLib::U8Entry* kmp = arc.getEntryAbsolute("./course.kmp");
+    hasKMP = kmp != nullptr && kmp->getType() == CTLib::U8EntryType::File;
+    if (hasKMP)
+    {
+        kmpData = kmp->asFile()->getData();
+    }
+    return true;
+}
+
+// adds points every 'step' units from 'a' to 'b', on the route and on each
+// side of it at the radius of the points
+void sampleRouteSegment(
+    const CTLib::KMP::ENPT* a, const CTLib::KMP::ENPT* b, float step,
+    std::vector<CTLib::Vector3f>& samples
+)
+{
+    CTLib::Vector3f from = a->getPosition();
+    CTLib::Vector3f dir = b->getPosition() - from;
+
+    CTLib::Vector3f side(-dir[2], 0.f, dir[0]);
+    if (side.lengthSquared() > 0.f)
+    {
+        side = CTLib::Vector3f::unit(side);
+    }
+
+    uint32_t count = std::max(static_cast<uint32_t>(std::ceil(dir.length() / step)), 1u);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        float t = static_cast<float>(i) / count;
+        CTLib::Vector3f pos = from + dir * t;
+        float radius = a->getRadius() + (b->getRadius() - a->getRadius()) * t;
+        samples.push_back(pos);
+        samples.push_back(pos + side * radius);
+        samples.push_back(pos - side * radius);
+    }
+}
+
+void sampleRoutes(const CTLib::KMP& kmp, float step, std::vector<CTLib::Vector3f>& samples)
+{
+    std::vector<CTLib::KMP::ENPT*> points = kmp.getAll<CTLib::KMP::ENPT>();
+    for (CTLib::KMP::ENPH* group : kmp.getAll<CTLib::KMP::ENPH>())
+    {
+        if (group->getFirst() == nullptr || group->getLast() == nullptr)
+        {
+            continue;
+        }
+
+        int16_t first = kmp.indexOf(group->getFirst());
+        int16_t last = kmp.indexOf(group->getLast());
+        for (int16_t i = first; i < last; ++i)
+        {
+            sampleRouteSegment(points[i], points[i + 1], step, samples);
+        }
+        for (CTLib::KMP::ENPH* next : group->getNext())
+        {
+            if (next->getFirst() != nullptr)
+            {
+                sampleRouteSegment(points[last], next->getFirst(), step, samples);
+            }
+        }
+    }
+}
+
+void sampleGrid(const CTLib::KCL& kcl, float spacing, std::vector<CTLib::Vector3f>& samples)
+{
+    CTLib::KCL::Octree* octree = kcl.getOctree();
+    CTLib::Vector3f min = octree->getMinPos();
+    CTLib::Vector3f blockSize = octree->getBlockSize();
+    CTLib::Vector<uint32_t, 3> blocks = octree->getSize();
+    CTLib::Vector3f max = {
+        min[0] + blockSize[0] * blocks[0],
+        min[1] + blockSize[1] * blocks[1],
+        min[2] + blockSize[2] * blocks[2]
+    };
+
+    for (float z = min[2] + spacing / 2.f; z < max[2]; z += spacing)
+    {
+        for (float y = min[1] + spacing / 2.f; y < max[1]; y += spacing)
+        {
+            for (float x = min[0] + spacing / 2.f; x < max[0]; x += spacing)
+            {
+                samples.push_back({x, y, z});
+            }
+        }
+    }
+}
+
+void printProfile(const CTLib::KCL::Profile& profile)
+{
+    const CTLib::KCL::Profile::Sizes& sizes = profile.sizes;
+    std::cout << "SIZES: " << std::endl;
+    std::cout << CTLib::Strings::format("  Header          %10d B", sizes.header) << std::endl;
+    std::cout << CTLib::Strings::format("  Vertices        %10d B", sizes.vertices) << std::endl;
+    std::cout << CTLib::Strings::format("  Normals         %10d B", sizes.normals) << std::endl;
+    std::cout << CTLib::Strings::format("  Triangles       %10d B", sizes.triangles) << std::endl;
+    std::cout << CTLib::Strings::format("  Octree nodes    %10d B", sizes.octreeNodes) << std::endl;
+    std::cout << CTLib::Strings::format("  Triangle lists  %10d B", sizes.triangleLists) << std::endl;
+    std::cout << CTLib::Strings::format("  Total           %10d B", sizes.total) << std::endl;
+    std::cout << std::endl;
+
+    const CTLib::KCL::FlatOctree::Stats& stats = profile.stats;
+    std::cout << CTLib::Strings::format(
+            "OCTREE: %d super nodes, %d leaves (%d empty)",
+            stats.superNodeCount, stats.leafCount, stats.emptyLeafCount
+        ) << std::endl;
+    std::cout << "  Depth      Nodes     Leaves" << std::endl;
+    for (size_t i = 0; i < stats.nodesPerDepth.size(); ++i)
+    {
+        std::cout << CTLib::Strings::format(
+                "  %5d %10d %10d", static_cast<uint32_t>(i), stats.nodesPerDepth[i],
+                stats.leavesPerDepth[i]
+            ) << std::endl;
+    }
+    std::cout << std::endl;
+
+    // counts are grouped by powers of 2
+    std::cout << "LEAF TRIANGLES: " << std::endl;
+    std::cout << "  Triangles  Leaves" << std::endl;
+    for (size_t lo = 0, hi = 0; lo < stats.leavesPerTriangleCount.size(); lo = hi + 1)
+    {
+        hi = std::min(lo == 0 ? 0 : lo * 2 - 1, stats.leavesPerTriangleCount.size() - 1);
+        uint32_t leaves = 0;
+        for (size_t i = lo; i <= hi; ++i)
+        {
+            leaves += stats.leavesPerTriangleCount[i];
+        }
+        std::string range = lo == hi ? std::to_string(lo)
+            : std::to_string(lo) + "-" + std::to_string(hi);
+        std::cout << CTLib::Strings::format("  %9s %7d", range.c_str(), leaves) << std::endl;
+    }
+    std::cout << CTLib::Strings::format(
+            "  Average %.2f per non-empty leaf, %.2f at a random point, %d at most",
+            stats.averageTriangles, stats.averageQueryTriangles, stats.maxTriangles
+        ) << std::endl;
+    std::cout << std::endl;
+
+    std::cout << CTLib::Strings::format(
+            "QUERIES: %d points (%d outside of the octree)",
+            profile.sampleCount, profile.outsideSampleCount
+        ) << std::endl;
+    std::cout << CTLib::Strings::format(
+            "  Average %.2f triangle tests per query, %d at most",
+            profile.averageTests, profile.maxTests
+        ) << std::endl;
+    std::cout << std::endl;
+
+    std::cout << "WORST CELLS: " << std::endl;
+    std::cout << "  Triangles  Points  Depth    Size  Position" << std::endl;
+    for (const CTLib::KCL::Profile::Cell& cell : profile.worstCells)
+    {
+        std::cout << CTLib::Strings::format(
+                "  %9d %7d %6d %7.0f  (%.0f, %.0f, %.0f)", cell.triangles, cell.samples,
+                cell.depth, cell.size, cell.min[0], cell.min[1], cell.min[2]
+            ) << std::endl;
+    }
+}
+
+int cmdProfile(std::vector<std::string>& args)
+{
+    if (args.size() < 2)
+    {
+        std::cout << "Not enough arguments! Type `KCLTool help profile` for help" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::filesystem::path inPath = args[1], kmpPath;
+    float step = 50.f, grid = 0.f, maxAverage = 0.f;
+    uint32_t cells = 10, maxTests = 0;
+    for (size_t i = 2; i < args.size(); ++i)
+    {
+        if (args[i].rfind("--", 0) != 0)
+        {
+            if (!kmpPath.empty())
+            {
+                std::cout << "Too many arguments! Type `KCLTool help profile` for help" << std::endl;
+                return EXIT_FAILURE;
+            }
+            kmpPath = args[i];
+            continue;
+        }
+        if (i + 1 == args.size())
+        {
+            std::cout << "Missing value for " << args[i] << "!" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        const std::string& value = args[++i];
+        try
+        {
+            if (args[i - 1] == "--step")
+            {
+                step = std::stof(value);
+            }
+            else if (args[i - 1] == "--grid")
+            {
+                grid = std::stof(value);
+            }
+            else if (args[i - 1] == "--cells")
+            {
+                cells = static_cast<uint32_t>(std::stoul(value));
+            }
+            else if (args[i - 1] == "--max-average")
+            {
+                maxAverage = std::stof(value);
+            }
+            else if (args[i - 1] == "--max-tests")
+            {
+                maxTests = static_cast<uint32_t>(std::stoul(value));
+            }
+            else
+            {
+                std::cout << "Unknown option " << args[i - 1] << "!" << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        catch (const std::logic_error&)
+        {
+            std::cout << "Invalid value for " << args[i - 1] << "!" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if (step <= 0.f || grid < 0.f)
+    {
+        std::cout << "Distances must be positive!" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (!std::filesystem::is_regular_file(inPath))
+    {
+        std::cout << "Input is a directory or non-existent!" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "Reading course files..." << std::flush;
+    CTLib::Buffer kclData, kmpData;
+    bool hasKMP;
+    std::vector<CTLib::Vector3f> samples;
+    try
+    {
+        if (!readCourseFiles(inPath, kmpPath, kclData, kmpData, hasKMP))
+        {
+            return EXIT_FAILURE;
+        }
+        if (hasKMP)
+        {
+            CTLib::KMP kmp = CTLib::KMP::read(kmpData);
+            sampleRoutes(kmp, step, samples);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cout << std::endl;
+        std::cout << "Invalid course files!" << std::endl;
+        std::cout << std::endl;
+        std::cout << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << " Done!" << std::endl;
+
+    std::cout << "Profiling octree..." << std::flush;
+    CTLib::KCL::Profile profile;
+    try
+    {
+        CTLib::KCL kcl = CTLib::KCL::read(kclData);
+        if (grid > 0.f)
+        {
+            sampleGrid(kcl, grid, samples);
+        }
+        profile = CTLib::KCL::profile(kcl, samples, cells);
+    }
+    catch (const CTLib::KCLError& e)
+    {
+        std::cout << std::endl;
+        std::cout << "Invalid KCL file!" << std::endl;
+        std::cout << std::endl;
+        std::cout << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << " Done!" << std::endl;
+    std::cout << std::endl;
+
+    printProfile(profile);
+
+    bool failed = false;
+    if (maxAverage > 0.f && profile.averageTests > maxAverage)
+    {
+        std::cout << std::endl;
+        std::cout << CTLib::Strings::format(
+                "FAILED: %.2f triangle tests per query on average, more than %.2f",
+                profile.averageTests, maxAverage
+            ) << std::endl;
+        failed = true;
+    }
+    if (maxTests > 0 && profile.maxTests > maxTests)
+    {
+        std::cout << std::endl;
+        std::cout << CTLib::Strings::format(
+                "FAILED: %d triangle tests in a query, more than %d", profile.maxTests, maxTests
+            ) << std::endl;
+        failed = true;
+    }
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -9,6 +9,7 @@
 #include <iostream>
 #include <vector>
 
+#include <CTLib/SZS.hpp>
 #include <CTLib/U8.hpp>
 #include <CTLib/Yaz.hpp>
 
@@ -144,10 +145,9 @@ CTLib::U8Arc readArchive(std::filesystem::path path)
 {
     CTLib::Buffer data = CTLib::IO::readFile(path.generic_string());
 
-    CTLib::Buffer decompressed;
     try
     {
-        decompressed = CTLib::Yaz::decompress(data, CTLib::YazFormat::Yaz0);
+        return CTLib::SZS::read(data);
     }
     catch(const CTLib::YazError& e)
     {
@@ -157,11 +157,6 @@ CTLib::U8Arc readArchive(std::filesystem::path path)
         std::cout << e.what() << std::endl;
         return CTLib::U8Arc();
     }
-
-    try
-    {
-        return CTLib::U8::read(decompressed);
-    }
     catch (const CTLib::U8Error& e)
     {
         std::cout << std::endl;
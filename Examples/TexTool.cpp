@@ -0,0 +1,671 @@
+//////////////////////////////////////////////////
+//  Copyright (c) 2020 Nara Hiero
+//
+// This file is licensed under GPLv3+
+// Refer to the `License.txt` file included.
+//////////////////////////////////////////////////
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <thread>
+#include <vector>
+
+#include <CTLib/BRRES.hpp>
+#include <CTLib/Image.hpp>
+#include <CTLib/Utilities.hpp>
+
+int cmdHelp(std::vector<std::string>& args);
+int cmdCreate(std::vector<std::string>& args);
+int cmdExtract(std::vector<std::string>& args);
+int cmdList(std::vector<std::string>& args);
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        std::cout << "Type `TexTool help` for more info on this tool" << std::endl;
+        return EXIT_SUCCESS;
+    }
+
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i)
+    {
+        args.push_back(argv[i]);
+    }
+
+    if (args[0] == "help")
+    {
+        return cmdHelp(args);
+    }
+    else if (args[0] == "create")
+    {
+        return cmdCreate(args);
+    }
+    else if (args[0] == "extract")
+    {
+        return cmdExtract(args);
+    }
+    else if (args[0] == "list")
+    {
+        return cmdList(args);
+    }
+    else
+    {
+        std::cout << "Unknown command! Type `TexTool help` for help" << std::endl;
+        return EXIT_FAILURE;
+    }
+}
+
+int cmdHelp(std::vector<std::string>& args)
+{
+    if (args.size() == 1)
+    {
+        std::cout << "SYNTAX: TexTool <command> [...]" << std::endl;
+        std::cout << std::endl;
+        std::cout << "Type `TexTool help <command>` for help on command" << std::endl;
+        std::cout << std::endl;
+        std::cout << "COMMANDS: " << std::endl;
+        std::cout << "  help       Prints help for a specific command" << std::endl;
+        std::cout << "  create     Creates a BRRES from the images in a directory" << std::endl;
+        std::cout << "  extract    Extracts the textures of a BRRES as PNG images" << std::endl;
+        std::cout << "  list       Lists the textures in a BRRES" << std::endl;
+        return EXIT_SUCCESS;
+    }
+    else if (args.size() == 2)
+    {
+        if (args[1] == "help")
+        {
+            std::cout << "SYNTAX: TexTool help <command>" << std::endl;
+            return EXIT_SUCCESS;
+        }
+        else if (args[1] == "create")
+        {
+            std::cout << "SYNTAX: TexTool create <directory> [output] [options...]" << std::endl;
+            std::cout << std::endl;
+            std::cout << "Creates a BRRES with one TEX0 per image in a directory" << std::endl;
+            std::cout << std::endl;
+            std::cout << "ARGUMENTS: " << std::endl;
+            std::cout << "  directory  The directory containing the input images" << std::endl;
+            std::cout << "  output     OPTIONAL The path to the output BRRES" << std::endl;
+            std::cout << std::endl;
+            std::cout << "OPTIONS: " << std::endl;
+            std::cout << "  --format <format>       The format of all textures (default: auto)"
+                << std::endl;
+            std::cout << "  --format <name>=<format>  The format of the texture `name`"
+                << std::endl;
+            std::cout << "  --psnr <dB>             The minimum quality of `auto` (default: 35)"
+                << std::endl;
+            std::cout << "  --palette               Allows `auto` to choose palette formats"
+                << std::endl;
+            std::cout << "  --mipmaps <count>       The mipmap count, capped per texture"
+                << std::endl;
+            std::cout << "  --filter <box|kaiser>   The mipmap filter (default: box)" << std::endl;
+            std::cout << "  --gamma                 Filters mipmaps in linear space" << std::endl;
+            std::cout << "  --coverage              Keeps the alpha coverage of mipmaps"
+                << std::endl;
+            std::cout << "  --threads <count>       The count of threads (default: all cores)"
+                << std::endl;
+            std::cout << std::endl;
+            std::cout << "FORMATS: " << std::endl;
+            std::cout << "  auto I4 I8 IA4 IA8 RGB565 RGB5A3 RGBA8 C4 C8 C14X2 CMPR" << std::endl;
+            return EXIT_SUCCESS;
+        }
+        else if (args[1] == "extract")
+        {
+            std::cout << "SYNTAX: TexTool extract <brres> [output] [--threads <count>]"
+                << std::endl;
+            std::cout << std::endl;
+            std::cout << "Extracts the textures of a BRRES as PNG images" << std::endl;
+            std::cout << std::endl;
+            std::cout << "ARGUMENTS: " << std::endl;
+            std::cout << "  brres      The BRRES to be extracted" << std::endl;
+            std::cout << "  output     OPTIONAL The path to the output directory" << std::endl;
+            return EXIT_SUCCESS;
+        }
+        else if (args[1] == "list")
+        {
+            std::cout << "SYNTAX: TexTool list <brres>" << std::endl;
+            std::cout << std::endl;
+            std::cout << "Lists the textures in a BRRES" << std::endl;
+            std::cout << std::endl;
+            std::cout << "ARGUMENTS: " << std::endl;
+            std::cout << "  brres      The BRRES to be listed" << std::endl;
+            return EXIT_SUCCESS;
+        }
+        else
+        {
+            std::cout << "Unknown command! Type `TexTool help` for help" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    else
+    {
+        std::cout << "Too many arguments! Type `TexTool help` for help" << std::endl;
+        return EXIT_FAILURE;
+    }
+}
+
+const std::map<std::string, CTLib::ImageFormat> FORMAT_NAMES = {
+    {"I4", CTLib::ImageFormat::I4}, {"I8", CTLib::ImageFormat::I8},
+    {"IA4", CTLib::ImageFormat::IA4}, {"IA8", CTLib::ImageFormat::IA8},
+    {"RGB565", CTLib::ImageFormat::RGB565}, {"RGB5A3", CTLib::ImageFormat::RGB5A3},
+    {"RGBA8", CTLib::ImageFormat::RGBA8}, {"C4", CTLib::ImageFormat::C4},
+    {"C8", CTLib::ImageFormat::C8}, {"C14X2", CTLib::ImageFormat::C14X2},
+    {"CMPR", CTLib::ImageFormat::CMPR}
+};
+
+std::string formatName(CTLib::ImageFormat format)
+{
+    for (auto& entry : FORMAT_NAMES)
+    {
+        if (entry.second == format)
+        {
+            return entry.first;
+        }
+    }
+    return "?";
+}
+
+uint32_t defaultThreadCount()
+{
+    return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+double millisSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start
+    ).count();
+}
+
+// the options of the `create` command
+struct CreateOptions
+{
+    bool autoFormat = true;
+    CTLib::ImageFormat format = CTLib::ImageFormat::CMPR;
+    std::map<std::string, CTLib::ImageFormat> formats;
+    double psnr = 35.;
+    bool palette = false;
+    uint32_t mipmaps = 0;
+    CTLib::MipmapOptions mipmapOptions;
+    uint32_t threads = defaultThreadCount();
+};
+
+// a texture converted by the `create` command
+struct ConvertedTexture
+{
+    std::filesystem::path path;
+    std::string name;
+    std::string error;
+    uint16_t width = 0;
+    uint16_t height = 0;
+    CTLib::ImageFormat format = CTLib::ImageFormat::I4;
+    CTLib::Buffer data;
+    std::vector<CTLib::Buffer> mipmaps;
+    bool hasPalette = false;
+    CTLib::Palette palette;
+    size_t size = 0;
+    double millis = 0.;
+};
+
+// returns the largest valid mipmap count not above the requested one
+uint32_t cappedMipmapCount(uint32_t width, uint32_t height, uint32_t requested)
+{
+    uint32_t count = 0;
+    while (count < requested && (width >> (count + 1)) > 0 && (height >> (count + 1)) > 0)
+    {
+        ++count;
+    }
+    return count;
+}
+
+// returns the palette format best suited to the specified image
+CTLib::PaletteFormat paletteFormatFor(const CTLib::Image& image)
+{
+    CTLib::ImageAnalysis analysis = CTLib::ImageCoder::analyse(image);
+    return analysis.greyscale ? CTLib::PaletteFormat::IA8
+        : analysis.alpha == CTLib::AlphaUsage::None ? CTLib::PaletteFormat::RGB565
+        : CTLib::PaletteFormat::RGB5A3;
+}
+
+// converts a single texture; each call uses its own scratch BRRES so textures
+// can be converted concurrently
+void convertTexture(ConvertedTexture& texture, const CreateOptions& options)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    CTLib::Image image = CTLib::ImageIO::read(texture.path.generic_string());
+    if (image.getWidth() > 1024 || image.getHeight() > 1024)
+    {
+        throw CTLib::ImageError("Images cannot be larger than 1024x1024!");
+    }
+
+    CTLib::BRRES scratch;
+    CTLib::TEX0* tex0 = scratch.add<CTLib::TEX0>(texture.name);
+
+    auto format = options.formats.find(texture.name);
+    if (format == options.formats.end() && options.autoFormat)
+    {
+        tex0->setTextureData(image, options.psnr, options.palette);
+    }
+    else
+    {
+        CTLib::ImageFormat fixed = format != options.formats.end() ? format->second
+            : options.format;
+        if (CTLib::ImageCoder::isPaletteFormat(fixed))
+        {
+            scratch.add<CTLib::PLT0>(texture.name)->setPalette(
+                CTLib::ImageCoder::createPalette(image, fixed, paletteFormatFor(image))
+            );
+        }
+        tex0->setTextureData(image, fixed);
+    }
+
+    uint32_t mipmaps = cappedMipmapCount(image.getWidth(), image.getHeight(), options.mipmaps);
+    if (mipmaps > 0)
+    {
+        tex0->generateMipmaps(mipmaps, image, options.mipmapOptions);
+    }
+
+    texture.width = tex0->getWidth();
+    texture.height = tex0->getHeight();
+    texture.format = tex0->getFormat();
+    texture.data = tex0->getTextureData();
+    texture.size = texture.data.capacity();
+    for (uint32_t i = 0; i < mipmaps; ++i)
+    {
+        texture.mipmaps.push_back(tex0->getMipmapTextureData(i));
+        texture.size += texture.mipmaps.back().capacity();
+    }
+
+    texture.hasPalette = scratch.has<CTLib::PLT0>(texture.name);
+    if (texture.hasPalette)
+    {
+        texture.palette = scratch.get<CTLib::PLT0>(texture.name)->getPalette();
+        texture.size += texture.palette.getCount() * 2;
+    }
+
+    texture.millis = millisSince(start);
+}
+
+bool isImageFile(const std::filesystem::path& path)
+{
+    std::string ext = path.extension().generic_string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == ".png" || ext == ".tga" || ext == ".bmp" || ext == ".jpg" || ext == ".jpeg";
+}
+
+// parses the options following the positional arguments of `create`, and
+// returns whether they are valid
+bool parseCreateOptions(std::vector<std::string>& args, size_t first, CreateOptions& options)
+{
+    for (size_t i = first; i < args.size(); ++i)
+    {
+        const std::string& option = args[i];
+        bool flag = option == "--palette" || option == "--gamma" || option == "--coverage";
+        if (!flag && i + 1 == args.size())
+        {
+            std::cout << "Missing value of option `" << option << "`!" << std::endl;
+            return false;
+        }
+
+        try
+        {
+            if (option == "--format")
+            {
+                std::string value = args[++i];
+                size_t equals = value.find('=');
+                std::string name = equals == std::string::npos ? "" : value.substr(0, equals);
+                std::string formatStr = value.substr(equals == std::string::npos ? 0 : equals + 1);
+                if (formatStr == "auto" && name.empty())
+                {
+                    options.autoFormat = true;
+                }
+                else if (FORMAT_NAMES.count(formatStr) == 0)
+                {
+                    std::cout << "Unknown format `" << formatStr << "`!" << std::endl;
+                    return false;
+                }
+                else if (name.empty())
+                {
+                    options.autoFormat = false;
+                    options.format = FORMAT_NAMES.at(formatStr);
+                }
+                else
+                {
+                    options.formats[name] = FORMAT_NAMES.at(formatStr);
+                }
+            }
+            else if (option == "--psnr")
+            {
+                options.psnr = std::stod(args[++i]);
+            }
+            else if (option == "--palette")
+            {
+                options.palette = true;
+            }
+            else if (option == "--mipmaps")
+            {
+                options.mipmaps = static_cast<uint32_t>(std::stoul(args[++i]));
+            }
+            else if (option == "--filter")
+            {
+                std::string value = args[++i];
+                if (value != "box" && value != "kaiser")
+                {
+                    std::cout << "Unknown filter `" << value << "`!" << std::endl;
+                    return false;
+                }
+                options.mipmapOptions.filter = value == "box" ? CTLib::MipmapFilter::Box
+                    : CTLib::MipmapFilter::Kaiser;
+            }
+            else if (option == "--gamma")
+            {
+                options.mipmapOptions.gammaCorrect = true;
+            }
+            else if (option == "--coverage")
+            {
+                options.mipmapOptions.keepCoverage = true;
+            }
+            else if (option == "--threads")
+            {
+                options.threads = static_cast<uint32_t>(std::stoul(args[++i]));
+                if (options.threads == 0)
+                {
+                    options.threads = defaultThreadCount();
+                }
+            }
+            else
+            {
+                std::cout << "Unknown option `" << option << "`!" << std::endl;
+                return false;
+            }
+        }
+        catch (const std::logic_error&)
+        {
+            std::cout << "Invalid value of option `" << option << "`!" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int cmdCreate(std::vector<std::string>& args)
+{
+    if (args.size() < 2)
+    {
+        std::cout << "Not enough arguments! Type `TexTool help create` for help" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::filesystem::path inPath = args[1];
+    if (!std::filesystem::is_directory(inPath))
+    {
+        std::cout << "Input is not a directory!" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    bool hasOutput = args.size() > 2 && args[2].rfind("--", 0) != 0;
+    CreateOptions options;
+    if (!parseCreateOptions(args, hasOutput ? 3 : 2, options))
+    {
+        std::cout << "Type `TexTool help create` for help" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<ConvertedTexture> textures;
+    for (auto& entry : std::filesystem::directory_iterator(inPath))
+    {
+        if (entry.is_regular_file() && isImageFile(entry.path()))
+        {
+            ConvertedTexture texture;
+            texture.path = entry.path();
+            texture.name = entry.path().stem().generic_string();
+            textures.push_back(std::move(texture));
+        }
+    }
+    std::sort(textures.begin(), textures.end(),
+        [](const ConvertedTexture& a, const ConvertedTexture& b) { return a.name < b.name; }
+    );
+
+    std::cout << "Converting " << textures.size() << " images on " << options.threads
+        << " threads..." << std::flush;
+    auto start = std::chrono::steady_clock::now();
+    CTLib::Parallel::forEach(textures.size(), options.threads, [&](size_t i) {
+        try
+        {
+            convertTexture(textures[i], options);
+        }
+        catch (const std::exception& e)
+        {
+            textures[i].error = e.what();
+        }
+    });
+    double millis = millisSince(start);
+    std::cout << " Done!" << std::endl;
+
+    // subfiles are added on this thread as a BRRES cannot be modified
+    // concurrently
+    CTLib::BRRES brres;
+    size_t failed = 0, totalSize = 0;
+    for (ConvertedTexture& texture : textures)
+    {
+        if (!texture.error.empty())
+        {
+            ++failed;
+            continue;
+        }
+
+        if (texture.hasPalette)
+        {
+            brres.add<CTLib::PLT0>(texture.name)->setPalette(texture.palette);
+        }
+        CTLib::TEX0* tex0 = brres.add<CTLib::TEX0>(texture.name);
+        tex0->setTextureData(texture.data, texture.width, texture.height, texture.format);
+        for (uint32_t i = 0; i < texture.mipmaps.size(); ++i)
+        {
+            tex0->setMipmapTextureData(i, texture.mipmaps[i]);
+        }
+        totalSize += texture.size;
+    }
+
+    std::cout << "Writing BRRES..." << std::flush;
+    std::filesystem::path outPath = hasOutput ? std::filesystem::path(args[2])
+        : inPath.replace_extension(".brres");
+    std::filesystem::create_directories(outPath.parent_path());
+    CTLib::Buffer data = CTLib::BRRES::write(brres);
+    CTLib::IO::writeFile(outPath.generic_string(), data);
+    std::cout << " Done!" << std::endl;
+    std::cout << std::endl;
+
+    constexpr const char* format = "  %-24s %9s %-6s %4s %9s %9s";
+    std::cout << CTLib::Strings::format(format, "Name", "Size", "Format", "Mips", "Bytes", "Time")
+        << std::endl;
+    std::cout << "----------------------------------------------------------------------"
+        << std::endl;
+    for (ConvertedTexture& texture : textures)
+    {
+        if (!texture.error.empty())
+        {
+            std::cout << "  " << texture.name << ": FAILED! " << texture.error << std::endl;
+            continue;
+        }
+        std::cout << CTLib::Strings::format(format, texture.name.c_str(),
+                CTLib::Strings::format("%dx%d", texture.width, texture.height).c_str(),
+                formatName(texture.format).c_str(),
+                std::to_string(texture.mipmaps.size()).c_str(),
+                std::to_string(texture.size).c_str(),
+                CTLib::Strings::format("%.1fms", texture.millis).c_str()
+            ) << std::endl;
+    }
+    std::cout << std::endl;
+    std::cout << CTLib::Strings::format(
+            "Converted %d of %d textures (%d bytes) in %.1fms",
+            static_cast<int>(textures.size() - failed), static_cast<int>(textures.size()),
+            static_cast<int>(totalSize), millis
+        ) << std::endl;
+
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+CTLib::BRRES readBRRES(std::filesystem::path path, bool& valid)
+{
+    CTLib::Buffer data = CTLib::IO::readFile(path.generic_string());
+
+    try
+    {
+        valid = true;
+        return CTLib::BRRES::read(data);
+    }
+    catch (const CTLib::BRRESError& e)
+    {
+        std::cout << std::endl;
+        std::cout << "Invalid BRRES file!" << std::endl;
+        std::cout << std::endl;
+        std::cout << e.what() << std::endl;
+        valid = false;
+        return CTLib::BRRES();
+    }
+}
+
+CTLib::Image decodeTexture(CTLib::BRRES& brres, CTLib::TEX0* tex0)
+{
+    CTLib::Buffer data = tex0->getTextureData();
+    if (CTLib::ImageCoder::isPaletteFormat(tex0->getFormat()))
+    {
+        CTLib::Palette palette = brres.get<CTLib::PLT0>(tex0->getName())->getPalette();
+        return CTLib::ImageCoder::decode(
+            data, tex0->getWidth(), tex0->getHeight(), tex0->getFormat(), palette
+        );
+    }
+    return CTLib::ImageCoder::decode(data, tex0->getWidth(), tex0->getHeight(), tex0->getFormat());
+}
+
+int cmdExtract(std::vector<std::string>& args)
+{
+    if (args.size() < 2)
+    {
+        std::cout << "Not enough arguments! Type `TexTool help extract` for help" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    bool hasOutput = args.size() > 2 && args[2].rfind("--", 0) != 0;
+    size_t first = hasOutput ? 3 : 2;
+    uint32_t threads = defaultThreadCount();
+    if (args.size() == first + 2 && args[first] == "--threads")
+    {
+        threads = std::max(static_cast<uint32_t>(std::stoul(args[first + 1])), 1u);
+    }
+    else if (args.size() != first)
+    {
+        std::cout << "Invalid arguments! Type `TexTool help extract` for help" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::filesystem::path inPath = args[1];
+    if (!std::filesystem::is_regular_file(inPath))
+    {
+        std::cout << "Input is a directory or non-existent!" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "Reading BRRES..." << std::flush;
+    bool valid;
+    CTLib::BRRES brres = readBRRES(inPath, valid);
+    if (!valid)
+    {
+        return EXIT_FAILURE;
+    }
+    std::cout << " Done!" << std::endl;
+
+    std::filesystem::path outPath = hasOutput ? std::filesystem::path(args[2])
+        : inPath.replace_extension(".d");
+    std::filesystem::create_directories(outPath);
+
+    std::vector<CTLib::TEX0*> tex0s = brres.getAll<CTLib::TEX0>();
+    std::vector<std::string> errors(tex0s.size());
+
+    std::cout << "Writing " << tex0s.size() << " images..." << std::flush;
+    auto start = std::chrono::steady_clock::now();
+    CTLib::Parallel::forEach(tex0s.size(), threads, [&](size_t i) {
+        try
+        {
+            std::filesystem::path path = outPath / (tex0s[i]->getName() + ".png");
+            CTLib::ImageIO::write(path.generic_string(), decodeTexture(brres, tex0s[i]));
+        }
+        catch (const std::exception& e)
+        {
+            errors[i] = e.what();
+        }
+    });
+    std::cout << CTLib::Strings::format(" Done! (%.1fms)", millisSince(start)) << std::endl;
+
+    bool failed = false;
+    for (size_t i = 0; i < tex0s.size(); ++i)
+    {
+        if (!errors[i].empty())
+        {
+            std::cout << "  " << tex0s[i]->getName() << ": FAILED! " << errors[i] << std::endl;
+            failed = true;
+        }
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int cmdList(std::vector<std::string>& args)
+{
+    if (args.size() < 2)
+    {
+        std::cout << "Not enough arguments! Type `TexTool help list` for help" << std::endl;
+        return EXIT_FAILURE;
+    }
+    else if (args.size() > 2)
+    {
+        std::cout << "Too many arguments! Type `TexTool help list` for help" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::filesystem::path inPath = args[1];
+    if (!std::filesystem::is_regular_file(inPath))
+    {
+        std::cout << "Input is a directory or non-existent!" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    bool valid;
+    CTLib::BRRES brres = readBRRES(inPath, valid);
+    if (!valid)
+    {
+        return EXIT_FAILURE;
+    }
+
+    constexpr const char* format = "  %-24s %9s %-6s %4s %9s";
+    std::cout << CTLib::Strings::format(format, "Name", "Size", "Format", "Mips", "Bytes")
+        << std::endl;
+    std::cout << "----------------------------------------------------------------------"
+        << std::endl;
+    for (CTLib::TEX0* tex0 : brres.getAll<CTLib::TEX0>())
+    {
+        size_t size = tex0->getTextureData().capacity();
+        for (uint32_t i = 0; i < tex0->getMipmapCount(); ++i)
+        {
+            size += tex0->getMipmapTextureData(i).capacity();
+        }
+        if (brres.has<CTLib::PLT0>(tex0->getName()))
+        {
+            size += brres.get<CTLib::PLT0>(tex0->getName())->getColourCount() * 2;
+        }
+        std::cout << CTLib::Strings::format(format, tex0->getName().c_str(),
+                CTLib::Strings::format("%dx%d", tex0->getWidth(), tex0->getHeight()).c_str(),
+                formatName(tex0->getFormat()).c_str(),
+                std::to_string(tex0->getMipmapCount()).c_str(),
+                std::to_string(size).c_str()
+            ) << std::endl;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -38,6 +38,7 @@ class BRRES;
 
 class MDL0;
 class TEX0;
+class PLT0;
 
 /*! @brief Superclass of all BRRES sub files. */
 class BRRESSubFile
@@ -1929,11 +1930,17 @@ public:
      *  as base texture data.
      * 
      *  This will also delete all mipmaps.
+     * 
+     *  Palette formats are encoded with the palette of the PLT0 with the same
+     *  name as this TEX0.
      *  
      *  @param[in] image The texture data
      *  @param[in] format The encoding format
      * 
      *  @throw CTLib::ImageError If format is not supported.
+     * 
+     *  @throw CTLib::BRRESError If format is a palette format and the BRRES
+     *  has no PLT0 with the same name as this TEX0.
      */
     void setTextureData(const Image& image, ImageFormat format);
 
@@ -1949,6 +1956,22 @@ public:
      */
     void setTextureData(const Image& image);
 
+    /*! @brief Encodes the specified image in the smallest format within the
+     *  specified PSNR, and sets it as the base texture data.
+     *  
+     *  The format is selected by
+     *  @link CTLib::ImageCoder::selectFormat() ImageCoder::selectFormat@endlink.
+     *  If a palette format is selected, the palette is set to the PLT0 with
+     *  the same name as this TEX0, which is added to the BRRES if needed.
+     * 
+     *  This will also delete all mipmaps.
+     * 
+     *  @param[in] image The texture data
+     *  @param[in] minPSNR The minimum PSNR, in decibels
+     *  @param[in] palette Whether palette formats can be selected
+     */
+    void setTextureData(const Image& image, double minPSNR, bool palette = false);
+
     /*! @brief Sets the texture data of this TEX0 to the contents of the
      *  specified buffer, and sets the width, height, and format of this
      *  TEX0.
@@ -2035,6 +2058,10 @@ public:
      *  it is recommended to use this function instead of
      *  `generateMipmaps(uint32_t)` as it will avoid an additional decode.
      * 
+     *  Every level is resized from the image with `Image::resize`, so the
+     *  image may be of any size. Use the overload taking `MipmapOptions` to
+     *  downsample each level from the previous one instead.
+     * 
      *  @param[in] count The amount of mipmaps to generate
      *  @param[in] image The image to use when generating mipmaps
      * 
@@ -2043,6 +2070,29 @@ public:
      */
     void generateMipmaps(uint32_t count, const Image& image);
 
+    /*! @brief Generates the specified count of mipmaps based on the specified
+     *  image, with the specified options.
+     * 
+     *  Any previously existing mipmaps will be deleted.
+     * 
+     *  Each level is downsampled from the previous one, then the levels are
+     *  encoded in parallel, largest first. A level larger than its source,
+     *  e.g. when the image is smaller than the first mipmap, is resized with
+     *  `Image::resize` instead.
+     * 
+     *  @param[in] count The amount of mipmaps to generate
+     *  @param[in] image The image to use when generating mipmaps
+     *  @param[in] options The filter and alpha options
+     *  @param[in] threads The count of threads encoding levels, or 0 to use
+     *  the hardware concurrency
+     * 
+     *  @throw CTLib::BRRESError If the width or height of at least one of the
+     *  generated mipmaps is zero, i.e., too many mipmaps.
+     */
+    void generateMipmaps(
+        uint32_t count, const Image& image, const MipmapOptions& options, uint32_t threads = 1
+    );
+
     /*! @brief Generates the specified count of mipmaps based on the base
      *  texture data.
      * 
@@ -2059,6 +2109,21 @@ public:
      */
     void generateMipmaps(uint32_t count);
 
+    /*! @brief Generates the specified count of mipmaps based on the base
+     *  texture data, with the specified options.
+     * 
+     *  Any previously existing mipmaps will be deleted.
+     * 
+     *  @param[in] count The amount of mipmaps to generate
+     *  @param[in] options The filter and alpha options
+     *  @param[in] threads The count of threads encoding levels, or 0 to use
+     *  the hardware concurrency
+     * 
+     *  @throw CTLib::BRRESError If the width or height of at least one of the
+     *  generated mipmaps is zero, i.e., too many mipmaps.
+     */
+    void generateMipmaps(uint32_t count, const MipmapOptions& options, uint32_t threads = 1);
+
     /*! @brief Removes all mipmaps from this TEX0. */
     void deleteMipmaps();
 
@@ -2096,6 +2161,17 @@ private:
 
     TEX0(BRRES* brres, const std::string& name);
 
+    // encodes the image in the format of this TEX0, with the palette of the
+    // PLT0 of the same name for palette formats
+    Buffer encodeImage(const Image& image) const;
+
+    // decodes the base texture data, with the palette of the PLT0 of the same
+    // name for palette formats
+    Image decodeImage() const;
+
+    // throws if the BRRES has no PLT0 with the same name as this TEX0
+    PLT0* getPLT0() const;
+
     // throws if data.remaining() < ImageCoder::sizeFor(width, height, format)
     void assertValidTextureData(
         const Buffer& data, uint16_t width, uint16_t height, ImageFormat format) const;
@@ -2131,6 +2207,41 @@ private:
     std::vector<Buffer> mipmaps;
 };
 
+/*! @brief A palette within a BRRES, used by the TEX0 with the same name when
+ *  it has a palette format.
+ */
+class PLT0 final : public BRRESSubFile
+{
+
+    friend class BRRES;
+
+public:
+
+    ~PLT0();
+
+    /*! @brief Sets the palette of this PLT0.
+     *  
+     *  @param[in] palette The palette
+     */
+    void setPalette(const Palette& palette);
+
+    /*! @brief Returns a copy of the palette of this PLT0. */
+    Palette getPalette() const;
+
+    /*! @brief Returns the format of the colours of this PLT0. */
+    PaletteFormat getFormat() const;
+
+    /*! @brief Returns the number of colours in this PLT0. */
+    uint16_t getColourCount() const;
+
+private:
+
+    PLT0(BRRES* brres, const std::string& name);
+
+    // the palette
+    Palette palette;
+};
+
 /*! @brief An object representation of Nintendo's BRRES file format. */
 class BRRES final
 {
@@ -2259,6 +2370,9 @@ private:
     // map of <name, TEX0> containing all TEX0s in this BRRES
     std::map<std::string, TEX0*> tex0s;
 
+    // map of <name, PLT0> containing all PLT0s in this BRRES
+    std::map<std::string, PLT0*> plt0s;
+
     std::vector<BRRESSubFileCallback*> callbacks;
 };
 
@@ -14,6 +14,7 @@
 
 
 #include <stdexcept>
+#include <vector>
 
 #include <CTLib/Memory.hpp>
 
@@ -40,6 +41,45 @@ struct RGBAColour
     uint8_t a = 0x00;
 };
 
+/*! @brief Enumeration of the filters used to downsample images. */
+enum class MipmapFilter
+{
+    /*! @brief Averages the source pixels covered by each destination pixel.
+     *  
+     *  This is the fastest filter.
+     */
+    Box,
+
+    /*! @brief Kaiser-windowed sinc over 3 destination pixels on each side.
+     *  
+     *  Sharper than the box filter, with little aliasing.
+     */
+    Kaiser
+};
+
+/*! @brief Options of the generation of mipmaps. */
+struct MipmapOptions
+{
+    /*! @brief The filter used to downsample each level from the previous one. */
+    MipmapFilter filter = MipmapFilter::Box;
+
+    /*! @brief Whether the colours are filtered in linear space, treating them
+     *  as sRGB.
+     */
+    bool gammaCorrect = false;
+
+    /*! @brief Whether the alpha of each level is scaled to keep the fraction
+     *  of pixels with an alpha of at least `alphaReference` of the base
+     *  image, so cutout textures do not fade out with distance.
+     */
+    bool keepCoverage = false;
+
+    /*! @brief The alpha reference used when `keepCoverage` is set, usually
+     *  the alpha test threshold of the material.
+     */
+    uint8_t alphaReference = 0x80;
+};
+
 /*! @brief An instance of the Image class is an immutable image representation
  *  with a width, height, and RGBA pixel data.
  */
@@ -47,6 +87,7 @@ class Image
 {
 
     friend class ImageIO;
+    friend class ImageCoder;
 
 public:
 
@@ -111,14 +152,89 @@ public:
      *  @param[in] nw The new width
      *  @param[in] nh The new height
      * 
+     *  @throw CTLib::ImageError If the new size is zero.
+     * 
      *  @return The resized image
      */
     Image resize(uint32_t nw, uint32_t nh) const;
 
+    /*! @brief Resizes this image into the specified image.
+     *  
+     *  The size of `out` is used as the new size, and no memory is allocated,
+     *  so a set of images can be reused as scratch space across calls.
+     * 
+     *  @param[out] out The image receiving the resized data, which must not be
+     *  this image
+     * 
+     *  @throw CTLib::ImageError If `out` is this image, or the size of `out`
+     *  is zero or does not match its data.
+     */
+    void resize(Image& out) const;
+
+    /*! @brief Returns a downsampled version of this image.
+     *  
+     *  Colours are filtered weighted by their alpha, so fully transparent
+     *  pixels do not bleed into visible ones.
+     * 
+     *  @param[in] nw The new width, at most the current width
+     *  @param[in] nh The new height, at most the current height
+     *  @param[in] filter The filter
+     *  @param[in] gammaCorrect Whether colours are filtered in linear space
+     * 
+     *  @throw CTLib::ImageError If the new size is zero or larger than the
+     *  current size.
+     * 
+     *  @return The downsampled image
+     */
+    Image downsample(
+        uint32_t nw, uint32_t nh, MipmapFilter filter = MipmapFilter::Box,
+        bool gammaCorrect = false
+    ) const;
+
+    /*! @brief Downsamples this image into the specified image.
+     *  
+     *  The size of `out` is used as the new size. Halving both dimensions
+     *  with the box filter and no gamma correction, as done for each level of
+     *  a mipmap chain, uses a dedicated 2x2 reduction that allocates nothing.
+     * 
+     *  @param[out] out The image receiving the downsampled data, which must
+     *  not be this image
+     *  @param[in] filter The filter
+     *  @param[in] gammaCorrect Whether colours are filtered in linear space
+     * 
+     *  @throw CTLib::ImageError If `out` is this image, or the size of `out`
+     *  is zero, larger than the size of this image, or does not match its
+     *  data.
+     */
+    void downsample(
+        Image& out, MipmapFilter filter = MipmapFilter::Box, bool gammaCorrect = false
+    ) const;
+
+    /*! @brief Returns the fraction of pixels of this image whose alpha is at
+     *  least the specified reference.
+     */
+    float alphaCoverage(uint8_t reference) const;
+
+    /*! @brief Returns a copy of this image whose alpha is scaled so that its
+     *  @link alphaCoverage() alpha coverage@endlink is as close as possible
+     *  to the specified one.
+     *  
+     *  @param[in] coverage The target coverage, between 0 and 1
+     *  @param[in] reference The alpha reference
+     * 
+     *  @return The image with scaled alpha
+     */
+    Image scaleAlphaToCoverage(float coverage, uint8_t reference) const;
+
 private:
 
-    // constructor used by ImageIO to prevent an additional copy
-    Image(uint32_t width, uint32_t height, uint8_t* data);
+    // constructor used by ImageIO and ImageCoder to adopt decoded data
+    // without a copy
+    Image(uint32_t width, uint32_t height, Buffer&& data);
+
+    // throws an ImageError if 'out' is this image, or if its size is zero or
+    // does not match its data, e.g. after it was moved
+    void assertValidOutput(const Image& out, const char* operation) const;
 
     // the width of this image, in pixels
     const uint32_t width;
@@ -165,19 +281,177 @@ enum class ImageFormat
      */
     RGBA8 = 0x6,
 
-    /*! @brief 4 bits per pixel image with palette. **NOT YET SUPPORTED** */
+    /*! @brief 4 bits per pixel image with a palette of up to 16 colours. */
     C4 = 0x8,
 
-    /*! @brief 8 bits per pixel image with palette. **NOT YET SUPPORTED** */
+    /*! @brief 8 bits per pixel image with a palette of up to 256 colours. */
     C8 = 0x9,
 
-    /*! @brief 14 bits per pixel image with palette. **NOT YET SUPPORTED** */
+    /*! @brief 14 bits (stored in 16) per pixel image with a palette of up
+     *  to 16384 colours.
+     */
     C14X2 = 0xA,
 
     /*! @brief 4 bits per pixel 'lossy-ly' compressed RGB image with alpha. */
     CMPR = 0xE
 };
 
+/*! @brief Enumeration of the quality levels of the
+ *  @link CTLib::ImageFormat::CMPR CMPR@endlink encoder.
+ */
+enum class CMPRQuality
+{
+    /*! @brief Fits the colours of each block to their range along their
+     *  principal axis.
+     *  
+     *  Pixels with an alpha below `0x80` are encoded as transparent.
+     */
+    Fast,
+
+    /*! @brief Uses the high quality mode of stb_dxt, the encoder CMPR has
+     *  always used by default, so that opaque images encode to the same
+     *  bytes as before.
+     *  
+     *  stb_dxt has no transparent colour, so blocks with pixels whose alpha
+     *  is below `0x80` are fitted like `Fast` instead, then their endpoints
+     *  are re-solved from the chosen indices while that lowers the error.
+     *  Those pixels are encoded as transparent.
+     */
+    Normal,
+
+    /*! @brief Iteratively searches the clustering of the colours of each
+     *  block minimizing the error.
+     *
+     *  The colours are ordered along their principal axis and every
+     *  clustering of that order is fitted; the colours are then re-ordered
+     *  along the fitted endpoints and fitted again until the order settles
+     *  or the error stops improving.
+     *
+     *  Pixels with an alpha below `0x80` are encoded as transparent.
+     */
+    High
+};
+
+/*! @brief Enumeration of the colour formats of palettes. */
+enum class PaletteFormat
+{
+    /*! @brief 16 bits per colour (8 for grey, 8 for alpha) greyscale with
+     *  alpha.
+     */
+    IA8 = 0x0,
+
+    /*! @brief 16 bits per colour (5 for red, 6 for green, 5 for blue) RGB. */
+    RGB565 = 0x1,
+
+    /*! @brief 16 bits per colour, with the same two formats as
+     *  @link CTLib::ImageFormat::RGB5A3 RGB5A3@endlink.
+     */
+    RGB5A3 = 0x2
+};
+
+/*! @brief A palette of colours, as used by the
+ *  @link CTLib::ImageFormat::C4 C4@endlink,
+ *  @link CTLib::ImageFormat::C8 C8@endlink, and
+ *  @link CTLib::ImageFormat::C14X2 C14X2@endlink formats.
+ */
+class Palette
+{
+
+public:
+
+    /*! @brief The maximum number of colours in a palette. */
+    static constexpr uint16_t MAX_COLOURS = 0x4000;
+
+    /*! @brief Constructs an empty palette of the specified format.
+     *  
+     *  @param[in] format The format of the colours
+     */
+    explicit Palette(PaletteFormat format = PaletteFormat::RGB5A3);
+
+    /*! @brief Constructs a palette of the specified format from the specified
+     *  count of encoded colours, 2 bytes each.
+     *  
+     *  @param[in] format The format of the encoded colours
+     *  @param[in] data The encoded colours
+     *  @param[in] count The number of colours
+     * 
+     *  @throw CTLib::ImageError If `count` is more than `MAX_COLOURS`, or
+     *  there are not enough bytes remaining in the buffer.
+     */
+    Palette(PaletteFormat format, Buffer& data, uint16_t count);
+
+    /*! @brief Returns the format of the colours of this palette. */
+    PaletteFormat getFormat() const;
+
+    /*! @brief Returns the number of colours in this palette. */
+    uint16_t getCount() const;
+
+    /*! @brief Converts the specified colour to the format of this palette and
+     *  appends it.
+     *  
+     *  @param[in] colour The colour to be added
+     * 
+     *  @throw CTLib::ImageError If this palette already has `MAX_COLOURS`
+     *  colours.
+     * 
+     *  @return The index of the added colour
+     */
+    uint16_t add(RGBAColour colour);
+
+    /*! @brief Returns the colour at the specified index, as decoded by the
+     *  console.
+     *  
+     *  @param[in] index The index of the colour
+     * 
+     *  @throw CTLib::ImageError If index is more than or equal to the colour
+     *  count.
+     */
+    RGBAColour getColour(uint16_t index) const;
+
+    /*! @brief Returns the encoded colours of this palette, 2 bytes each, in a
+     *  new buffer.
+     */
+    Buffer getData() const;
+
+private:
+
+    // the format of the colours
+    PaletteFormat format;
+
+    // the encoded colours
+    std::vector<uint16_t> entries;
+};
+
+/*! @brief Enumeration of the ways an image uses its alpha channel. */
+enum class AlphaUsage
+{
+    /*! @brief All pixels are opaque. */
+    None,
+
+    /*! @brief All pixels are either opaque or fully transparent. */
+    OneBit,
+
+    /*! @brief Some pixels are translucent. */
+    Full
+};
+
+/*! @brief Properties of an image relevant to the choice of its format, as
+ *  computed by @link CTLib::ImageCoder::analyse() ImageCoder::analyse()@endlink.
+ */
+struct ImageAnalysis
+{
+    /*! @brief Whether the red, green, and blue components of every pixel are
+     *  equal.
+     */
+    bool greyscale = true;
+
+    /*! @brief How the image uses its alpha channel. */
+    AlphaUsage alpha = AlphaUsage::None;
+
+    /*! @brief The number of distinct RGBA colours in the image. */
+    uint32_t colourCount = 0;
+};
+
 /*! @brief The ImageCoder class contains methods to encode and decode image
  *  data.
  */
@@ -188,31 +462,140 @@ public:
 
     /*! @brief Encodes the specified image in the specified format.
      *  
-     *  **NOTE**: The @link CTLib::ImageFormat::CMPR CMPR@endlink format
-     *  currently results in an incorrect image.
+     *  The @link CTLib::ImageFormat::CMPR CMPR@endlink format is encoded
+     *  with @link CTLib::CMPRQuality::Normal normal@endlink quality. Palette
+     *  formats must be encoded with
+     *  @link CTLib::ImageCoder::createPalette() a palette@endlink.
+     * 
+     *  Tile rows are independent, so they can be split across multiple
+     *  threads each writing to its own part of the output.
      * 
      *  @param[in] image The image to be encoded
      *  @param[in] format The encoding format
+     *  @param[in] threads The number of threads to use, or `0` for one per
+     *  hardware thread
      * 
      *  @throw CTLib::ImageError If the specified format is unsupported.
      * 
      *  @return The encoded image data
      */
-    static Buffer encode(const Image& image, ImageFormat format);
+    static Buffer encode(const Image& image, ImageFormat format, uint32_t threads = 1);
+
+    /*! @brief Encodes the specified image in the specified format, using the
+     *  specified quality for the @link CTLib::ImageFormat::CMPR CMPR@endlink
+     *  format.
+     *  
+     *  For any other format, `quality` is ignored.
+     * 
+     *  @param[in] image The image to be encoded
+     *  @param[in] format The encoding format
+     *  @param[in] quality The CMPR encoder quality
+     *  @param[in] threads The number of threads to use, or `0` for one per
+     *  hardware thread
+     * 
+     *  @throw CTLib::ImageError If the specified format is unsupported.
+     * 
+     *  @return The encoded image data
+     */
+    static Buffer encode(
+        const Image& image, ImageFormat format, CMPRQuality quality, uint32_t threads = 1
+    );
+
+    /*! @brief Creates a palette of the specified format for the specified
+     *  image, with at most as many colours as the specified palette image
+     *  format can index.
+     *  
+     *  If the image has few enough distinct colours once converted to the
+     *  palette format, all of them are kept. Otherwise, they are reduced by
+     *  median cut, refined by a few k-means iterations for the
+     *  @link CTLib::ImageFormat::C4 C4@endlink and
+     *  @link CTLib::ImageFormat::C8 C8@endlink formats.
+     * 
+     *  @param[in] image The image whose colours are quantised
+     *  @param[in] format The palette image format
+     *  @param[in] paletteFormat The format of the palette colours
+     * 
+     *  @throw CTLib::ImageError If the specified format is not a palette
+     *  format.
+     * 
+     *  @return The created palette
+     */
+    static Palette createPalette(
+        const Image& image, ImageFormat format, PaletteFormat paletteFormat
+    );
+
+    /*! @brief Encodes the specified image in the specified palette format,
+     *  mapping each pixel to the nearest colour of the specified palette.
+     *  
+     *  @param[in] image The image to be encoded
+     *  @param[in] format The palette image format
+     *  @param[in] palette The palette
+     *  @param[in] threads The number of threads to use, or `0` for one per
+     *  hardware thread
+     * 
+     *  @throw CTLib::ImageError If the specified format is not a palette
+     *  format, or the palette is empty or has more colours than the format
+     *  can index.
+     * 
+     *  @return The encoded image data
+     */
+    static Buffer encode(
+        const Image& image, ImageFormat format, const Palette& palette, uint32_t threads = 1
+    );
 
     /*! @brief Decodes the specified image data.
+     *  
+     *  The `I4`, `I8`, `IA4`, `IA8`, `RGB565`, `RGB5A3` and `RGBA8` tiles are
+     *  decoded with SSE2 when the library is compiled for a target that has
+     *  it, e.g. any x86-64 target, and with scalar code otherwise. This is
+     *  chosen at compile time only: there is no run-time CPU detection, and
+     *  no wider instruction set such as AVX2 is used.
      *  
      *  @param[in] data The encoded image data
      *  @param[in] width The width of the encoded image data
      *  @param[in] height The height of the encoded image data
      *  @param[in] format The format of the encoded image data
+     *  @param[in] threads The number of threads to use, or `0` for one per
+     *  hardware thread
      * 
      *  @throw CTLib::ImageError If the encoded image data is invalid, or the
      *  format is unsupported.
      * 
      *  @return The decoded image
      */
-    static Image decode(Buffer& data, uint32_t width, uint32_t height, ImageFormat format);
+    static Image decode(
+        Buffer& data, uint32_t width, uint32_t height, ImageFormat format, uint32_t threads = 1
+    );
+
+    /*! @brief Decodes the specified image data of a palette format with the
+     *  specified palette.
+     *  
+     *  Indices past the end of the palette are decoded as transparent black.
+     *  
+     *  @param[in] data The encoded image data
+     *  @param[in] width The width of the encoded image data
+     *  @param[in] height The height of the encoded image data
+     *  @param[in] format The palette format of the encoded image data
+     *  @param[in] palette The palette
+     *  @param[in] threads The number of threads to use, or `0` for one per
+     *  hardware thread
+     * 
+     *  @throw CTLib::ImageError If the encoded image data is invalid, or the
+     *  format is not a palette format.
+     * 
+     *  @return The decoded image
+     */
+    static Image decode(
+        Buffer& data, uint32_t width, uint32_t height, ImageFormat format,
+        const Palette& palette, uint32_t threads = 1
+    );
+
+    /*! @brief Returns whether the specified format is indexed in a palette,
+     *  i.e., is @link CTLib::ImageFormat::C4 C4@endlink,
+     *  @link CTLib::ImageFormat::C8 C8@endlink, or
+     *  @link CTLib::ImageFormat::C14X2 C14X2@endlink.
+     */
+    static bool isPaletteFormat(ImageFormat format);
 
     /*! @brief Returns the minimum number of bytes required to contain encoded
      *  image data of the specified width and height for the specified format.
@@ -222,6 +605,58 @@ public:
      *  @param[in] format The format of the encoded image data
      */
     static size_t sizeFor(uint32_t width, uint32_t height, ImageFormat format);
+
+    /*! @brief Returns the greyscale-ness, alpha usage, and colour count of
+     *  the specified image.
+     *  
+     *  @param[in] image The image to be analysed
+     * 
+     *  @return The analysis of the image
+     */
+    static ImageAnalysis analyse(const Image& image);
+
+    /*! @brief Returns the smallest format encoding the specified image with
+     *  a PSNR of at least the specified one.
+     *  
+     *  Candidate formats are ordered by their size as returned by `sizeFor`,
+     *  plus the palette for palette formats, which holds up to as many
+     *  entries as the image has colours. Formats unable to represent the
+     *  colours or alpha of the image according to `analyse` are skipped, as
+     *  are palette formats larger than one holding every colour of the image.
+     *  CMPR is a candidate for images with one bit alpha, as its transparent
+     *  pixels are kept. Each remaining candidate is encoded as `encode` would,
+     *  then decoded and measured, until one is within the threshold.
+     *  @link CTLib::ImageFormat::RGBA8 RGBA8@endlink, being lossless, is
+     *  returned when no other format is.
+     * 
+     *  Palette formats are only candidates if `palette` is not `nullptr`.
+     *  The palette colour format is IA8 for greyscale images, RGB565 for
+     *  opaque images, and RGB5A3 otherwise.
+     * 
+     *  @param[in] image The image to be encoded
+     *  @param[in] minPSNR The minimum PSNR, in decibels
+     *  @param[out] palette If not `nullptr`, set to the palette to encode the
+     *  image with when a palette format is returned
+     * 
+     *  @return The selected format
+     */
+    static ImageFormat selectFormat(
+        const Image& image, double minPSNR, Palette* palette = nullptr
+    );
+
+    /*! @brief Returns the peak signal-to-noise ratio, in decibels, of the
+     *  specified image against the reference image, over all RGBA channels.
+     *  
+     *  Identical images result in an infinite value.
+     * 
+     *  @param[in] image The image to be measured, usually decoded
+     *  @param[in] reference The reference image, usually the source
+     * 
+     *  @throw CTLib::ImageError If the images are not of the same size.
+     * 
+     *  @return The PSNR, in decibels
+     */
+    static double psnr(const Image& image, const Image& reference);
 };
 
 /*! @brief Enumeration of supported image formats when writing. */
@@ -13,6 +13,7 @@
  */
 
 
+#include <utility>
 #include <vector>
 
 #include <CTLib/Math.hpp>
@@ -143,6 +144,11 @@ public:
          */
         std::vector<OctreeNode*> getAllNodes() const;
 
+        /*! @brief Returns the count of bytes used by this Octree, including
+         *  all of its nodes.
+         */
+        size_t getMemoryUsage() const;
+
     private:
 
         struct Elem
@@ -162,8 +168,21 @@ public:
         // generate nodes
         void genRootNodes();
 
-        // inserts the specified triangle in this octree
-        void insert(uint16_t idx, const Vector3f& t0, const Vector3f& t1, const Vector3f& t2);
+        // inserts the specified triangle, relative to 'minPos', in this octree;
+        // the triangle must be in 'elems'
+        void insert(const Elem& tri);
+
+        // inserts the specified triangles in this octree, building the root
+        // nodes on the specified count of threads; 'tris[i].idx' must be 'i'
+        void insert(std::vector<Elem> tris, uint32_t threads);
+
+        // merges the nodes which are not worth their size, and deletes the
+        // nodes which are no longer used
+        void mergeNodes();
+
+        // sets 'lo' and 'hi' to the range of root nodes the triangle, relative
+        // to 'minPos', may be in
+        void findRootRange(const Elem& tri, uint32_t lo[3], uint32_t hi[3]) const;
 
         // converts the KCL::Triangle at the specified index to an Elem instance
         Elem toElem(uint16_t triIdx) const;
@@ -191,6 +210,10 @@ public:
 
         // vector containing all nodes in this octree
         std::vector<OctreeNode*> nodes;
+
+        // triangles being inserted, relative to 'minPos', by index; only set
+        // while the octree is built
+        std::vector<Elem> elems;
     };
 
     /*! @brief A node in a KCL octree. */
@@ -211,6 +234,9 @@ public:
         /*! @brief Returns whether this node points to other nodes. */
         bool isSuperNode() const;
 
+        /*! @brief Returns the depth of this node, `0` for root nodes. */
+        uint32_t getDepth() const;
+
         /*! @brief Returns the child node at the specified index.
          *  
          *  @param[in] index The child index (0-7)
@@ -255,11 +281,19 @@ public:
         // returns whether this node can be split
         bool canSplit() const;
 
-        // inserts the specified triangle element in this node
-        void insert(const Octree::Elem& tri);
+        // inserts the triangle at the specified index in the octree's 'elems'
+        // in this node; the nodes created by splits are added to 'pool'
+        void insert(uint16_t idx, std::vector<OctreeNode*>& pool);
 
-        // mark this node as 'superNode' and create 8 child nodes
-        void split();
+        // mark this node as 'superNode' and create 8 child nodes, which are
+        // added to 'pool'
+        void split(std::vector<OctreeNode*>& pool);
+
+        // merges the children of this node back into it, once their own
+        // children are merged, if splitting it does not save enough triangle
+        // tests for its size with 'KCL::settings.memoryCost'; the merged
+        // children are added to 'removed'
+        void merge(std::vector<OctreeNode*>& removed);
 
         // throws if 'superNode' == false
         void assertSuperNode() const;
@@ -282,11 +316,188 @@ public:
         // whether this node points to other nodes
         bool superNode;
 
+        // count of super nodes above this node
+        uint32_t depth;
+
         // pointer to OctreeNode childs; unused if 'superNode' is false
         OctreeNode* childs[8];
 
-        // triangles in this node; unused if 'superNode'
-        std::vector<Octree::Elem> elems;
+        // indices of the triangles in this node; unused if 'superNode'
+        std::vector<uint16_t> indices;
+    };
+
+    /*! @brief A compact, read-only copy of an Octree, laid out like the
+     *  octree section of KCL files.
+     *  
+     *  All nodes are stored in a single array of 32-bit values, with the root
+     *  nodes first. The value of a super node is the index of the first of
+     *  its 8 children, which are stored next to each other. The value of a
+     *  leaf node has `LEAF` set, and its other bits are the offset of its
+     *  triangle list in the triangle lists array. Each triangle list is a
+     *  run of triangle indices ending with `END`, and all empty leaves share
+     *  the first list. Leaves with the same triangles share the same list,
+     *  and a list which is the end of a longer one is stored as part of it.
+     *  
+     *  Unlike an Octree, a FlatOctree does not keep a copy of the vertices of
+     *  each triangle in each node it is in.
+     */
+    class FlatOctree final
+    {
+
+        friend class KCL;
+
+    public:
+
+        /*! @brief The bit set in the value of leaf nodes. */
+        static constexpr uint32_t LEAF = 0x80000000;
+
+        /*! @brief The value ending each triangle list. */
+        static constexpr uint16_t END = 0xFFFF;
+
+        /*! @brief Statistics about the nodes of a FlatOctree. */
+        struct Stats
+        {
+
+            /*! @brief The count of nodes at each depth, root nodes being at
+             *  depth `0`.
+             */
+            std::vector<uint32_t> nodesPerDepth;
+
+            /*! @brief The count of leaf nodes at each depth, root nodes being
+             *  at depth `0`.
+             */
+            std::vector<uint32_t> leavesPerDepth;
+
+            /*! @brief The count of leaf nodes with each count of triangles,
+             *  from `0` to `maxTriangles`.
+             */
+            std::vector<uint32_t> leavesPerTriangleCount;
+
+            /*! @brief The count of super nodes. */
+            uint32_t superNodeCount = 0;
+
+            /*! @brief The count of leaf nodes, including empty ones. */
+            uint32_t leafCount = 0;
+
+            /*! @brief The count of leaf nodes without triangles. */
+            uint32_t emptyLeafCount = 0;
+
+            /*! @brief The highest count of triangles in a leaf node. */
+            uint32_t maxTriangles = 0;
+
+            /*! @brief The average count of triangles in non-empty leaf nodes. */
+            float averageTriangles = 0.f;
+
+            /*! @brief The average count of triangles in the leaf node found by
+             *  a query at a random position in the octree.
+             *  
+             *  This is the average count of triangles a query must test, and
+             *  is the average of the triangle counts of all leaf nodes
+             *  weighted by their volume.
+             */
+            float averageQueryTriangles = 0.f;
+
+            /*! @brief The size of the octree section in KCL files, in bytes. */
+            uint32_t size = 0;
+        };
+
+        /*! @brief Constructs a FlatOctree from the specified Octree. */
+        explicit FlatOctree(const Octree& octree);
+
+        /*! @brief Returns the minimum value for each axis of this FlatOctree. */
+        Vector3f getMinPos() const;
+
+        /*! @brief Returns the mask value for each axis of this FlatOctree. */
+        Vector<uint32_t, 3> getMasks() const;
+
+        /*! @brief Returns the coordinate shift value of this FlatOctree. */
+        uint32_t getShift() const;
+
+        /*! @brief Returns the Y-axis shift value of this FlatOctree. */
+        uint32_t getShiftY() const;
+
+        /*! @brief Returns the Z-axis shift value of this FlatOctree. */
+        uint32_t getShiftZ() const;
+
+        /*! @brief Returns the number of root nodes in this FlatOctree. */
+        uint32_t getRootNodeCount() const;
+
+        /*! @brief Returns the values of all nodes in this FlatOctree. */
+        const std::vector<uint32_t>& getNodes() const;
+
+        /*! @brief Returns the triangle lists of this FlatOctree. */
+        const std::vector<uint16_t>& getTriangleLists() const;
+
+        /*! @brief Returns whether the node at the specified index is a leaf.
+         *  
+         *  @throw CTLib::KCLError If the specified index is out of range.
+         */
+        bool isLeaf(uint32_t index) const;
+
+        /*! @brief Returns the index of the child at the specified index of the
+         *  node at the specified index.
+         *  
+         *  @throw CTLib::KCLError If the node is a leaf, or if either index is
+         *  out of range.
+         */
+        uint32_t getChild(uint32_t index, uint8_t child) const;
+
+        /*! @brief Returns the triangle indices in the leaf at the specified
+         *  index.
+         *  
+         *  @throw CTLib::KCLError If the node is not a leaf, or if the index
+         *  is out of range.
+         */
+        std::vector<uint16_t> getIndices(uint32_t index) const;
+
+        /*! @brief Returns the count of bytes used by this FlatOctree. */
+        size_t getMemoryUsage() const;
+
+        /*! @brief Returns statistics about the nodes of this FlatOctree. */
+        Stats getStats() const;
+
+    private:
+
+        // sets the value at 'index' from 'node'; the children of super nodes
+        // are placed at 'next', which is then moved past them, and non-empty
+        // leaves are added to 'leaves' with their index
+        void flatten(
+            const OctreeNode* node, uint32_t index, uint32_t& next,
+            std::vector<std::pair<uint32_t, const OctreeNode*>>& leaves
+        );
+
+        // adds the triangle lists of 'leaves' to 'lists', sharing identical
+        // lists and suffixes of longer lists, and sets the leaf values
+        void addTriangleLists(std::vector<std::pair<uint32_t, const OctreeNode*>>& leaves);
+
+        // adds the node at 'index', at the specified depth, and its children
+        // to 'stats'; 'volume' is the fraction of the octree volume the node
+        // covers
+        void addStats(uint32_t index, uint32_t depth, float volume, Stats& stats) const;
+
+        // throws if 'index' >= 'nodes.size()'
+        void assertValidIndex(uint32_t index) const;
+
+        // first coordinate
+        Vector3f minPos;
+
+        // coord masks
+        uint32_t maskX, maskY, maskZ;
+
+        // coord right shift
+        uint32_t shift;
+
+        // coord left shifts
+        uint32_t shiftY, shiftZ;
+
+        // count of root nodes at the start of 'nodes'
+        uint32_t rootCount;
+
+        // node values
+        std::vector<uint32_t> nodes;
+
+        // triangle lists, each ending with 'END'
+        std::vector<uint16_t> lists;
     };
 
     /*! @brief KCL creation settings. */
@@ -307,6 +518,312 @@ public:
          *  smaller nodes.
          */
         uint32_t maxTriangles = 32;
+
+        /*! @brief The minimum size of octree nodes.
+         *  
+         *  Octree nodes are only split if they are larger than this on the
+         *  X-axis, without the blow factor.
+         */
+        float minNodeSize = 512.f;
+
+        /*! @brief The maximum depth of octree nodes, root nodes being at
+         *  depth `0`.
+         *  
+         *  Octree nodes at this depth are never split. When `0`, the depth of
+         *  nodes is only limited by `minNodeSize`.
+         */
+        uint32_t maxDepth = 0;
+
+        /*! @brief The cost of one byte of octree, in triangle tests per query.
+         *  
+         *  Once the octree is built, super nodes whose children are all
+         *  leaves are merged back into a single leaf, from the bottom up,
+         *  unless splitting them saves more triangle tests than their extra
+         *  bytes cost. The triangle tests saved are averaged over queries at
+         *  random positions in the octree, so splitting a large node saves
+         *  more than splitting a small one. Along with a lower `maxTriangles`,
+         *  this gives faster queries for the same file size; values between
+         *  `0.00001` and `0.0001` are a good start. When `0.0`, nodes are
+         *  never merged.
+         */
+        float memoryCost = 0.f;
+
+        /*! @brief The tolerance used to merge normals.
+         *  
+         *  When more than `0.0`, the normal components are rounded to
+         *  multiples of this value, and normals which round to the same
+         *  values share an entry in the normals array. This makes files
+         *  smaller at the cost of slightly less accurate triangles; values
+         *  around `0.0001` are usually safe. When `0.0`, only identical normals
+         *  are merged.
+         */
+        float normalEpsilon = 0.f;
+    };
+
+    /*! @brief Collision queries against the octree of a KCL.
+     *  
+     *  Points are located in the octree the same way the game does it: the
+     *  coordinates relative to the minimum position are checked against the
+     *  masks, the root node is selected with the shifts, and each level of
+     *  super nodes is descended with one bit per axis.
+     *  
+     *  A Query keeps a pointer to its KCL, which must outlive it and must not
+     *  be modified while it is used. Queries do not modify any state, so a
+     *  single Query can be used by several threads at once.
+     */
+    class Query final
+    {
+
+    public:
+
+        /*! @brief The result of a surface query. */
+        struct Hit
+        {
+
+            /*! @brief The value of `triangle` when nothing was hit. */
+            static constexpr uint16_t NONE = 0xFFFF;
+
+            /*! @brief The index of the triangle hit, or `NONE`. */
+            uint16_t triangle = NONE;
+
+            /*! @brief The KCL flag of the triangle hit. */
+            uint16_t flag = 0;
+
+            /*! @brief The distance from the query position to `position`. */
+            float distance = 0.f;
+
+            /*! @brief The point on the surface. */
+            Vector3f position;
+
+            /*! @brief The normal of the triangle hit. */
+            Vector3f normal;
+        };
+
+        /*! @brief A ray used by the batch version of `raycast()`. */
+        struct Ray
+        {
+
+            /*! @brief The origin of the ray. */
+            Vector3f origin;
+
+            /*! @brief The direction of the ray, which need not be normalized. */
+            Vector3f direction;
+
+            /*! @brief The maximum distance of a hit from the origin. */
+            float maxDistance;
+        };
+
+        /*! @brief Constructs a Query for the specified KCL.
+         *  
+         *  @throw CTLib::KCLError If the KCL has more than 65535 triangles,
+         *  or a triangle of the KCL has out of range indices.
+         */
+        explicit Query(const KCL& kcl);
+
+        /*! @brief The value returned by `findLeaf()` for points outside of
+         *  the octree.
+         */
+        static constexpr uint32_t NO_LEAF = 0xFFFFFFFF;
+
+        /*! @brief Returns the FlatOctree the queries run on. */
+        const FlatOctree& getOctree() const;
+
+        /*! @brief Returns the index in the FlatOctree of the leaf containing
+         *  the specified point, or `NO_LEAF` if it is outside of the octree.
+         */
+        uint32_t findLeaf(const Vector3f& point) const;
+
+        /*! @brief Returns the sorted indices of the triangles with at least
+         *  one point within the specified sphere.
+         */
+        std::vector<uint16_t> findTriangles(const Vector3f& centre, float radius) const;
+
+        /*! @brief Returns the first triangle hit by the specified ray.
+         *  
+         *  Like in the game, triangles are one-sided: only triangles facing
+         *  the ray origin can be hit.
+         *  
+         *  @param[in] origin The origin of the ray
+         *  @param[in] direction The direction of the ray
+         *  @param[in] maxDistance The maximum distance of a hit from `origin`
+         */
+        Hit raycast(const Vector3f& origin, const Vector3f& direction, float maxDistance) const;
+
+        /*! @brief Returns the closest point on the surface within the
+         *  specified distance of the specified point.
+         */
+        Hit findClosest(const Vector3f& point, float maxDistance) const;
+
+        /*! @brief Returns the first surface below the specified position
+         *  within the specified distance.
+         *  
+         *  This is a ray cast along the negative Y-axis, and can be used to
+         *  check that a spawn point sits on drivable ground.
+         */
+        Hit findGround(const Vector3f& position, float maxDistance) const;
+
+        /*! @brief Runs `raycast()` for each of the specified rays.
+         *  
+         *  @param[in] rays The rays
+         *  @param[in] threads The count of threads, or 0 to use the hardware
+         *  concurrency
+         */
+        std::vector<Hit> raycast(const std::vector<Ray>& rays, uint32_t threads = 1) const;
+
+        /*! @brief Runs `findClosest()` for each of the specified points.
+         *  
+         *  @param[in] points The points
+         *  @param[in] maxDistance The maximum distance of the surface
+         *  @param[in] threads The count of threads, or 0 to use the hardware
+         *  concurrency
+         */
+        std::vector<Hit> findClosest(
+            const std::vector<Vector3f>& points, float maxDistance, uint32_t threads = 1
+        ) const;
+
+        /*! @brief Runs `findGround()` for each of the specified positions.
+         *  
+         *  @param[in] positions The positions
+         *  @param[in] maxDistance The maximum distance of the ground
+         *  @param[in] threads The count of threads, or 0 to use the hardware
+         *  concurrency
+         */
+        std::vector<Hit> findGround(
+            const std::vector<Vector3f>& positions, float maxDistance, uint32_t threads = 1
+        ) const;
+
+    private:
+
+        // a leaf node with the bounds of its cell, relative to the minimum
+        // position and not blown up
+        struct Cell
+        {
+            uint32_t node;
+            Vector3f min;
+            float size;
+        };
+
+        // finds the leaf containing the specified point relative to the
+        // minimum position; returns false if it is outside of the octree
+        bool locate(const Vector3f& rel, Cell& cell) const;
+
+        // appends the leaves whose cell overlaps the specified box, relative
+        // to the minimum position
+        void collectLeaves(const Vector3f& min, const Vector3f& max, std::vector<Cell>& out) const;
+
+        // returns the sorted triangles of the leaves overlapping the box
+        std::vector<uint16_t> collectTriangles(const Vector3f& min, const Vector3f& max) const;
+
+        // returns the triangle list of the specified leaf
+        const uint16_t* leafTriangles(uint32_t node) const;
+
+        // fills 'hit' with the specified triangle and point
+        void fillHit(Hit& hit, uint16_t tri, const Vector3f& point, float distance) const;
+
+        // the KCL being queried
+        const KCL* kcl;
+
+        // the flattened octree of the KCL
+        FlatOctree octree;
+
+        // the size of the octree on each axis
+        Vector3f extent;
+
+        // the vertices of every triangle, 3 per triangle
+        std::vector<Vector3f> vertices;
+    };
+
+    /*! @brief An analysis of the octree of a KCL, to find out why collision
+     *  queries against it are slow.
+     *  
+     *  Like in the game, a query at a point tests all triangles in the leaf
+     *  containing that point. The query cost is simulated by counting the
+     *  triangles tested by queries at sample points, which can for example
+     *  be taken along the enemy routes of a course, or on a grid.
+     *  
+     *  @see KCL::profile()
+     */
+    struct Profile final
+    {
+
+        /*! @brief A leaf node of the octree. */
+        struct Cell
+        {
+
+            /*! @brief The index of the leaf in the FlatOctree. */
+            uint32_t node = 0;
+
+            /*! @brief The depth of the leaf, root nodes being at depth `0`. */
+            uint32_t depth = 0;
+
+            /*! @brief The minimum position of the leaf, not blown up. */
+            Vector3f min;
+
+            /*! @brief The size of the leaf on each axis, not blown up. */
+            float size = 0.f;
+
+            /*! @brief The count of triangles in the leaf. */
+            uint32_t triangles = 0;
+
+            /*! @brief The count of sample points in the leaf. */
+            uint32_t samples = 0;
+        };
+
+        /*! @brief The size of each section of a KCL file, in bytes. */
+        struct Sizes
+        {
+
+            /*! @brief The size of the header. */
+            uint32_t header = 0;
+
+            /*! @brief The size of the vertices section. */
+            uint32_t vertices = 0;
+
+            /*! @brief The size of the normals section. */
+            uint32_t normals = 0;
+
+            /*! @brief The size of the triangles section. */
+            uint32_t triangles = 0;
+
+            /*! @brief The size of the octree nodes. */
+            uint32_t octreeNodes = 0;
+
+            /*! @brief The size of the octree triangle lists. */
+            uint32_t triangleLists = 0;
+
+            /*! @brief The size of the whole file. */
+            uint32_t total = 0;
+        };
+
+        /*! @brief Statistics about the nodes of the octree. */
+        FlatOctree::Stats stats;
+
+        /*! @brief The size of each section of the KCL file. */
+        Sizes sizes;
+
+        /*! @brief The leaves in which the queries at the sample points test
+         *  the most triangles in total, most first.
+         *  
+         *  Leaves in which the queries test no triangles come after all
+         *  others, ordered by their count of triangles.
+         */
+        std::vector<Cell> worstCells;
+
+        /*! @brief The count of sample points. */
+        uint32_t sampleCount = 0;
+
+        /*! @brief The count of sample points outside of the octree. */
+        uint32_t outsideSampleCount = 0;
+
+        /*! @brief The average count of triangles tested by a query at a
+         *  sample point inside the octree.
+         */
+        float averageTests = 0.f;
+
+        /*! @brief The highest count of triangles tested by a query at a
+         *  sample point.
+         */
+        uint32_t maxTests = 0;
     };
 
     /*! @brief Sets the KCL creation settings. */
@@ -322,20 +839,44 @@ public:
      *  `vertices`: 3 vertex per face, 3 floats per vertex
      *  `flags`: 1 KCL flag per face, 1 uint16 per flag
      *  
-     *  If the last parameter is negative, the number of triangles will be
-     *  calculated _from the `vertices` buffer_. Else the number of triangles
-     *  is that value.
+     *  If `count` is negative, the number of triangles will be calculated
+     *  _from the `vertices` buffer_. Else the number of triangles is that
+     *  value.
      *  
      *  The normals are calculated by this function.
      *  
+     *  With more than one thread, the triangles are first sorted into the
+     *  root nodes of the octree, and then each root node is built by one of
+     *  the threads. The octree is the same as with a single thread.
+     *  
      *  @param[in] vertices The vertex data
      *  @param[in] flags The KCL flags
      *  @param[in] count The triangle count
+     *  @param[in] threads The count of threads used to build the octree, or 0
+     *  to use the hardware concurrency
      *  
      *  @throw CTLib::KCLError If there is not enough data remaining in the
-     *  specified data buffers.
+     *  specified data buffers, or the model has more than 65535 triangles, or
+     *  more than 65536 distinct vertices or normals.
+     */
+    static KCL fromModel(
+        Buffer& vertices, Buffer& flags, int32_t count = -1, uint32_t threads = 1
+    );
+
+    /*! @brief Profiles the octree of the specified KCL with queries at the
+     *  specified sample points.
+     *  
+     *  @param[in] kcl The KCL
+     *  @param[in] samples The sample points
+     *  @param[in] worstCellCount The maximum count of cells in
+     *  `Profile::worstCells`
+     *  
+     *  @throw CTLib::KCLError If the KCL has more than 65535 triangles, or a
+     *  triangle of the KCL has out of range indices.
      */
-    static KCL fromModel(Buffer& vertices, Buffer& flags, int32_t count = -1);
+    static Profile profile(
+        const KCL& kcl, const std::vector<Vector3f>& samples, uint32_t worstCellCount = 10
+    );
 
     /*! @brief Delete copy constructor for move-only class. */
     KCL(const KCL&) = delete;
@@ -362,9 +903,8 @@ public:
 
 private:
 
-    // methods part of KCL class to access private members of Octree
+    // method part of KCL class to access private members of Octree
     static void readOctree(Buffer& data, Octree* octree);
-    static void readOctreeNode(Buffer& data, OctreeNode* octree, uint32_t pos);
 
     // constructs an empty KCL
     KCL();
@@ -411,5 +411,23 @@ public:
     static bool isPartlyInsideAABB(
         const AABB& aabb, const Vector3f& t0, const Vector3f& t1, const Vector3f& t2
     );
+
+    /*! @brief Returns which of the specified AABBs the triangle defined by
+     *  `t0`, `t1` and `t2` is partly or fully inside.
+     *  
+     *  Bit `i` of the returned mask is set if the triangle is inside
+     *  `*aabbs[i]`, with the same result as `isPartlyInsideAABB()`. Several
+     *  AABBs are tested at once when SIMD instructions are available.
+     *  
+     *  @param[in] aabbs Pointers to the AABBs
+     *  @param[in] count The count of AABBs, up to 8
+     *  @param[in] t0 The first vertex of the triangle
+     *  @param[in] t1 The second vertex of the triangle
+     *  @param[in] t2 The third vertex of the triangle
+     */
+    static uint8_t getPartlyInsideAABBs(
+        const AABB* const* aabbs, uint32_t count,
+        const Vector3f& t0, const Vector3f& t1, const Vector3f& t2
+    );
 };
 }
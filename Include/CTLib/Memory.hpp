@@ -14,6 +14,7 @@
 
 
 #include <cstdint>
+#include <functional>
 #include <stdexcept>
 #include <string>
 #include <memory>
@@ -160,6 +161,20 @@ public:
      */
     Buffer(size_t size);
 
+    /*! @brief Constructs a buffer adopting the specified memory.
+     *
+     *  No copy is made; the memory will be released with the specified
+     *  deleter once this buffer and all buffers sharing its data, such as
+     *  @link duplicate() duplicates@endlink, are destroyed.
+     * 
+     *  This is useful to wrap memory allocated by another library.
+     * 
+     *  @param[in] data The memory to be adopted
+     *  @param[in] size The size of the memory, in bytes
+     *  @param[in] deleter The function releasing the memory
+     */
+    Buffer(uint8_t* data, size_t size, std::function<void(uint8_t*)> deleter);
+
     /*! @brief Constructs a fully independent copy of the specified buffer.
      *
      *  This constructor will construct a new buffer with its state and data
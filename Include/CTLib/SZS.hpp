@@ -0,0 +1,69 @@
+//////////////////////////////////////////////////
+//  Copyright (c) 2020 Nara Hiero
+//
+// This file is licensed under GPLv3+
+// Refer to the `License.txt` file included.
+//////////////////////////////////////////////////
+
+#pragma once
+
+/*! @file SZS.hpp
+ * 
+ *  @brief The header for SZS archives, built with the Yaz and U8 modules.
+ */
+
+
+#include <CTLib/Memory.hpp>
+#include <CTLib/U8.hpp>
+#include <CTLib/Yaz.hpp>
+
+
+namespace CTLib
+{
+
+/*! @defgroup szs SZS
+ * 
+ *  @addtogroup szs
+ * 
+ *  @brief The SZS module contains methods to read and write Yaz0 compressed
+ *  U8 archives.
+ *  
+ *  This module is only available when both the Yaz and U8 modules are.
+ *  @{
+ */
+
+/*! @brief The SZS class contains methods to read and write SZS archives. */
+class SZS
+{
+
+public:
+
+    /*! @brief Decompresses and parses a U8Arc from the specified SZS data.
+     *  
+     *  The data is decompressed once to a single buffer, and the files of the
+     *  returned archive share that buffer instead of holding a copy of their
+     *  contents (see CTLib::U8File::setDataShared()). As such, the memory of
+     *  the decompressed archive is released only once all files are replaced
+     *  or destroyed.
+     *  
+     *  @param[in] data The buffer containing the compressed archive
+     *  
+     *  @throw CTLib::YazError If data is not Yaz compressed, or corrupted.
+     *  @throw CTLib::U8Error If the decompressed data is not a valid U8
+     *  archive.
+     *  
+     *  @return The parsed U8Arc
+     */
+    static U8Arc read(Buffer& data);
+
+    /*! @brief Writes the specified U8 archive to a Yaz0 compressed buffer.
+     *  
+     *  @param[in] arc The archive to be written
+     *  
+     *  @return The buffer containing the compressed archive
+     */
+    static Buffer write(const U8Arc& arc);
+};
+
+/*! @} addtogroup szs */
+}
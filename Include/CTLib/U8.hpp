@@ -16,6 +16,7 @@
 #include <map>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include <CTLib/Memory.hpp>
@@ -28,6 +29,7 @@ namespace CTLib
 class U8Arc;
 class U8Dir;
 class U8File;
+class U8Patch;
 
 /*! @defgroup u8 U8
  *  
@@ -73,6 +75,14 @@ public:
     /*! @brief Returns the name of this entry. */
     std::string getName() const;
 
+    /*! @brief Returns a view of the name of this entry, without copying it.
+     *  
+     *  The name is stored in the string pool of the archive owning this entry,
+     *  so the view remains valid until the archive is destroyed, even if this
+     *  entry is renamed.
+     */
+    std::string_view getNameView() const;
+
     /*! @brief Returns the absolute path of this entry. */
     virtual std::string getAbsolutePath() const = 0;
 
@@ -117,8 +127,12 @@ protected:
     //! the parent directory
     U8Dir* parent;
 
-    //! name of this entry
-    std::string name;
+    //! name of this entry, interned in the archive's string pool
+    std::string_view name;
+
+    //! returns the absolute path of this entry, with a trailing slash if
+    //! `directory` is `true`
+    std::string makeAbsolutePath(bool directory) const;
 
 private:
 
@@ -140,7 +154,7 @@ class U8Dir final : public U8Entry
 public:
 
     /*! @brief An iterator to iterate over the entries in this directory. */
-    using Iterator = MapValueIterator<std::string, U8Entry*>;
+    using Iterator = MapValueIterator<std::string_view, U8Entry*>;
 
     ~U8Dir();
 
@@ -214,7 +228,7 @@ private:
     void assertUniqueName(const std::string& name);
 
     // map of <name, entry> containing all entries in this directory
-    std::map<std::string, U8Entry*> entries;
+    std::map<std::string_view, U8Entry*> entries;
 };
 
 /*! @brief A file within a U8 archive. */
@@ -230,12 +244,33 @@ public:
     /*! @brief Sets the contents of this file to the specified buffer. */
     void setData(const Buffer& data);
 
+    /*! @brief Sets the contents of this file to the remaining bytes of the
+     *  specified buffer, without copying them.
+     *  
+     *  The file shares memory with `data`, so any later modification to the
+     *  memory of `data` is reflected in this file. This is used to hold many
+     *  files within a single buffer, such as a decompressed SZS archive.
+     *  
+     *  @param[in] data The buffer containing the contents of this file
+     */
+    void setDataShared(const Buffer& data);
+
     /*! @brief Returns a copy of the contents of this file. */
     Buffer getData() const;
 
     /*! @brief Returns the size of the data. */
     uint32_t getDataSize() const;
 
+    /*! @brief Returns the 64-bit hash of the contents of this file.
+     *  
+     *  The hash is computed with CTLib::Bytes::hash() the first time this
+     *  method is called, and cached until the contents are set again.
+     *  
+     *  _**NOTE**: If the memory shared with setDataShared() is modified, the
+     *  cached hash is not updated._
+     */
+    uint64_t getHash() const;
+
     /*! @brief Returns the absolute path of the file. */
     std::string getAbsolutePath() const override;
 
@@ -255,6 +290,12 @@ private:
 
     // contents of this file
     Buffer data;
+
+    // cached hash of the contents
+    mutable uint64_t hash;
+
+    // whether 'hash' is valid
+    mutable bool hashed;
 };
 
 /*! @brief The U8Arc class is a object-oriented representation of Nintendo's U8
@@ -422,6 +463,9 @@ private:
     // adds an entry of the specified type at the specified path
     U8Entry* addEntryAbsolute(const std::string& path, U8EntryType type);
 
+    // pool containing the names of all entries in this archive
+    StringPool names;
+
     // vector containing all entries in this archive
     std::vector<U8Entry*> entries;
 
@@ -429,6 +473,136 @@ private:
     U8Dir* root;
 };
 
+/*! @brief A list of the entries of a U8 archive with the hash of their
+ *  contents, used to detect changes between archives.
+ *  
+ *  Comparing manifests is much faster than writing and comparing archives, as
+ *  file hashes are cached by U8File::getHash(). Manifests can be saved by a
+ *  build system, using getEntries() and setEntry(), to skip writing archives
+ *  which did not change.
+ *  
+ *  ~~~{.cpp}
+ *  U8Manifest before(arc);
+ *  arc.getEntryAbsolute("./course.kmp")->asFile()->setData(kmpData);
+ *  U8Manifest after(arc);
+ *  
+ *  before.getChangedPaths(after); // {"./course.kmp"}
+ *  ~~~
+ */
+class U8Manifest final
+{
+
+public:
+
+    /*! @brief Constructs an empty manifest. */
+    U8Manifest();
+
+    /*! @brief Constructs the manifest of the specified archive.
+     *  
+     *  Directories are listed with a trailing slash `'/'` and a hash of `0`.
+     *  
+     *  @param[in] arc The archive to list
+     */
+    explicit U8Manifest(const U8Arc& arc);
+
+    ~U8Manifest();
+
+    /*! @brief Sets the hash of the entry at the specified path.
+     *  
+     *  @param[in] path The absolute path to the entry
+     *  @param[in] hash The hash of the contents of the entry
+     */
+    void setEntry(const std::string& path, uint64_t hash);
+
+    /*! @brief Returns the map of <absolute path, hash> of all entries. */
+    const std::map<std::string, uint64_t>& getEntries() const;
+
+    /*! @brief Returns the hash of the whole archive, covering the path and
+     *  hash of every entry.
+     */
+    uint64_t getHash() const;
+
+    /*! @brief Returns the sorted paths of the entries which were added,
+     *  removed or modified between this manifest and `other`.
+     *  
+     *  @param[in] other The manifest to compare with
+     *  
+     *  @return The paths of the changed entries
+     */
+    std::vector<std::string> getChangedPaths(const U8Manifest& other) const;
+
+    /*! @brief Returns whether both manifests list the same entries with the
+     *  same hashes.
+     */
+    bool operator==(const U8Manifest& other) const;
+
+    /*! @brief Returns whether the manifests differ. */
+    bool operator!=(const U8Manifest& other) const;
+
+private:
+
+    // map of <absolute path, hash> of entries
+    std::map<std::string, uint64_t> entries;
+};
+
+/*! @brief A set of changes to be applied to an existing U8 archive.
+ *  
+ *  A U8Patch is passed to CTLib::U8::patch() to modify the files of a written
+ *  U8 archive without parsing the whole archive into a U8Arc first. Paths are
+ *  absolute, in the same format as CTLib::U8Arc::getEntryAbsolute().
+ *  
+ *  ~~~{.cpp}
+ *  U8Patch patch;
+ *  patch.setFile("./course.kmp", kmpData);
+ *  patch.remove("./posteffect");
+ *  
+ *  Buffer patched = U8::patch(szsData, patch);
+ *  ~~~
+ */
+class U8Patch final
+{
+
+    friend class U8;
+
+public:
+
+    /*! @brief Constructs an empty patch. */
+    U8Patch();
+
+    ~U8Patch();
+
+    /*! @brief Sets the contents of the file at the specified path.
+     *  
+     *  If no entry exists at the specified path when the patch is applied, the
+     *  file is added along with any missing parent directory. The remaining
+     *  bytes of `data` are copied.
+     *  
+     *  @param[in] path The absolute path to the file
+     *  @param[in] data The new contents of the file
+     */
+    void setFile(const std::string& path, const Buffer& data);
+
+    /*! @brief Removes the entry at the specified path.
+     *  
+     *  If the entry is a directory, all of its contents are removed as well.
+     *  Removals are applied before files are set.
+     *  
+     *  @param[in] path The absolute path to the entry
+     */
+    void remove(const std::string& path);
+
+    /*! @brief Returns whether this patch contains no change. */
+    bool isEmpty() const;
+
+private:
+
+    // map of <path, data> of files to be set
+    std::map<std::string, Buffer> files;
+
+    // paths of entries to be removed
+    std::vector<std::string> removed;
+};
+
 /*! @brief The U8 class contains methods to read and write U8Arc objects. */
 class U8
 {
@@ -452,6 +626,38 @@ public:
      *  @return The buffer containing the written archive
      */
     static Buffer write(const U8Arc& arc);
+
+    /*! @brief Writes the specified U8 archive to a buffer, optionally storing
+     *  the data of identical files only once.
+     *  
+     *  When `deduplicate` is `true`, the data of each file is hashed and the
+     *  nodes of files with byte-identical contents all point to the same data
+     *  region. This makes the archive smaller, and leaves less data to
+     *  compress. The data is still read back as separate files.
+     *  
+     *  @param[in] arc The archive to be written
+     *  @param[in] deduplicate Whether to share the data of identical files
+     *  
+     *  @return The buffer containing the written archive
+     */
+    static Buffer write(const U8Arc& arc, bool deduplicate);
+
+    /*! @brief Applies the specified patch to a written U8 archive.
+     *  
+     *  Only the filesystem section is rebuilt; the data of unchanged files is
+     *  copied from `data` in contiguous runs, without being parsed into a
+     *  U8Arc. The returned archive has the same layout as the one returned by
+     *  CTLib::U8::write() for the patched archive.
+     *  
+     *  @param[in] data The buffer containing the archive to be patched
+     *  @param[in] patch The changes to apply
+     *  
+     *  @throw CTLib::U8Error If data is invalid or corrupted, or if the patch
+     *  removes a missing entry or sets a file where a directory exists.
+     *  
+     *  @return The buffer containing the patched archive
+     */
+    static Buffer patch(Buffer& data, const U8Patch& patch);
 };
 
 /*! @brief U8Error is the error class used by the methods in this header. */
@@ -20,9 +20,13 @@
 
 
 #include <cstdint>
+#include <functional>
 #include <map>
+#include <memory>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <unordered_set>
 #include <vector>
 
 #include <CTLib/Memory.hpp>
@@ -220,6 +224,20 @@ public:
     static uint8_t* findLongestMatch(
         uint8_t* bytes, size_t bytesSize, uint8_t* find, size_t& findSize
     );
+
+    /*! @brief Computes the 64-bit xxHash (XXH64) of the first `count` bytes
+     *  of `bytes`.
+     *  
+     *  The hash is not cryptographic, but is fast and has a very low collision
+     *  rate, which makes it suitable to detect identical or changed data.
+     * 
+     *  @param[in] bytes The bytes to be hashed
+     *  @param[in] count The amount of bytes to be hashed
+     *  @param[in] seed The seed of the hash
+     * 
+     *  @return The hash of the bytes
+     */
+    static uint64_t hash(const uint8_t* bytes, size_t count, uint64_t seed = 0);
 };
 
 /*! @brief Utility class containing various methods to perform I/O operations. 
@@ -270,6 +288,111 @@ public:
     static bool writeFile(const std::string& filename, Buffer& data);
 };
 
+/*! @brief An arena storing distinct strings.
+ *  
+ *  Interned strings are stored back-to-back in large blocks of memory, and are
+ *  never moved nor freed before the pool is destroyed. This avoids one
+ *  allocation per string when holding many short strings, such as the names
+ *  of the entries of an archive. Each distinct string is stored only once.
+ */
+class StringPool final
+{
+
+public:
+
+    /*! @brief Constructs an empty string pool. */
+    StringPool();
+
+    /*! @brief Delete copy constructor, as views point into the pool. */
+    StringPool(const StringPool&) = delete;
+
+    /*! @brief Moves the strings of `src` to this newly created pool.
+     *  
+     *  Views returned by `src` remain valid, and `src` is then empty.
+     * 
+     *  @param[in] src The pool to move
+     */
+    StringPool(StringPool&& src) noexcept;
+
+    ~StringPool();
+
+    /*! @brief Returns a view of the copy of `str` stored in this pool.
+     *  
+     *  If an equal string was already interned, a view of that string is
+     *  returned instead of storing `str` again. The returned view is followed
+     *  by a null character `'\0'`, and remains valid until this pool is
+     *  destroyed.
+     *  
+     *  @param[in] str The string to intern
+     *  
+     *  @return A view of the interned string
+     */
+    std::string_view intern(std::string_view str);
+
+    /*! @brief Returns the number of distinct strings in this pool. */
+    size_t count() const;
+
+private:
+
+    // returns 'size' bytes of memory from the current block or a new one
+    char* allocate(size_t size);
+
+    // memory blocks containing the strings
+    std::vector<std::unique_ptr<char[]>> blocks;
+
+    // amount of bytes used in the current (last) block
+    size_t used;
+
+    // size of the current (last) block
+    size_t available;
+
+    // views of every string in this pool
+    std::unordered_set<std::string_view> strings;
+};
+
+/*! @brief Utility class containing methods to spread work over threads. */
+class Parallel final
+{
+
+public:
+
+    /*! @brief Calls `func` for every index in [0, `count`) on up to the
+     *  specified count of threads.
+     *  
+     *  Indices are handed out in increasing order, and the calling thread is
+     *  one of the threads doing the work. If `func` throws, the remaining
+     *  indices are still processed and the first exception thrown is
+     *  rethrown once all threads are done.
+     *  
+     *  @param[in] count The count of indices
+     *  @param[in] threads The count of threads, or 0 to use the hardware
+     *  concurrency
+     *  @param[in] func The function called with every index
+     */
+    static void forEach(
+        size_t count, uint32_t threads, const std::function<void(size_t)>& func
+    );
+
+    /*! @brief Calls `func` for every range of at most `chunk` indices in
+     *  [0, `count`) on up to the specified count of threads.
+     *  
+     *  This behaves like `forEach`, except that `func` is called with the
+     *  begin and end of a range at a time, which is cheaper when the work per
+     *  index is small.
+     *  
+     *  @param[in] count The count of indices
+     *  @param[in] threads The count of threads, or 0 to use the hardware
+     *  concurrency
+     *  @param[in] chunk The maximum count of indices in a range
+     *  @param[in] func The function called with the begin and end of every
+     *  range
+     */
+    static void forChunks(
+        size_t count, uint32_t threads, size_t chunk,
+        const std::function<void(size_t, size_t)>& func
+    );
+};
+
 /*! @brief Utility class used to iterate over the values of a map. */
 template <class K, class V>
 class MapValueIterator final
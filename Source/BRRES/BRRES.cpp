@@ -18,6 +18,7 @@ namespace CTLib
 BRRES::BRRES() :
     mdl0s{},
     tex0s{},
+    plt0s{},
     callbacks{}
 {
 
@@ -29,10 +30,12 @@ BRRES::BRRES() :
 
 BRRES::BRRES(BRRES&& src) :
     mdl0s{std::move(src.mdl0s)},
-    tex0s{std::move(src.tex0s)}
+    tex0s{std::move(src.tex0s)},
+    plt0s{std::move(src.plt0s)}
 {
     CT_LIB_BRRES_MOVE_CONTAINER(mdl0s);
     CT_LIB_BRRES_MOVE_CONTAINER(tex0s);
+    CT_LIB_BRRES_MOVE_CONTAINER(plt0s);
 }
 
 #undef CT_LIB_BRRES_MOVE_CONTAINER
@@ -45,6 +48,7 @@ BRRES::~BRRES()
 {
     CT_LIB_BRRES_DELETE_CONTAINER(mdl0s);
     CT_LIB_BRRES_DELETE_CONTAINER(tex0s);
+    CT_LIB_BRRES_DELETE_CONTAINER(plt0s);
 }
 
 #undef CT_LIB_BRRES_DELETE_CONTAINER
@@ -54,6 +58,7 @@ uint16_t BRRES::getSubfileCount() const
     return static_cast<uint16_t>(
         mdl0s.size()
         + tex0s.size()
+        + plt0s.size()
     );
 }
 
@@ -136,6 +141,7 @@ CT_LIB_DEFINE_BRRES_COUNT(Type, container) \
 
 CT_LIB_DEFINE_ALL_BRRES(MDL0, mdl0s)
 CT_LIB_DEFINE_ALL_BRRES(TEX0, tex0s)
+CT_LIB_DEFINE_ALL_BRRES(PLT0, plt0s)
 
 #undef CT_LIB_DEFINE_ALL_BRRES
 #undef CT_LIB_DEFINE_BRRES_ADD
@@ -0,0 +1,41 @@
+//////////////////////////////////////////////////
+//  Copyright (c) 2020 Nara Hiero
+//
+// This file is licensed under GPLv3+
+// Refer to the `License.txt` file included.
+//////////////////////////////////////////////////
+
+#include <CTLib/BRRES.hpp>
+
+namespace CTLib
+{
+
+PLT0::PLT0(BRRES* brres, const std::string& name) :
+    BRRESSubFile(brres, name),
+    palette{}
+{
+
+}
+
+PLT0::~PLT0() = default;
+
+void PLT0::setPalette(const Palette& palette)
+{
+    this->palette = palette;
+}
+
+Palette PLT0::getPalette() const
+{
+    return palette;
+}
+
+PaletteFormat PLT0::getFormat() const
+{
+    return palette.getFormat();
+}
+
+uint16_t PLT0::getColourCount() const
+{
+    return palette.getCount();
+}
+}
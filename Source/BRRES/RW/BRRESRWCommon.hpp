@@ -201,4 +201,16 @@ uint32_t calculateTEX0Size(TEX0* tex0);
 void writeTEX0(
     Buffer& out, TEX0* tex0, int32_t offToBRRES, BRRESStringTable* table, uint32_t tableOff
 );
+
+/// PLT0 ///////////////////////////////
+
+void readPLT0(Buffer& data, PLT0* plt0);
+
+void addPLT0StringsToTable(BRRESStringTable* table, PLT0* plt0);
+
+uint32_t calculatePLT0Size(PLT0* plt0);
+
+void writePLT0(
+    Buffer& out, PLT0* plt0, int32_t offToBRRES, BRRESStringTable* table, uint32_t tableOff
+);
 }
@@ -128,6 +128,10 @@ void readBRRESSectionEntry(
     {
         readTEX0(data, brres.add<TEX0>(entry->getName()));
     }
+    else if (name == "Palettes(NW4R)")
+    {
+        readPLT0(data, brres.add<PLT0>(entry->getName()));
+    }
 }
 
 void readBRRESSections(Buffer& data, BRRES& brres, BRRESHeader* header, BRRESIndexGroup* root)
@@ -0,0 +1,146 @@
+//////////////////////////////////////////////////
+//  Copyright (c) 2020 Nara Hiero
+//
+// This file is licensed under GPLv3+
+// Refer to the `License.txt` file included.
+//////////////////////////////////////////////////
+
+#include "BRRES/RW/BRRESRWCommon.hpp"
+
+#include <CTLib/Utilities.hpp>
+
+namespace CTLib
+{
+
+struct PLT0Header
+{
+
+    // offset to data (section 1) in bytes
+    uint32_t dataOff;
+};
+
+struct PLT0PaletteInfo
+{
+
+    // format of the colours
+    PaletteFormat format;
+
+    // number of colours
+    uint16_t count;
+};
+
+void readPLT0Header(Buffer& data, PLT0* plt0, PLT0Header* header)
+{
+    const uint32_t dataSize = static_cast<uint32_t>(data.remaining());
+
+    if (dataSize < 0x18)
+    {
+        throw BRRESError(Strings::format(
+            "PLT0: Invalid header! Not enough bytes in buffer! (%d < 24)",
+            dataSize
+        ));
+    }
+
+    if (!Bytes::matchesString("PLT0", *data + 0x00, 0x4))
+    {
+        throw BRRESError(Strings::format(
+            "PLT0: Invalid header! Invalid magic! (Expected 'PLT0', Got '%s')",
+            Strings::stringify(*data + 0x00, 0x4).c_str()
+        ));
+    }
+    data.getInt(); // skip magic
+
+    uint32_t size = data.getInt();
+    if (dataSize < size)
+    {
+        throw BRRESError(Strings::format(
+            "PLT0: Invalid data! Not enough bytes in buffer! (%d < %d)",
+            dataSize, size
+        ));
+    }
+
+    uint32_t version = data.getInt();
+    if (version != 1 && version != 3)
+    {
+        throw BRRESError(Strings::format(
+            "PLT0: Unsupported version number (%d)! (Supported version numbers are 1 and 3)",
+            version
+        ));
+    }
+
+    data.getInt(); // ignore offset to BRRES
+
+    header->dataOff = data.getInt();
+    if (header->dataOff > size)
+    {
+        throw BRRESError(Strings::format(
+            "PLT0: Data offset is out of range! (%d > %d)",
+            header->dataOff, size
+        ));
+    }
+
+    std::string name = readBRRESString(data, data.getInt());
+    if (name != plt0->getName())
+    {
+        throw BRRESError(Strings::format(
+            "PLT0: Section name does not match index group entry name! (%s != %s)",
+            name.c_str(), plt0->getName().c_str()
+        ));
+    }
+
+    data.limit(size);
+}
+
+void readPLT0PaletteInfo(Buffer& data, PLT0PaletteInfo* info)
+{
+    if (data.remaining() < 0x8)
+    {
+        throw BRRESError(Strings::format(
+            "PLT0: Invalid palette info header! Not enough bytes in buffer! (%d < 8)",
+            data.remaining()
+        ));
+    }
+
+    uint32_t format = data.getInt();
+    if (format > static_cast<uint32_t>(PaletteFormat::RGB5A3))
+    {
+        throw BRRESError(Strings::format(
+            "PLT0: Invalid palette format! (%d)", format
+        ));
+    }
+    info->format = static_cast<PaletteFormat>(format);
+
+    info->count = data.getShort();
+    data.getShort(); // padding
+}
+
+void readPLT0Data(Buffer& data, PLT0* plt0, PLT0Header* header, PLT0PaletteInfo* info)
+{
+    data.position(header->dataOff);
+
+    if (data.remaining() < static_cast<size_t>(info->count) * 2)
+    {
+        throw BRRESError(Strings::format(
+            "PLT0: Not enough bytes remaining in buffer for palette! (%d < %d)",
+            data.remaining(), info->count * 2
+        ));
+    }
+    plt0->setPalette(Palette(info->format, data, info->count));
+}
+
+void readPLT0(Buffer& buffer, PLT0* plt0)
+{
+    Buffer data = buffer.slice();
+
+    ////// Read header /////////////////
+    PLT0Header header;
+    readPLT0Header(data, plt0, &header);
+
+    ////// Read palette info ///////////
+    PLT0PaletteInfo info;
+    readPLT0PaletteInfo(data, &info);
+
+    ////// Read data ///////////////////
+    readPLT0Data(data, plt0, &header, &info);
+}
+}
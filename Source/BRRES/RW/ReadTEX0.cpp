@@ -104,7 +104,7 @@ void readTEX0ImageInfo(Buffer& data, TEX0ImageInfo* info)
         ));
     }
 
-    data.getInt(); // unknown/unused
+    data.getInt(); // has palette; implied by the format
 
     info->width = data.getShort();
     info->height = data.getShort();
@@ -12,6 +12,7 @@ namespace CTLib
 
 constexpr const char* MDL0_GROUP = "3DModels(NW4R)";
 constexpr const char* TEX0_GROUP = "Textures(NW4R)";
+constexpr const char* PLT0_GROUP = "Palettes(NW4R)";
 
 struct BRRESInfo
 {
@@ -70,6 +71,7 @@ void createStringTable(const BRRES& brres, BRRESStringTable* table)
 {
     addAllToStringTable<MDL0>(brres, table, MDL0_GROUP, &addMDL0StringsToTable);
     addAllToStringTable<TEX0>(brres, table, TEX0_GROUP, &addTEX0StringsToTable);
+    addAllToStringTable<PLT0>(brres, table, PLT0_GROUP, &addPLT0StringsToTable);
 }
 
 template <class Type>
@@ -92,6 +94,7 @@ void createRootIndexGroup(const BRRES& brres, BRRESIndexGroup* root, BRRESGroups
 
     addIfNotEmpty<MDL0>(brres, root, info, MDL0_GROUP);
     addIfNotEmpty<TEX0>(brres, root, info, TEX0_GROUP);
+    addIfNotEmpty<PLT0>(brres, root, info, PLT0_GROUP);
 }
 
 template <class Type>
@@ -116,6 +119,7 @@ void createIndexGroups(const BRRES& brres, BRRESIndexGroup* groups, BRRESGroupsI
 {
     createIndexGroup<MDL0>(brres, groups, info, MDL0_GROUP);
     createIndexGroup<TEX0>(brres, groups, info, TEX0_GROUP);
+    createIndexGroup<PLT0>(brres, groups, info, PLT0_GROUP);
 }
 
 template <class Type>
@@ -155,6 +159,7 @@ uint32_t calculateSizeAndOffsets(
 
     addSubfilesSize<MDL0>(brres, offsets, size, &calculateMDL0Size);
     addSubfilesSize<TEX0>(brres, offsets, size, &calculateTEX0Size);
+    addSubfilesSize<PLT0>(brres, offsets, size, &calculatePLT0Size);
 
     ////////////////////////////////////
     /// string table
@@ -258,6 +263,7 @@ void writeData(Buffer& out, const BRRES& brres, BRRESStringTable* table, BRRESOf
 {
     writeSubfilesData<MDL0>(out, brres, table, offsets, &writeMDL0);
     writeSubfilesData<TEX0>(out, brres, table, offsets, &writeTEX0);
+    writeSubfilesData<PLT0>(out, brres, table, offsets, &writePLT0);
 }
 
 void writeStringTable(Buffer& out, BRRESStringTable* table, BRRESOffsets* offsets)
@@ -0,0 +1,88 @@
+//////////////////////////////////////////////////
+//  Copyright (c) 2020 Nara Hiero
+//
+// This file is licensed under GPLv3+
+// Refer to the `License.txt` file included.
+//////////////////////////////////////////////////
+
+#include "BRRES/RW/BRRESRWCommon.hpp"
+
+namespace CTLib
+{
+
+void addPLT0StringsToTable(BRRESStringTable* table, PLT0* plt0)
+{
+    // there are no internal strings used by PLT0
+}
+
+uint32_t calculatePLT0Size(PLT0* plt0)
+{
+    uint32_t size = 0x40; // header size
+    size += static_cast<uint32_t>(plt0->getColourCount()) * 2;
+
+    return padNumber(size, 0x10);
+}
+
+struct PLT0Info
+{
+
+    // size of file in bytes
+    uint32_t size;
+
+    // offset to outer BRRES file
+    int32_t offToBRRES;
+
+    // offset to data
+    uint32_t dataOff;
+    
+    // offset to name
+    uint32_t nameOff;
+};
+
+void createInfo(
+    PLT0* plt0, PLT0Info* info, int32_t offToBRRES, BRRESStringTable* table, uint32_t tableOff
+)
+{
+    info->size = calculatePLT0Size(plt0);
+    info->offToBRRES = offToBRRES;
+    info->dataOff = 0x40;
+    info->nameOff = table->offsets.at(plt0->getName()) + tableOff;
+}
+
+void writeHeader(Buffer& out, PLT0Info* info)
+{
+    out.putArray((uint8_t*)"PLT0", 4);
+    out.putInt(info->size);
+    out.putInt(1); // PLT0 version
+    out.putInt(static_cast<uint32_t>(info->offToBRRES));
+    out.putInt(info->dataOff); // offset to data
+    out.putInt(info->nameOff);
+}
+
+void writePLT0Header(Buffer& out, PLT0* plt0)
+{
+    out.putInt(static_cast<uint32_t>(plt0->getFormat()));
+    out.putShort(plt0->getColourCount());
+    out.putShort(0); // padding
+    out.putInt(0); // offset to original path (unused)
+}
+
+void writePaletteData(Buffer& out, PLT0Info* info, PLT0* plt0)
+{
+    out.position(info->dataOff);
+
+    out.put(plt0->getPalette().getData());
+}
+
+void writePLT0(
+    Buffer& out, PLT0* plt0, int32_t offToBRRES, BRRESStringTable* table, uint32_t tableOff
+)
+{
+    PLT0Info info;
+    createInfo(plt0, &info, offToBRRES, table, tableOff);
+
+    writeHeader(out, &info);
+    writePLT0Header(out, plt0);
+    writePaletteData(out, &info, plt0);
+}
+}
@@ -66,7 +66,7 @@ void writeHeader(Buffer& out, TEX0Info* info)
 
 void writeTEX0Header(Buffer& out, TEX0* tex0)
 {
-    out.putInt(0); // unknown/unused
+    out.putInt(ImageCoder::isPaletteFormat(tex0->getFormat()) ? 1 : 0); // has palette
     out.putShort(tex0->getWidth());
     out.putShort(tex0->getHeight());
     out.putInt(static_cast<uint32_t>(tex0->getFormat()));
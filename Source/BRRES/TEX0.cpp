@@ -34,11 +34,23 @@ void TEX0::setTextureData(const Image& image, ImageFormat format)
 void TEX0::setTextureData(const Image& image)
 {
     deleteMipmaps();
-    data = ImageCoder::encode(image, format);
+    data = encodeImage(image);
     width = static_cast<uint16_t>(image.getWidth());
     height = static_cast<uint16_t>(image.getHeight());
 }
 
+void TEX0::setTextureData(const Image& image, double minPSNR, bool palette)
+{
+    Palette selected;
+    ImageFormat format = ImageCoder::selectFormat(image, minPSNR, palette ? &selected : nullptr);
+    if (ImageCoder::isPaletteFormat(format))
+    {
+        PLT0* plt0 = brres->has<PLT0>(name) ? brres->get<PLT0>(name) : brres->add<PLT0>(name);
+        plt0->setPalette(selected);
+    }
+    setTextureData(image, format);
+}
+
 void TEX0::setTextureData(Buffer& data, uint16_t width, uint16_t height, ImageFormat format)
 {
     this->format = format;
@@ -87,7 +99,7 @@ void TEX0::setMipmapTextureData(uint32_t index, const Image& image)
     assertValidMipmapInsert(index);
     assertValidMipmapImage(index, image);
 
-    Buffer mipmapData = ImageCoder::encode(image, format);
+    Buffer mipmapData = encodeImage(image);
     if (mipmaps.size() == index)
     {
         mipmaps.push_back(std::move(mipmapData));
@@ -123,19 +135,78 @@ void TEX0::setMipmapTextureData(uint32_t index, Buffer& data)
 void TEX0::generateMipmaps(uint32_t count, const Image& image)
 {
     assertValidMipmapCount(count);
-    
-    deleteMipmaps();
+
+    // every level is resized from the base image, so the output does not
+    // depend on the MipmapOptions defaults
+    std::vector<Buffer> levels;
+    levels.reserve(count);
     for (uint32_t i = 0; i < count; ++i)
     {
-        Image mipmapImg = image.resize(getMipmapWidth(i), getMipmapHeight(i));
-        mipmaps.push_back(ImageCoder::encode(mipmapImg, format));
+        levels.push_back(encodeImage(image.resize(getMipmapWidth(i), getMipmapHeight(i))));
+    }
+    mipmaps = std::move(levels);
+}
+
+void TEX0::generateMipmaps(
+    uint32_t count, const Image& image, const MipmapOptions& options, uint32_t threads
+)
+{
+    assertValidMipmapCount(count);
+
+    // each level is downsampled from the previous one rather than from the
+    // base image, so every level only reads a quarter of the previous pixels;
+    // a source smaller than the level cannot be downsampled and is resized
+    // instead, like every level used to be
+    std::vector<Image> levels;
+    levels.reserve(count);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const Image& source = i == 0 ? image : levels.back();
+        const uint32_t width = getMipmapWidth(i);
+        const uint32_t height = getMipmapHeight(i);
+        if (width > source.getWidth() || height > source.getHeight())
+        {
+            levels.push_back(source.resize(width, height));
+        }
+        else
+        {
+            levels.push_back(
+                source.downsample(width, height, options.filter, options.gammaCorrect)
+            );
+        }
+    }
+
+    const float coverage = options.keepCoverage
+        ? image.alphaCoverage(options.alphaReference) : 0.f;
+
+    deleteMipmaps();
+    mipmaps.resize(count);
+
+    // levels are handed out largest first to the threads
+    try
+    {
+        Parallel::forEach(count, threads, [&](size_t i) {
+            mipmaps[i] = encodeImage(options.keepCoverage
+                ? levels[i].scaleAlphaToCoverage(coverage, options.alphaReference)
+                : levels[i]
+            );
+        });
+    }
+    catch (...)
+    {
+        deleteMipmaps();
+        throw;
     }
 }
 
 void TEX0::generateMipmaps(uint32_t count)
 {
-    // data is duplicated in order to avoid changing this buffer's state
-    generateMipmaps(count, ImageCoder::decode(data.duplicate(), width, height, format));
+    generateMipmaps(count, decodeImage());
+}
+
+void TEX0::generateMipmaps(uint32_t count, const MipmapOptions& options, uint32_t threads)
+{
+    generateMipmaps(count, decodeImage(), options, threads);
 }
 
 void TEX0::deleteMipmaps()
@@ -164,6 +235,37 @@ Buffer TEX0::getMipmapTextureData(uint32_t index) const
     return mipmaps[index].duplicate();
 }
 
+Buffer TEX0::encodeImage(const Image& image) const
+{
+    if (ImageCoder::isPaletteFormat(format))
+    {
+        return ImageCoder::encode(image, format, getPLT0()->getPalette());
+    }
+    return ImageCoder::encode(image, format);
+}
+
+Image TEX0::decodeImage() const
+{
+    // data is duplicated in order to avoid changing this buffer's state
+    Buffer buffer = data.duplicate();
+    if (ImageCoder::isPaletteFormat(format))
+    {
+        return ImageCoder::decode(buffer, width, height, format, getPLT0()->getPalette());
+    }
+    return ImageCoder::decode(buffer, width, height, format);
+}
+
+PLT0* TEX0::getPLT0() const
+{
+    if (!brres->has<PLT0>(name))
+    {
+        throw BRRESError(Strings::format(
+            "TEX0: Palette format requires a PLT0 with the same name! (%s)", name.c_str()
+        ));
+    }
+    return brres->get<PLT0>(name);
+}
+
 void TEX0::assertValidTextureData(
     const Buffer& data, uint16_t width, uint16_t height, ImageFormat format) const
 {
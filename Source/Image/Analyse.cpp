@@ -0,0 +1,147 @@
+//////////////////////////////////////////////////
+//  Copyright (c) 2020 Nara Hiero
+//
+// This file is licensed under GPLv3+
+// Refer to the `License.txt` file included.
+//////////////////////////////////////////////////
+
+#include "Image/ImageCoderCommon.hpp"
+
+#include <algorithm>
+#include <vector>
+
+namespace CTLib
+{
+
+ImageAnalysis ImageCoder::analyse(const Image& image)
+{
+    size_t count = static_cast<size_t>(image.getWidth()) * image.getHeight();
+    const uint8_t* px = *image;
+
+    ImageAnalysis analysis;
+    std::vector<uint32_t> colours(count);
+    for (size_t i = 0; i < count; ++i, px += 4)
+    {
+        analysis.greyscale &= px[0] == px[1] && px[1] == px[2];
+        if (px[3] != 0xFF)
+        {
+            analysis.alpha = px[3] != 0x00 ? AlphaUsage::Full
+                : analysis.alpha == AlphaUsage::None ? AlphaUsage::OneBit : analysis.alpha;
+        }
+        colours[i] = (static_cast<uint32_t>(px[0]) << 24) | (px[1] << 16) | (px[2] << 8) | px[3];
+    }
+
+    std::sort(colours.begin(), colours.end());
+    analysis.colourCount = static_cast<uint32_t>(
+        std::unique(colours.begin(), colours.end()) - colours.begin()
+    );
+
+    return analysis;
+}
+
+// a format considered by selectFormat, with the size of its data
+struct FormatCandidate
+{
+    ImageFormat format;
+    size_t size;
+};
+
+// returns whether the format can represent the colours and alpha described by
+// the analysis; CMPR encodes pixels with an alpha below 0x80 as transparent,
+// and a larger palette format than one holding every colour is of no use
+bool isFormatCandidate(ImageFormat format, const ImageAnalysis& analysis, bool palette)
+{
+    switch (format)
+    {
+    case ImageFormat::I4:
+    case ImageFormat::I8:
+        return analysis.greyscale && analysis.alpha == AlphaUsage::None;
+
+    case ImageFormat::IA4:
+    case ImageFormat::IA8:
+        return analysis.greyscale;
+
+    case ImageFormat::RGB565:
+        return analysis.alpha == AlphaUsage::None;
+
+    case ImageFormat::CMPR:
+        return analysis.alpha != AlphaUsage::Full;
+
+    case ImageFormat::C4:
+        return palette;
+
+    case ImageFormat::C8:
+        return palette && analysis.colourCount > paletteSizeFor(ImageFormat::C4);
+
+    case ImageFormat::C14X2:
+        return palette && analysis.colourCount > paletteSizeFor(ImageFormat::C8);
+
+    default:
+        return true;
+    }
+}
+
+ImageFormat ImageCoder::selectFormat(const Image& image, double minPSNR, Palette* palette)
+{
+    ImageAnalysis analysis = analyse(image);
+    uint32_t width = image.getWidth(), height = image.getHeight();
+
+    // formats of equal size are tried in this order
+    constexpr ImageFormat FORMATS[] = {
+        ImageFormat::I4, ImageFormat::CMPR, ImageFormat::C4, ImageFormat::IA4, ImageFormat::I8,
+        ImageFormat::C8, ImageFormat::IA8, ImageFormat::RGB565, ImageFormat::RGB5A3,
+        ImageFormat::C14X2
+    };
+
+    std::vector<FormatCandidate> candidates;
+    for (ImageFormat format : FORMATS)
+    {
+        if (!isFormatCandidate(format, analysis, palette != nullptr))
+        {
+            continue;
+        }
+        size_t size = sizeFor(width, height, format);
+        if (isPaletteFormat(format))
+        {
+            size += static_cast<size_t>(std::min(analysis.colourCount, paletteSizeFor(format))) * 2;
+        }
+        candidates.push_back({format, size});
+    }
+    std::stable_sort(candidates.begin(), candidates.end(),
+        [](const FormatCandidate& a, const FormatCandidate& b) { return a.size < b.size; }
+    );
+
+    PaletteFormat paletteFormat = analysis.greyscale ? PaletteFormat::IA8
+        : analysis.alpha == AlphaUsage::None ? PaletteFormat::RGB565 : PaletteFormat::RGB5A3;
+
+    size_t rgba8Size = sizeFor(width, height, ImageFormat::RGBA8);
+    for (const FormatCandidate& candidate : candidates)
+    {
+        if (candidate.size >= rgba8Size)
+        {
+            break;
+        }
+
+        if (isPaletteFormat(candidate.format))
+        {
+            Palette created = createPalette(image, candidate.format, paletteFormat);
+            Buffer data = encode(image, candidate.format, created);
+            if (psnr(decode(data, width, height, candidate.format, created), image) >= minPSNR)
+            {
+                *palette = std::move(created);
+                return candidate.format;
+            }
+        }
+        else
+        {
+            Buffer data = encode(image, candidate.format);
+            if (psnr(decode(data, width, height, candidate.format), image) >= minPSNR)
+            {
+                return candidate.format;
+            }
+        }
+    }
+
+    return ImageFormat::RGBA8;
+}
+}
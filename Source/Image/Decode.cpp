@@ -5,219 +5,295 @@
 // Refer to the `License.txt` file included.
 //////////////////////////////////////////////////
 
-#include <CTLib/Image.hpp>
+#include "Image/ImageCoderCommon.hpp"
+
+#include <cstring>
 
 namespace CTLib
 {
 
-using PixelFunc = void (*)(Buffer&, Buffer&, uint32_t, uint32_t, uint32_t, uint32_t);
-using BlockFunc = void (*)(Buffer&, Buffer&, uint32_t, uint32_t, uint32_t, uint32_t);
-
-Image decodeBase(
-    Buffer& data, uint32_t width, uint32_t height, uint8_t bw, uint8_t bh, PixelFunc func
+// decodes the tile rows [rowBegin, rowEnd) of 'in' to the RGBA pixels 'out'
+void decodeTileRows(
+    const uint8_t* in, uint8_t* out, uint32_t width, uint32_t height,
+    FormatInfo info, DecodeTileFunc func, uint32_t rowBegin, uint32_t rowEnd
 )
 {
-    Buffer out(width * height * 4);
+    size_t tileSize = tileSizeFor(info);
+    size_t stride = static_cast<size_t>(width) * 4;
+    uint32_t tilesPerRow = (width + info.bw - 1) / info.bw;
+    in += static_cast<size_t>(rowBegin) * tilesPerRow * tileSize;
 
-    uint32_t nw = (width & ~(bw - 1)) + ((width & (bw - 1)) > 0 ? bw : 0);
-    uint32_t nh = (height & ~(bh - 1)) + ((height & (bh - 1)) > 0 ? bh : 0);
+    // partial tiles are decoded here first, then their visible part is copied
+    uint8_t scratch[8 * 8 * 4];
+    size_t scratchStride = static_cast<size_t>(info.bw) * 4;
 
-    for (uint32_t gy = 0; gy < nh; gy += bh)
+    for (uint32_t row = rowBegin; row < rowEnd; ++row)
     {
-        for (uint32_t gx = 0; gx < nw; gx += bw)
+        uint32_t gy = row * info.bh;
+        uint32_t th = height - gy < info.bh ? height - gy : info.bh;
+        for (uint32_t gx = 0; gx < width; gx += info.bw, in += tileSize)
         {
-            for (uint32_t y = 0; y < bh; ++y)
+            uint32_t tw = width - gx < info.bw ? width - gx : info.bw;
+            uint8_t* dst = out + (gy * stride) + (static_cast<size_t>(gx) * 4);
+            if (tw == info.bw && th == info.bh)
             {
-                for (uint32_t x = 0; x < bw; ++x)
-                {
-                    func(data, out, width, height, gx + x, gy + y);
-                }
+                func(in, dst, stride);
+                continue;
+            }
+
+            func(in, scratch, scratchStride);
+            for (uint32_t y = 0; y < th; ++y)
+            {
+                std::memcpy(dst + (y * stride), scratch + (y * scratchStride), tw * 4);
             }
         }
     }
+}
 
-    return Image(width, height, out);
+#ifdef CT_LIB_SSE2
+
+// expands 8 grey values and 8 alpha values to 8 RGBA pixels
+inline void storeGreyAlpha8(__m128i grey, __m128i alpha, uint8_t* out)
+{
+    __m128i gg = _mm_unpacklo_epi8(grey, grey);
+    __m128i ga = _mm_unpacklo_epi8(grey, alpha);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi16(gg, ga));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16), _mm_unpackhi_epi16(gg, ga));
 }
 
-Image decodeBlock(
-    Buffer& data, uint32_t width, uint32_t height, uint8_t bw, uint8_t bh, int8_t sshift,
-    BlockFunc func
-)
+// packs 4 pixels of 16-bit channels, whose values are all below 0x100
+inline void storeRGBA16x4(__m128i r, __m128i g, __m128i b, __m128i a, uint8_t* out)
 {
-    Buffer out(width * height * 4);
+    __m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+    __m128i ba = _mm_or_si128(b, _mm_slli_epi16(a, 8));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi16(rg, ba));
+}
 
-    uint32_t nw = (width & ~(bw - 1)) + ((width & (bw - 1)) > 0 ? bw : 0);
-    uint32_t nh = (height & ~(bh - 1)) + ((height & (bh - 1)) > 0 ? bh : 0);
+// loads 8 bytes, swapping the bytes of each of the 4 big endian shorts
+inline __m128i loadShortsBE4(const uint8_t* in)
+{
+    __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(in));
+    return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
 
-    size_t bSize = sshift < 0 ? ((bw * bh) >> -sshift) : ((bw * bh) << sshift);
-    Buffer block(bSize);
+// 'x * 0x11' for each byte, where every byte is below 0x10
+inline __m128i expandNibbles(__m128i x)
+{
+    return _mm_or_si128(x, _mm_slli_epi16(x, 4));
+}
 
-    for (uint32_t gy = 0; gy < nh; gy += bh)
+void decodeTileI4SSE2(const uint8_t* in, uint8_t* out, size_t stride)
+{
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    const __m128i alpha = _mm_set1_epi8(static_cast<char>(0xFF));
+    for (uint32_t y = 0; y < 8; ++y, in += 4, out += stride)
     {
-        for (uint32_t gx = 0; gx < nw; gx += bw)
-        {
-            block.put(data.limit(data.position() + bSize));
-            func(block, out, width, height, gx, gy);
-            block.clear();
-        }
+        int32_t row;
+        std::memcpy(&row, in, 4);
+        __m128i v = _mm_cvtsi32_si128(row);
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+        __m128i lo = _mm_and_si128(v, mask);
+        storeGreyAlpha8(expandNibbles(_mm_unpacklo_epi8(hi, lo)), alpha, out);
     }
+}
 
-    return Image(width, height, out);
+void decodeTileI8SSE2(const uint8_t* in, uint8_t* out, size_t stride)
+{
+    const __m128i alpha = _mm_set1_epi8(static_cast<char>(0xFF));
+    for (uint32_t y = 0; y < 4; ++y, in += 8, out += stride)
+    {
+        storeGreyAlpha8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in)), alpha, out);
+    }
 }
 
-Image decodeI4(Buffer& data, uint32_t width, uint32_t height)
+void decodeTileIA4SSE2(const uint8_t* in, uint8_t* out, size_t stride)
 {
-    return decodeBase(data, width, height, 8, 8,
-        [](Buffer& data, Buffer& out, uint32_t width, uint32_t height, uint32_t x, uint32_t y)
-        {
-            uint8_t grey = data.get();
-            if ((x & 1) == 0)
-            {
-                grey = (grey >> 4) * 0x11;
-                data.position(data.position() - 1);
-            }
-            else
-            {
-                grey = (grey & 0xF) * 0x11;
-            }
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    for (uint32_t y = 0; y < 4; ++y, in += 8, out += stride)
+    {
+        __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(in));
+        __m128i grey = expandNibbles(_mm_and_si128(v, mask));
+        __m128i alpha = expandNibbles(_mm_and_si128(_mm_srli_epi16(v, 4), mask));
+        storeGreyAlpha8(grey, alpha, out);
+    }
+}
 
-            if (x < width && y < height)
-            {
-                size_t off = ((y * width) + x) * 4;
-                out.put(off + 0, grey);
-                out.put(off + 1, grey);
-                out.put(off + 2, grey);
-                out.put(off + 3, 0xFF);
-            }
+void decodeTileIA8SSE2(const uint8_t* in, uint8_t* out, size_t stride)
+{
+    const __m128i mask = _mm_set1_epi16(0x00FF);
+    for (uint32_t y = 0; y < 4; ++y, in += 8, out += stride)
+    {
+        // little endian shorts of (alpha | grey << 8)
+        __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(in));
+        __m128i grey = _mm_srli_epi16(v, 8);
+        __m128i alpha = _mm_and_si128(v, mask);
+        storeRGBA16x4(grey, grey, grey, alpha, out);
+    }
+}
+
+void decodeTileRGB565SSE2(const uint8_t* in, uint8_t* out, size_t stride)
+{
+    const __m128i alpha = _mm_set1_epi16(0xFF);
+    for (uint32_t y = 0; y < 4; ++y, in += 8, out += stride)
+    {
+        __m128i v = loadShortsBE4(in);
+        __m128i r = _mm_and_si128(_mm_srli_epi16(v, 8), _mm_set1_epi16(0xF8));
+        __m128i g = _mm_and_si128(_mm_srli_epi16(v, 3), _mm_set1_epi16(0xFC));
+        __m128i b = _mm_and_si128(_mm_slli_epi16(v, 3), _mm_set1_epi16(0xF8));
+        storeRGBA16x4(r, g, b, alpha, out);
+    }
+}
+
+void decodeTileRGB5A3SSE2(const uint8_t* in, uint8_t* out, size_t stride)
+{
+    const __m128i mask4 = _mm_set1_epi16(0x0F);
+    const __m128i mask5 = _mm_set1_epi16(0xF8);
+    for (uint32_t y = 0; y < 4; ++y, in += 8, out += stride)
+    {
+        __m128i v = loadShortsBE4(in);
+
+        // all bits set for the pixels without alpha
+        __m128i opaque = _mm_srai_epi16(v, 15);
+
+        __m128i r5 = _mm_and_si128(_mm_srli_epi16(v, 7), mask5);
+        __m128i g5 = _mm_and_si128(_mm_srli_epi16(v, 2), mask5);
+        __m128i b5 = _mm_and_si128(_mm_slli_epi16(v, 3), mask5);
+
+        __m128i r4 = _mm_and_si128(_mm_srli_epi16(v, 8), mask4);
+        __m128i g4 = _mm_and_si128(_mm_srli_epi16(v, 4), mask4);
+        __m128i b4 = _mm_and_si128(v, mask4);
+        __m128i a3 = _mm_and_si128(_mm_srli_epi16(v, 7), _mm_set1_epi16(0xE0));
+
+        __m128i r = _mm_or_si128(_mm_and_si128(opaque, r5), _mm_andnot_si128(opaque, expandNibbles(r4)));
+        __m128i g = _mm_or_si128(_mm_and_si128(opaque, g5), _mm_andnot_si128(opaque, expandNibbles(g4)));
+        __m128i b = _mm_or_si128(_mm_and_si128(opaque, b5), _mm_andnot_si128(opaque, expandNibbles(b4)));
+        __m128i a = _mm_or_si128(_mm_srli_epi16(opaque, 8), a3);
+        storeRGBA16x4(r, g, b, a, out);
+    }
+}
+
+void decodeTileRGBA8SSE2(const uint8_t* in, uint8_t* out, size_t stride)
+{
+    for (uint32_t y = 0; y < 4; ++y, in += 8, out += stride)
+    {
+        __m128i ar = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(in));
+        __m128i gb = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + 0x20));
+
+        // bytes A R G B per pixel, rotated to R G B A
+        __m128i argb = _mm_unpacklo_epi16(ar, gb);
+        __m128i rgba = _mm_or_si128(_mm_srli_epi32(argb, 8), _mm_slli_epi32(argb, 24));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), rgba);
+    }
+}
+
+#endif // CT_LIB_SSE2
+
+// scalar kernels, used for the formats and builds without SIMD kernels
+
+inline void putPixel(uint8_t* out, uint8_t r, uint8_t g, uint8_t b, uint8_t a)
+{
+    out[0] = r;
+    out[1] = g;
+    out[2] = b;
+    out[3] = a;
+}
+
+void decodeTileI4(const uint8_t* in, uint8_t* out, size_t stride)
+{
+    for (uint32_t y = 0; y < 8; ++y, out += stride)
+    {
+        for (uint32_t x = 0; x < 8; x += 2, ++in)
+        {
+            uint8_t hi = (*in >> 4) * 0x11, lo = (*in & 0xF) * 0x11;
+            putPixel(out + (x * 4), hi, hi, hi, 0xFF);
+            putPixel(out + (x * 4) + 4, lo, lo, lo, 0xFF);
         }
-    );
+    }
 }
 
-Image decodeI8(Buffer& data, uint32_t width, uint32_t height)
+void decodeTileI8(const uint8_t* in, uint8_t* out, size_t stride)
 {
-    return decodeBase(data, width, height, 8, 4,
-        [](Buffer& data, Buffer& out, uint32_t width, uint32_t height, uint32_t x, uint32_t y)
+    for (uint32_t y = 0; y < 4; ++y, out += stride)
+    {
+        for (uint32_t x = 0; x < 8; ++x, ++in)
         {
-            uint8_t grey = data.get();
-            if (x < width && y < height)
-            {
-                size_t off = ((y * width) + x) * 4;
-                out.put(off + 0, grey);
-                out.put(off + 1, grey);
-                out.put(off + 2, grey);
-                out.put(off + 3, 0xFF);
-            }
+            putPixel(out + (x * 4), *in, *in, *in, 0xFF);
         }
-    );
+    }
 }
 
-Image decodeIA4(Buffer& data, uint32_t width, uint32_t height)
+void decodeTileIA4(const uint8_t* in, uint8_t* out, size_t stride)
 {
-    return decodeBase(data, width, height, 8, 4,
-        [](Buffer& data, Buffer& out, uint32_t width, uint32_t height, uint32_t x, uint32_t y)
+    for (uint32_t y = 0; y < 4; ++y, out += stride)
+    {
+        for (uint32_t x = 0; x < 8; ++x, ++in)
         {
-            uint8_t px = data.get();
-            uint8_t grey = (px & 0xF) * 0x11;
-            if (x < width && y < height)
-            {
-                size_t off = ((y * width) + x) * 4;
-                out.put(off + 0, grey);
-                out.put(off + 1, grey);
-                out.put(off + 2, grey);
-                out.put(off + 3, (px >> 4) * 0x11);
-            }
+            uint8_t grey = (*in & 0xF) * 0x11;
+            putPixel(out + (x * 4), grey, grey, grey, (*in >> 4) * 0x11);
         }
-    );
+    }
 }
 
-Image decodeIA8(Buffer& data, uint32_t width, uint32_t height)
+void decodeTileIA8(const uint8_t* in, uint8_t* out, size_t stride)
 {
-    return decodeBase(data, width, height, 4, 4,
-        [](Buffer& data, Buffer& out, uint32_t width, uint32_t height, uint32_t x, uint32_t y)
+    for (uint32_t y = 0; y < 4; ++y, out += stride)
+    {
+        for (uint32_t x = 0; x < 4; ++x, in += 2)
         {
-            uint8_t alpha = data.get();
-            uint8_t grey = data.get();
-            if (x < width && y < height)
-            {
-                size_t off = ((y * width) + x) * 4;
-                out.put(off + 0, grey);
-                out.put(off + 1, grey);
-                out.put(off + 2, grey);
-                out.put(off + 3, alpha);
-            }
+            putPixel(out + (x * 4), in[1], in[1], in[1], in[0]);
         }
-    );
+    }
 }
 
-Image decodeRGB565(Buffer& data, uint32_t width, uint32_t height)
+void decodeTileRGB565(const uint8_t* in, uint8_t* out, size_t stride)
 {
-    return decodeBase(data, width, height, 4, 4,
-        [](Buffer& data, Buffer& out, uint32_t width, uint32_t height, uint32_t x, uint32_t y)
+    for (uint32_t y = 0; y < 4; ++y, out += stride)
+    {
+        for (uint32_t x = 0; x < 4; ++x, in += 2)
         {
-            uint16_t rgb565 = data.getShort();
-            if (x < width && y < height)
-            {
-                size_t off = ((y * width) + x) * 4;
-                out.put(off + 0, (rgb565 & 0xF800) >> 8);
-                out.put(off + 1, (rgb565 & 0x07E0) >> 3);
-                out.put(off + 2, (rgb565 & 0x001F) << 3);
-                out.put(off + 3, 0xFF);
-            }
+            uint16_t rgb565 = (in[0] << 8) | in[1];
+            putPixel(out + (x * 4),
+                (rgb565 & 0xF800) >> 8, (rgb565 & 0x07E0) >> 3, (rgb565 & 0x001F) << 3, 0xFF
+            );
         }
-    );
+    }
 }
 
-Image decodeRGB5A3(Buffer& data, uint32_t width, uint32_t height)
+void decodeTileRGB5A3(const uint8_t* in, uint8_t* out, size_t stride)
 {
-    return decodeBase(data, width, height, 4, 4,
-        [](Buffer& data, Buffer& out, uint32_t width, uint32_t height, uint32_t x, uint32_t y)
+    for (uint32_t y = 0; y < 4; ++y, out += stride)
+    {
+        for (uint32_t x = 0; x < 4; ++x, in += 2)
         {
-            uint16_t rgb5a3 = data.getShort();
-            if (x < width && y < height)
+            uint16_t rgb5a3 = (in[0] << 8) | in[1];
+            if ((rgb5a3 & 0x8000) == 0) // with alpha
             {
-                size_t off = ((y * width) + x) * 4;
-                if ((rgb5a3 & 0x8000) == 0) // with alpha
-                {
-                    out.put(off + 0, ((rgb5a3 & 0x0F00) >> 8) * 0x11);
-                    out.put(off + 1, ((rgb5a3 & 0x00F0) >> 4) * 0x11);
-                    out.put(off + 2, (rgb5a3 & 0x000F) * 0x11);
-                    out.put(off + 3, (rgb5a3 & 0x7000) >> 7);
-                }
-                else // no alpha
-                {
-                    out.put(off + 0, (rgb5a3 & 0x7C00) >> 7);
-                    out.put(off + 1, (rgb5a3 & 0x03E0) >> 2);
-                    out.put(off + 2, (rgb5a3 & 0x001F) << 3);
-                    out.put(off + 3, 0xFF);
-                }
+                putPixel(out + (x * 4),
+                    ((rgb5a3 & 0x0F00) >> 8) * 0x11, ((rgb5a3 & 0x00F0) >> 4) * 0x11,
+                    (rgb5a3 & 0x000F) * 0x11, (rgb5a3 & 0x7000) >> 7
+                );
+            }
+            else // no alpha
+            {
+                putPixel(out + (x * 4),
+                    (rgb5a3 & 0x7C00) >> 7, (rgb5a3 & 0x03E0) >> 2, (rgb5a3 & 0x001F) << 3, 0xFF
+                );
             }
         }
-    );
+    }
 }
 
-Image decodeRGBA8(Buffer& data, uint32_t width, uint32_t height)
+void decodeTileRGBA8(const uint8_t* in, uint8_t* out, size_t stride)
 {
-    return decodeBlock(data, width, height, 4, 4, 2,
-        [](Buffer& block, Buffer& out, uint32_t width, uint32_t height, uint32_t gx, uint32_t gy)
+    for (uint32_t y = 0; y < 4; ++y, out += stride)
+    {
+        for (uint32_t x = 0; x < 4; ++x)
         {
-            for (uint32_t y = 0; y < 4; ++y)
-            {
-                for (uint32_t x = 0; x < 4; ++x)
-                {
-                    size_t off = (((gy + y) * width) + (gx + x)) * 4;
-                    size_t offAR = ((y * 4) + x) * 2;
-                    size_t offGB = offAR + 0x20;
-                    if ((gx + x) < width && (gy + y) < height)
-                    {
-                        out.put(off + 0, block.get(offAR + 1));
-                        out.put(off + 1, block.get(offGB + 0));
-                        out.put(off + 2, block.get(offGB + 1));
-                        out.put(off + 3, block.get(offAR + 0));
-                    }
-                }
-            }
+            const uint8_t* ar = in + (((y * 4) + x) * 2);
+            const uint8_t* gb = ar + 0x20;
+            putPixel(out + (x * 4), ar[1], gb[0], gb[1], ar[0]);
         }
-    );
+    }
 }
 
 RGBAColour rgb565ToRGBA(uint16_t rgb565)
@@ -253,89 +329,135 @@ RGBAColour colourOneThird(RGBAColour a, RGBAColour b)
     };
 }
 
-Image decodeCMPR(Buffer& data, uint32_t width, uint32_t height)
+void decodeTileCMPR(const uint8_t* in, uint8_t* out, size_t stride)
 {
-    return decodeBlock(data, width, height, 8, 8, -1,
-        [](Buffer& block, Buffer& out, uint32_t width, uint32_t height, uint32_t gx, uint32_t gy)
+    for (uint32_t y = 0; y < 8; y += 4)
+    {
+        for (uint32_t x = 0; x < 8; x += 4, in += 8)
         {
-            block.clear();
-            for (uint32_t y = 0; y < 8; y += 4)
+            uint16_t c0 = (in[0] << 8) | in[1], c1 = (in[2] << 8) | in[3];
+            RGBAColour c[4] = {rgb565ToRGBA(c0), rgb565ToRGBA(c1), {}, {}};
+            if (c0 < c1)
+            {
+                c[2] = colourHalf(c[0], c[1]);
+                c[3] = {0x00, 0x00, 0x00, 0x00};
+            }
+            else
+            {
+                c[2] = colourOneThird(c[1], c[0]);
+                c[3] = colourOneThird(c[0], c[1]);
+            }
+
+            // each row of the sub-block is one byte of indices, 2 bits per pixel
+            for (uint32_t py = 0; py < 4; ++py)
             {
-                for (uint32_t x = 0; x < 8; x += 4)
+                uint8_t indices = in[4 + py];
+                uint8_t* row = out + ((y + py) * stride) + (x * 4);
+                for (uint32_t px = 0; px < 4; ++px)
                 {
-                    uint16_t c0 = block.getShort(), c1 = block.getShort();
-                    RGBAColour c[4] = {rgb565ToRGBA(c0), rgb565ToRGBA(c1), {}, {}};
-                    if (c0 < c1)
-                    {
-                        c[2] = colourHalf(c[0], c[1]);
-                        c[3] = {0x00, 0x00, 0x00, 0x00};
-                    }
-                    else
-                    {
-                        c[2] = colourOneThird(c[1], c[0]);
-                        c[3] = colourOneThird(c[0], c[1]);
-                    }
-
-                    uint32_t indices = block.getInt();
-                    for (uint32_t py = 0; py < 4; ++py)
-                    {
-                        for (uint32_t px = 0; px < 4; ++px)
-                        {
-                            size_t off = (((gy + y + py) * width) + (gx + x + px)) * 4;
-                            if ((gx + x + px) < width && (gy + y + py) < height)
-                            {
-                                uint8_t idx = (indices >> (30 - (((py * 4) + px) * 2))) & 3;
-                                out.put(off + 0, c[idx].r);
-                                out.put(off + 1, c[idx].g);
-                                out.put(off + 2, c[idx].b);
-                                out.put(off + 3, c[idx].a);
-                            }
-                        }
-                    }
+                    const RGBAColour& colour = c[(indices >> (6 - (px * 2))) & 3];
+                    row[(px * 4) + 0] = colour.r;
+                    row[(px * 4) + 1] = colour.g;
+                    row[(px * 4) + 2] = colour.b;
+                    row[(px * 4) + 3] = colour.a;
                 }
             }
-            block.clear();
         }
-    );
+    }
 }
 
-Image ImageCoder::decode(Buffer& data, uint32_t width, uint32_t height, ImageFormat format)
+DecodeTileFunc decodeTileFunc(ImageFormat format, bool simd)
 {
-    try
+#ifdef CT_LIB_SSE2
+    if (simd)
     {
         switch (format)
         {
         case ImageFormat::I4:
-            return decodeI4(data, width, height);
+            return decodeTileI4SSE2;
 
         case ImageFormat::I8:
-            return decodeI8(data, width, height);
+            return decodeTileI8SSE2;
 
         case ImageFormat::IA4:
-            return decodeIA4(data, width, height);
-        
+            return decodeTileIA4SSE2;
+
         case ImageFormat::IA8:
-            return decodeIA8(data, width, height);
+            return decodeTileIA8SSE2;
 
         case ImageFormat::RGB565:
-            return decodeRGB565(data, width, height);
+            return decodeTileRGB565SSE2;
 
         case ImageFormat::RGB5A3:
-            return decodeRGB5A3(data, width, height);
+            return decodeTileRGB5A3SSE2;
 
         case ImageFormat::RGBA8:
-            return decodeRGBA8(data, width, height);
-
-        case ImageFormat::CMPR:
-            return decodeCMPR(data, width, height);
+            return decodeTileRGBA8SSE2;
 
         default:
-            throw ImageError("Unsupported format!");
+            break; // no SSE2 kernel
         }
     }
-    catch (const BufferError&)
+#endif
+
+    switch (format)
+    {
+    case ImageFormat::I4:
+        return decodeTileI4;
+
+    case ImageFormat::I8:
+        return decodeTileI8;
+
+    case ImageFormat::IA4:
+        return decodeTileIA4;
+
+    case ImageFormat::IA8:
+        return decodeTileIA8;
+
+    case ImageFormat::RGB565:
+        return decodeTileRGB565;
+
+    case ImageFormat::RGB5A3:
+        return decodeTileRGB5A3;
+
+    case ImageFormat::RGBA8:
+        return decodeTileRGBA8;
+
+    case ImageFormat::CMPR:
+        return decodeTileCMPR;
+
+    case ImageFormat::C4:
+    case ImageFormat::C8:
+    case ImageFormat::C14X2:
+        throw ImageError("Palette formats can only be decoded with a palette!");
+
+    default:
+        throw ImageError("Unsupported format!");
+    }
+}
+
+Image ImageCoder::decode(
+    Buffer& data, uint32_t width, uint32_t height, ImageFormat format, uint32_t threads
+)
+{
+    DecodeTileFunc func = decodeTileFunc(format, true);
+    FormatInfo info = formatInfo(format);
+
+    size_t size = sizeFor(width, height, format);
+    if (data.remaining() < size)
     {
         throw ImageError("Not enough bytes in encoded buffer!");
     }
+
+    Buffer out(static_cast<size_t>(width) * height * 4);
+    uint32_t rows = (height + info.bh - 1) / info.bh;
+    const uint8_t* in = *data + data.position();
+    uint8_t* pixels = *out;
+    runTileRows(rows, threads, [&](uint32_t begin, uint32_t end) {
+        decodeTileRows(in, pixels, width, height, info, func, begin, end);
+    });
+    data.position(data.position() + size);
+
+    return Image(width, height, std::move(out));
 }
 }
@@ -5,62 +5,158 @@
 // Refer to the `License.txt` file included.
 //////////////////////////////////////////////////
 
-#include <CTLib/Image.hpp>
+#include "Image/ImageCoderCommon.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include <stb_dxt.h>
 
+#include <CTLib/Utilities.hpp>
+
 namespace CTLib
 {
 
-using PixelFunc = void (*)(Buffer&, Buffer&, uint32_t, uint32_t, uint32_t, uint32_t);
-using BlockFunc = void (*)(Buffer&, Buffer&, uint32_t, uint32_t, uint32_t, uint32_t);
+FormatInfo formatInfo(ImageFormat format)
+{
+    switch (format)
+    {
+    case ImageFormat::I4:
+        return {8, 8, -1};
+
+    case ImageFormat::I8:
+        return {8, 4, 0};
+
+    case ImageFormat::IA4:
+        return {8, 4, 0};
+
+    case ImageFormat::IA8:
+        return {4, 4, 1};
+
+    case ImageFormat::RGB565:
+        return {4, 4, 1};
+
+    case ImageFormat::RGB5A3:
+        return {4, 4, 1};
+
+    case ImageFormat::RGBA8:
+        return {4, 4, 2};
+
+    case ImageFormat::C4:
+        return {8, 8, -1};
+
+    case ImageFormat::C8:
+        return {8, 4, 0};
+
+    case ImageFormat::C14X2:
+        return {4, 4, 1};
+
+    case ImageFormat::CMPR:
+        return {8, 8, -1};
 
-Buffer encodeBase(const Image& image, uint8_t bw, uint8_t bh, int8_t sshift, PixelFunc func)
+    default:
+        throw ImageError("Unsupported encoding format!");
+    }
+}
+
+// read-only view of the RGBA pixels of an image, fetched once per encode
+struct PixelView
 {
-    uint32_t nw = (image.getWidth() & ~(bw - 1)) + ((image.getWidth() & (bw - 1)) > 0 ? bw : 0);
-    uint32_t nh = (image.getHeight() & ~(bh - 1)) + ((image.getHeight() & (bh - 1)) > 0 ? bh : 0);
+    // pointer to the first pixel
+    const uint8_t* data;
 
-    Buffer data(sshift < 0 ? ((nw * nh) >> -sshift) : ((nw * nh) << sshift));
+    // size of the image, in pixels
+    uint32_t width, height;
+};
 
-    for (uint32_t gy = 0; gy < nh; gy += bh)
+// encodes the tile whose top-left pixel is (gx, gy) to 'out', which has room
+// for exactly one tile
+using TileFunc = void (*)(const PixelView&, uint8_t*, uint32_t, uint32_t);
+
+size_t tileSizeFor(FormatInfo info)
+{
+    return info.sshift < 0 ? ((info.bw * info.bh) >> -info.sshift)
+        : ((info.bw * info.bh) << info.sshift);
+}
+
+// encodes the tile rows [rowBegin, rowEnd) to their place in 'out', the
+// encoded data of the whole image
+void encodeTileRows(
+    const PixelView& view, FormatInfo info, TileFunc func, uint8_t* out,
+    uint32_t rowBegin, uint32_t rowEnd
+)
+{
+    size_t tileSize = tileSizeFor(info);
+    uint32_t tilesPerRow = (view.width + info.bw - 1) / info.bw;
+    out += static_cast<size_t>(rowBegin) * tilesPerRow * tileSize;
+
+    for (uint32_t row = rowBegin; row < rowEnd; ++row)
     {
-        for (uint32_t gx = 0; gx < nw; gx += bw)
+        for (uint32_t gx = 0; gx < view.width; gx += info.bw)
         {
-            for (uint32_t y = 0; y < bh; ++y)
-            {
-                for (uint32_t x = 0; x < bw; ++x)
-                {
-                    func(
-                        image.getData(), data, image.getWidth(), image.getHeight(),
-                        gx + x, gy + y
-                    );
-                }
-            }
+            func(view, out, gx, row * info.bh);
+            out += tileSize;
         }
     }
+}
+
+void runTileRows(
+    uint32_t rows, uint32_t threads, const std::function<void(uint32_t, uint32_t)>& func
+)
+{
+    if (threads == 0)
+    {
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
 
-    return data.flip();
+    // one range per thread, the first one processed on the calling thread
+    const size_t chunk = std::max<size_t>((static_cast<size_t>(rows) + threads - 1) / threads, 1);
+    Parallel::forChunks(rows, threads, chunk, [&](size_t begin, size_t end) {
+        func(static_cast<uint32_t>(begin), static_cast<uint32_t>(end));
+    });
 }
 
-Buffer encodeBlock(const Image& image, uint8_t bw, uint8_t bh, int8_t sshift, BlockFunc func)
+Buffer encodeTiles(const Image& image, ImageFormat format, TileFunc func, uint32_t threads)
 {
-    uint32_t nw = (image.getWidth() & ~(bw - 1)) + ((image.getWidth() & (bw - 1)) > 0 ? bw : 0);
-    uint32_t nh = (image.getHeight() & ~(bh - 1)) + ((image.getHeight() & (bh - 1)) > 0 ? bh : 0);
+    FormatInfo info = formatInfo(format);
+    PixelView view{*image, image.getWidth(), image.getHeight()};
 
-    Buffer data(sshift < 0 ? ((nw * nh) >> -sshift) : ((nw * nh) << sshift));
-    Buffer block(sshift < 0 ? ((bw * bh) >> -sshift) : ((bw * bh) << sshift));
+    Buffer data(ImageCoder::sizeFor(view.width, view.height, format));
+    uint8_t* out = *data;
+    uint32_t rows = (view.height + info.bh - 1) / info.bh;
+    runTileRows(rows, threads, [&](uint32_t begin, uint32_t end) {
+        encodeTileRows(view, info, func, out, begin, end);
+    });
 
-    for (uint32_t gy = 0; gy < nh; gy += bh)
+    return data;
+}
+
+// returns the pixel at (x, y), or nullptr if it is outside the image
+inline const uint8_t* pixelAt(const PixelView& view, uint32_t x, uint32_t y)
+{
+    if (x >= view.width || y >= view.height)
     {
-        for (uint32_t gx = 0; gx < nw; gx += bw)
-        {
-            func(image.getData(), block, image.getWidth(), image.getHeight(), gx, gy);
-            data.put(block);
-            block.clear();
-        }
+        return nullptr;
     }
-    
-    return data.flip();
+    return view.data + (((static_cast<size_t>(y) * view.width) + x) * 4);
+}
+
+// returns the pixel at (x, y), clamped to the edges of the image
+inline const uint8_t* pixelClamped(const PixelView& view, uint32_t x, uint32_t y)
+{
+    x = x < view.width ? x : view.width - 1;
+    y = y < view.height ? y : view.height - 1;
+    return view.data + (((static_cast<size_t>(y) * view.width) + x) * 4);
+}
+
+inline void putShortBE(uint8_t* out, uint16_t value)
+{
+    out[0] = static_cast<uint8_t>(value >> 8);
+    out[1] = static_cast<uint8_t>(value);
 }
 
 uint8_t computeGreyscale(uint8_t rB, uint8_t gB, uint8_t bB)
@@ -71,324 +167,282 @@ uint8_t computeGreyscale(uint8_t rB, uint8_t gB, uint8_t bB)
     return static_cast<uint8_t>(add * 255);
 }
 
-Buffer encodeI4(const Image& image)
+inline uint8_t greyscaleAt(const PixelView& view, uint32_t x, uint32_t y)
 {
-    return encodeBase(image, 8, 8, -1,
-        [](Buffer& img, Buffer& data, uint32_t width, uint32_t height, uint32_t x, uint32_t y)
+    const uint8_t* px = pixelAt(view, x, y);
+    return px == nullptr ? 0 : computeGreyscale(px[0], px[1], px[2]);
+}
+
+void encodeTileI4(const PixelView& view, uint8_t* out, uint32_t gx, uint32_t gy)
+{
+    for (uint32_t y = 0; y < 8; ++y)
+    {
+        for (uint32_t x = 0; x < 8; x += 2)
         {
-            if (x >= width || y >= height)
-            {
-                if ((x & 1) == 0)
-                {
-                    data.put(0);
-                }
-            }
-            else
-            {
-                size_t off = ((y * width) + x) * 4;
-                uint8_t grey = computeGreyscale(
-                    img.get(off + 0), img.get(off + 1), img.get(off + 2)
-                );
-
-                if ((x & 1) == 0)
-                {
-                    data.put(grey & 0xF0);
-                }
-                else
-                {
-                    data.position(data.position() - 1);
-                    uint8_t old = data[data.position()];
-                    data.put(old | (grey >> 4));
-                }
-            }
+            uint8_t hi = greyscaleAt(view, gx + x, gy + y);
+            uint8_t lo = greyscaleAt(view, gx + x + 1, gy + y);
+            *out++ = (hi & 0xF0) | (lo >> 4);
         }
-    );
+    }
 }
 
-Buffer encodeI8(const Image& image)
+void encodeTileI8(const PixelView& view, uint8_t* out, uint32_t gx, uint32_t gy)
 {
-    return encodeBase(image, 8, 4, 0,
-        [](Buffer& img, Buffer& data, uint32_t width, uint32_t height, uint32_t x, uint32_t y)
+    for (uint32_t y = 0; y < 4; ++y)
+    {
+        for (uint32_t x = 0; x < 8; ++x)
         {
-            if (x >= width || y >= height)
-            {
-                data.put(0);
-            }
-            else
-            {
-                size_t off = ((y * width) + x) * 4;
-                data.put(computeGreyscale(
-                    img.get(off + 0), img.get(off + 1), img.get(off + 2)    
-                ));
-            }
+            *out++ = greyscaleAt(view, gx + x, gy + y);
         }
-    );
+    }
 }
 
-Buffer encodeIA4(const Image& image)
+void encodeTileIA4(const PixelView& view, uint8_t* out, uint32_t gx, uint32_t gy)
 {
-    return encodeBase(image, 8, 4, 0,
-        [](Buffer& img, Buffer& data, uint32_t width, uint32_t height, uint32_t x, uint32_t y)
+    for (uint32_t y = 0; y < 4; ++y)
+    {
+        for (uint32_t x = 0; x < 8; ++x)
         {
-            if (x >= width || y >= height)
-            {
-                data.put(0);
-            }
-            else
-            {
-                size_t off = ((y * width) + x) * 4;
-                uint8_t grey = computeGreyscale(
-                    img.get(off + 0), img.get(off + 1), img.get(off + 2)    
-                );
-                data.put((img.get(off + 3) & 0xF0) | (grey >> 4));
-            }
+            const uint8_t* px = pixelAt(view, gx + x, gy + y);
+            *out++ = px == nullptr ? 0
+                : (px[3] & 0xF0) | (computeGreyscale(px[0], px[1], px[2]) >> 4);
+        }
+    }
+}
+
+void encodeTileIA8(const PixelView& view, uint8_t* out, uint32_t gx, uint32_t gy)
+{
+    for (uint32_t y = 0; y < 4; ++y)
+    {
+        for (uint32_t x = 0; x < 4; ++x, out += 2)
+        {
+            const uint8_t* px = pixelAt(view, gx + x, gy + y);
+            out[0] = px == nullptr ? 0 : px[3];
+            out[1] = px == nullptr ? 0 : computeGreyscale(px[0], px[1], px[2]);
         }
-    );
+    }
 }
 
-Buffer encodeIA8(const Image& image)
+void encodeTileRGB565(const PixelView& view, uint8_t* out, uint32_t gx, uint32_t gy)
 {
-    return encodeBase(image, 4, 4, 1,
-        [](Buffer& img, Buffer& data, uint32_t width, uint32_t height, uint32_t x, uint32_t y)
+    for (uint32_t y = 0; y < 4; ++y)
+    {
+        for (uint32_t x = 0; x < 4; ++x, out += 2)
         {
-            if (x >= width || y >= height)
-            {
-                data.putShort(0);
-            }
-            else
-            {
-                size_t off = ((y * width) + x) * 4;
-                data.put(img.get(off + 3));
-                data.put(computeGreyscale(
-                    img.get(off + 0), img.get(off + 1), img.get(off + 2)    
-                ));
-            }
+            const uint8_t* px = pixelAt(view, gx + x, gy + y);
+            putShortBE(out, px == nullptr ? 0
+                : (static_cast<uint16_t>(px[0] & 0xF8) << 8)
+                | (static_cast<uint16_t>(px[1] & 0xFC) << 3)
+                | (static_cast<uint16_t>(px[2]) >> 3));
         }
-    );
+    }
 }
 
-Buffer encodeRGB565(const Image& image)
+void encodeTileRGB5A3(const PixelView& view, uint8_t* out, uint32_t gx, uint32_t gy)
 {
-    return encodeBase(image, 4, 4, 1,
-        [](Buffer& img, Buffer& data, uint32_t width, uint32_t height, uint32_t x, uint32_t y)
+    for (uint32_t y = 0; y < 4; ++y)
+    {
+        for (uint32_t x = 0; x < 4; ++x, out += 2)
         {
-            if (x >= width || y >= height)
+            const uint8_t* px = pixelAt(view, gx + x, gy + y);
+            if (px == nullptr)
             {
-                data.putShort(0);
+                putShortBE(out, 0);
             }
-            else
+            else if (px[3] < 0xE0) // add alpha
+            {
+                putShortBE(out, (static_cast<uint16_t>(px[3] & 0xE0) << 7)
+                    | (static_cast<uint16_t>(px[0] & 0xF0) << 4)
+                    | static_cast<uint16_t>(px[1] & 0xF0)
+                    | (static_cast<uint16_t>(px[2]) >> 4));
+            }
+            else // no alpha
             {
-                size_t off = ((y * width) + x) * 4;
-                data.putShort((static_cast<uint16_t>(img.get(off + 0) & 0xF8) << 8)
-                    | (static_cast<uint16_t>(img.get(off + 1) & 0xFC) << 3)
-                    | (static_cast<uint16_t>(img.get(off + 2)) >> 3));
+                putShortBE(out, 0x8000 // first bit set
+                    | (static_cast<uint16_t>(px[0] & 0xF8) << 7)
+                    | (static_cast<uint16_t>(px[1] & 0xF8) << 2)
+                    | (static_cast<uint16_t>(px[2]) >> 3));
             }
         }
-    );
+    }
 }
 
-Buffer encodeRGB5A3(const Image& image)
+void encodeTileRGBA8(const PixelView& view, uint8_t* out, uint32_t gx, uint32_t gy)
 {
-    return encodeBase(image, 4, 4, 1,
-        [](Buffer& img, Buffer& data, uint32_t width, uint32_t height, uint32_t x, uint32_t y)
+    // 32 bytes of AR pairs followed by 32 bytes of GB pairs
+    uint8_t* ar = out;
+    uint8_t* gb = out + 0x20;
+    for (uint32_t y = 0; y < 4; ++y)
+    {
+        for (uint32_t x = 0; x < 4; ++x, ar += 2, gb += 2)
         {
-            if (x >= width || y >= height)
+            const uint8_t* px = pixelAt(view, gx + x, gy + y);
+            if (px == nullptr)
             {
-                data.putShort(0);
+                ar[0] = ar[1] = gb[0] = gb[1] = 0;
             }
             else
             {
-                size_t off = ((y * width) + x) * 4;
-                uint8_t alpha = img.get(off + 3);
-                if (alpha < 0xE0) // add alpha
-                {
-                    data.putShort((static_cast<uint16_t>(img.get(off + 3) & 0xE0) << 7)
-                        | (static_cast<uint16_t>(img.get(off + 0) & 0xF0) << 4)
-                        | static_cast<uint16_t>(img.get(off + 1) & 0xF0)
-                        | (static_cast<uint16_t>(img.get(off + 2)) >> 4));
-                }
-                else // no alpha
-                {
-                    data.putShort(0x8000 // first bit set
-                        | (static_cast<uint16_t>(img.get(off + 0) & 0xF8) << 7)
-                        | (static_cast<uint16_t>(img.get(off + 1) & 0xF8) << 2)
-                        | (static_cast<uint16_t>(img.get(off + 2)) >> 3));
-                }
+                ar[0] = px[3];
+                ar[1] = px[0];
+                gb[0] = px[1];
+                gb[1] = px[2];
             }
         }
-    );
+    }
 }
 
-Buffer encodeRGBA8(const Image& image)
+// stb_dxt lazily builds its tables on the first compressed block, which must
+// not happen concurrently
+void initDXT()
 {
-    return encodeBlock(image, 4, 4, 2,
-        [](Buffer& img, Buffer& block, uint32_t width, uint32_t height, uint32_t gx, uint32_t gy)
-        {
-            for (uint32_t y = 0; y < 4; ++y)
-            {
-                for (uint32_t x = 0; x < 4; ++x)
-                {
-                    size_t off = (((gy + y) * width) + (gx + x)) * 4;
-                    size_t offAR = ((y * 4) + x) * 2;
-                    size_t offGB = offAR + 0x20;
-                    if ((gx + x) >= width || (gy + y) >= height)
-                    {
-                        block.put(offAR + 0, 0).put(offAR + 1, 0);
-                        block.put(offGB + 0, 0).put(offGB + 1, 0);
-                    }
-                    else
-                    {
-                        block.put(offAR + 0, img.get(off + 3)).put(offAR + 1, img.get(off + 0));
-                        block.put(offGB + 0, img.get(off + 1)).put(offGB + 1, img.get(off + 2));
-                    }
-                }
-            }
-        }
-    );
+    static std::once_flag flag;
+    std::call_once(flag, []() {
+        uint8_t block[0x40] = {}, out[8];
+        stb_compress_dxt_block(out, block, false, STB_DXT_DITHER | STB_DXT_HIGHQUAL);
+    });
 }
 
-void getDataBlock(Buffer& imgBlock, Buffer& img, uint32_t w, uint32_t h, uint32_t x, uint32_t y)
+// copies the 4x4 block at (x, y) to 'block'; pixels outside the image repeat
+// the closest edge pixel
+void readBlock(const PixelView& view, uint8_t* block, uint32_t x, uint32_t y)
 {
     for (uint32_t l = 0; l < 4; ++l)
     {
-        if ((y + l) >= h)
-        {
-            // copy first row
-            imgBlock.putArray(*imgBlock, 4 * 4);
-            continue;
-        }
-
         for (uint32_t p = 0; p < 4; ++p)
         {
-            if ((x + p) >= w)
-            {
-                // copy first pixel of row
-                imgBlock.putInt(imgBlock.getInt((y + l) * w * 4));
-            }
-            else
-            {
-                imgBlock.putInt(img.getInt((((y + l) * w) + (x + p)) * 4));
-            }
+            const uint8_t* px = pixelClamped(view, x + p, y + l);
+            uint8_t* dst = block + (((l * 4) + p) * 4);
+            dst[0] = px[0];
+            dst[1] = px[1];
+            dst[2] = px[2];
+            dst[3] = px[3];
         }
     }
 }
 
-void compressBlockDXT1(Buffer& block, Buffer& imgBlock)
+// compresses the 4x4 block at (x, y) to 8 bytes of GX ordered DXT1; stb_dxt
+// has no transparent colour, so blocks with transparent pixels are encoded by
+// the native encoder instead
+void encodeBlockDXT1(const PixelView& view, uint8_t* out, uint32_t x, uint32_t y)
 {
-    stb_compress_dxt_block(
-        *block + block.position(), *imgBlock, false, STB_DXT_DITHER | STB_DXT_HIGHQUAL
-    );
+    uint8_t block[0x40];
+    readBlock(view, block, x, y);
 
-    block.order(Buffer::LITTLE_ENDIAN);
+    for (uint32_t i = 3; i < 0x40; i += 4)
+    {
+        if (block[i] < 0x80)
+        {
+            encodeBlockCMPR(block, out, CMPRQuality::Normal);
+            return;
+        }
+    }
+
+    stb_compress_dxt_block(out, block, false, STB_DXT_DITHER | STB_DXT_HIGHQUAL);
 
-    // I know c0 and c1 are supposed to be called c1 and c2 but whatever... :P
-    uint16_t c0 = block.getShort(block.position()), c1 = block.getShort(block.position() + 2);
-    block.order(Buffer::BIG_ENDIAN).putShort(block.position(), c0).putShort(block.position() + 2, c1);
+    // colours are little endian in DXT1, but big endian on GX
+    std::swap(out[0], out[1]);
+    std::swap(out[2], out[3]);
 
     // flip block horizontally
-    uint32_t indices = block.getInt(block.position() + 4);
-    for (size_t i = 0; i < 4; ++i)
+    for (size_t i = 4; i < 8; ++i)
     {
-        const size_t shift = i * 8;
-        uint8_t row = (indices >> shift) & 0xFF;
-        row = ((row & 0x03) << 6) | ((row & 0x0C) << 2) | ((row & 0x30) >> 2) | ((row & 0xC0) >> 6);
-        indices = (indices & ~(0xFF << shift)) | (row << shift);
+        uint8_t row = out[i];
+        out[i] = ((row & 0x03) << 6) | ((row & 0x0C) << 2) | ((row & 0x30) >> 2) | ((row & 0xC0) >> 6);
     }
-    block.putInt(block.position() + 4, indices);
+}
 
-    block.position(block.position() + 8);
+void encodeTileCMPR(const PixelView& view, uint8_t* out, uint32_t gx, uint32_t gy)
+{
+    for (uint32_t y = 0; y < 8; y += 4)
+    {
+        for (uint32_t x = 0; x < 8; x += 4, out += 8)
+        {
+            encodeBlockDXT1(view, out, gx + x, gy + y);
+        }
+    }
 }
 
-Buffer encodeCMPR(const Image& image)
+template <CMPRQuality quality>
+void encodeTileCMPRNative(const PixelView& view, uint8_t* out, uint32_t gx, uint32_t gy)
 {
-    return encodeBlock(image, 8, 8, -1,
-        [](Buffer& img, Buffer& block, uint32_t width, uint32_t height, uint32_t gx, uint32_t gy)
+    uint8_t block[0x40];
+    for (uint32_t y = 0; y < 8; y += 4)
+    {
+        for (uint32_t x = 0; x < 8; x += 4, out += 8)
         {
-            Buffer imgBlock(0x40); // 4x4 RGBA block
-            for (uint32_t y = 0; y < 8; y += 4)
-            {
-                for (uint32_t x = 0; x < 8; x += 4)
-                {
-                    imgBlock.clear();
-                    getDataBlock(imgBlock, img, width, height, gx + x, gy + y);
-                    compressBlockDXT1(block, imgBlock);
-                }
-            }
-            block.flip();
+            readBlock(view, block, gx + x, gy + y);
+            encodeBlockCMPR(block, out, quality);
         }
-    );
+    }
 }
 
-Buffer ImageCoder::encode(const Image& image, ImageFormat format)
+TileFunc encodeTileFunc(ImageFormat format)
 {
     switch (format)
     {
     case ImageFormat::I4:
-        return encodeI4(image);
+        return encodeTileI4;
 
     case ImageFormat::I8:
-        return encodeI8(image);
+        return encodeTileI8;
 
     case ImageFormat::IA4:
-        return encodeIA4(image);
+        return encodeTileIA4;
     
     case ImageFormat::IA8:
-        return encodeIA8(image);
+        return encodeTileIA8;
 
     case ImageFormat::RGB565:
-        return encodeRGB565(image);
+        return encodeTileRGB565;
 
     case ImageFormat::RGB5A3:
-        return encodeRGB5A3(image);
+        return encodeTileRGB5A3;
 
     case ImageFormat::RGBA8:
-        return encodeRGBA8(image);
+        return encodeTileRGBA8;
 
     case ImageFormat::CMPR:
-        return encodeCMPR(image);
+        return encodeTileCMPR;
+
+    case ImageFormat::C4:
+    case ImageFormat::C8:
+    case ImageFormat::C14X2:
+        throw ImageError("Palette formats can only be encoded with a palette!");
 
     default:
         throw ImageError("Unsupported encoding format!");
     }
 }
 
-struct FormatInfo
+Buffer ImageCoder::encode(const Image& image, ImageFormat format, uint32_t threads)
 {
-    uint8_t bw, bh;
-    int8_t sshift;
-};
+    return encode(image, format, CMPRQuality::Normal, threads);
+}
 
-FormatInfo formatInfo(ImageFormat format)
+Buffer ImageCoder::encode(
+    const Image& image, ImageFormat format, CMPRQuality quality, uint32_t threads
+)
 {
-    switch (format)
+    TileFunc func = encodeTileFunc(format);
+    if (format == ImageFormat::CMPR)
     {
-    case ImageFormat::I4:
-        return {8, 8, -1};
-
-    case ImageFormat::I8:
-        return {8, 4, 0};
-
-    case ImageFormat::IA4:
-        return {8, 4, 0};
-
-    case ImageFormat::IA8:
-        return {4, 4, 1};
-
-    case ImageFormat::RGB565:
-        return {4, 4, 1};
-
-    case ImageFormat::RGB5A3:
-        return {4, 4, 1};
+        switch (quality)
+        {
+        case CMPRQuality::Fast:
+            func = encodeTileCMPRNative<CMPRQuality::Fast>;
+            break;
 
-    case ImageFormat::RGBA8:
-        return {4, 4, 2};
+        case CMPRQuality::High:
+            func = encodeTileCMPRNative<CMPRQuality::High>;
+            break;
 
-    case ImageFormat::CMPR:
-        return {8, 8, -1};
-
-    default:
-        throw ImageError("Unsupported encoding format!");
+        default:
+            initDXT();
+            break;
+        }
     }
+    return encodeTiles(image, format, func, threads);
 }
 
 size_t ImageCoder::sizeFor(uint32_t width, uint32_t height, ImageFormat format)
@@ -400,4 +454,30 @@ size_t ImageCoder::sizeFor(uint32_t width, uint32_t height, ImageFormat format)
 
     return info.sshift < 0 ? ((nw * nh) >> -info.sshift) : ((nw * nh) << info.sshift);
 }
+
+double ImageCoder::psnr(const Image& image, const Image& reference)
+{
+    if (image.getWidth() != reference.getWidth() || image.getHeight() != reference.getHeight())
+    {
+        throw ImageError("Cannot compute the PSNR of images of different sizes!");
+    }
+
+    const uint8_t* a = *image;
+    const uint8_t* b = *reference;
+    size_t size = static_cast<size_t>(image.getWidth()) * image.getHeight() * 4;
+
+    uint64_t sum = 0;
+    for (size_t i = 0; i < size; ++i)
+    {
+        int diff = a[i] - b[i];
+        sum += static_cast<uint64_t>(diff * diff);
+    }
+    if (sum == 0)
+    {
+        return INFINITY;
+    }
+
+    double mse = static_cast<double>(sum) / size;
+    return 10 * std::log10((255. * 255.) / mse);
+}
 }
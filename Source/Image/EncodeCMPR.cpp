@@ -0,0 +1,534 @@
+//////////////////////////////////////////////////
+//  Copyright (c) 2020 Nara Hiero
+//
+// This file is licensed under GPLv3+
+// Refer to the `License.txt` file included.
+//////////////////////////////////////////////////
+
+#include "Image/ImageCoderCommon.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace CTLib
+{
+
+// the colours of a block being fitted
+struct CMPRFit
+{
+    // RGB of the opaque pixels
+    float points[16][3];
+
+    // number of opaque pixels
+    uint32_t count;
+
+    // whether the block has transparent pixels, requiring the 3 colour mode
+    bool alpha;
+};
+
+inline bool isTransparent(const uint8_t* px)
+{
+    return px[3] < 0x80;
+}
+
+void readCMPRFit(const uint8_t* block, CMPRFit* fit)
+{
+    fit->count = 0;
+    fit->alpha = false;
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        const uint8_t* px = block + (i * 4);
+        if (isTransparent(px))
+        {
+            fit->alpha = true;
+            continue;
+        }
+        float* point = fit->points[fit->count++];
+        point[0] = px[0];
+        point[1] = px[1];
+        point[2] = px[2];
+    }
+}
+
+// returns the principal axis of the points, using power iterations on their
+// covariance matrix
+void principalAxis(const CMPRFit& fit, float* axis)
+{
+    float mean[3] = {0, 0, 0};
+    for (uint32_t i = 0; i < fit.count; ++i)
+    {
+        for (uint32_t c = 0; c < 3; ++c)
+        {
+            mean[c] += fit.points[i][c];
+        }
+    }
+    for (uint32_t c = 0; c < 3; ++c)
+    {
+        mean[c] /= fit.count;
+    }
+
+    // rr, rg, rb, gg, gb, bb
+    float cov[6] = {0, 0, 0, 0, 0, 0};
+    for (uint32_t i = 0; i < fit.count; ++i)
+    {
+        float r = fit.points[i][0] - mean[0];
+        float g = fit.points[i][1] - mean[1];
+        float b = fit.points[i][2] - mean[2];
+        cov[0] += r * r;
+        cov[1] += r * g;
+        cov[2] += r * b;
+        cov[3] += g * g;
+        cov[4] += g * b;
+        cov[5] += b * b;
+    }
+
+    float v[3] = {1, 1, 1};
+    for (uint32_t i = 0; i < 8; ++i)
+    {
+        float x = (v[0] * cov[0]) + (v[1] * cov[1]) + (v[2] * cov[2]);
+        float y = (v[0] * cov[1]) + (v[1] * cov[3]) + (v[2] * cov[4]);
+        float z = (v[0] * cov[2]) + (v[1] * cov[4]) + (v[2] * cov[5]);
+        float norm = std::max(std::max(std::fabs(x), std::fabs(y)), std::fabs(z));
+        if (norm < 1e-6f)
+        {
+            break;
+        }
+        v[0] = x / norm;
+        v[1] = y / norm;
+        v[2] = z / norm;
+    }
+
+    axis[0] = v[0];
+    axis[1] = v[1];
+    axis[2] = v[2];
+}
+
+inline float projectOn(const float* point, const float* axis)
+{
+    return (point[0] * axis[0]) + (point[1] * axis[1]) + (point[2] * axis[2]);
+}
+
+// rounds a colour to the nearest RGB565 value, as expanded by the decoder
+uint16_t quantiseRGB565(const float* colour)
+{
+    int r = std::min(std::max(static_cast<int>((colour[0] / 8) + .5f), 0), 31);
+    int g = std::min(std::max(static_cast<int>((colour[1] / 4) + .5f), 0), 63);
+    int b = std::min(std::max(static_cast<int>((colour[2] / 8) + .5f), 0), 31);
+    return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+// orders the endpoints for the wanted mode: c0 > c1 for 4 colours, and
+// c0 < c1 for 3 colours and transparency
+void orderEndpoints(uint16_t* c0, uint16_t* c1, bool alpha)
+{
+    if (alpha ? (*c0 > *c1) : (*c0 < *c1))
+    {
+        std::swap(*c0, *c1);
+    }
+    if (alpha && *c0 == *c1)
+    {
+        if (*c1 < 0xFFFF)
+        {
+            ++*c1;
+        }
+        else
+        {
+            --*c0;
+        }
+    }
+}
+
+// writes the block with the closest palette entry for each pixel, and
+// returns the squared error of the opaque pixels
+uint32_t writeCMPRBlock(const uint8_t* block, uint16_t c0, uint16_t c1, uint8_t* out)
+{
+    RGBAColour c[4] = {rgb565ToRGBA(c0), rgb565ToRGBA(c1), {}, {}};
+    uint32_t entries = 4;
+    if (c0 < c1)
+    {
+        c[2] = colourHalf(c[0], c[1]);
+        entries = 3;
+    }
+    else
+    {
+        c[2] = colourOneThird(c[1], c[0]);
+        c[3] = colourOneThird(c[0], c[1]);
+    }
+
+    out[0] = static_cast<uint8_t>(c0 >> 8);
+    out[1] = static_cast<uint8_t>(c0);
+    out[2] = static_cast<uint8_t>(c1 >> 8);
+    out[3] = static_cast<uint8_t>(c1);
+
+    uint32_t error = 0;
+    for (uint32_t y = 0; y < 4; ++y)
+    {
+        uint8_t row = 0;
+        for (uint32_t x = 0; x < 4; ++x)
+        {
+            const uint8_t* px = block + (((y * 4) + x) * 4);
+            uint32_t idx = 3;
+            if (entries == 4 || !isTransparent(px))
+            {
+                uint32_t best = ~0U;
+                for (uint32_t i = 0; i < entries; ++i)
+                {
+                    int dr = px[0] - c[i].r, dg = px[1] - c[i].g, db = px[2] - c[i].b;
+                    uint32_t dist = (dr * dr) + (dg * dg) + (db * db);
+                    if (dist < best)
+                    {
+                        best = dist;
+                        idx = i;
+                    }
+                }
+                error += best;
+            }
+            row |= idx << (6 - (x * 2));
+        }
+        out[4 + y] = row;
+    }
+    return error;
+}
+
+// endpoints are the opaque pixels with the lowest and highest projection on
+// the principal axis
+uint32_t encodeRangeFit(const uint8_t* block, const CMPRFit& fit, uint8_t* out)
+{
+    float axis[3];
+    principalAxis(fit, axis);
+
+    uint32_t minIdx = 0, maxIdx = 0;
+    float min = projectOn(fit.points[0], axis), max = min;
+    for (uint32_t i = 1; i < fit.count; ++i)
+    {
+        float proj = projectOn(fit.points[i], axis);
+        if (proj < min)
+        {
+            min = proj;
+            minIdx = i;
+        }
+        else if (proj > max)
+        {
+            max = proj;
+            maxIdx = i;
+        }
+    }
+
+    uint16_t c0 = quantiseRGB565(fit.points[maxIdx]);
+    uint16_t c1 = quantiseRGB565(fit.points[minIdx]);
+    orderEndpoints(&c0, &c1, fit.alpha);
+    return writeCMPRBlock(block, c0, c1, out);
+}
+
+// sorts the points by their projection on 'axis', keeping the order of equal
+// projections; returns whether the order changed
+bool sortPoints(CMPRFit& fit, const float* axis)
+{
+    uint32_t order[16];
+    float proj[16];
+    for (uint32_t i = 0; i < fit.count; ++i)
+    {
+        order[i] = i;
+        proj[i] = projectOn(fit.points[i], axis);
+    }
+    std::stable_sort(order, order + fit.count, [&proj](uint32_t a, uint32_t b) {
+        return proj[a] < proj[b];
+    });
+
+    bool changed = false;
+    float sorted[16][3];
+    for (uint32_t i = 0; i < fit.count; ++i)
+    {
+        std::copy(fit.points[order[i]], fit.points[order[i]] + 3, sorted[i]);
+        changed |= order[i] != i;
+    }
+    std::copy(&sorted[0][0], &sorted[0][0] + (fit.count * 3), &fit.points[0][0]);
+    return changed;
+}
+
+// a split of 'n' sorted points in consecutive clusters [0, i), [i, j), [j, k)
+// and [k, n), with the coefficients of its least squares endpoints
+struct ClusterSplit
+{
+    uint8_t i, j, k;
+
+    // alpha², beta² and alpha * beta sums, divided by the determinant
+    float alpha2, beta2, alphaBeta;
+};
+
+// the splits of every number of points, for the 4 and 3 colour modes; they
+// only depend on the cluster sizes, so they are computed once
+class ClusterSplits
+{
+
+public:
+
+    ClusterSplits()
+    {
+        // weight of the start endpoint for each cluster; the 3 colour mode
+        // keeps the last cluster empty, so that [j, n) gets the weight 0
+        const float weights4[4] = {1.f, 2.f / 3.f, 1.f / 3.f, 0.f};
+        const float weights3[4] = {1.f, .5f, 0.f, 0.f};
+
+        for (uint32_t n = 0; n <= 16; ++n)
+        {
+            addSplits(splits4[n], weights4, n, false);
+            addSplits(splits3[n], weights3, n, true);
+        }
+    }
+
+    const std::vector<ClusterSplit>& get(uint32_t n, bool alpha) const
+    {
+        return alpha ? splits3[n] : splits4[n];
+    }
+
+private:
+
+    static void addSplits(std::vector<ClusterSplit>& out, const float* w, uint32_t n, bool alpha)
+    {
+        for (uint32_t i = 0; i <= n; ++i)
+        {
+            for (uint32_t j = i; j <= n; ++j)
+            {
+                for (uint32_t k = alpha ? n : j; k <= n; ++k)
+                {
+                    float counts[4] = {
+                        static_cast<float>(i), static_cast<float>(j - i),
+                        static_cast<float>(k - j), static_cast<float>(n - k)
+                    };
+
+                    float alpha2 = 0, beta2 = 0, alphaBeta = 0;
+                    for (uint32_t c = 0; c < 4; ++c)
+                    {
+                        alpha2 += counts[c] * w[c] * w[c];
+                        beta2 += counts[c] * (1 - w[c]) * (1 - w[c]);
+                        alphaBeta += counts[c] * w[c] * (1 - w[c]);
+                    }
+
+                    float det = (alpha2 * beta2) - (alphaBeta * alphaBeta);
+                    if (det < 1e-6f)
+                    {
+                        continue;
+                    }
+
+                    out.push_back({
+                        static_cast<uint8_t>(i), static_cast<uint8_t>(j), static_cast<uint8_t>(k),
+                        alpha2 / det, beta2 / det, alphaBeta / det
+                    });
+                }
+            }
+        }
+    }
+
+    // splits for the 4 colour mode, by number of points
+    std::vector<ClusterSplit> splits4[17];
+
+    // splits for the 3 colour mode, by number of points
+    std::vector<ClusterSplit> splits3[17];
+};
+
+// maximum count of cluster fits per block, each one over the order of the
+// points given by the previous fit
+constexpr uint32_t CLUSTER_FIT_ITERATIONS = 8;
+
+// tries every split of the sorted points in consecutive clusters, each mapped
+// to one palette entry, and solves the least squares endpoints of each split;
+// 'start' gets the weight 1 and 'end' the weight 0
+void clusterFit(const CMPRFit& fit, float* start, float* end, float* bestError)
+{
+    static const ClusterSplits SPLITS;
+
+    // weight of the start endpoint for the 2 middle clusters
+    float w1 = fit.alpha ? .5f : 2.f / 3.f;
+    float w2 = fit.alpha ? 0.f : 1.f / 3.f;
+
+    uint32_t n = fit.count;
+    float prefix[17][3];
+    prefix[0][0] = prefix[0][1] = prefix[0][2] = 0;
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        for (uint32_t c = 0; c < 3; ++c)
+        {
+            prefix[i + 1][c] = prefix[i][c] + fit.points[i][c];
+        }
+    }
+    const float* total = prefix[n];
+
+    for (const ClusterSplit& split : SPLITS.get(n, fit.alpha))
+    {
+        const float* pi = prefix[split.i];
+        const float* pj = prefix[split.j];
+        const float* pk = prefix[split.k];
+
+        float a[3], b[3], error = 0;
+        for (uint32_t c = 0; c < 3; ++c)
+        {
+            float alphaX = pi[c] + (w1 * (pj[c] - pi[c])) + (w2 * (pk[c] - pj[c]));
+            float betaX = total[c] - alphaX;
+            a[c] = (alphaX * split.beta2) - (betaX * split.alphaBeta);
+            b[c] = (betaX * split.alpha2) - (alphaX * split.alphaBeta);
+
+            // squared error of the unconstrained least squares solution,
+            // without the constant sum of x²; the endpoints are clamped and
+            // snapped to the grid only for the best split
+            error -= (a[c] * alphaX) + (b[c] * betaX);
+        }
+
+        if (error < *bestError)
+        {
+            *bestError = error;
+            std::copy(a, a + 3, start);
+            std::copy(b, b + 3, end);
+        }
+    }
+}
+
+// re-solves the least squares endpoints for the indices chosen in 'out' and
+// rewrites the block while that lowers its error
+uint32_t refineEndpoints(const uint8_t* block, bool alpha, uint8_t* out, uint32_t error)
+{
+    // weight of c0 for each index
+    const float weights4[4] = {1.f, 0.f, 2.f / 3.f, 1.f / 3.f};
+    const float weights3[4] = {1.f, 0.f, .5f, 0.f};
+    const float* w = alpha ? weights3 : weights4;
+
+    for (uint32_t iter = 0; iter < 4 && error > 0; ++iter)
+    {
+        float alpha2 = 0, beta2 = 0, alphaBeta = 0;
+        float alphaX[3] = {0, 0, 0}, betaX[3] = {0, 0, 0};
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            uint32_t idx = (out[4 + (i / 4)] >> (6 - ((i % 4) * 2))) & 3;
+            const uint8_t* px = block + (i * 4);
+            if (alpha && idx == 3)
+            {
+                continue;
+            }
+
+            float a = w[idx], b = 1 - a;
+            alpha2 += a * a;
+            beta2 += b * b;
+            alphaBeta += a * b;
+            for (uint32_t c = 0; c < 3; ++c)
+            {
+                alphaX[c] += a * px[c];
+                betaX[c] += b * px[c];
+            }
+        }
+
+        float det = (alpha2 * beta2) - (alphaBeta * alphaBeta);
+        if (det < 1e-6f)
+        {
+            break;
+        }
+
+        float start[3], end[3];
+        for (uint32_t c = 0; c < 3; ++c)
+        {
+            start[c] = ((alphaX[c] * beta2) - (betaX[c] * alphaBeta)) / det;
+            end[c] = ((betaX[c] * alpha2) - (alphaX[c] * alphaBeta)) / det;
+        }
+
+        uint16_t c0 = quantiseRGB565(start);
+        uint16_t c1 = quantiseRGB565(end);
+        orderEndpoints(&c0, &c1, alpha);
+
+        uint8_t candidate[8];
+        uint32_t candidateError = writeCMPRBlock(block, c0, c1, candidate);
+        if (candidateError >= error)
+        {
+            break;
+        }
+        std::copy(candidate, candidate + 8, out);
+        error = candidateError;
+    }
+    return error;
+}
+
+uint32_t encodeClusterFit(const uint8_t* block, CMPRFit& fit, uint8_t* out)
+{
+    // the range fit is cheap and sometimes better after quantisation
+    uint32_t error = encodeRangeFit(block, fit, out);
+    if (error == 0)
+    {
+        return 0;
+    }
+
+    float axis[3];
+    principalAxis(fit, axis);
+    sortPoints(fit, axis);
+
+    float start[3], end[3];
+    float bestError = INFINITY;
+    clusterFit(fit, start, end, &bestError);
+
+    // the principal axis only approximates the best order of the points, so
+    // they are sorted again along the fitted endpoints and fitted again until
+    // the order settles or the error stops improving
+    for (uint32_t iter = 1; iter < CLUSTER_FIT_ITERATIONS && bestError != INFINITY; ++iter)
+    {
+        for (uint32_t c = 0; c < 3; ++c)
+        {
+            axis[c] = end[c] - start[c];
+        }
+        if (!sortPoints(fit, axis))
+        {
+            break;
+        }
+
+        float error = bestError;
+        clusterFit(fit, start, end, &error);
+        if (error >= bestError)
+        {
+            break;
+        }
+        bestError = error;
+    }
+
+    if (bestError != INFINITY)
+    {
+        uint16_t c0 = quantiseRGB565(start);
+        uint16_t c1 = quantiseRGB565(end);
+        orderEndpoints(&c0, &c1, fit.alpha);
+
+        uint8_t candidate[8];
+        uint32_t clusterError = writeCMPRBlock(block, c0, c1, candidate);
+        if (clusterError < error)
+        {
+            std::copy(candidate, candidate + 8, out);
+            error = clusterError;
+        }
+    }
+
+    return refineEndpoints(block, fit.alpha, out, error);
+}
+
+void encodeBlockCMPR(const uint8_t* block, uint8_t* out, CMPRQuality quality)
+{
+    CMPRFit fit;
+    readCMPRFit(block, &fit);
+
+    if (fit.count == 0)
+    {
+        // fully transparent: 3 colour mode and every index at 3
+        writeCMPRBlock(block, 0x0000, 0x0001, out);
+        return;
+    }
+
+    switch (quality)
+    {
+    case CMPRQuality::Fast:
+        encodeRangeFit(block, fit, out);
+        break;
+
+    case CMPRQuality::High:
+        encodeClusterFit(block, fit, out);
+        break;
+
+    default:
+        refineEndpoints(block, fit.alpha, out, encodeRangeFit(block, fit, out));
+        break;
+    }
+}
+}
@@ -7,6 +7,9 @@
 
 #include <CTLib/Image.hpp>
 
+#include <cstring>
+#include <fstream>
+
 #include <stb_image.h>
 #include <stb_image_resize.h>
 #include <stb_image_write.h>
@@ -43,10 +46,7 @@ Image::Image(uint32_t width, uint32_t height, const Buffer& data, RGBAColour col
 {
     buffer = Buffer(width * height * 4);
     size_t min = buffer.remaining() > data.remaining() ? data.remaining() : buffer.remaining();
-    for (size_t i = 0; i < min; ++i)
-    {
-        buffer[i] = data[i];
-    }
+    std::memcpy(*buffer, *data, min);
     int64_t fill = buffer.remaining() - min;
     for (int64_t i = 0; i < fill; ++i)
     {
@@ -66,13 +66,12 @@ Image::Image(uint32_t width, uint32_t height, RGBAColour colour) :
     buffer.clear();
 }
 
-Image::Image(uint32_t width, uint32_t height, uint8_t* data) :
+Image::Image(uint32_t width, uint32_t height, Buffer&& data) :
     width{width},
-    height{height}
+    height{height},
+    buffer{std::move(data)}
 {
-    buffer = Buffer(width * height * 4);
-    buffer.putArray(data, buffer.capacity());
-    buffer.flip();
+
 }
 
 Image::Image(const Image& src) :
@@ -147,10 +146,31 @@ size_t Image::offsetFor(uint32_t x, uint32_t y) const
 Image Image::resize(uint32_t nw, uint32_t nh) const
 {
     Image out(nw, nh);
-    stbir_resize_uint8(*buffer, width, height, 0, *out, nw, nh, 0, 4);
+    resize(out);
     return out;
 }
 
+void Image::resize(Image& out) const
+{
+    assertValidOutput(out, "resize");
+    stbir_resize_uint8(*buffer, width, height, 0, *out, out.width, out.height, 0, 4);
+}
+
+void Image::assertValidOutput(const Image& out, const char* operation) const
+{
+    if (&out == this)
+    {
+        throw ImageError(Strings::format("Cannot %s an image into itself!", operation));
+    }
+    if (out.width == 0 || out.height == 0
+        || out.buffer.capacity() != static_cast<size_t>(out.width) * out.height * 4)
+    {
+        throw ImageError(Strings::format(
+            "Invalid %s size! (%dx%d -> %dx%d)", operation, width, height, out.width, out.height
+        ));
+    }
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
@@ -159,27 +179,48 @@ Image Image::resize(uint32_t nw, uint32_t nh) const
 ////
 ////
 
+int readImageFile(void* user, char* data, int size)
+{
+    std::ifstream& file = *static_cast<std::ifstream*>(user);
+    file.read(data, size);
+    return static_cast<int>(file.gcount());
+}
+
+void skipImageFile(void* user, int n)
+{
+    std::ifstream& file = *static_cast<std::ifstream*>(user);
+    file.clear();
+    file.seekg(n, std::ios::cur);
+}
+
+int eofImageFile(void* user)
+{
+    std::ifstream& file = *static_cast<std::ifstream*>(user);
+    return file.peek() == std::ifstream::traits_type::eof();
+}
+
 Image ImageIO::read(const char* filename)
 {
-    uint32_t err = 0;
-    Buffer data = IO::readFile(filename, &err);
-    if (err)
+    std::ifstream file(filename, std::ios::in | std::ios::binary);
+    if (!file.is_open())
     {
         throw ImageError("File not found!");
     }
 
+    // the file is streamed through stb rather than read whole beforehand
+    const stbi_io_callbacks callbacks{readImageFile, skipImageFile, eofImageFile};
+
     int width, height, c;
-    uint8_t* img = stbi_load_from_memory(*data, (int)data.capacity(), &width, &height, &c, 4);
+    uint8_t* img = stbi_load_from_callbacks(&callbacks, &file, &width, &height, &c, 4);
     if (img == nullptr)
     {
         throw ImageError("Invalid or corrupted image data!");
     }
 
-    Image image(static_cast<uint32_t>(width), static_cast<uint32_t>(height), img);
-
-    stbi_image_free(img);
-
-    return image;
+    // the decoded pixels are adopted and released by stb once unused
+    const size_t size = static_cast<size_t>(width) * height * 4;
+    Buffer data(img, size, [](uint8_t* ptr) { stbi_image_free(ptr); });
+    return Image(static_cast<uint32_t>(width), static_cast<uint32_t>(height), std::move(data));
 }
 
 Image ImageIO::read(const std::string& filename)
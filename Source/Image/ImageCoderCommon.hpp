@@ -0,0 +1,76 @@
+//////////////////////////////////////////////////
+//  Copyright (c) 2020 Nara Hiero
+//
+// This file is licensed under GPLv3+
+// Refer to the `License.txt` file included.
+//////////////////////////////////////////////////
+
+#pragma once
+
+
+/**************************************************************************
+ * This header contains functionalities shared by the GX texture encoders
+ * and decoders.
+ **************************************************************************/
+
+
+#include <CTLib/Image.hpp>
+
+#include <functional>
+
+#include "SIMD.hpp"
+
+
+namespace CTLib
+{
+
+// size of the tiles of a format, and shift from pixel count to byte count
+struct FormatInfo
+{
+    uint8_t bw, bh;
+    int8_t sshift;
+};
+
+// throws ImageError if the format is not supported
+FormatInfo formatInfo(ImageFormat format);
+
+// returns the size in bytes of one tile of the specified format
+size_t tileSizeFor(FormatInfo info);
+
+// splits the tile rows [0, rows) in contiguous ranges [begin, end) passed to
+// 'func' on up to 'threads' threads (0 for one per hardware thread); tiles of
+// different rows never share input or output bytes
+void runTileRows(
+    uint32_t rows, uint32_t threads, const std::function<void(uint32_t, uint32_t)>& func
+);
+
+// decodes one whole tile from 'in' to 'out', which points to the top-left
+// pixel of the tile in an RGBA image whose rows are 'stride' bytes apart
+using DecodeTileFunc = void (*)(const uint8_t*, uint8_t*, size_t);
+
+// returns the tile decoder of the non-palette format; the SIMD kernel is
+// returned if 'simd' is true and the format has one, else the scalar kernel
+DecodeTileFunc decodeTileFunc(ImageFormat format, bool simd);
+
+// reduces each 2x2 block of the RGBA pixels 'src', 'w' * 2 pixels wide, to one
+// pixel of 'dst', averaging colours weighted by their alpha; the SIMD kernel is
+// used if 'simd' is true and it is compiled in, else the scalar kernel
+void boxReduce2x2(const uint8_t* src, uint8_t* dst, uint32_t w, uint32_t h, bool simd);
+
+// returns the grey level of the colour, as encoded by the intensity formats
+uint8_t computeGreyscale(uint8_t r, uint8_t g, uint8_t b);
+
+// CMPR palette colours, as computed by the decoder
+RGBAColour rgb565ToRGBA(uint16_t rgb565);
+RGBAColour colourHalf(RGBAColour a, RGBAColour b);
+RGBAColour colourOneThird(RGBAColour a, RGBAColour b);
+
+// returns the number of colours the palette format can index; throws
+// ImageError if the format is not a palette format
+uint32_t paletteSizeFor(ImageFormat format);
+
+// encodes the 4x4 RGBA block to 8 bytes of CMPR at the specified quality;
+// Normal blocks only get here when they have transparent pixels, as the
+// others are encoded by stb_dxt
+void encodeBlockCMPR(const uint8_t* block, uint8_t* out, CMPRQuality quality);
+}
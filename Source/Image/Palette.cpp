@@ -0,0 +1,790 @@
+//////////////////////////////////////////////////
+//  Copyright (c) 2020 Nara Hiero
+//
+// This file is licensed under GPLv3+
+// Refer to the `License.txt` file included.
+//////////////////////////////////////////////////
+
+#include "Image/ImageCoderCommon.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <queue>
+
+#include <CTLib/Utilities.hpp>
+
+namespace CTLib
+{
+
+//////////////////////////////
+///  palette colours
+
+// converts the RGBA pixel to a palette colour, like the matching encoders
+using ToEntryFunc = uint16_t (*)(const uint8_t*);
+
+uint16_t toEntryIA8(const uint8_t* px)
+{
+    return (static_cast<uint16_t>(px[3]) << 8) | computeGreyscale(px[0], px[1], px[2]);
+}
+
+uint16_t toEntryRGB565(const uint8_t* px)
+{
+    return (static_cast<uint16_t>(px[0] & 0xF8) << 8)
+        | (static_cast<uint16_t>(px[1] & 0xFC) << 3)
+        | (static_cast<uint16_t>(px[2]) >> 3);
+}
+
+uint16_t toEntryRGB5A3(const uint8_t* px)
+{
+    if (px[3] < 0xE0) // with alpha
+    {
+        return (static_cast<uint16_t>(px[3] & 0xE0) << 7)
+            | (static_cast<uint16_t>(px[0] & 0xF0) << 4)
+            | static_cast<uint16_t>(px[1] & 0xF0)
+            | (static_cast<uint16_t>(px[2]) >> 4);
+    }
+    return 0x8000 // no alpha
+        | (static_cast<uint16_t>(px[0] & 0xF8) << 7)
+        | (static_cast<uint16_t>(px[1] & 0xF8) << 2)
+        | (static_cast<uint16_t>(px[2]) >> 3);
+}
+
+ToEntryFunc toEntryFunc(PaletteFormat format)
+{
+    switch (format)
+    {
+    case PaletteFormat::IA8:
+        return toEntryIA8;
+
+    case PaletteFormat::RGB565:
+        return toEntryRGB565;
+
+    case PaletteFormat::RGB5A3:
+        return toEntryRGB5A3;
+
+    default:
+        throw ImageError("Unsupported palette format!");
+    }
+}
+
+// converts the palette colour to RGBA, like the matching decoders
+RGBAColour fromEntry(PaletteFormat format, uint16_t entry)
+{
+    switch (format)
+    {
+    case PaletteFormat::IA8:
+    {
+        uint8_t grey = static_cast<uint8_t>(entry);
+        return {grey, grey, grey, static_cast<uint8_t>(entry >> 8)};
+    }
+
+    case PaletteFormat::RGB565:
+        return rgb565ToRGBA(entry);
+
+    case PaletteFormat::RGB5A3:
+        if ((entry & 0x8000) == 0) // with alpha
+        {
+            return
+            {
+                static_cast<uint8_t>(((entry & 0x0F00) >> 8) * 0x11),
+                static_cast<uint8_t>(((entry & 0x00F0) >> 4) * 0x11),
+                static_cast<uint8_t>((entry & 0x000F) * 0x11),
+                static_cast<uint8_t>((entry & 0x7000) >> 7)
+            };
+        }
+        return
+        {
+            static_cast<uint8_t>((entry & 0x7C00) >> 7),
+            static_cast<uint8_t>((entry & 0x03E0) >> 2),
+            static_cast<uint8_t>((entry & 0x001F) << 3),
+            static_cast<uint8_t>(0xFF)
+        };
+
+    default:
+        throw ImageError("Unsupported palette format!");
+    }
+}
+
+// returns the number of colours the palette format can index
+uint32_t paletteSizeFor(ImageFormat format)
+{
+    switch (format)
+    {
+    case ImageFormat::C4:
+        return 0x10;
+
+    case ImageFormat::C8:
+        return 0x100;
+
+    case ImageFormat::C14X2:
+        return Palette::MAX_COLOURS;
+
+    default:
+        throw ImageError("Not a palette format!");
+    }
+}
+
+// converts all pixels of the image to palette colours
+std::vector<uint16_t> toEntries(const Image& image, PaletteFormat format)
+{
+    ToEntryFunc func = toEntryFunc(format);
+    size_t count = static_cast<size_t>(image.getWidth()) * image.getHeight();
+
+    std::vector<uint16_t> entries(count);
+    const uint8_t* px = *image;
+    for (size_t i = 0; i < count; ++i, px += 4)
+    {
+        entries[i] = func(px);
+    }
+    return entries;
+}
+
+
+//////////////////////////////
+///  class Palette
+
+Palette::Palette(PaletteFormat format) :
+    format{format},
+    entries{}
+{
+
+}
+
+Palette::Palette(PaletteFormat format, Buffer& data, uint16_t count) :
+    format{format},
+    entries{}
+{
+    if (count > MAX_COLOURS)
+    {
+        throw ImageError(Strings::format(
+            "Too many colours in palette! (%d > %d)", count, MAX_COLOURS
+        ));
+    }
+    if (data.remaining() < static_cast<size_t>(count) * 2)
+    {
+        throw ImageError("Not enough bytes in encoded palette buffer!");
+    }
+
+    entries.reserve(count);
+    const uint8_t* in = *data + data.position();
+    for (uint16_t i = 0; i < count; ++i, in += 2)
+    {
+        entries.push_back(static_cast<uint16_t>((in[0] << 8) | in[1]));
+    }
+    data.position(data.position() + (static_cast<size_t>(count) * 2));
+}
+
+PaletteFormat Palette::getFormat() const
+{
+    return format;
+}
+
+uint16_t Palette::getCount() const
+{
+    return static_cast<uint16_t>(entries.size());
+}
+
+uint16_t Palette::add(RGBAColour colour)
+{
+    if (entries.size() >= MAX_COLOURS)
+    {
+        throw ImageError("Cannot add more colours to palette!");
+    }
+
+    uint8_t px[4] = {colour.r, colour.g, colour.b, colour.a};
+    entries.push_back(toEntryFunc(format)(px));
+    return static_cast<uint16_t>(entries.size() - 1);
+}
+
+RGBAColour Palette::getColour(uint16_t index) const
+{
+    if (index >= entries.size())
+    {
+        throw ImageError(Strings::format(
+            "Palette colour index out of range! (%d >= %d)", index, entries.size()
+        ));
+    }
+    return fromEntry(format, entries[index]);
+}
+
+Buffer Palette::getData() const
+{
+    Buffer data(entries.size() * 2);
+    for (uint16_t entry : entries)
+    {
+        data.putShort(entry);
+    }
+    return data.flip();
+}
+
+
+//////////////////////////////
+///  nearest colour search
+
+// the colours of a palette laid out for the nearest colour search; the red
+// and green, and blue and alpha components of 4 consecutive colours fill one
+// SSE2 register each
+struct ColourTable
+{
+    // interleaved red and green components
+    std::vector<int16_t> rg;
+
+    // interleaved blue and alpha components
+    std::vector<int16_t> ba;
+
+    // number of actual colours
+    uint32_t count;
+};
+
+ColourTable createColourTable(const std::vector<RGBAColour>& colours)
+{
+    // padding colours are far enough to never be the nearest, yet close enough
+    // for their distance not to overflow
+    size_t padded = (colours.size() + 3) & ~static_cast<size_t>(3);
+    ColourTable table{
+        std::vector<int16_t>(padded * 2, 0x1000), std::vector<int16_t>(padded * 2, 0x1000),
+        static_cast<uint32_t>(colours.size())
+    };
+    for (size_t i = 0; i < colours.size(); ++i)
+    {
+        table.rg[(i * 2) + 0] = colours[i].r;
+        table.rg[(i * 2) + 1] = colours[i].g;
+        table.ba[(i * 2) + 0] = colours[i].b;
+        table.ba[(i * 2) + 1] = colours[i].a;
+    }
+    return table;
+}
+
+// returns the index of the colour of the table nearest to 'c', the first one
+// on ties
+uint32_t nearestColour(const ColourTable& table, RGBAColour c)
+{
+#ifdef CT_LIB_SSE2
+    const __m128i rg = _mm_set1_epi32((c.g << 16) | c.r);
+    const __m128i ba = _mm_set1_epi32((c.a << 16) | c.b);
+    const __m128i four = _mm_set1_epi32(4);
+
+    __m128i best = _mm_set1_epi32(INT_MAX);
+    __m128i bestIdx = _mm_setzero_si128();
+    __m128i idx = _mm_setr_epi32(0, 1, 2, 3);
+    for (size_t i = 0; i < table.rg.size(); i += 8, idx = _mm_add_epi32(idx, four))
+    {
+        __m128i drg = _mm_sub_epi16(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(table.rg.data() + i)), rg
+        );
+        __m128i dba = _mm_sub_epi16(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(table.ba.data() + i)), ba
+        );
+        __m128i dist = _mm_add_epi32(_mm_madd_epi16(drg, drg), _mm_madd_epi16(dba, dba));
+
+        __m128i less = _mm_cmplt_epi32(dist, best);
+        best = _mm_or_si128(_mm_and_si128(less, dist), _mm_andnot_si128(less, best));
+        bestIdx = _mm_or_si128(_mm_and_si128(less, idx), _mm_andnot_si128(less, bestIdx));
+    }
+
+    int32_t dists[4], indices[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dists), best);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(indices), bestIdx);
+
+    uint32_t result = 0;
+    int32_t min = INT_MAX;
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        if (dists[i] < min || (dists[i] == min && static_cast<uint32_t>(indices[i]) < result))
+        {
+            min = dists[i];
+            result = indices[i];
+        }
+    }
+    return result;
+#else
+    uint32_t result = 0;
+    int32_t min = INT_MAX;
+    for (uint32_t i = 0; i < table.count; ++i)
+    {
+        int32_t dr = table.rg[(i * 2) + 0] - c.r, dg = table.rg[(i * 2) + 1] - c.g;
+        int32_t db = table.ba[(i * 2) + 0] - c.b, da = table.ba[(i * 2) + 1] - c.a;
+        int32_t dist = (dr * dr) + (dg * dg) + (db * db) + (da * da);
+        if (dist < min)
+        {
+            min = dist;
+            result = i;
+        }
+    }
+    return result;
+#endif
+}
+
+
+//////////////////////////////
+///  quantisation
+
+// a distinct palette colour of the image
+struct PalettePoint
+{
+    // the decoded colour
+    RGBAColour colour;
+
+    // the number of pixels of this colour
+    uint32_t weight;
+};
+
+// a box of the median cut, covering points [begin, end)
+struct PaletteBox
+{
+    uint32_t begin, end;
+
+    // the component with the widest range
+    uint8_t axis;
+
+    // the priority of splitting this box; 0 if it cannot be split
+    uint64_t score;
+};
+
+bool operator<(const PaletteBox& a, const PaletteBox& b)
+{
+    return a.score < b.score;
+}
+
+PaletteBox createPaletteBox(const std::vector<PalettePoint>& points, uint32_t begin, uint32_t end)
+{
+    uint8_t min[4] = {0xFF, 0xFF, 0xFF, 0xFF}, max[4] = {0, 0, 0, 0};
+    uint64_t weight = 0;
+    for (uint32_t i = begin; i < end; ++i)
+    {
+        for (uint32_t c = 0; c < 4; ++c)
+        {
+            min[c] = std::min(min[c], points[i].colour[c]);
+            max[c] = std::max(max[c], points[i].colour[c]);
+        }
+        weight += points[i].weight;
+    }
+
+    PaletteBox box{begin, end, 0, 0};
+    uint32_t range = 0;
+    for (uint8_t c = 0; c < 4; ++c)
+    {
+        if (static_cast<uint32_t>(max[c] - min[c]) > range)
+        {
+            range = max[c] - min[c];
+            box.axis = c;
+        }
+    }
+
+    // approximates the squared error removed by splitting the box
+    box.score = end - begin > 1 ? static_cast<uint64_t>(range) * range * weight : 0;
+    return box;
+}
+
+// splits the colours in at most 'count' boxes
+std::vector<PaletteBox> medianCut(std::vector<PalettePoint>& points, uint32_t count)
+{
+    std::priority_queue<PaletteBox> queue;
+    queue.push(createPaletteBox(points, 0, static_cast<uint32_t>(points.size())));
+
+    std::vector<PaletteBox> done;
+    while (!queue.empty() && queue.size() + done.size() < count)
+    {
+        PaletteBox box = queue.top();
+        queue.pop();
+        if (box.score == 0)
+        {
+            done.push_back(box);
+            continue;
+        }
+
+        uint8_t axis = box.axis;
+        std::sort(points.begin() + box.begin, points.begin() + box.end,
+            [axis](const PalettePoint& a, const PalettePoint& b) {
+                return a.colour[axis] < b.colour[axis];
+            }
+        );
+
+        // split at the weighted median, keeping both halves non-empty
+        uint64_t total = 0;
+        for (uint32_t i = box.begin; i < box.end; ++i)
+        {
+            total += points[i].weight;
+        }
+        uint64_t sum = 0;
+        uint32_t split = box.begin;
+        while (split < box.end - 1 && (sum + points[split].weight) * 2 <= total)
+        {
+            sum += points[split++].weight;
+        }
+        split = std::max(split, box.begin + 1);
+
+        queue.push(createPaletteBox(points, box.begin, split));
+        queue.push(createPaletteBox(points, split, box.end));
+    }
+
+    while (!queue.empty())
+    {
+        done.push_back(queue.top());
+        queue.pop();
+    }
+    return done;
+}
+
+// sums of the components of the points of a cluster, weighted by pixel count
+struct ColourSum
+{
+    uint64_t c[4];
+    uint64_t weight;
+};
+
+void addToSum(ColourSum& sum, const PalettePoint& point)
+{
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        sum.c[i] += static_cast<uint64_t>(point.colour[i]) * point.weight;
+    }
+    sum.weight += point.weight;
+}
+
+// returns the mean of the sum, as represented in the palette format
+RGBAColour meanColour(const ColourSum& sum, PaletteFormat format)
+{
+    uint8_t px[4];
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        px[i] = static_cast<uint8_t>((sum.c[i] + (sum.weight / 2)) / sum.weight);
+    }
+    return fromEntry(format, toEntryFunc(format)(px));
+}
+
+// moves the colours to the mean of the points nearest to them
+void refineColours(
+    const std::vector<PalettePoint>& points, std::vector<RGBAColour>& colours,
+    PaletteFormat format, uint32_t iterations
+)
+{
+    for (uint32_t it = 0; it < iterations; ++it)
+    {
+        ColourTable table = createColourTable(colours);
+        std::vector<ColourSum> sums(colours.size(), ColourSum{{0, 0, 0, 0}, 0});
+        for (const PalettePoint& point : points)
+        {
+            addToSum(sums[nearestColour(table, point.colour)], point);
+        }
+
+        bool changed = false;
+        for (size_t i = 0; i < colours.size(); ++i)
+        {
+            if (sums[i].weight == 0)
+            {
+                continue; // keep unused colours
+            }
+            RGBAColour mean = meanColour(sums[i], format);
+            changed |= std::memcmp(&mean, &colours[i], sizeof(RGBAColour)) != 0;
+            colours[i] = mean;
+        }
+        if (!changed)
+        {
+            break;
+        }
+    }
+}
+
+Palette ImageCoder::createPalette(
+    const Image& image, ImageFormat format, PaletteFormat paletteFormat
+)
+{
+    uint32_t max = paletteSizeFor(format);
+
+    // histogram of the palette colours of all pixels
+    std::vector<uint32_t> histogram(0x10000, 0);
+    for (uint16_t entry : toEntries(image, paletteFormat))
+    {
+        ++histogram[entry];
+    }
+
+    std::vector<PalettePoint> points;
+    for (uint32_t entry = 0; entry < 0x10000; ++entry)
+    {
+        if (histogram[entry] > 0)
+        {
+            RGBAColour colour = fromEntry(paletteFormat, static_cast<uint16_t>(entry));
+            points.push_back({colour, histogram[entry]});
+        }
+    }
+
+    Palette palette(paletteFormat);
+    if (points.size() <= max)
+    {
+        for (const PalettePoint& point : points)
+        {
+            palette.add(point.colour);
+        }
+        return palette;
+    }
+
+    std::vector<RGBAColour> colours;
+    for (const PaletteBox& box : medianCut(points, max))
+    {
+        ColourSum sum{{0, 0, 0, 0}, 0};
+        for (uint32_t i = box.begin; i < box.end; ++i)
+        {
+            addToSum(sum, points[i]);
+        }
+        colours.push_back(meanColour(sum, paletteFormat));
+    }
+
+    // the nearest colour search over 16384 colours is too slow to iterate
+    if (max <= 0x100)
+    {
+        refineColours(points, colours, paletteFormat, 4);
+    }
+
+    for (const RGBAColour& colour : colours)
+    {
+        palette.add(colour);
+    }
+    return palette;
+}
+
+
+//////////////////////////////
+///  palette formats coding
+
+// writes the palette index of the 'i'th pixel of the tile
+template <ImageFormat format>
+inline void putIndex(uint8_t* tile, uint32_t i, uint16_t index);
+
+template <>
+inline void putIndex<ImageFormat::C4>(uint8_t* tile, uint32_t i, uint16_t index)
+{
+    uint8_t& out = tile[i >> 1];
+    out = (i & 1) == 0 ? static_cast<uint8_t>(index << 4) : (out | static_cast<uint8_t>(index));
+}
+
+template <>
+inline void putIndex<ImageFormat::C8>(uint8_t* tile, uint32_t i, uint16_t index)
+{
+    tile[i] = static_cast<uint8_t>(index);
+}
+
+template <>
+inline void putIndex<ImageFormat::C14X2>(uint8_t* tile, uint32_t i, uint16_t index)
+{
+    tile[(i * 2) + 0] = static_cast<uint8_t>(index >> 8);
+    tile[(i * 2) + 1] = static_cast<uint8_t>(index);
+}
+
+// returns the palette index of the 'i'th pixel of the tile
+template <ImageFormat format>
+inline uint16_t getIndex(const uint8_t* tile, uint32_t i);
+
+template <>
+inline uint16_t getIndex<ImageFormat::C4>(const uint8_t* tile, uint32_t i)
+{
+    return (i & 1) == 0 ? (tile[i >> 1] >> 4) : (tile[i >> 1] & 0xF);
+}
+
+template <>
+inline uint16_t getIndex<ImageFormat::C8>(const uint8_t* tile, uint32_t i)
+{
+    return tile[i];
+}
+
+template <>
+inline uint16_t getIndex<ImageFormat::C14X2>(const uint8_t* tile, uint32_t i)
+{
+    return ((tile[i * 2] << 8) | tile[(i * 2) + 1]) & 0x3FFF;
+}
+
+// writes the palette indices of the tile rows [rowBegin, rowEnd); 'indices'
+// maps the palette colour of each pixel to its palette index
+template <ImageFormat format>
+void encodeIndexTileRows(
+    const std::vector<uint16_t>& entries, const std::vector<uint16_t>& indices,
+    uint32_t width, uint32_t height, uint8_t* out, uint32_t rowBegin, uint32_t rowEnd
+)
+{
+    FormatInfo info = formatInfo(format);
+    size_t tileSize = tileSizeFor(info);
+    uint32_t tilesPerRow = (width + info.bw - 1) / info.bw;
+    out += static_cast<size_t>(rowBegin) * tilesPerRow * tileSize;
+
+    for (uint32_t row = rowBegin; row < rowEnd; ++row)
+    {
+        uint32_t gy = row * info.bh;
+        for (uint32_t gx = 0; gx < width; gx += info.bw, out += tileSize)
+        {
+            for (uint32_t y = 0, i = 0; y < info.bh; ++y)
+            {
+                for (uint32_t x = 0; x < info.bw; ++x, ++i)
+                {
+                    uint32_t px = gx + x, py = gy + y;
+                    putIndex<format>(out, i, px < width && py < height
+                        ? indices[entries[(static_cast<size_t>(py) * width) + px]] : 0
+                    );
+                }
+            }
+        }
+    }
+}
+
+// reads the palette indices of the tile rows [rowBegin, rowEnd) to the RGBA
+// pixels 'out'; 'colours' holds the RGBA colour of every possible index
+template <ImageFormat format>
+void decodeIndexTileRows(
+    const uint8_t* in, const std::vector<uint8_t>& colours, uint32_t width, uint32_t height,
+    uint8_t* out, uint32_t rowBegin, uint32_t rowEnd
+)
+{
+    FormatInfo info = formatInfo(format);
+    size_t tileSize = tileSizeFor(info);
+    uint32_t tilesPerRow = (width + info.bw - 1) / info.bw;
+    in += static_cast<size_t>(rowBegin) * tilesPerRow * tileSize;
+
+    for (uint32_t row = rowBegin; row < rowEnd; ++row)
+    {
+        uint32_t gy = row * info.bh;
+        for (uint32_t gx = 0; gx < width; gx += info.bw, in += tileSize)
+        {
+            for (uint32_t y = 0, i = 0; y < info.bh; ++y)
+            {
+                for (uint32_t x = 0; x < info.bw; ++x, ++i)
+                {
+                    uint32_t px = gx + x, py = gy + y;
+                    if (px < width && py < height)
+                    {
+                        std::memcpy(out + ((static_cast<size_t>(py) * width) + px) * 4,
+                            colours.data() + (getIndex<format>(in, i) * 4), 4
+                        );
+                    }
+                }
+            }
+        }
+    }
+}
+
+// count of distinct colours handed to a thread at once when searching their
+// nearest palette colours
+constexpr size_t NEAREST_CHUNK = 64;
+
+Buffer ImageCoder::encode(
+    const Image& image, ImageFormat format, const Palette& palette, uint32_t threads
+)
+{
+    uint32_t max = paletteSizeFor(format);
+    if (palette.getCount() == 0)
+    {
+        throw ImageError("Cannot encode with an empty palette!");
+    }
+    if (palette.getCount() > max)
+    {
+        throw ImageError(Strings::format(
+            "Too many colours in palette for format! (%d > %d)", palette.getCount(), max
+        ));
+    }
+
+    std::vector<RGBAColour> colours;
+    colours.reserve(palette.getCount());
+    for (uint16_t i = 0; i < palette.getCount(); ++i)
+    {
+        colours.push_back(palette.getColour(i));
+    }
+    ColourTable table = createColourTable(colours);
+
+    // the nearest colour is searched once per distinct palette colour
+    std::vector<uint16_t> entries = toEntries(image, palette.getFormat());
+    std::vector<uint8_t> present(0x10000, 0);
+    for (uint16_t entry : entries)
+    {
+        present[entry] = 1;
+    }
+    std::vector<uint16_t> distinct;
+    for (uint32_t entry = 0; entry < 0x10000; ++entry)
+    {
+        if (present[entry] != 0)
+        {
+            distinct.push_back(static_cast<uint16_t>(entry));
+        }
+    }
+
+    // colours found as is in the palette need no search
+    std::vector<uint16_t> indices(0x10000, 0);
+    Buffer paletteData = palette.getData();
+    const uint8_t* raw = *paletteData;
+    for (uint16_t i = palette.getCount(); i-- > 0;)
+    {
+        uint16_t entry = static_cast<uint16_t>((raw[i * 2] << 8) | raw[(i * 2) + 1]);
+        indices[entry] = i;
+        present[entry] = present[entry] != 0 ? 2 : 0;
+    }
+
+    Parallel::forChunks(distinct.size(), threads, NEAREST_CHUNK, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            if (present[distinct[i]] == 1)
+            {
+                RGBAColour colour = fromEntry(palette.getFormat(), distinct[i]);
+                indices[distinct[i]] = static_cast<uint16_t>(nearestColour(table, colour));
+            }
+        }
+    });
+
+    FormatInfo info = formatInfo(format);
+    uint32_t width = image.getWidth(), height = image.getHeight();
+    Buffer data(sizeFor(width, height, format));
+    uint8_t* out = *data;
+    uint32_t rows = (height + info.bh - 1) / info.bh;
+    auto func = format == ImageFormat::C4 ? encodeIndexTileRows<ImageFormat::C4>
+        : format == ImageFormat::C8 ? encodeIndexTileRows<ImageFormat::C8>
+        : encodeIndexTileRows<ImageFormat::C14X2>;
+    runTileRows(rows, threads, [&](uint32_t begin, uint32_t end) {
+        func(entries, indices, width, height, out, begin, end);
+    });
+
+    return data;
+}
+
+Image ImageCoder::decode(
+    Buffer& data, uint32_t width, uint32_t height, ImageFormat format,
+    const Palette& palette, uint32_t threads
+)
+{
+    uint32_t max = paletteSizeFor(format);
+    FormatInfo info = formatInfo(format);
+
+    size_t size = sizeFor(width, height, format);
+    if (data.remaining() < size)
+    {
+        throw ImageError("Not enough bytes in encoded buffer!");
+    }
+
+    // indices without a colour decode as transparent black
+    std::vector<uint8_t> colours(static_cast<size_t>(max) * 4, 0);
+    for (uint16_t i = 0; i < palette.getCount() && i < max; ++i)
+    {
+        RGBAColour colour = palette.getColour(i);
+        colours[(i * 4) + 0] = colour.r;
+        colours[(i * 4) + 1] = colour.g;
+        colours[(i * 4) + 2] = colour.b;
+        colours[(i * 4) + 3] = colour.a;
+    }
+
+    Buffer out(static_cast<size_t>(width) * height * 4);
+    uint32_t rows = (height + info.bh - 1) / info.bh;
+    const uint8_t* in = *data + data.position();
+    uint8_t* pixels = *out;
+    auto func = format == ImageFormat::C4 ? decodeIndexTileRows<ImageFormat::C4>
+        : format == ImageFormat::C8 ? decodeIndexTileRows<ImageFormat::C8>
+        : decodeIndexTileRows<ImageFormat::C14X2>;
+    runTileRows(rows, threads, [&](uint32_t begin, uint32_t end) {
+        func(in, colours, width, height, pixels, begin, end);
+    });
+    data.position(data.position() + size);
+
+    return Image(width, height, std::move(out));
+}
+
+bool ImageCoder::isPaletteFormat(ImageFormat format)
+{
+    return format == ImageFormat::C4 || format == ImageFormat::C8
+        || format == ImageFormat::C14X2;
+}
+}
@@ -0,0 +1,382 @@
+//////////////////////////////////////////////////
+//  Copyright (c) 2020 Nara Hiero
+//
+// This file is licensed under GPLv3+
+// Refer to the `License.txt` file included.
+//////////////////////////////////////////////////
+
+#include "Image/ImageCoderCommon.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include <CTLib/Utilities.hpp>
+
+namespace CTLib
+{
+
+constexpr double PI = 3.14159265358979323846;
+
+// radius of the Kaiser filter, in destination pixels
+constexpr double KAISER_RADIUS = 3.;
+
+// shape of the Kaiser window
+constexpr double KAISER_ALPHA = 4.;
+
+// a source pixel contributing to a destination pixel
+struct ResampleTap
+{
+    uint32_t index;
+    float weight;
+};
+
+// the source pixels contributing to each destination pixel of a row or column
+struct ResampleTaps
+{
+    std::vector<uint32_t> start; // index in `taps` of the first tap of each pixel
+    std::vector<ResampleTap> taps;
+};
+
+// modified Bessel function of the first kind of order 0
+double besselI0(double x)
+{
+    double sum = 1., term = 1.;
+    for (uint32_t k = 1; k < 32 && term > sum * 1e-12; ++k)
+    {
+        term *= (x * x) / (4. * k * k);
+        sum += term;
+    }
+    return sum;
+}
+
+double kaiserWeight(double t)
+{
+    if (std::abs(t) >= KAISER_RADIUS)
+    {
+        return 0.;
+    }
+    double r = t / KAISER_RADIUS;
+    double sinc = t == 0. ? 1. : std::sin(PI * t) / (PI * t);
+    return sinc * besselI0(KAISER_ALPHA * std::sqrt(1. - r * r)) / besselI0(KAISER_ALPHA);
+}
+
+ResampleTaps computeResampleTaps(uint32_t srcSize, uint32_t dstSize, MipmapFilter filter)
+{
+    ResampleTaps result;
+    result.start.reserve(dstSize + 1);
+
+    const double scale = static_cast<double>(srcSize) / dstSize;
+    for (uint32_t x = 0; x < dstSize; ++x)
+    {
+        result.start.push_back(static_cast<uint32_t>(result.taps.size()));
+
+        double total = 0.;
+        size_t first = result.taps.size();
+        if (filter == MipmapFilter::Box)
+        {
+            double left = x * scale, right = (x + 1) * scale;
+            uint32_t end = std::min(srcSize, static_cast<uint32_t>(std::ceil(right)));
+            for (uint32_t i = static_cast<uint32_t>(left); i < end; ++i)
+            {
+                double weight = std::min<double>(right, i + 1) - std::max<double>(left, i);
+                if (weight > 0.)
+                {
+                    result.taps.push_back({i, static_cast<float>(weight)});
+                    total += weight;
+                }
+            }
+        }
+        else
+        {
+            // taps past the edges are clamped to the edge pixels
+            double centre = (x + .5) * scale;
+            int32_t begin = static_cast<int32_t>(std::floor(centre - KAISER_RADIUS * scale));
+            int32_t end = static_cast<int32_t>(std::ceil(centre + KAISER_RADIUS * scale));
+            for (int32_t i = begin; i < end; ++i)
+            {
+                double weight = kaiserWeight((i + .5 - centre) / scale);
+                if (weight == 0.)
+                {
+                    continue;
+                }
+                uint32_t index = static_cast<uint32_t>(
+                    std::clamp<int32_t>(i, 0, static_cast<int32_t>(srcSize) - 1)
+                );
+                result.taps.push_back({index, static_cast<float>(weight)});
+                total += weight;
+            }
+        }
+
+        for (size_t i = first; i < result.taps.size(); ++i)
+        {
+            result.taps[i].weight = static_cast<float>(result.taps[i].weight / total);
+        }
+    }
+    result.start.push_back(static_cast<uint32_t>(result.taps.size()));
+
+    return result;
+}
+
+// returns the linear value of each 8-bit sRGB value
+const float* srgbToLinearTable()
+{
+    static const std::vector<float> table = [] {
+        std::vector<float> values(256);
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            double c = i / 255.;
+            values[i] = static_cast<float>(
+                c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4)
+            );
+        }
+        return values;
+    }();
+    return table.data();
+}
+
+float linearToSRGB(float c)
+{
+    return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.f / 2.4f) - 0.055f;
+}
+
+uint8_t toUnorm8(float c)
+{
+    return static_cast<uint8_t>(std::clamp(c, 0.f, 1.f) * 255.f + .5f);
+}
+
+#ifdef CT_LIB_SSE2
+
+void boxReduce2x2SSE2(const uint8_t* src, uint8_t* dst, uint32_t w, uint32_t h)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 alphaMask = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+    const __m128 one = _mm_set1_ps(1.f), quarter = _mm_set1_ps(.25f), half = _mm_set1_ps(.5f);
+
+    const size_t stride = static_cast<size_t>(w) * 8;
+    for (uint32_t y = 0; y < h; ++y)
+    {
+        const uint8_t* top = src + stride * y * 2;
+        const uint8_t* bottom = top + stride;
+        for (uint32_t x = 0; x < w; ++x, top += 8, bottom += 8, dst += 4)
+        {
+            __m128i t = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)top), zero);
+            __m128i b = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)bottom), zero);
+            __m128 p0 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(t, zero));
+            __m128 p1 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(t, zero));
+            __m128 p2 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(b, zero));
+            __m128 p3 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(b, zero));
+            __m128 a0 = _mm_shuffle_ps(p0, p0, 0xFF), a1 = _mm_shuffle_ps(p1, p1, 0xFF);
+            __m128 a2 = _mm_shuffle_ps(p2, p2, 0xFF), a3 = _mm_shuffle_ps(p3, p3, 0xFF);
+
+            __m128 sum = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(p0, a0), _mm_mul_ps(p1, a1)),
+                _mm_add_ps(_mm_mul_ps(p2, a2), _mm_mul_ps(p3, a3))
+            );
+            __m128 sumA = _mm_add_ps(_mm_add_ps(a0, a1), _mm_add_ps(a2, a3));
+
+            // alpha is a whole number, so transparent blocks divide 0 by 1
+            __m128 colour = _mm_div_ps(sum, _mm_max_ps(sumA, one));
+            __m128 result = _mm_or_ps(
+                _mm_andnot_ps(alphaMask, colour), _mm_and_ps(alphaMask, _mm_mul_ps(sumA, quarter))
+            );
+
+            __m128i packed = _mm_cvttps_epi32(_mm_add_ps(result, half));
+            packed = _mm_packs_epi32(packed, packed);
+            packed = _mm_packus_epi16(packed, packed);
+            uint32_t pixel = static_cast<uint32_t>(_mm_cvtsi128_si32(packed));
+            std::memcpy(dst, &pixel, 4);
+        }
+    }
+}
+
+#endif // CT_LIB_SSE2
+
+void boxReduce2x2Scalar(const uint8_t* src, uint8_t* dst, uint32_t w, uint32_t h)
+{
+    const size_t stride = static_cast<size_t>(w) * 8;
+    for (uint32_t y = 0; y < h; ++y)
+    {
+        const uint8_t* top = src + stride * y * 2;
+        const uint8_t* bottom = top + stride;
+        for (uint32_t x = 0; x < w; ++x, top += 8, bottom += 8, dst += 4)
+        {
+            const uint8_t* px[4] = {top, top + 4, bottom, bottom + 4};
+            uint32_t sumA = px[0][3] + px[1][3] + px[2][3] + px[3][3];
+            for (uint32_t c = 0; c < 3; ++c)
+            {
+                uint32_t sum = px[0][c] * px[0][3] + px[1][c] * px[1][3]
+                    + px[2][c] * px[2][3] + px[3][c] * px[3][3];
+                dst[c] = sumA == 0 ? 0 : static_cast<uint8_t>((sum + sumA / 2) / sumA);
+            }
+            dst[3] = static_cast<uint8_t>((sumA + 2) / 4);
+        }
+    }
+}
+
+void boxReduce2x2(const uint8_t* src, uint8_t* dst, uint32_t w, uint32_t h, bool simd)
+{
+#ifdef CT_LIB_SSE2
+    if (simd)
+    {
+        boxReduce2x2SSE2(src, dst, w, h);
+        return;
+    }
+#endif // CT_LIB_SSE2
+    boxReduce2x2Scalar(src, dst, w, h);
+}
+
+Image Image::downsample(uint32_t nw, uint32_t nh, MipmapFilter filter, bool gammaCorrect) const
+{
+    Image out(nw, nh);
+    downsample(out, filter, gammaCorrect);
+    return out;
+}
+
+void Image::downsample(Image& out, MipmapFilter filter, bool gammaCorrect) const
+{
+    assertValidOutput(out, "downsample");
+    const uint32_t nw = out.width, nh = out.height;
+    if (nw > width || nh > height)
+    {
+        throw ImageError(Strings::format(
+            "Invalid downsample size! (%dx%d -> %dx%d)", width, height, nw, nh
+        ));
+    }
+
+    if (filter == MipmapFilter::Box && !gammaCorrect && nw * 2 == width && nh * 2 == height)
+    {
+        boxReduce2x2(*buffer, *out, nw, nh, true);
+        return;
+    }
+
+    const float* toLinear = srgbToLinearTable();
+    const uint8_t* src = *buffer;
+
+    // the float buffers are kept per thread, so generating a mipmap chain
+    // only allocates them for its first level
+    thread_local std::vector<float> pixels, rows, row;
+
+    // convert to floats with premultiplied alpha
+    pixels.resize(static_cast<size_t>(width) * height * 4);
+    for (size_t i = 0; i < pixels.size(); i += 4)
+    {
+        float alpha = src[i + 3] / 255.f;
+        for (uint32_t c = 0; c < 3; ++c)
+        {
+            pixels[i + c] = (gammaCorrect ? toLinear[src[i + c]] : src[i + c] / 255.f) * alpha;
+        }
+        pixels[i + 3] = alpha;
+    }
+
+    // horizontal pass
+    ResampleTaps taps = computeResampleTaps(width, nw, filter);
+    rows.assign(static_cast<size_t>(nw) * height * 4, 0.f);
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        const float* in = pixels.data() + static_cast<size_t>(y) * width * 4;
+        float* dstRow = rows.data() + static_cast<size_t>(y) * nw * 4;
+        for (uint32_t x = 0; x < nw; ++x, dstRow += 4)
+        {
+            for (uint32_t t = taps.start[x]; t < taps.start[x + 1]; ++t)
+            {
+                const float* px = in + taps.taps[t].index * 4;
+                float weight = taps.taps[t].weight;
+                for (uint32_t c = 0; c < 4; ++c)
+                {
+                    dstRow[c] += px[c] * weight;
+                }
+            }
+        }
+    }
+
+    // vertical pass
+    taps = computeResampleTaps(height, nh, filter);
+    uint8_t* dst = *out;
+    row.resize(static_cast<size_t>(nw) * 4);
+    for (uint32_t y = 0; y < nh; ++y)
+    {
+        std::fill(row.begin(), row.end(), 0.f);
+        for (uint32_t t = taps.start[y]; t < taps.start[y + 1]; ++t)
+        {
+            const float* in = rows.data() + static_cast<size_t>(taps.taps[t].index) * nw * 4;
+            float weight = taps.taps[t].weight;
+            for (size_t i = 0; i < row.size(); ++i)
+            {
+                row[i] += in[i] * weight;
+            }
+        }
+
+        for (size_t i = 0; i < row.size(); i += 4, dst += 4)
+        {
+            float alpha = std::clamp(row[i + 3], 0.f, 1.f);
+            for (uint32_t c = 0; c < 3; ++c)
+            {
+                float value = alpha > 0.f ? row[i + c] / alpha : 0.f;
+                dst[c] = toUnorm8(gammaCorrect ? linearToSRGB(std::max(value, 0.f)) : value);
+            }
+            dst[3] = toUnorm8(alpha);
+        }
+    }
+}
+
+// returns the count of pixels of each alpha value
+std::vector<size_t> alphaHistogram(const uint8_t* data, size_t count)
+{
+    std::vector<size_t> histogram(256, 0);
+    for (size_t i = 0; i < count; ++i)
+    {
+        ++histogram[data[i * 4 + 3]];
+    }
+    return histogram;
+}
+
+// returns the fraction of pixels with an alpha of at least the reference once
+// scaled by the specified factor
+float scaledAlphaCoverage(const std::vector<size_t>& histogram, float scale, uint8_t reference)
+{
+    size_t covered = 0, total = 0;
+    for (uint32_t a = 0; a < 256; ++a)
+    {
+        total += histogram[a];
+        if (std::min(a * scale + .5f, 255.f) >= reference)
+        {
+            covered += histogram[a];
+        }
+    }
+    return total == 0 ? 0.f : static_cast<float>(covered) / total;
+}
+
+float Image::alphaCoverage(uint8_t reference) const
+{
+    std::vector<size_t> histogram = alphaHistogram(*buffer, static_cast<size_t>(width) * height);
+    return scaledAlphaCoverage(histogram, 1.f, reference);
+}
+
+Image Image::scaleAlphaToCoverage(float coverage, uint8_t reference) const
+{
+    const size_t count = static_cast<size_t>(width) * height;
+    std::vector<size_t> histogram = alphaHistogram(*buffer, count);
+
+    // coverage only grows with the scale, so binary search the scales around
+    // the target, then keep the closest one as coverage moves in steps
+    float low = 0.f, high = 256.f;
+    for (uint32_t i = 0; i < 24; ++i)
+    {
+        float mid = (low + high) / 2;
+        (scaledAlphaCoverage(histogram, mid, reference) < coverage ? low : high) = mid;
+    }
+    float scale = coverage - scaledAlphaCoverage(histogram, low, reference)
+        < scaledAlphaCoverage(histogram, high, reference) - coverage ? low : high;
+
+    Buffer out(count * 4);
+    std::memcpy(*out, *buffer, count * 4);
+    uint8_t* px = *out;
+    for (size_t i = 0; i < count; ++i)
+    {
+        px[i * 4 + 3] = static_cast<uint8_t>(std::min(px[i * 4 + 3] * scale + .5f, 255.f));
+    }
+    return Image(width, height, std::move(out));
+}
+}
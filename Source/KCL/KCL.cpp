@@ -7,6 +7,14 @@
 
 #include <CTLib/KCL.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <numeric>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
 #include <CTLib/Utilities.hpp>
 
 namespace CTLib
@@ -141,7 +149,8 @@ KCL::Octree::Octree(KCL* kcl) :
     shift{0},
     shiftY{0},
     shiftZ{0},
-    nodes{}
+    nodes{},
+    elems{}
 {
 
 }
@@ -245,6 +254,16 @@ std::vector<KCL::OctreeNode*> KCL::Octree::getAllNodes() const
     return nodes;
 }
 
+size_t KCL::Octree::getMemoryUsage() const
+{
+    size_t size = sizeof(Octree) + nodes.capacity() * sizeof(OctreeNode*);
+    for (OctreeNode* node : nodes)
+    {
+        size += sizeof(OctreeNode) + node->indices.capacity() * sizeof(uint16_t);
+    }
+    return size + elems.capacity() * sizeof(Elem);
+}
+
 // calculates the kcl coord mask for the specified value
 uint32_t toMask(float f)
 {
@@ -291,17 +310,153 @@ void KCL::Octree::genRootNodes()
     }
 }
 
-void KCL::Octree::insert(uint16_t idx, const Vector3f& t0, const Vector3f& t1, const Vector3f& t2)
+void KCL::Octree::insert(const Elem& tri)
+{
+    uint32_t lo[3], hi[3];
+    findRootRange(tri, lo, hi);
+    for (uint32_t z = lo[2]; z <= hi[2]; ++z)
+    {
+        for (uint32_t y = lo[1]; y <= hi[1]; ++y)
+        {
+            for (uint32_t x = lo[0]; x <= hi[0]; ++x)
+            {
+                OctreeNode* node = nodes[x | (y << shiftY) | (z << shiftZ)];
+                if (Math::isPartlyInsideAABB(node->bounds, tri.t0, tri.t1, tri.t2))
+                {
+                    node->insert(tri.idx, nodes);
+                }
+            }
+        }
+    }
+}
+
+void KCL::Octree::insert(std::vector<Elem> tris, uint32_t threads)
 {
-    Elem tri = {idx, t0 - minPos, t1 - minPos, t2 - minPos};
+    for (Elem& tri : tris)
+    {
+        tri.t0 = tri.t0 - minPos;
+        tri.t1 = tri.t1 - minPos;
+        tri.t2 = tri.t2 - minPos;
+    }
+    elems = std::move(tris);
 
-    for (uint32_t i = 0; i < getRootNodeCount(); ++i)
+    if (threads == 0)
+    {
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    if (threads == 1)
     {
-        OctreeNode* node = nodes.at(i);
-        if (Math::isPartlyInsideAABB(node->bounds, tri.t0, tri.t1, tri.t2))
+        for (const Elem& tri : elems)
         {
-            node->insert(tri);
+            insert(tri);
         }
+        std::vector<Elem>().swap(elems);
+        return;
+    }
+
+    // root nodes only share their triangles, so once the triangles are sorted
+    // into them in order, each one can be built on its own like the serial
+    // insertion would
+    const uint32_t rootCount = getRootNodeCount();
+    std::vector<std::vector<uint16_t>> rootTris(rootCount);
+    for (const Elem& tri : elems)
+    {
+        uint32_t lo[3], hi[3];
+        findRootRange(tri, lo, hi);
+        for (uint32_t z = lo[2]; z <= hi[2]; ++z)
+        {
+            for (uint32_t y = lo[1]; y <= hi[1]; ++y)
+            {
+                for (uint32_t x = lo[0]; x <= hi[0]; ++x)
+                {
+                    uint32_t root = x | (y << shiftY) | (z << shiftZ);
+                    if (Math::isPartlyInsideAABB(nodes[root]->bounds, tri.t0, tri.t1, tri.t2))
+                    {
+                        rootTris[root].push_back(tri.idx);
+                    }
+                }
+            }
+        }
+    }
+
+    // the busiest root nodes are handed out first to the workers
+    std::vector<uint32_t> order(rootCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return rootTris[a].size() > rootTris[b].size();
+    });
+
+    // each root node gets its own pool, so that the nodes are added to
+    // 'nodes' in the same order whatever thread built them
+    std::vector<std::vector<OctreeNode*>> pools(rootCount);
+    std::exception_ptr error;
+    try
+    {
+        Parallel::forEach(rootCount, threads, [&](size_t i) {
+            uint32_t root = order[i];
+            for (uint16_t idx : rootTris[root])
+            {
+                nodes[root]->insert(idx, pools[root]);
+            }
+            std::vector<uint16_t>().swap(rootTris[root]);
+        });
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
+
+    // the pools are moved to 'nodes' even on error so that they get deleted
+    for (std::vector<OctreeNode*>& pool : pools)
+    {
+        nodes.insert(nodes.end(), pool.begin(), pool.end());
+    }
+    std::vector<Elem>().swap(elems);
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+// returns the root block containing 'coord', clamped to [0, 'count')
+uint32_t clampRootBlock(float coord, float blockSize, uint32_t count)
+{
+    float block = std::floor(coord / blockSize);
+    return block <= 0.f ? 0 : std::min(static_cast<uint32_t>(block), count - 1);
+}
+
+void KCL::Octree::mergeNodes()
+{
+    std::vector<OctreeNode*> removed;
+    for (uint32_t i = 0; i < getRootNodeCount(); ++i)
+    {
+        nodes[i]->merge(removed);
+    }
+
+    std::unordered_set<OctreeNode*> unused(removed.begin(), removed.end());
+    nodes.erase(std::remove_if(nodes.begin(), nodes.end(), [&unused](OctreeNode* node) {
+        return unused.count(node) > 0;
+    }), nodes.end());
+    for (OctreeNode* node : removed)
+    {
+        delete node;
+    }
+}
+
+void KCL::Octree::findRootRange(const Elem& tri, uint32_t lo[3], uint32_t hi[3]) const
+{
+    // only the root nodes whose blown up bounds overlap the bounding box of
+    // the triangle need to be tested; the range is widened by one block on
+    // each side so that rounding cannot exclude a node
+    Vector<uint32_t, 3> size = getSize();
+    float blockSize = static_cast<float>(1 << shift);
+    float blow = KCL::settings.blowFactor;
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+        float min = std::min(tri.t0[i], std::min(tri.t1[i], tri.t2[i])) - blow - blockSize;
+        float max = std::max(tri.t0[i], std::max(tri.t1[i], tri.t2[i])) + blow + blockSize;
+        lo[i] = clampRootBlock(min, blockSize, size[i]);
+        hi[i] = clampRootBlock(max, blockSize, size[i]);
     }
 }
 
@@ -369,7 +524,8 @@ KCL::OctreeNode::OctreeNode(Octree* octree, const Vector<uint32_t, 3>& index) :
     octree{octree},
     bounds{calcAABBRoot(index)},
     superNode{false},
-    elems{}
+    depth{0},
+    indices{}
 {
     for (uint32_t i = 0; i < 8; ++i)
     {
@@ -381,7 +537,8 @@ KCL::OctreeNode::OctreeNode(Octree* octree, OctreeNode* node, const Vector<uint3
     octree{octree},
     bounds{calcAABBChild(node, index)},
     superNode{false},
-    elems{}
+    depth{node->depth + 1},
+    indices{}
 {
     for (uint32_t i = 0; i < 8; ++i)
     {
@@ -401,6 +558,11 @@ bool KCL::OctreeNode::isSuperNode() const
     return superNode;
 }
 
+uint32_t KCL::OctreeNode::getDepth() const
+{
+    return depth;
+}
+
 KCL::OctreeNode* KCL::OctreeNode::getChild(uint8_t index) const
 {
     assertSuperNode();
@@ -436,51 +598,125 @@ AABB KCL::OctreeNode::calcAABBChild(OctreeNode* node, const Vector<uint32_t, 3>&
 
 bool KCL::OctreeNode::canSplit() const
 {
-    // TODO: make minimum block size configurable
+    if (KCL::settings.maxDepth > 0 && depth >= KCL::settings.maxDepth)
+    {
+        return false;
+    }
     Vector3f size = bounds.getSize() - (BLOW_V * 2.f);
-    return size[0] > 512;
+    return size[0] > KCL::settings.minNodeSize;
 }
 
-void KCL::OctreeNode::insert(const Octree::Elem& tri)
+void KCL::OctreeNode::insert(uint16_t idx, std::vector<OctreeNode*>& pool)
 {
     if (superNode)
     {
+        const Octree::Elem& tri = octree->elems[idx];
+        const AABB* bounds[8];
         for (uint32_t i = 0; i < 8; ++i)
         {
-            if (Math::isPartlyInsideAABB(childs[i]->bounds, tri.t0, tri.t1, tri.t2))
+            bounds[i] = &childs[i]->bounds;
+        }
+
+        uint8_t inside = Math::getPartlyInsideAABBs(bounds, 8, tri.t0, tri.t1, tri.t2);
+        for (uint32_t i = 0; i < 8; ++i)
+        {
+            if (inside & (1 << i))
             {
-                childs[i]->insert(tri);
+                childs[i]->insert(idx, pool);
             }
         }
     }
     else
     {
-        elems.push_back(tri);
-        if (canSplit() && elems.size() > KCL::settings.maxTriangles)
+        indices.push_back(idx);
+        if (canSplit() && indices.size() > KCL::settings.maxTriangles)
         {
-            split();
+            split(pool);
         }
     }
 }
 
-void KCL::OctreeNode::split()
+void KCL::OctreeNode::split(std::vector<OctreeNode*>& pool)
 {
     for (uint32_t i = 0; i < 8; ++i)
     {
         Vector<uint32_t, 3> index = {i & 1, (i >> 1) & 1, i >> 2};
         OctreeNode* node = new OctreeNode(octree, this, index);
-        octree->nodes.push_back(node);
+        pool.push_back(node);
         childs[i] = node;
     }
 
     superNode = true;
 
-    for (const Octree::Elem& tri : elems)
+    for (uint16_t idx : indices)
     {
-        insert(tri); // insert logic different when 'superNode' is true
+        insert(idx, pool); // insert logic different when 'superNode' is true
     }
 
-    elems.clear();
+    indices.clear();
+}
+
+// returns the size of a triangle list with 'count' triangles in KCL files
+uint32_t getTriangleListSize(size_t count)
+{
+    return count == 0 ? 0 : static_cast<uint32_t>(count + 1) * 2;
+}
+
+void KCL::OctreeNode::merge(std::vector<OctreeNode*>& removed)
+{
+    if (!superNode)
+    {
+        return;
+    }
+
+    for (uint32_t i = 0; i < 8; ++i)
+    {
+        childs[i]->merge(removed);
+    }
+    for (uint32_t i = 0; i < 8; ++i)
+    {
+        if (childs[i]->superNode)
+        {
+            return;
+        }
+    }
+
+    // the bounds of the children cover the bounds of this node, so the
+    // triangles in this node are the ones in any of its children
+    std::vector<uint16_t> merged;
+    for (uint32_t i = 0; i < 8; ++i)
+    {
+        merged.insert(merged.end(), childs[i]->indices.begin(), childs[i]->indices.end());
+    }
+    std::sort(merged.begin(), merged.end());
+    merged.erase(std::unique(merged.begin(), merged.end()), merged.end());
+
+    // a query tests all triangles in the leaf it ends in, and descending one
+    // more level is counted as one more triangle test
+    float splitTests = 1.f;
+    uint32_t splitSize = 8 * 4;
+    for (uint32_t i = 0; i < 8; ++i)
+    {
+        splitTests += childs[i]->indices.size() / 8.f;
+        splitSize += getTriangleListSize(childs[i]->indices.size());
+    }
+    float leafTests = static_cast<float>(merged.size());
+    uint32_t leafSize = getTriangleListSize(merged.size());
+
+    // queries at random positions end in this node this often
+    float volume = std::ldexp(1.f, -3 * static_cast<int>(depth)) / octree->getRootNodeCount();
+    if ((leafTests - splitTests) * volume > KCL::settings.memoryCost * (splitSize - leafSize))
+    {
+        return;
+    }
+
+    for (uint32_t i = 0; i < 8; ++i)
+    {
+        removed.push_back(childs[i]);
+        childs[i] = nullptr;
+    }
+    superNode = false;
+    indices = std::move(merged);
 }
 
 void KCL::OctreeNode::assertSuperNode() const
@@ -530,15 +766,276 @@ std::vector<uint16_t> KCL::OctreeNode::getIndices() const
 {
     assertNotSuperNode();
 
+    return indices;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+////
+////   KCL FlatOctree class
+////
+
+KCL::FlatOctree::FlatOctree(const Octree& octree) :
+    minPos{octree.minPos},
+    maskX{octree.maskX},
+    maskY{octree.maskY},
+    maskZ{octree.maskZ},
+    shift{octree.shift},
+    shiftY{octree.shiftY},
+    shiftZ{octree.shiftZ},
+    rootCount{octree.nodes.empty() ? 0 : octree.getRootNodeCount()},
+    nodes(octree.nodes.size()),
+    lists{END} // shared empty list
+{
+    // nodes are laid out in the same order as in KCL files: each super node
+    // gets its children block before any of their own children
+    uint32_t next = rootCount;
+    std::vector<std::pair<uint32_t, const OctreeNode*>> leaves;
+    for (uint32_t i = 0; i < rootCount; ++i)
+    {
+        flatten(octree.nodes[i], i, next, leaves);
+    }
+    addTriangleLists(leaves);
+}
+
+Vector3f KCL::FlatOctree::getMinPos() const
+{
+    return minPos;
+}
+
+Vector<uint32_t, 3> KCL::FlatOctree::getMasks() const
+{
+    return {maskX, maskY, maskZ};
+}
+
+uint32_t KCL::FlatOctree::getShift() const
+{
+    return shift;
+}
+
+uint32_t KCL::FlatOctree::getShiftY() const
+{
+    return shiftY;
+}
+
+uint32_t KCL::FlatOctree::getShiftZ() const
+{
+    return shiftZ;
+}
+
+uint32_t KCL::FlatOctree::getRootNodeCount() const
+{
+    return rootCount;
+}
+
+const std::vector<uint32_t>& KCL::FlatOctree::getNodes() const
+{
+    return nodes;
+}
+
+const std::vector<uint16_t>& KCL::FlatOctree::getTriangleLists() const
+{
+    return lists;
+}
+
+bool KCL::FlatOctree::isLeaf(uint32_t index) const
+{
+    assertValidIndex(index);
+    return nodes[index] & LEAF;
+}
+
+uint32_t KCL::FlatOctree::getChild(uint32_t index, uint8_t child) const
+{
+    if (isLeaf(index))
+    {
+        throw KCLError("KCL: The FlatOctree node is a leaf!");
+    }
+    if (child >= 8)
+    {
+        throw KCLError(Strings::format(
+            "KCL: The specified child index is out of range! (%d >= 8)",
+            child
+        ));
+    }
+    return nodes[index] + child;
+}
+
+std::vector<uint16_t> KCL::FlatOctree::getIndices(uint32_t index) const
+{
+    if (!isLeaf(index))
+    {
+        throw KCLError("KCL: The FlatOctree node is not a leaf!");
+    }
+
     std::vector<uint16_t> indices;
-    indices.reserve(elems.size());
-    for (const auto& tri : elems)
+    for (const uint16_t* tri = lists.data() + (nodes[index] & ~LEAF); *tri != END; ++tri)
     {
-        indices.push_back(tri.idx);
+        indices.push_back(*tri);
     }
     return indices;
 }
 
+size_t KCL::FlatOctree::getMemoryUsage() const
+{
+    return sizeof(FlatOctree) + nodes.capacity() * sizeof(uint32_t)
+        + lists.capacity() * sizeof(uint16_t);
+}
+
+KCL::FlatOctree::Stats KCL::FlatOctree::getStats() const
+{
+    Stats stats;
+    for (uint32_t i = 0; i < rootCount; ++i)
+    {
+        addStats(i, 0, 1.f / rootCount, stats);
+    }
+    if (stats.leafCount > stats.emptyLeafCount)
+    {
+        stats.averageTriangles /= stats.leafCount - stats.emptyLeafCount;
+    }
+    stats.size = static_cast<uint32_t>(nodes.size() * 4 + lists.size() * 2);
+    return stats;
+}
+
+void KCL::FlatOctree::flatten(
+    const OctreeNode* node, uint32_t index, uint32_t& next,
+    std::vector<std::pair<uint32_t, const OctreeNode*>>& leaves
+)
+{
+    if (!node->superNode)
+    {
+        nodes[index] = LEAF;
+        if (!node->indices.empty())
+        {
+            leaves.emplace_back(index, node);
+        }
+        return;
+    }
+
+    uint32_t first = next;
+    nodes[index] = first;
+    next += 8;
+    for (uint32_t i = 0; i < 8; ++i)
+    {
+        flatten(node->childs[i], first + i, next, leaves);
+    }
+}
+
+// returns the hash of the triangle list with hash 'hash' once 'idx' is added
+// in front of it
+uint64_t hashTriangleList(uint64_t hash, uint16_t idx)
+{
+    return (hash ^ idx) * 0x100000001B3ULL;
+}
+
+void KCL::FlatOctree::addTriangleLists(
+    std::vector<std::pair<uint32_t, const OctreeNode*>>& leaves
+)
+{
+    // longer lists go first, so that shorter ones can be found at their end
+    std::stable_sort(leaves.begin(), leaves.end(), [](const auto& a, const auto& b) {
+        return a.second->indices.size() > b.second->indices.size();
+    });
+
+    // offsets of all stored lists and of their suffixes, by hash
+    std::unordered_multimap<uint64_t, uint32_t> stored;
+    std::vector<uint64_t> hashes;
+    for (const auto& leaf : leaves)
+    {
+        const std::vector<uint16_t>& indices = leaf.second->indices;
+        const uint32_t count = static_cast<uint32_t>(indices.size());
+
+        // hashes[i] is the hash of the list starting at element 'i'
+        hashes.resize(count + 1);
+        hashes[count] = 0xCBF29CE484222325ULL;
+        for (uint32_t i = count; i-- > 0;)
+        {
+            hashes[i] = hashTriangleList(hashes[i + 1], indices[i]);
+        }
+
+        bool found = false;
+        auto range = stored.equal_range(hashes[0]);
+        for (auto it = range.first; it != range.second && !found; ++it)
+        {
+            const uint16_t* list = lists.data() + it->second;
+            found = list[count] == END;
+            for (uint32_t i = 0; i < count && found; ++i)
+            {
+                found = list[i] == indices[i];
+            }
+            if (found)
+            {
+                nodes[leaf.first] |= it->second;
+            }
+        }
+        if (found)
+        {
+            continue;
+        }
+
+        const uint32_t offset = static_cast<uint32_t>(lists.size());
+        nodes[leaf.first] |= offset;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            lists.push_back(indices[i]);
+            stored.emplace(hashes[i], offset + i);
+        }
+        lists.push_back(END);
+    }
+}
+
+void KCL::FlatOctree::addStats(uint32_t index, uint32_t depth, float volume, Stats& stats) const
+{
+    if (stats.nodesPerDepth.size() <= depth)
+    {
+        stats.nodesPerDepth.resize(depth + 1);
+        stats.leavesPerDepth.resize(depth + 1);
+    }
+    ++stats.nodesPerDepth[depth];
+
+    if (!(nodes[index] & LEAF))
+    {
+        ++stats.superNodeCount;
+        for (uint32_t i = 0; i < 8; ++i)
+        {
+            addStats(nodes[index] + i, depth + 1, volume / 8.f, stats);
+        }
+        return;
+    }
+
+    ++stats.leafCount;
+    ++stats.leavesPerDepth[depth];
+
+    uint32_t count = 0;
+    for (const uint16_t* tri = lists.data() + (nodes[index] & ~LEAF); *tri != END; ++tri)
+    {
+        ++count;
+    }
+    if (count == 0)
+    {
+        ++stats.emptyLeafCount;
+    }
+    if (stats.leavesPerTriangleCount.size() <= count)
+    {
+        stats.leavesPerTriangleCount.resize(count + 1);
+    }
+    ++stats.leavesPerTriangleCount[count];
+    stats.maxTriangles = std::max(stats.maxTriangles, count);
+    stats.averageTriangles += count; // divided once all leaves are added
+    stats.averageQueryTriangles += count * volume;
+}
+
+void KCL::FlatOctree::assertValidIndex(uint32_t index) const
+{
+    if (index >= nodes.size())
+    {
+        throw KCLError(Strings::format(
+            "KCL: The specified node index is out of range! (%d >= %d)",
+            index, nodes.size()
+        ));
+    }
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
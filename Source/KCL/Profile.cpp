@@ -0,0 +1,129 @@
+//////////////////////////////////////////////////
+//  Copyright (c) 2020 Nara Hiero
+//
+// This file is licensed under GPLv3+
+// Refer to the `License.txt` file included.
+//////////////////////////////////////////////////
+
+#include <CTLib/KCL.hpp>
+
+#include <algorithm>
+
+namespace CTLib
+{
+
+// appends the leaf at 'index' of 'octree', or the leaves below it, to 'cells';
+// 'cellOf' is set to the index in 'cells' of each leaf
+void addProfileCells(
+    const KCL::FlatOctree& octree, uint32_t index, uint32_t depth, const Vector3f& min,
+    float size, std::vector<KCL::Profile::Cell>& cells, std::vector<uint32_t>& cellOf
+)
+{
+    uint32_t value = octree.getNodes()[index];
+    if (!(value & KCL::FlatOctree::LEAF))
+    {
+        float half = size / 2.f;
+        for (uint32_t i = 0; i < 8; ++i)
+        {
+            Vector3f childMin = {
+                min[0] + (i & 1 ? half : 0.f),
+                min[1] + (i & 2 ? half : 0.f),
+                min[2] + (i & 4 ? half : 0.f)
+            };
+            addProfileCells(octree, value + i, depth + 1, childMin, half, cells, cellOf);
+        }
+        return;
+    }
+
+    KCL::Profile::Cell cell;
+    cell.node = index;
+    cell.depth = depth;
+    cell.min = min;
+    cell.size = size;
+    const uint16_t* tri = octree.getTriangleLists().data() + (value & ~KCL::FlatOctree::LEAF);
+    for (; *tri != KCL::FlatOctree::END; ++tri)
+    {
+        ++cell.triangles;
+    }
+
+    cellOf[index] = static_cast<uint32_t>(cells.size());
+    cells.push_back(cell);
+}
+
+KCL::Profile KCL::profile(
+    const KCL& kcl, const std::vector<Vector3f>& samples, uint32_t worstCellCount
+)
+{
+    Query query(kcl);
+    const FlatOctree& octree = query.getOctree();
+
+    Profile profile;
+    profile.stats = octree.getStats();
+
+    // same layout as written by KCL::write
+    Profile::Sizes& sizes = profile.sizes;
+    sizes.header = 0x3C;
+    sizes.vertices = static_cast<uint32_t>(kcl.vertices.size()) * 0xC;
+    sizes.normals = static_cast<uint32_t>(kcl.normals.size()) * 0xC;
+    sizes.triangles = static_cast<uint32_t>(kcl.triangles.size()) * 0x10;
+    sizes.octreeNodes = static_cast<uint32_t>(octree.getNodes().size()) * 4;
+    sizes.triangleLists = static_cast<uint32_t>(octree.getTriangleLists().size()) * 2;
+    sizes.total = sizes.header + sizes.vertices + sizes.normals + sizes.triangles
+        + sizes.octreeNodes + sizes.triangleLists;
+
+    std::vector<Profile::Cell> cells;
+    std::vector<uint32_t> cellOf(octree.getNodes().size());
+    const uint32_t maskY = (1 << (octree.getShiftZ() - octree.getShiftY())) - 1;
+    const float rootSize = static_cast<float>(1 << octree.getShift());
+    for (uint32_t i = 0; i < octree.getRootNodeCount(); ++i)
+    {
+        uint32_t x = i & ((1 << octree.getShiftY()) - 1);
+        uint32_t y = (i >> octree.getShiftY()) & maskY;
+        uint32_t z = i >> octree.getShiftZ();
+        Vector3f min = octree.getMinPos() + Vector3f(x * rootSize, y * rootSize, z * rootSize);
+        addProfileCells(octree, i, 0, min, rootSize, cells, cellOf);
+    }
+
+    uint64_t tests = 0;
+    profile.sampleCount = static_cast<uint32_t>(samples.size());
+    for (const Vector3f& sample : samples)
+    {
+        uint32_t leaf = query.findLeaf(sample);
+        if (leaf == Query::NO_LEAF)
+        {
+            ++profile.outsideSampleCount;
+            continue;
+        }
+
+        Profile::Cell& cell = cells[cellOf[leaf]];
+        ++cell.samples;
+        tests += cell.triangles;
+        profile.maxTests = std::max(profile.maxTests, cell.triangles);
+    }
+    if (profile.sampleCount > profile.outsideSampleCount)
+    {
+        profile.averageTests = static_cast<float>(tests)
+            / (profile.sampleCount - profile.outsideSampleCount);
+    }
+
+    size_t count = std::min<size_t>(worstCellCount, cells.size());
+    std::partial_sort(cells.begin(), cells.begin() + count, cells.end(),
+        [](const Profile::Cell& a, const Profile::Cell& b) {
+            uint64_t testsA = static_cast<uint64_t>(a.triangles) * a.samples;
+            uint64_t testsB = static_cast<uint64_t>(b.triangles) * b.samples;
+            if (testsA != testsB)
+            {
+                return testsA > testsB;
+            }
+            if (a.triangles != b.triangles)
+            {
+                return a.triangles > b.triangles;
+            }
+            return a.node < b.node;
+        }
+    );
+    profile.worstCells.assign(cells.begin(), cells.begin() + count);
+
+    return profile;
+}
+}
@@ -0,0 +1,456 @@
+//////////////////////////////////////////////////
+//  Copyright (c) 2020 Nara Hiero
+//
+// This file is licensed under GPLv3+
+// Refer to the `License.txt` file included.
+//////////////////////////////////////////////////
+
+#include <CTLib/KCL.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <CTLib/Utilities.hpp>
+
+namespace CTLib
+{
+
+// count of queries handed to a thread at once in batch queries
+constexpr size_t QUERY_CHUNK = 256;
+
+// runs 'query' for every index in [0, count) on the specified count of threads
+template <class Func>
+void runQueries(size_t count, uint32_t threads, Func query)
+{
+    Parallel::forChunks(count, threads, QUERY_CHUNK, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            query(i);
+        }
+    });
+}
+
+// returns the point of triangle 'abc' closest to 'p' (Ericson, Real-Time
+// Collision Detection, 5.1.5)
+Vector3f closestPointOnTriangle(
+    const Vector3f& p, const Vector3f& a, const Vector3f& b, const Vector3f& c
+)
+{
+    Vector3f ab = b - a, ac = c - a, ap = p - a;
+    float d1 = Vector3f::dot(ab, ap), d2 = Vector3f::dot(ac, ap);
+    if (d1 <= 0.f && d2 <= 0.f)
+    {
+        return a;
+    }
+
+    Vector3f bp = p - b;
+    float d3 = Vector3f::dot(ab, bp), d4 = Vector3f::dot(ac, bp);
+    if (d3 >= 0.f && d4 <= d3)
+    {
+        return b;
+    }
+
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.f && d1 >= 0.f && d3 <= 0.f)
+    {
+        return a + ab * (d1 / (d1 - d3));
+    }
+
+    Vector3f cp = p - c;
+    float d5 = Vector3f::dot(ab, cp), d6 = Vector3f::dot(ac, cp);
+    if (d6 >= 0.f && d5 <= d6)
+    {
+        return c;
+    }
+
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.f && d2 >= 0.f && d6 <= 0.f)
+    {
+        return a + ac * (d2 / (d2 - d6));
+    }
+
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.f && (d4 - d3) >= 0.f && (d5 - d6) >= 0.f)
+    {
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+    }
+
+    float denom = 1.f / (va + vb + vc);
+    return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+// returns the distance along 'dir' from 'origin' to front-facing triangle
+// 'abc', or a negative value if it is missed (Moller-Trumbore)
+float intersectRayTriangle(
+    const Vector3f& origin, const Vector3f& dir,
+    const Vector3f& a, const Vector3f& b, const Vector3f& c
+)
+{
+    Vector3f e1 = b - a, e2 = c - a;
+    Vector3f pvec = Vector3f::cross(dir, e2);
+    float det = Vector3f::dot(e1, pvec);
+    if (det <= 1e-12f) // parallel or back-facing
+    {
+        return -1.f;
+    }
+
+    Vector3f tvec = origin - a;
+    float u = Vector3f::dot(tvec, pvec);
+    if (u < 0.f || u > det)
+    {
+        return -1.f;
+    }
+
+    Vector3f qvec = Vector3f::cross(tvec, e1);
+    float v = Vector3f::dot(dir, qvec);
+    if (v < 0.f || u + v > det)
+    {
+        return -1.f;
+    }
+
+    return Vector3f::dot(e2, qvec) / det;
+}
+
+// clips the ray to the box [0, extent]; returns false if it misses the box
+bool clipRay(
+    const Vector3f& origin, const Vector3f& dir, const Vector3f& extent, float& enter, float& exit
+)
+{
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+        if (dir[i] == 0.f)
+        {
+            if (origin[i] < 0.f || origin[i] > extent[i])
+            {
+                return false;
+            }
+            continue;
+        }
+        float t0 = -origin[i] / dir[i], t1 = (extent[i] - origin[i]) / dir[i];
+        enter = std::max(enter, std::min(t0, t1));
+        exit = std::min(exit, std::max(t0, t1));
+    }
+    return enter <= exit;
+}
+
+KCL::Query::Query(const KCL& kcl) :
+    kcl{&kcl},
+    octree{*kcl.octree},
+    extent{},
+    vertices{}
+{
+    if (kcl.triangles.size() > 0xFFFF)
+    {
+        throw KCLError(Strings::format(
+            "KCL: Too many triangles to query! (%d > 65535)",
+            static_cast<uint32_t>(kcl.triangles.size())
+        ));
+    }
+
+    extent = {
+        static_cast<float>(~octree.maskX) + 1.f,
+        static_cast<float>(~octree.maskY) + 1.f,
+        static_cast<float>(~octree.maskZ) + 1.f
+    };
+
+    vertices.reserve(kcl.triangles.size() * 3);
+    for (size_t i = 0; i < kcl.triangles.size(); ++i)
+    {
+        Octree::Elem elem = kcl.octree->toElem(static_cast<uint16_t>(i));
+        vertices.push_back(elem.t0);
+        vertices.push_back(elem.t1);
+        vertices.push_back(elem.t2);
+    }
+}
+
+bool KCL::Query::locate(const Vector3f& rel, Cell& cell) const
+{
+    if (octree.nodes.empty() || rel[0] < 0.f || rel[1] < 0.f || rel[2] < 0.f)
+    {
+        return false;
+    }
+
+    uint32_t x = static_cast<uint32_t>(rel[0]);
+    uint32_t y = static_cast<uint32_t>(rel[1]);
+    uint32_t z = static_cast<uint32_t>(rel[2]);
+    if ((x & octree.maskX) || (y & octree.maskY) || (z & octree.maskZ))
+    {
+        return false;
+    }
+
+    uint32_t shift = octree.shift;
+    uint32_t node = ((z >> shift) << octree.shiftZ) | ((y >> shift) << octree.shiftY)
+        | (x >> shift);
+    while (!(octree.nodes[node] & FlatOctree::LEAF))
+    {
+        --shift;
+        node = octree.nodes[node]
+            + (((x >> shift) & 1) | (((y >> shift) & 1) << 1) | (((z >> shift) & 1) << 2));
+    }
+
+    cell.node = node;
+    cell.min = {
+        static_cast<float>((x >> shift) << shift),
+        static_cast<float>((y >> shift) << shift),
+        static_cast<float>((z >> shift) << shift)
+    };
+    cell.size = static_cast<float>(1u << shift);
+    return true;
+}
+
+void KCL::Query::collectLeaves(
+    const Vector3f& min, const Vector3f& max, std::vector<Cell>& out
+) const
+{
+    if (octree.nodes.empty())
+    {
+        return;
+    }
+
+    uint32_t lo[3], hi[3];
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+        if (max[i] < 0.f || min[i] >= extent[i])
+        {
+            return;
+        }
+        lo[i] = static_cast<uint32_t>(std::max(min[i], 0.f)) >> octree.shift;
+        hi[i] = static_cast<uint32_t>(std::min(max[i], extent[i] - 1.f)) >> octree.shift;
+    }
+
+    const float rootSize = static_cast<float>(1u << octree.shift);
+    std::vector<Cell> stack;
+    for (uint32_t z = lo[2]; z <= hi[2]; ++z)
+    {
+        for (uint32_t y = lo[1]; y <= hi[1]; ++y)
+        {
+            for (uint32_t x = lo[0]; x <= hi[0]; ++x)
+            {
+                uint32_t root = (z << octree.shiftZ) | (y << octree.shiftY) | x;
+                stack.push_back({root, {x * rootSize, y * rootSize, z * rootSize}, rootSize});
+            }
+        }
+    }
+
+    while (!stack.empty())
+    {
+        Cell cell = stack.back();
+        stack.pop_back();
+        uint32_t value = octree.nodes[cell.node];
+        if (value & FlatOctree::LEAF)
+        {
+            out.push_back(cell);
+            continue;
+        }
+
+        float half = cell.size / 2.f;
+        for (uint32_t i = 0; i < 8; ++i)
+        {
+            Vector3f childMin = {
+                cell.min[0] + half * (i & 1),
+                cell.min[1] + half * ((i >> 1) & 1),
+                cell.min[2] + half * (i >> 2)
+            };
+            bool overlaps = true;
+            for (uint32_t a = 0; a < 3; ++a)
+            {
+                overlaps &= max[a] >= childMin[a] && min[a] <= childMin[a] + half;
+            }
+            if (overlaps)
+            {
+                stack.push_back({value + i, childMin, half});
+            }
+        }
+    }
+}
+
+std::vector<uint16_t> KCL::Query::collectTriangles(const Vector3f& min, const Vector3f& max) const
+{
+    std::vector<Cell> cells;
+    collectLeaves(min, max, cells);
+
+    std::vector<uint16_t> tris;
+    for (const Cell& cell : cells)
+    {
+        for (const uint16_t* tri = leafTriangles(cell.node); *tri != FlatOctree::END; ++tri)
+        {
+            tris.push_back(*tri);
+        }
+    }
+    std::sort(tris.begin(), tris.end());
+    tris.erase(std::unique(tris.begin(), tris.end()), tris.end());
+    return tris;
+}
+
+const uint16_t* KCL::Query::leafTriangles(uint32_t node) const
+{
+    return octree.lists.data() + (octree.nodes[node] & ~FlatOctree::LEAF);
+}
+
+void KCL::Query::fillHit(Hit& hit, uint16_t tri, const Vector3f& point, float distance) const
+{
+    const Triangle& t = kcl->triangles[tri];
+    hit.triangle = tri;
+    hit.flag = t.flag;
+    hit.distance = distance;
+    hit.position = point;
+    hit.normal = kcl->normals[t.direction];
+}
+
+const KCL::FlatOctree& KCL::Query::getOctree() const
+{
+    return octree;
+}
+
+uint32_t KCL::Query::findLeaf(const Vector3f& point) const
+{
+    Cell cell;
+    return locate(point - octree.minPos, cell) ? cell.node : NO_LEAF;
+}
+
+std::vector<uint16_t> KCL::Query::findTriangles(const Vector3f& centre, float radius) const
+{
+    Vector3f rel = centre - octree.minPos, r = {radius, radius, radius};
+
+    std::vector<uint16_t> result;
+    for (uint16_t tri : collectTriangles(rel - r, rel + r))
+    {
+        const Vector3f* v = vertices.data() + tri * 3;
+        Vector3f closest = closestPointOnTriangle(centre, v[0], v[1], v[2]);
+        if ((closest - centre).lengthSquared() <= radius * radius)
+        {
+            result.push_back(tri);
+        }
+    }
+    return result;
+}
+
+KCL::Query::Hit KCL::Query::raycast(
+    const Vector3f& origin, const Vector3f& direction, float maxDistance
+) const
+{
+    Hit best;
+    if (direction.lengthSquared() == 0.f)
+    {
+        return best;
+    }
+    Vector3f dir = Vector3f::unit(direction);
+    Vector3f rel = origin - octree.minPos;
+
+    float t = 0.f, end = maxDistance;
+    if (!clipRay(rel, dir, extent, t, end))
+    {
+        return best;
+    }
+
+    float bestT = std::numeric_limits<float>::max();
+    while (t <= end)
+    {
+        // points on the far faces of the octree are moved back inside it
+        Vector3f p = rel + dir * t;
+        for (uint32_t i = 0; i < 3; ++i)
+        {
+            p[i] = std::min(std::max(p[i], 0.f), std::nextafter(extent[i], 0.f));
+        }
+
+        Cell cell;
+        if (!locate(p, cell))
+        {
+            break;
+        }
+
+        for (const uint16_t* tri = leafTriangles(cell.node); *tri != FlatOctree::END; ++tri)
+        {
+            const Vector3f* v = vertices.data() + *tri * 3;
+            float hitT = intersectRayTriangle(origin, dir, v[0], v[1], v[2]);
+            if (hitT >= 0.f && hitT <= maxDistance && hitT < bestT)
+            {
+                bestT = hitT;
+                fillHit(best, *tri, origin + dir * hitT, hitT);
+            }
+        }
+
+        // distance at which the ray leaves the cell
+        float exit = end;
+        for (uint32_t i = 0; i < 3; ++i)
+        {
+            if (dir[i] != 0.f)
+            {
+                float bound = cell.min[i] + (dir[i] > 0.f ? cell.size : 0.f);
+                exit = std::min(exit, (bound - rel[i]) / dir[i]);
+            }
+        }
+
+        // hits in later cells cannot be closer than one inside this cell
+        if (bestT <= exit)
+        {
+            break;
+        }
+        // the step is at least one float spacing of 't', or far rays would
+        // stop moving at cell boundaries
+        t = std::max(exit, t);
+        t += std::max(cell.size * 1e-4f, t * std::numeric_limits<float>::epsilon());
+    }
+
+    return best;
+}
+
+KCL::Query::Hit KCL::Query::findClosest(const Vector3f& point, float maxDistance) const
+{
+    Vector3f rel = point - octree.minPos, r = {maxDistance, maxDistance, maxDistance};
+
+    Hit best;
+    float bestSq = maxDistance * maxDistance;
+    for (uint16_t tri : collectTriangles(rel - r, rel + r))
+    {
+        const Vector3f* v = vertices.data() + tri * 3;
+        Vector3f closest = closestPointOnTriangle(point, v[0], v[1], v[2]);
+        float distSq = (closest - point).lengthSquared();
+        if (distSq <= bestSq)
+        {
+            bestSq = distSq;
+            fillHit(best, tri, closest, std::sqrt(distSq));
+        }
+    }
+    return best;
+}
+
+KCL::Query::Hit KCL::Query::findGround(const Vector3f& position, float maxDistance) const
+{
+    return raycast(position, {0.f, -1.f, 0.f}, maxDistance);
+}
+
+std::vector<KCL::Query::Hit> KCL::Query::raycast(
+    const std::vector<Ray>& rays, uint32_t threads
+) const
+{
+    std::vector<Hit> hits(rays.size());
+    runQueries(rays.size(), threads, [&](size_t i) {
+        hits[i] = raycast(rays[i].origin, rays[i].direction, rays[i].maxDistance);
+    });
+    return hits;
+}
+
+std::vector<KCL::Query::Hit> KCL::Query::findClosest(
+    const std::vector<Vector3f>& points, float maxDistance, uint32_t threads
+) const
+{
+    std::vector<Hit> hits(points.size());
+    runQueries(points.size(), threads, [&](size_t i) {
+        hits[i] = findClosest(points[i], maxDistance);
+    });
+    return hits;
+}
+
+std::vector<KCL::Query::Hit> KCL::Query::findGround(
+    const std::vector<Vector3f>& positions, float maxDistance, uint32_t threads
+) const
+{
+    std::vector<Hit> hits(positions.size());
+    runQueries(positions.size(), threads, [&](size_t i) {
+        hits[i] = findGround(positions[i], maxDistance);
+    });
+    return hits;
+}
+}
@@ -195,45 +195,74 @@ std::vector<KCL::Triangle> readKCLTriangles(Buffer& data, KCLHeader* header)
 void KCL::readOctree(Buffer& buffer, KCL::Octree* octree)
 {
     Buffer data = buffer.slice();
+    const KCL* kcl = octree->kcl;
+
+    // a triangle is usually in many leaves, but only needs to be checked once
+    std::vector<bool> checked(kcl->triangles.size());
+
+    // nodes left to read, with the offset of their value and of the group of
+    // nodes they are in, to which the offsets in their value are relative
+    struct PendingNode
+    {
+        OctreeNode* node;
+        uint32_t pos, group;
+    };
+    std::vector<PendingNode> pending;
 
     try
     {
         octree->genRootNodes();
-        for (uint32_t i = 0; i < octree->getRootNodeCount(); ++i)
+
+        // nodes are taken from the back, so they are pushed in reverse order
+        // to be read (and split) in the same order as they are in the file
+        for (uint32_t i = octree->getRootNodeCount(); i-- > 0;)
         {
-            readOctreeNode(data, octree->getNode(i), 0);
+            pending.push_back({octree->nodes[i], i * 4, 0});
         }
-    }
-    catch (const BufferError&)
-    {
-        throw KCLError("KCL: Invalid octree data!");
-    }
-}
 
-void KCL::readOctreeNode(Buffer& data, KCL::OctreeNode* node, uint32_t pos)
-{
-    uint32_t nv = data.getInt();
-    if (nv >> 31) // triangle list node
-    {
-        Buffer triData = data.duplicate();
-        triData.position(pos + (nv & 0x7FFFFFFF) + 2);
-
-        uint16_t idx;
-        while ((idx = triData.getShort()) != 0)
+        while (!pending.empty())
         {
-            node->elems.push_back(node->octree->toElem(idx - 1));
+            PendingNode next = pending.back();
+            pending.pop_back();
+
+            uint32_t nv = data.getInt(next.pos);
+            if (nv >> 31) // triangle list node
+            {
+                uint32_t pos = next.group + (nv & 0x7FFFFFFF) + 2;
+
+                uint16_t idx;
+                for (; (idx = data.getShort(pos)) != 0; pos += 2)
+                {
+                    kcl->assertValidTriangleIndex(idx - 1);
+                    if (!checked[idx - 1])
+                    {
+                        kcl->assertValidTriangle(kcl->triangles[idx - 1]);
+                        checked[idx - 1] = true;
+                    }
+                    next.node->indices.push_back(idx - 1);
+                }
+            }
+            else // super node
+            {
+                // children always come after their parent, which also keeps
+                // invalid data from looping forever
+                uint32_t group = next.group + nv;
+                if (group <= next.pos)
+                {
+                    throw KCLError("KCL: Invalid octree data!");
+                }
+
+                next.node->split(octree->nodes);
+                for (uint32_t i = 8; i-- > 0;)
+                {
+                    pending.push_back({next.node->childs[i], group + i * 4, group});
+                }
+            }
         }
     }
-    else // super node
+    catch (const BufferError&)
     {
-        Buffer nodeData = data.duplicate();
-        nodeData.position(pos + nv);
-
-        node->split();
-        for (uint8_t i = 0; i < 8; ++i)
-        {
-            readOctreeNode(nodeData, node->getChild(i), pos + nv);
-        }
+        throw KCLError("KCL: Invalid octree data!");
     }
 }
 
@@ -7,9 +7,10 @@
 
 #include <CTLib/KCL.hpp>
 
+#include <cmath>
+#include <cstring>
 #include <limits>
-#include <map>
-#include <set>
+#include <unordered_map>
 
 #include <CTLib/Utilities.hpp>
 
@@ -23,22 +24,55 @@ struct Tri
     Vector3f t0, t1, t2;
 };
 
-bool less(const Vector3f& lhs, const Vector3f& rhs);
-using Less = decltype(&less);
+// the bit patterns of a vector, or its quantised components
+struct VectorKey
+{
+    uint32_t x, y, z;
 
-Vector3f min(const Vector3f& a, const Vector3f& b);
-Vector3f max(const Vector3f& a, const Vector3f& b);
+    bool operator==(const VectorKey& other) const
+    {
+        return x == other.x && y == other.y && z == other.z;
+    }
+};
+
+struct VectorKeyHash
+{
+    size_t operator()(const VectorKey& key) const
+    {
+        return (key.x * 73856093u) ^ (key.y * 19349663u) ^ (key.z * 83492791u);
+    }
+};
 
-uint16_t insert(std::map<Vector3f, uint16_t, Less>& m, const Vector3f& v)
+// vectors in the order they are first inserted, with their indices
+struct VectorTable
 {
-    return (*(m.insert({v, static_cast<uint16_t>(m.size())}).first)).second;
+    std::unordered_map<VectorKey, uint16_t, VectorKeyHash> indices;
+    std::vector<Vector3f> values;
+
+    // 0 to only merge identical vectors
+    float epsilon;
+};
+
+VectorKey toKey(const Vector3f& v, float epsilon);
+
+uint16_t insert(VectorTable& table, const Vector3f& v)
+{
+    auto result = table.indices.insert(
+        {toKey(v, table.epsilon), static_cast<uint16_t>(table.values.size())}
+    );
+    if (result.second)
+    {
+        table.values.push_back(v);
+    }
+    return result.first->second;
 }
 
-bool ignoreTriangle(const Tri& t);
+Vector3f min(const Vector3f& a, const Vector3f& b);
+Vector3f max(const Vector3f& a, const Vector3f& b);
 
-std::vector<Vector3f> toStdVector(const std::map<Vector3f, uint16_t, Less>& m);
+bool ignoreTriangle(const Tri& t);
 
-KCL KCL::fromModel(Buffer& vertices, Buffer& flags, int32_t count)
+KCL KCL::fromModel(Buffer& vertices, Buffer& flags, int32_t count, uint32_t threads)
 {
     count = count < 0 ? static_cast<int32_t>(vertices.remaining() / 36) : count;
     assertRemaining(vertices, flags, count);
@@ -52,8 +86,10 @@ KCL KCL::fromModel(Buffer& vertices, Buffer& flags, int32_t count)
     constexpr float MAX = std::numeric_limits<float>::max();
     Vector3f minPos{MAX, MAX, MAX}, maxPos{MIN, MIN, MIN};
 
-    std::map<Vector3f, uint16_t, Less> vMap(&less);
-    std::map<Vector3f, uint16_t, Less> nMap(&less);
+    VectorTable vTable{{}, {}, 0.f};
+    VectorTable nTable{{}, {}, KCL::settings.normalEpsilon};
+    vTable.indices.reserve(count * 2);
+    nTable.indices.reserve(count * 2);
     std::vector<Triangle> triangles;
     std::vector<Tri> tris;
     for (int32_t i = 0; i < count; ++i)
@@ -80,30 +116,53 @@ KCL KCL::fromModel(Buffer& vertices, Buffer& flags, int32_t count)
 
         Triangle tri;
         tri.length = len;
-        tri.position = insert(vMap, t0);
-        tri.direction = insert(nMap, dir);
-        tri.normA = insert(nMap, normA);
-        tri.normB = insert(nMap, normB);
-        tri.normC = insert(nMap, normC);
+        tri.position = insert(vTable, t0);
+        tri.direction = insert(nTable, dir);
+        tri.normA = insert(nTable, normA);
+        tri.normB = insert(nTable, normB);
+        tri.normC = insert(nTable, normC);
         tri.flag = flags.getShort();
 
         triangles.push_back(tri);
         tris.push_back(t);
     }
 
+    // triangles are referenced by 16 bit indices, 0xFFFF ending the lists
+    // of flattened octrees, and so are vertices and normals
+    if (triangles.size() > 0xFFFF)
+    {
+        throw KCLError(Strings::format(
+            "KCL: Too many triangles! (%d > 65535)", static_cast<uint32_t>(triangles.size())
+        ));
+    }
+    if (vTable.values.size() > 0x10000 || nTable.values.size() > 0x10000)
+    {
+        throw KCLError(Strings::format(
+            "KCL: Too many vertices or normals! (%d vertices, %d normals, max 65536)",
+            static_cast<uint32_t>(vTable.values.size()), static_cast<uint32_t>(nTable.values.size())
+        ));
+    }
+
     KCL kcl;
-    kcl.vertices = toStdVector(vMap);
-    kcl.normals = toStdVector(nMap);
+    kcl.vertices = std::move(vTable.values);
+    kcl.normals = std::move(nTable.values);
     kcl.triangles = triangles;
 
     kcl.octree->setBounds(minPos, maxPos);
     kcl.octree->calculateShifts();
     kcl.octree->genRootNodes();
 
-    for (uint16_t i = 0; i < tris.size(); ++i)
+    std::vector<Octree::Elem> elems;
+    elems.reserve(tris.size());
+    for (size_t i = 0; i < tris.size(); ++i)
+    {
+        const Tri& t = tris[i];
+        elems.push_back({static_cast<uint16_t>(i), t.t0, t.t1, t.t2});
+    }
+    kcl.octree->insert(std::move(elems), threads);
+    if (KCL::settings.memoryCost > 0.f)
     {
-        Tri t = tris[i];
-        kcl.octree->insert(i, t.t0, t.t1, t.t2);
+        kcl.octree->mergeNodes();
     }
 
     return kcl;
@@ -127,28 +186,22 @@ void assertRemaining(Buffer& vertices, Buffer& flags, int32_t count)
     }
 }
 
-bool less(const Vector3f& lhs, const Vector3f& rhs)
+VectorKey toKey(const Vector3f& v, float epsilon)
 {
-    if (lhs.lengthSquared() < rhs.lengthSquared())
-    {
-        return true;
-    }
-    else if (lhs.lengthSquared() > rhs.lengthSquared())
-    {
-        return false;
-    }
+    uint32_t bits[3];
     for (uint32_t i = 0; i < 3; ++i)
     {
-        if (lhs[i] < rhs[i])
+        if (epsilon > 0.f)
         {
-            return true;
+            bits[i] = static_cast<uint32_t>(static_cast<int32_t>(std::lround(v[i] / epsilon)));
         }
-        else if (lhs[i] > rhs[i])
+        else
         {
-            return false;
+            float f = v[i] + 0.f; // -0.0 and 0.0 are the same value
+            std::memcpy(bits + i, &f, 4);
         }
     }
-    return false;
+    return {bits[0], bits[1], bits[2]};
 }
 
 Vector3f min(const Vector3f& a, const Vector3f& b)
@@ -186,15 +239,4 @@ bool ignoreTriangle(const Tri& t)
 
     return false;
 }
-
-std::vector<Vector3f> toStdVector(const std::map<Vector3f, uint16_t, Less>& m)
-{
-    std::vector<Vector3f> v;
-    v.resize(m.size());
-    for (const auto& p : m)
-    {
-        v[p.second] = p.first;
-    }
-    return v;
-}
 }
@@ -7,7 +7,6 @@
 
 #include <CTLib/KCL.hpp>
 
-#include <map>
 #include <vector>
 
 namespace CTLib
@@ -31,34 +30,13 @@ struct KCLOffsets
     // offsets to sections
     std::vector<uint32_t> sectionOffs;
 
-    // offsets to octree nodes relative to octree section start
-    std::map<KCL::OctreeNode*, uint32_t> nodeOffs;
-
     // offset of octree triangle lists
     uint32_t triListOff;
 };
 
-uint32_t calcNodeSizeAndOffsets(KCL::OctreeNode* node, uint32_t& pos, KCLOffsets* offsets)
-{
-    if (node->isSuperNode())
-    {
-        offsets->nodeOffs.insert(std::map<KCL::OctreeNode*, uint32_t>::value_type(node, pos));
-        pos += 0x20;
-
-        uint32_t size = 0;
-        for (uint32_t i = 0; i < 8; ++i)
-        {
-            size += calcNodeSizeAndOffsets(node->getChild(i), pos, offsets);
-        }
-        return 4 + size;
-    }
-    else
-    {
-        return 4;
-    }
-}
-
-void createKCLInfoAndOffsets(const KCL& kcl, KCLInfo* info, KCLOffsets* offsets)
+void createKCLInfoAndOffsets(
+    const KCL& kcl, const KCL::FlatOctree& octree, KCLInfo* info, KCLOffsets* offsets
+)
 {
     info->size = 0x3C; // header
 
@@ -73,25 +51,11 @@ void createKCLInfoAndOffsets(const KCL& kcl, KCLInfo* info, KCLOffsets* offsets)
 
     offsets->sectionOffs.push_back(info->size); // OCTREE
 
-    KCL::Octree* octree = kcl.getOctree();
-
-    uint32_t count = octree->getRootNodeCount();
-    uint32_t pos = count * 4;
-    for (uint32_t i = 0; i < count; ++i)
-    {
-        info->size += calcNodeSizeAndOffsets(octree->getNode(i), pos, offsets);
-    }
+    // the nodes of a FlatOctree are in the same order as in the file
+    info->size += static_cast<uint32_t>(octree.getNodes().size()) * 4;
 
-    offsets->triListOff = info->size;   
-    info->size += 2; // first empty list
-    for (KCL::OctreeNode* node : octree->getAllNodes())
-    {
-        if (!node->isSuperNode())
-        {
-            uint32_t size = static_cast<uint32_t>(node->getIndices().size());
-            info->size += size == 0 ? 0 : (size + 1) * 2;
-        }
-    }
+    offsets->triListOff = info->size;
+    info->size += static_cast<uint32_t>(octree.getTriangleLists().size()) * 2;
 }
 
 void writeKCLHeader(Buffer& out, const KCL& kcl, KCLOffsets* offsets)
@@ -157,55 +121,32 @@ void writeKCLTriangles(Buffer& out, const KCL& kcl, KCLOffsets* offsets)
     }
 }
 
-void writeKCLOctreeNode(
-    Buffer& out, Buffer& triOut, KCL::OctreeNode* node, KCLOffsets* offsets, uint32_t pos
-)
+void writeKCLOctree(Buffer& out, const KCL::FlatOctree& octree, KCLOffsets* offsets)
 {
-    if (node->isSuperNode())
-    {
-        uint32_t off = offsets->nodeOffs.at(node);
-        out.putInt(off - pos);
+    out.position(offsets->sectionOffs.at(OCTREE));
 
-        Buffer tmp = out.duplicate(); // to prevent from changing the original buffer's position
-        tmp.position(offsets->sectionOffs.at(OCTREE) + off);
-        for (uint32_t i = 0; i < 8; ++i)
-        {
-            writeKCLOctreeNode(tmp, triOut, node->getChild(i), offsets, off);
-        }
-    }
-    else
+    const std::vector<uint32_t>& nodes = octree.getNodes();
+    uint32_t rootCount = octree.getRootNodeCount();
+    uint32_t listsOff = offsets->triListOff - offsets->sectionOffs.at(OCTREE) - 2;
+    for (uint32_t i = 0; i < nodes.size(); ++i)
     {
-        uint32_t baseOff = offsets->triListOff - offsets->sectionOffs.at(OCTREE) - pos - 2;
-        std::vector<uint16_t> tris = node->getIndices();
-        if (tris.empty())
+        // offsets are relative to the start of the block of siblings
+        uint32_t pos = (i < rootCount ? 0 : rootCount + ((i - rootCount) & ~7u)) * 4;
+        if (nodes[i] & KCL::FlatOctree::LEAF)
         {
-            out.putInt(0x80000000 | baseOff);
+            uint32_t listOff = nodes[i] & ~KCL::FlatOctree::LEAF;
+            out.putInt(0x80000000 | (listsOff - pos + listOff * 2));
         }
         else
         {
-            out.putInt(0x80000000 | (baseOff + static_cast<uint32_t>(triOut.position())));
-            for (uint16_t tri : tris)
-            {
-                triOut.putShort(tri + 1);
-            }
-            triOut.putShort(0x0000);
+            out.putInt(nodes[i] * 4 - pos);
         }
     }
-}
-
-void writeKCLOctree(Buffer& out, const KCL& kcl, KCLOffsets* offsets)
-{
-    uint32_t baseOff = offsets->sectionOffs.at(OCTREE);
-    out.position(baseOff);
 
-    Buffer triOut = out.duplicate();
-    triOut = triOut.position(offsets->triListOff).slice();
-    triOut.putShort(0x0000); // empty list
-
-    KCL::Octree* octree = kcl.getOctree();
-    for (uint32_t i = 0; i < octree->getRootNodeCount(); ++i)
+    // triangle indices are 1-based in files, and lists end with 0
+    for (uint16_t tri : octree.getTriangleLists())
     {
-        writeKCLOctreeNode(out, triOut, octree->getNode(i), offsets, 0);
+        out.putShort(tri == KCL::FlatOctree::END ? 0x0000 : tri + 1);
     }
 }
 
@@ -214,9 +155,11 @@ Buffer KCL::write(const KCL& kcl)
     ////////////////////////////////////
     /// Setup required information
 
+    KCL::FlatOctree octree(*kcl.getOctree());
+
     KCLInfo info;
     KCLOffsets offsets;
-    createKCLInfoAndOffsets(kcl, &info, &offsets);
+    createKCLInfoAndOffsets(kcl, octree, &info, &offsets);
 
     ////////////////////////////////////
     /// Write MDL0 file
@@ -227,7 +170,7 @@ Buffer KCL::write(const KCL& kcl)
     writeKCLVertices(out, kcl, &offsets);
     writeKCLNormals(out, kcl, &offsets);
     writeKCLTriangles(out, kcl, &offsets);
-    writeKCLOctree(out, kcl, &offsets);
+    writeKCLOctree(out, octree, &offsets);
 
     return out.clear();
 }
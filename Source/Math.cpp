@@ -7,8 +7,11 @@
 
 #include <CTLib/Math.hpp>
 
+#include <cmath>
 #include <limits>
 
+#include "SIMD.hpp"
+
 namespace CTLib
 {
 
@@ -104,82 +107,240 @@ bool Math::isInsideAABB(const AABB& aabb, const Vector3f& p)
         && p[2] >= aabb.min[2] && p[2] <= aabb.max[2];
 }
 
-void getPoints(const AABB& aabb, Vector3f points[8])
+// the triangle/AABB test below is written once for both a single box, with
+// floats, and 4 boxes at once, with FloatLanes; the operations are done in
+// the same order in both cases so that they give the same results, and
+// comparisons give all bits set in FloatLanes where they give true in floats
+
+#ifdef CT_LIB_SSE2
+
+// 4 floats, one per box
+struct FloatLanes
 {
-    Vector3f min = aabb.getMin(), max = aabb.getMax();
-    points[0] = min;
-    points[1] = {min[0], min[1], max[2]};
-    points[2] = {min[0], max[1], min[2]};
-    points[3] = {min[0], max[1], max[2]};
-    points[4] = {max[0], min[1], min[2]};
-    points[5] = {max[0], min[1], max[2]};
-    points[6] = {max[0], max[1], min[2]};
-    points[7] = max;
+    __m128 v;
+
+    FloatLanes() : v{_mm_setzero_ps()} {}
+    FloatLanes(__m128 v) : v{v} {}
+    FloatLanes(float f) : v{_mm_set1_ps(f)} {}
+};
+
+inline FloatLanes operator+(FloatLanes a, FloatLanes b) { return _mm_add_ps(a.v, b.v); }
+inline FloatLanes operator-(FloatLanes a, FloatLanes b) { return _mm_sub_ps(a.v, b.v); }
+inline FloatLanes operator*(FloatLanes a, FloatLanes b) { return _mm_mul_ps(a.v, b.v); }
+inline FloatLanes operator>(FloatLanes a, FloatLanes b) { return _mm_cmpgt_ps(a.v, b.v); }
+inline FloatLanes operator<(FloatLanes a, FloatLanes b) { return _mm_cmplt_ps(a.v, b.v); }
+inline FloatLanes operator|(FloatLanes a, FloatLanes b) { return _mm_or_ps(a.v, b.v); }
+inline FloatLanes minOf(FloatLanes a, FloatLanes b) { return _mm_min_ps(a.v, b.v); }
+inline FloatLanes maxOf(FloatLanes a, FloatLanes b) { return _mm_max_ps(a.v, b.v); }
+
+inline FloatLanes notOf(FloatLanes mask)
+{
+    return _mm_xor_ps(mask.v, _mm_castsi128_ps(_mm_set1_epi32(-1)));
 }
 
-void project(Vector3f* points, uint32_t count, const Vector3f& axis, float& min, float& max)
+inline bool allSet(FloatLanes mask)
 {
-    min = FLOAT_MAX; max = FLOAT_MIN;
+    return _mm_movemask_ps(mask.v) == 0xF;
+}
 
-    for (uint32_t i = 0; i < count; ++i)
+#endif
+
+inline float minOf(float a, float b) { return MIN(a, b); }
+inline float maxOf(float a, float b) { return MAX(a, b); }
+
+inline bool notOf(bool mask)
+{
+    return !mask;
+}
+
+inline bool allSet(bool mask)
+{
+    return mask;
+}
+
+// the vertices of a triangle, and its edges and normal once they are needed
+struct SATTriangle
+{
+    float v[3][3];
+    float e[3][3];
+    float n[3];
+    bool hasAxes;
+};
+
+SATTriangle toSATTriangle(const Vector3f& t0, const Vector3f& t1, const Vector3f& t2)
+{
+    SATTriangle tri;
+    for (uint32_t i = 0; i < 3; ++i)
     {
-        float val = Vector3f::dot(points[i], axis);
-        min = min < val ? min : val;
-        max = max > val ? max : val;
+        tri.v[0][i] = t0[i];
+        tri.v[1][i] = t1[i];
+        tri.v[2][i] = t2[i];
     }
+    tri.hasAxes = false;
+    return tri;
 }
 
-bool Math::isPartlyInsideAABB(
-    const AABB& aabb, const Vector3f& t0, const Vector3f& t1, const Vector3f& t2
-)
+void computeAxes(SATTriangle& tri)
 {
-    if (isInsideAABB(aabb, t0) || isInsideAABB(aabb, t1) || isInsideAABB(aabb, t2))
+    for (uint32_t j = 0; j < 3; ++j)
     {
-        return true; // at least one vertex is inside the AABB
+        for (uint32_t i = 0; i < 3; ++i)
+        {
+            tri.e[j][i] = tri.v[(j + 1) % 3][i] - tri.v[j][i];
+        }
     }
+    tri.n[0] = tri.e[0][1] * tri.e[1][2] - tri.e[0][2] * tri.e[1][1];
+    tri.n[1] = tri.e[0][2] * tri.e[1][0] - tri.e[0][0] * tri.e[1][2];
+    tri.n[2] = tri.e[0][0] * tri.e[1][1] - tri.e[0][1] * tri.e[1][0];
+    tri.hasAxes = true;
+}
 
-    for (uint32_t i = 0; i < 3; ++i)
+// returns whether the triangle is partly inside each box, given by its centre
+// and half size; this is the separating axis test from Akenine-Moller, "Fast
+// 3D Triangle-Box Overlap Testing", which does not need normalised axes
+template <class Lanes, class Mask>
+Mask findPartlyInside(const Lanes centre[3], const Lanes half[3], SATTriangle& tri)
+{
+    // triangle vertices relative to the box centres
+    Lanes v[3][3];
+    for (uint32_t k = 0; k < 3; ++k)
     {
-        if (MAX(t0[i], MAX(t1[i], t2[i])) < aabb.min[i] 
-            || MIN(t0[i], MIN(t1[i], t2[i])) > aabb.max[i])
+        for (uint32_t i = 0; i < 3; ++i)
         {
-            return false; // all vertices are outside the AABB planes
+            v[k][i] = Lanes(tri.v[k][i]) - centre[i];
         }
     }
 
-    // calculate triangle normal (assume counter-clockwise)
-    Vector3f norm = Vector3f::unit(Vector3f::cross(t1 - t0, t2 - t0));
+    // box face normals, which reject most of the boxes that are missed
+    Mask done{};
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+        Lanes lo = minOf(v[0][i], minOf(v[1][i], v[2][i]));
+        Lanes hi = maxOf(v[0][i], maxOf(v[1][i], v[2][i]));
+        done = done | (lo > half[i]) | (hi < Lanes(0.f) - half[i]);
+        if (allSet(done))
+        {
+            return Mask{};
+        }
+    }
 
-    // calculate AABB vertices
-    Vector3f points[8];
-    getPoints(aabb, points);
+    // a vertex inside the box is enough, and is the most common case when
+    // building an octree
+    Mask inside{};
+    for (uint32_t k = 0; k < 3; ++k)
+    {
+        Mask outside{};
+        for (uint32_t i = 0; i < 3; ++i)
+        {
+            outside = outside | (v[k][i] > half[i]) | (v[k][i] < Lanes(0.f) - half[i]);
+        }
+        inside = inside | notOf(outside);
+        if (allSet(done | inside))
+        {
+            return inside;
+        }
+    }
+    done = done | inside;
 
-    float projTri = Vector3f::dot(norm, t0);
-    float boxMin, boxMax;
-    project(points, 8, norm, boxMin, boxMax);
-    if (projTri < boxMin || projTri > boxMax)
+    // triangle normal
+    if (!tri.hasAxes)
     {
-        return false; // triangle is outside of the AABB
+        computeAxes(tri);
+    }
+    const float* n = tri.n;
+    Lanes d = Lanes(n[0]) * v[0][0] + Lanes(n[1]) * v[0][1] + Lanes(n[2]) * v[0][2];
+    Lanes r = Lanes(std::fabs(n[0])) * half[0] + Lanes(std::fabs(n[1])) * half[1]
+        + Lanes(std::fabs(n[2])) * half[2];
+    done = done | (d > r) | (d < Lanes(0.f) - r);
+    if (allSet(done))
+    {
+        return inside;
     }
 
-    Vector3f tris[] = {t0, t1, t2};
-    Vector3f edges[] = {t0 - t1, t1 - t2, t2 - t0};
-    Vector3f boxNormals[] = {{1.f, 0.f, 0.f}, {0.f, 1.f, 0.f}, {0.f, 0.f, 1.f}};
-    float triMin, triMax;
-    for (uint32_t edge = 0; edge < 3; ++edge)
+    // cross products of the triangle edges and the box axes; axis 'i' of an
+    // edge only has components 'a' and 'b'
+    for (uint32_t j = 0; j < 3; ++j)
     {
+        const float* e = tri.e[j];
         for (uint32_t i = 0; i < 3; ++i)
         {
-            Vector3f axis = Vector3f::unit(Vector3f::cross(edges[edge], boxNormals[i]));
-            project(points, 8, axis, boxMin, boxMax);
-            project(tris, 3, axis, triMin, triMax);
-            if (triMax < boxMin || triMin > boxMax)
+            uint32_t a = (i + 1) % 3, b = (i + 2) % 3;
+            Lanes axisA = Lanes(e[b]), axisB = Lanes(0.f - e[a]);
+            Lanes p0 = axisA * v[0][a] + axisB * v[0][b];
+            Lanes p1 = axisA * v[1][a] + axisB * v[1][b];
+            Lanes p2 = axisA * v[2][a] + axisB * v[2][b];
+            Lanes radius = Lanes(std::fabs(e[b])) * half[a] + Lanes(std::fabs(e[a])) * half[b];
+            done = done | (minOf(p0, minOf(p1, p2)) > radius)
+                | (maxOf(p0, maxOf(p1, p2)) < Lanes(0.f) - radius);
+        }
+        if (allSet(done))
+        {
+            return inside;
+        }
+    }
+
+    // no separating axis was found for the boxes which are not done
+    return notOf(done) | inside;
+}
+
+bool Math::isPartlyInsideAABB(
+    const AABB& aabb, const Vector3f& t0, const Vector3f& t1, const Vector3f& t2
+)
+{
+    float centre[3], half[3];
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+        centre[i] = (aabb.min[i] + aabb.max[i]) * .5f;
+        half[i] = (aabb.max[i] - aabb.min[i]) * .5f;
+    }
+
+    SATTriangle tri = toSATTriangle(t0, t1, t2);
+    return findPartlyInside<float, bool>(centre, half, tri);
+}
+
+uint8_t Math::getPartlyInsideAABBs(
+    const AABB* const* aabbs, uint32_t count,
+    const Vector3f& t0, const Vector3f& t1, const Vector3f& t2
+)
+{
+    uint8_t mask = 0;
+
+#ifdef CT_LIB_SSE2
+    SATTriangle tri = toSATTriangle(t0, t1, t2);
+    for (uint32_t first = 0; first < count; first += 4)
+    {
+        // unused lanes repeat the last box
+        alignas(16) float centre[3][4], half[3][4];
+        for (uint32_t lane = 0; lane < 4; ++lane)
+        {
+            const AABB* aabb = aabbs[MIN(first + lane, count - 1)];
+            for (uint32_t i = 0; i < 3; ++i)
             {
-                return false; // a separating axis was found
+                centre[i][lane] = (aabb->min[i] + aabb->max[i]) * .5f;
+                half[i][lane] = (aabb->max[i] - aabb->min[i]) * .5f;
             }
         }
-    }
 
-    return true;
+        FloatLanes c[3], h[3];
+        for (uint32_t i = 0; i < 3; ++i)
+        {
+            c[i] = _mm_load_ps(centre[i]);
+            h[i] = _mm_load_ps(half[i]);
+        }
+
+        FloatLanes inside = findPartlyInside<FloatLanes, FloatLanes>(c, h, tri);
+        mask |= static_cast<uint8_t>(_mm_movemask_ps(inside.v) << first);
+    }
+    return mask & static_cast<uint8_t>((1u << count) - 1);
+#else
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (isPartlyInsideAABB(*aabbs[i], t0, t1, t2))
+        {
+            mask |= 1 << i;
+        }
+    }
+    return mask;
+#endif
 }
 }
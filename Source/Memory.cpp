@@ -54,10 +54,21 @@ Buffer::Buffer(size_t size) :
     }
 }
 
+Buffer::Buffer(uint8_t* data, size_t size, std::function<void(uint8_t*)> deleter) :
+    buffer{data, std::move(deleter)},
+    size{size},
+    off{0},
+    pos{0},
+    max{size},
+    endian{BIG_ENDIAN}
+{
+
+}
+
 Buffer::Buffer(const Buffer& src) :
     buffer{nullptr},
-    size{src.getSize()},
-    off{src.offset()},
+    size{src.capacity()},
+    off{0},
     pos{src.position()},
     max{src.limit()},
     endian{src.order()}
@@ -108,14 +119,17 @@ Buffer& Buffer::operator=(const Buffer& src)
     {
         return *this;
     }
-    if (src.getSize() > 0)
+    // only the memory accessible to 'src' is copied
+    size_t capacity = src.capacity();
+    buffer = nullptr;
+    if (capacity > 0)
     {
-        buffer = std::shared_ptr<uint8_t[]>(new uint8_t[src.getSize()]);
+        buffer = std::shared_ptr<uint8_t[]>(new uint8_t[capacity]);
     }
-    setSize(src.getSize());
-    offset(src.offset());
-    position(src.position());
+    setSize(capacity);
+    offset(0);
     limit(src.limit());
+    position(src.position());
     order(src.order());
     for (size_t i = 0; i < getSize(); ++i)
     {
@@ -0,0 +1,23 @@
+//////////////////////////////////////////////////
+//  Copyright (c) 2020 Nara Hiero
+//
+// This file is licensed under GPLv3+
+// Refer to the `License.txt` file included.
+//////////////////////////////////////////////////
+
+#pragma once
+
+
+/**************************************************************************
+ * This header selects the SIMD instruction sets used by the library
+ * sources, each of which keeps a scalar fallback.
+ **************************************************************************/
+
+
+// SSE2 is part of the x86-64 baseline, so it is detected at compile time
+// instead of at run time, and is then always available; there is no run-time
+// dispatch, and no wider instruction set is used even when the CPU has one
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CT_LIB_SSE2
+#include <emmintrin.h>
+#endif
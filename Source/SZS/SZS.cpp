@@ -0,0 +1,27 @@
+//////////////////////////////////////////////////
+//  Copyright (c) 2020 Nara Hiero
+//
+// This file is licensed under GPLv3+
+// Refer to the `License.txt` file included.
+//////////////////////////////////////////////////
+
+#include <CTLib/SZS.hpp>
+
+#include "U8/U8RWCommon.hpp"
+
+namespace CTLib
+{
+
+U8Arc SZS::read(Buffer& data)
+{
+    // the files of the archive are slices of this buffer
+    Buffer decompressed = Yaz::decompress(data);
+    return readU8Archive(decompressed, true);
+}
+
+Buffer SZS::write(const U8Arc& arc)
+{
+    Buffer data = U8::write(arc);
+    return Yaz::compress(data, YazFormat::Yaz0);
+}
+}
@@ -0,0 +1,104 @@
+//////////////////////////////////////////////////
+//  Copyright (c) 2020 Nara Hiero
+//
+// This file is licensed under GPLv3+
+// Refer to the `License.txt` file included.
+//////////////////////////////////////////////////
+
+#include <CTLib/U8.hpp>
+
+#include <CTLib/Utilities.hpp>
+
+namespace CTLib
+{
+
+U8Manifest::U8Manifest() :
+    entries{}
+{
+
+}
+
+U8Manifest::U8Manifest(const U8Arc& arc) :
+    entries{}
+{
+    for (auto it = arc.cbegin(); it != arc.cend(); ++it)
+    {
+        U8Entry* entry = *it;
+        uint64_t hash = entry->getType() == U8EntryType::File ? entry->asFile()->getHash() : 0;
+        entries.insert(std::map<std::string, uint64_t>::value_type(entry->getAbsolutePath(), hash));
+    }
+}
+
+U8Manifest::~U8Manifest() = default;
+
+void U8Manifest::setEntry(const std::string& path, uint64_t hash)
+{
+    entries[path] = hash;
+}
+
+const std::map<std::string, uint64_t>& U8Manifest::getEntries() const
+{
+    return entries;
+}
+
+uint64_t U8Manifest::getHash() const
+{
+    // each entry is hashed as its null terminated path followed by its hash
+    std::vector<uint8_t> record;
+    uint64_t hash = 0;
+    for (auto& pair : entries)
+    {
+        record.assign(pair.first.begin(), pair.first.end());
+        record.push_back(0);
+        for (int i = 0; i < 8; ++i)
+        {
+            record.push_back(static_cast<uint8_t>(pair.second >> (i * 8)));
+        }
+        hash = Bytes::hash(record.data(), record.size(), hash);
+    }
+    return hash;
+}
+
+std::vector<std::string> U8Manifest::getChangedPaths(const U8Manifest& other) const
+{
+    std::vector<std::string> changed;
+
+    // both maps are sorted, so walk them side by side
+    auto a = entries.begin();
+    auto b = other.entries.begin();
+    while (a != entries.end() || b != other.entries.end())
+    {
+        if (b == other.entries.end() || (a != entries.end() && a->first < b->first))
+        {
+            changed.push_back(a->first); // removed
+            ++a;
+        }
+        else if (a == entries.end() || b->first < a->first)
+        {
+            changed.push_back(b->first); // added
+            ++b;
+        }
+        else
+        {
+            if (a->second != b->second)
+            {
+                changed.push_back(a->first); // modified
+            }
+            ++a;
+            ++b;
+        }
+    }
+
+    return changed;
+}
+
+bool U8Manifest::operator==(const U8Manifest& other) const
+{
+    return entries == other.entries;
+}
+
+bool U8Manifest::operator!=(const U8Manifest& other) const
+{
+    return !(*this == other);
+}
+}
@@ -0,0 +1,387 @@
+//////////////////////////////////////////////////
+//  Copyright (c) 2020 Nara Hiero
+//
+// This file is licensed under GPLv3+
+// Refer to the `License.txt` file included.
+//////////////////////////////////////////////////
+
+#include "U8/U8RWCommon.hpp"
+
+namespace CTLib
+{
+
+//////////////////////////////
+///  class U8Patch
+
+U8Patch::U8Patch() :
+    files{},
+    removed{}
+{
+
+}
+
+U8Patch::~U8Patch() = default;
+
+void U8Patch::setFile(const std::string& path, const Buffer& data)
+{
+    Buffer src = data.duplicate();
+    Buffer copy(src.remaining());
+    copy.put(src).flip();
+
+    files.erase(path);
+    files.insert(std::map<std::string, Buffer>::value_type(path, std::move(copy)));
+}
+
+void U8Patch::remove(const std::string& path)
+{
+    files.erase(path);
+    removed.push_back(path);
+}
+
+bool U8Patch::isEmpty() const
+{
+    return files.empty() && removed.empty();
+}
+
+
+//////////////////////////////
+///  U8::patch
+
+// an entry of the archive being patched
+struct U8PatchNode
+{
+    // whether this node is a directory
+    bool directory;
+
+    // file: offset to the data in the source archive
+    uint32_t dataOff;
+
+    // file: size of the data
+    uint32_t size;
+
+    // file: new contents, or `nullptr` if unchanged
+    const Buffer* data;
+
+    // directory: map of <name, node> of entries, ordered like U8Dir
+    std::map<std::string, U8PatchNode> children;
+};
+
+// a node of the patched archive in filesystem order
+struct U8PatchEntry
+{
+    // name of the entry
+    std::string name;
+
+    // the node of this entry
+    U8PatchNode* node;
+
+    // index of the parent directory
+    uint32_t parent;
+
+    // directory: index of the first node out of the directory
+    uint32_t end;
+};
+
+// builds the tree of nodes [begin, end) into 'dir'
+void readPatchNodes(
+    std::vector<U8Node>& nodes, Buffer& stringTable, uint32_t max,
+    uint32_t begin, uint32_t end, U8PatchNode* dir
+)
+{
+    uint32_t i = begin;
+    while (i < end)
+    {
+        U8Node& node = nodes[i];
+
+        U8PatchNode child;
+        child.directory = node.type == 1;
+        child.dataOff = 0;
+        child.size = 0;
+        child.data = nullptr;
+
+        uint32_t next = i + 1;
+        if (child.directory)
+        {
+            if (node.size <= i || node.size > end)
+            {
+                throw U8Error(Strings::format(
+                    "Invalid U8 filesystem section: Directory node with invalid first node out index! "
+                    "(Index 0x%02X not in [0x%02X, 0x%02X])",
+                    node.size, i + 1, end
+                ));
+            }
+            readPatchNodes(nodes, stringTable, max, i + 1, node.size, &child);
+            next = node.size;
+        }
+        else
+        {
+            child.dataOff = node.offIdx;
+            child.size = node.size;
+        }
+
+        std::string name = readNodeName(stringTable, node.nameOff, max);
+        dir->children[name] = std::move(child);
+
+        i = next;
+    }
+}
+
+// splits an absolute path in its parts and checks that none is empty
+std::vector<std::string> splitPatchPath(const std::string& path)
+{
+    std::vector<std::string> parts = Strings::split(path, '/');
+    for (const std::string& part : parts)
+    {
+        if (part.empty())
+        {
+            throw U8Error(Strings::format(
+                "Invalid U8 patch path: '%s' contains an empty name!", path.c_str()
+            ));
+        }
+    }
+    return parts;
+}
+
+void removePatchNode(U8PatchNode* root, const std::string& path)
+{
+    std::vector<std::string> parts = splitPatchPath(path);
+
+    U8PatchNode* dir = root;
+    for (size_t i = 0; i < parts.size(); ++i)
+    {
+        auto it = dir->children.find(parts[i]);
+        if (!dir->directory || it == dir->children.end())
+        {
+            throw U8Error(Strings::format(
+                "Cannot remove '%s': No such entry in archive!", path.c_str()
+            ));
+        }
+
+        if (i == parts.size() - 1)
+        {
+            dir->children.erase(it);
+        }
+        else
+        {
+            dir = &it->second;
+        }
+    }
+}
+
+void setPatchFile(U8PatchNode* root, const std::string& path, const Buffer* data)
+{
+    std::vector<std::string> parts = splitPatchPath(path);
+
+    U8PatchNode* node = root;
+    for (size_t i = 0; i < parts.size(); ++i)
+    {
+        if (!node->directory)
+        {
+            throw U8Error(Strings::format(
+                "Cannot set '%s': A parent entry is a file!", path.c_str()
+            ));
+        }
+
+        bool last = i == parts.size() - 1;
+        auto it = node->children.find(parts[i]);
+        if (it == node->children.end())
+        {
+            U8PatchNode child;
+            child.directory = !last;
+            child.dataOff = 0;
+            child.size = 0;
+            child.data = nullptr;
+            it = node->children.insert(
+                std::map<std::string, U8PatchNode>::value_type(parts[i], std::move(child))
+            ).first;
+        }
+        node = &it->second;
+    }
+
+    if (node->directory)
+    {
+        throw U8Error(Strings::format(
+            "Cannot set '%s': Entry is a directory!", path.c_str()
+        ));
+    }
+
+    node->data = data;
+    node->size = static_cast<uint32_t>(data->remaining());
+}
+
+void orderPatchEntries(U8PatchNode* dir, uint32_t parent, std::vector<U8PatchEntry>& out)
+{
+    for (auto& pair : dir->children)
+    {
+        U8PatchEntry entry;
+        entry.name = pair.first;
+        entry.node = &pair.second;
+        entry.parent = parent;
+        entry.end = 0;
+        out.push_back(entry);
+
+        // the root node is not part of 'out'
+        uint32_t idx = static_cast<uint32_t>(out.size());
+        if (pair.second.directory)
+        {
+            orderPatchEntries(&pair.second, idx, out);
+            out[idx - 1].end = static_cast<uint32_t>(out.size() + 1);
+        }
+    }
+}
+
+// copies the source range [start, end) and pads the output to 0x20 bytes
+void copyPatchRun(Buffer& src, uint32_t start, uint32_t end, Buffer& out)
+{
+    if (start == end)
+    {
+        return;
+    }
+    if (end > src.limit())
+    {
+        throw U8Error("Invalid U8 data section: Not enough data remaining!");
+    }
+
+    out.putArray(*src + start, end - start);
+    padFileData(out);
+}
+
+Buffer U8::patch(Buffer& data, const U8Patch& patch)
+{
+    Buffer buffer = data.slice();
+    buffer.order(Buffer::BIG_ENDIAN);
+
+    U8Header header;
+    readHeader(buffer, &header);
+
+    buffer.position(header.entriesOff);
+    Buffer filesystem = buffer.slice();
+    if (filesystem.remaining() < header.entriesSize)
+    {
+        throw U8Error("Invalid U8 filesystem section: Not enough data for nodes!");
+    }
+    filesystem.limit(header.entriesSize);
+    buffer.rewind();
+
+    std::vector<U8Node> nodes;
+    U8Node root = readNode(filesystem, nodes, ~0Ui32);
+    if (root.type != 1)
+    {
+        throw U8Error("Invalid U8 filesystem section: Root entry is not a directory!");
+    }
+    if (root.size == 0 || filesystem.remaining() < ((root.size - 1) * 0xC))
+    {
+        throw U8Error("Invalid U8 filesystem section: Not enough data for nodes!");
+    }
+
+    nodes.reserve(root.size);
+    while (nodes.size() < root.size)
+    {
+        readNode(filesystem, nodes, root.size);
+    }
+
+    Buffer stringTable = filesystem.slice();
+    uint32_t stringTableMax = getMaxStringTableOffset(stringTable);
+
+    // build the tree and apply the changes
+    U8PatchNode tree;
+    tree.directory = true;
+    tree.dataOff = 0;
+    tree.size = 0;
+    tree.data = nullptr;
+    readPatchNodes(nodes, stringTable, stringTableMax, 1, root.size, &tree);
+
+    for (const std::string& path : patch.removed)
+    {
+        removePatchNode(&tree, path);
+    }
+    for (auto& pair : patch.files)
+    {
+        setPatchFile(&tree, pair.first, &pair.second);
+    }
+
+    std::vector<U8PatchEntry> entries;
+    orderPatchEntries(&tree, 0, entries);
+
+    std::vector<std::string_view> entryNames;
+    entryNames.reserve(entries.size());
+    for (U8PatchEntry& entry : entries)
+    {
+        entryNames.push_back(entry.name);
+    }
+    U8StringTable table;
+    makeStringTable(entryNames, &table);
+
+    uint32_t nodeCount = static_cast<uint32_t>(entries.size() + 1);
+    uint32_t dataOff = getDataOffset(getEntriesSize(nodeCount, table));
+
+    std::vector<U8PackedNode> packed;
+    packed.reserve(nodeCount);
+    packed.push_back(makePackedNode(0, true, 0, 0, nodeCount));
+
+    uint32_t dataSize = 0;
+    for (uint32_t i = 1; i <= entries.size(); ++i)
+    {
+        U8PatchEntry& entry = entries[i - 1];
+        uint32_t nameOff = table.offsets[entry.name];
+        if (entry.node->directory)
+        {
+            packed.push_back(makePackedNode(i, true, nameOff, entry.parent, entry.end));
+        }
+        else
+        {
+            uint32_t size = entry.node->size;
+            uint32_t offset = size == 0 ? 0 : dataOff + dataSize;
+            packed.push_back(makePackedNode(i, false, nameOff, offset, size));
+            dataSize += padNum(size, 0x20);
+        }
+    }
+
+    Buffer out(dataOff + dataSize);
+    writeFilesystem(packed, table, out);
+
+    // data; unchanged files stored back-to-back in the source are copied at
+    // once, which only keeps their offsets if the run starts on 0x20 bytes
+    uint32_t runStart = 0;
+    uint32_t runEnd = 0;
+    for (U8PatchEntry& entry : entries)
+    {
+        U8PatchNode* node = entry.node;
+        if (node->directory || node->size == 0)
+        {
+            continue;
+        }
+
+        if (node->data == nullptr)
+        {
+            // checked apart so that the end of the file cannot wrap around
+            if (node->dataOff > buffer.limit() || node->size > buffer.limit() - node->dataOff)
+            {
+                throw U8Error("Invalid U8 data section: Not enough data remaining!");
+            }
+
+            if (runStart == runEnd || (runStart & 0x1F) != 0
+                || padNum(runEnd, 0x20) != node->dataOff)
+            {
+                copyPatchRun(buffer, runStart, runEnd, out);
+                runStart = node->dataOff;
+            }
+            runEnd = node->dataOff + node->size;
+        }
+        else
+        {
+            copyPatchRun(buffer, runStart, runEnd, out);
+            runStart = runEnd = 0;
+
+            Buffer src = node->data->duplicate();
+            out.put(src);
+            padFileData(out);
+        }
+    }
+    copyPatchRun(buffer, runStart, runEnd, out);
+
+    data.position(data.limit());
+
+    return out.clear();
+}
+}
@@ -5,45 +5,11 @@
 // Refer to the `License.txt` file included.
 //////////////////////////////////////////////////
 
-#include <CTLib/U8.hpp>
+#include "U8/U8RWCommon.hpp"
 
 namespace CTLib
 {
 
-// u8 archive header
-struct U8Header
-{
-    // offset to the first node in the filesystem section (usually 0x20)
-    uint32_t entriesOff;
-
-    // size of the filesystem section including the string table
-    uint32_t entriesSize;
-
-    // offset to the beginning of file data
-    uint32_t dataOff;
-};
-
-// a node in the filesystem section
-struct U8Node
-{
-    // node index
-    uint32_t index;
-
-    // node type (0 for file, 1 for directory)
-    uint8_t type;
-
-    // offset to name (24 bits; 0x00FFFFFF mask)
-    uint32_t nameOff;
-
-    /* file: offset to the data
-     * directory: index of the parent node */
-    uint32_t offIdx;
-
-    /* file: size of the data
-     * directory: index of first entry not part of this node */
-    uint32_t size;
-};
-
 void readHeader(Buffer& data, U8Header* header)
 {
     if (data.remaining() < 0x20)
@@ -167,7 +133,7 @@ std::string readNodeName(Buffer& stringTable, uint32_t off, uint32_t max)
     return std::string((const char*)(*stringTable + off));
 }
 
-void readFileData(Buffer& base, U8Node node, U8File* file)
+void readFileData(Buffer& base, U8Node node, U8File* file, bool share)
 {
     Buffer data = base.position(node.offIdx).slice();
     base.rewind();
@@ -178,14 +144,20 @@ void readFileData(Buffer& base, U8Node node, U8File* file)
     }
     data.limit(node.size);
 
+    if (share)
+    {
+        file->setDataShared(data);
+        return;
+    }
+
     Buffer filedata(node.size);
     filedata.put(data).flip();
-    file->setData(std::move(filedata));
+    file->setDataShared(filedata);
 }
 
 // 'filesystem' points to filesystem section
 // 'data' points to file data section
-U8Arc readData(Buffer& filesystem, Buffer& data, U8Header* header)
+U8Arc readData(Buffer& filesystem, Buffer& data, U8Header* header, bool share)
 {
     U8Arc arc;
 
@@ -227,7 +199,7 @@ U8Arc readData(Buffer& filesystem, Buffer& data, U8Header* header)
         if (node.type == 0) // file
         {
             U8File* file = parent->addFile(name);
-            readFileData(data, node, file);
+            readFileData(data, node, file, share);
         }
         else if (node.type == 1) // directory
         {
@@ -239,7 +211,7 @@ U8Arc readData(Buffer& filesystem, Buffer& data, U8Header* header)
     return arc;
 }
 
-U8Arc U8::read(Buffer& data)
+U8Arc readU8Archive(Buffer& data, bool share)
 {
     Buffer buffer = data.slice();
 
@@ -259,11 +231,16 @@ U8Arc U8::read(Buffer& data)
     buffer.rewind();
 
     // parse the actual U8 archive
-    U8Arc arc = readData(filesystem, buffer, &header);
+    U8Arc arc = readData(filesystem, buffer, &header, share);
 
     // pretend the data was read in a normal way :-)
     data.position(data.limit());
 
     return arc;
 }
+
+U8Arc U8::read(Buffer& data)
+{
+    return readU8Archive(data, false);
+}
 }
@@ -16,6 +16,7 @@ namespace CTLib
 ///  class U8Arc
 
 U8Arc::U8Arc() :
+    names{},
     entries{},
     root{}
 {
@@ -23,6 +24,7 @@ U8Arc::U8Arc() :
 }
 
 U8Arc::U8Arc(U8Arc&& src) :
+    names{std::move(src.names)},
     entries{std::move(src.entries)},
     root{src.root}
 {
@@ -177,7 +179,7 @@ U8Entry* U8Arc::addEntryAbsolute(const std::string& path, U8EntryType type)
 U8Entry::U8Entry(U8Arc* arc) :
     arc{arc},
     parent{nullptr},
-    name{}
+    name{arc->names.intern("")}
 {
     arc->entries.push_back(this);
 }
@@ -185,12 +187,13 @@ U8Entry::U8Entry(U8Arc* arc) :
 U8Entry::U8Entry(U8Arc* arc, U8Dir* parent, const std::string& name) :
     arc{arc},
     parent{parent},
-    name{name}
+    name{}
 {
     assertValidName(name);
+    this->name = arc->names.intern(name);
 
     arc->entries.push_back(this);
-    parent->entries.insert(std::map<std::string, U8Entry*>::value_type(name, this));
+    parent->entries.insert(std::map<std::string_view, U8Entry*>::value_type(this->name, this));
 }
 
 U8Entry::~U8Entry() = default;
@@ -201,8 +204,8 @@ void U8Entry::rename(const std::string& name)
     parent->assertUniqueName(name);
 
     parent->entries.erase(this->name);
-    this->name = name;
-    parent->entries.insert(std::map<std::string, U8Entry*>::value_type(name, this));
+    this->name = arc->names.intern(name);
+    parent->entries.insert(std::map<std::string_view, U8Entry*>::value_type(this->name, this));
 }
 
 U8Dir* U8Entry::getParent() const
@@ -211,10 +214,40 @@ U8Dir* U8Entry::getParent() const
 }
 
 std::string U8Entry::getName() const
+{
+    return std::string(name);
+}
+
+std::string_view U8Entry::getNameView() const
 {
     return name;
 }
 
+std::string U8Entry::makeAbsolutePath(bool directory) const
+{
+    // the root directory is unnamed and not part of paths
+    size_t size = 0;
+    for (const U8Entry* entry = this; entry->parent != nullptr; entry = entry->parent)
+    {
+        size += entry->name.size() + 1; // name followed by a slash
+    }
+    if (size == 0)
+    {
+        return std::string();
+    }
+
+    // fill names from the end, over a path containing only slashes
+    std::string path(directory ? size : size - 1, '/');
+    size_t end = size - 1;
+    for (const U8Entry* entry = this; entry->parent != nullptr; entry = entry->parent)
+    {
+        end -= entry->name.size();
+        path.replace(end, entry->name.size(), entry->name.data(), entry->name.size());
+        --end; // skip the slash
+    }
+    return path;
+}
+
 void U8Entry::assertValidName(const std::string& name) const
 {
     if (name.empty())
@@ -266,7 +299,8 @@ uint32_t U8Dir::count() const
 
 U8Entry* U8Dir::getEntry(const std::string& name) const
 {
-    return entries.count(name) > 0 ? entries.at(name) : nullptr;
+    auto it = entries.find(name);
+    return it == entries.end() ? nullptr : it->second;
 }
 
 bool U8Dir::hasEntry(const std::string& name) const
@@ -276,7 +310,7 @@ bool U8Dir::hasEntry(const std::string& name) const
 
 std::string U8Dir::getAbsolutePath() const
 {
-    return parent == nullptr ? "" : (parent->getAbsolutePath() + name + "/");
+    return makeAbsolutePath(true);
 }
 
 U8EntryType U8Dir::getType() const
@@ -310,7 +344,7 @@ void U8Dir::assertUniqueName(const std::string& name)
     {
         throw U8Error(Strings::format(
             "The directory '%s' already has an entry with name '%s'!",
-            this->name.c_str(), name.c_str()
+            this->name.data(), name.c_str()
         ));
     }
 }
@@ -320,7 +354,10 @@ void U8Dir::assertUniqueName(const std::string& name)
 ///  class U8File
 
 U8File::U8File(U8Arc* arc, U8Dir* parent, const std::string& name) :
-    U8Entry{arc, parent, name}
+    U8Entry{arc, parent, name},
+    data{},
+    hash{0},
+    hashed{false}
 {
 
 }
@@ -335,11 +372,22 @@ void U8File::setData(const Buffer& data)
         this->data.put(data[data.position() + this->data.position()]);
     }
     this->data.clear();
+    hashed = false;
+}
+
+void U8File::setDataShared(const Buffer& data)
+{
+    Buffer view = data.slice();
+    view.limit(data.remaining());
+    this->data = std::move(view);
+    hashed = false;
 }
 
 Buffer U8File::getData() const
 {
-    return data;
+    Buffer copy(data.remaining());
+    copy.putArray(*data + data.position(), data.remaining());
+    return copy.flip();
 }
 
 uint32_t U8File::getDataSize() const
@@ -347,9 +395,19 @@ uint32_t U8File::getDataSize() const
     return static_cast<uint32_t>(data.remaining());
 }
 
+uint64_t U8File::getHash() const
+{
+    if (!hashed)
+    {
+        hash = Bytes::hash(*data + data.position(), data.remaining());
+        hashed = true;
+    }
+    return hash;
+}
+
 std::string U8File::getAbsolutePath() const
 {
-    return parent->getAbsolutePath() + name;
+    return makeAbsolutePath(false);
 }
 
 U8EntryType U8File::getType() const
@@ -0,0 +1,133 @@
+//////////////////////////////////////////////////
+//  Copyright (c) 2020 Nara Hiero
+//
+// This file is licensed under GPLv3+
+// Refer to the `License.txt` file included.
+//////////////////////////////////////////////////
+
+#pragma once
+
+
+/**************************************************************************
+ * This header contains functionalities shared by the U8 reader, writer and
+ * patcher.
+ **************************************************************************/
+
+
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <CTLib/U8.hpp>
+
+
+namespace CTLib
+{
+
+// u8 archive header
+struct U8Header
+{
+    // offset to the first node in the filesystem section (usually 0x20)
+    uint32_t entriesOff;
+
+    // size of the filesystem section including the string table
+    uint32_t entriesSize;
+
+    // offset to the beginning of file data
+    uint32_t dataOff;
+};
+
+// a node in the filesystem section
+struct U8Node
+{
+    // node index
+    uint32_t index;
+
+    // node type (0 for file, 1 for directory)
+    uint8_t type;
+
+    // offset to name (24 bits; 0x00FFFFFF mask)
+    uint32_t nameOff;
+
+    /* file: offset to the data
+     * directory: index of the parent node */
+    uint32_t offIdx;
+
+    /* file: size of the data
+     * directory: index of first entry not part of this node */
+    uint32_t size;
+};
+
+// string table in filesystem section of u8 archive
+struct U8StringTable
+{
+    // map of <string, offset> of strings in table; the viewed strings must
+    // outlive the table
+    std::map<std::string_view, uint32_t> offsets;
+
+    // total size of table in bytes
+    uint32_t size;
+};
+
+// node in filesystem section, as written
+struct U8PackedNode
+{
+    // index of node
+    uint32_t idx;
+
+    // packed node type and name offset
+    uint32_t tn;
+
+    // data offset or index to parent directory
+    uint32_t offIdx;
+
+    // size of data or index of first node out of directory
+    uint32_t size;
+};
+
+// rounds 'num' up to a multiple of 'pad' (which must be a power of two)
+uint32_t padNum(uint32_t num, uint8_t pad);
+
+// makes the string table of an archive from the names of its entries; the
+// name of the root node is added to it
+void makeStringTable(const std::vector<std::string_view>& names, U8StringTable* table);
+
+// returns the size of the filesystem section of an archive with 'nodeCount'
+// nodes, the root node included
+uint32_t getEntriesSize(uint32_t nodeCount, const U8StringTable& table);
+
+// returns the offset to the data section following a filesystem section of
+// 'entriesSize' bytes
+uint32_t getDataOffset(uint32_t entriesSize);
+
+// makes a node of the filesystem section; 'offIdx' and 'size' are as in U8Node
+U8PackedNode makePackedNode(
+    uint32_t idx, bool directory, uint32_t nameOff, uint32_t offIdx, uint32_t size
+);
+
+// writes the header, 'nodes' (starting with the root node) and 'table', and
+// pads the output up to the data section
+void writeFilesystem(
+    const std::vector<U8PackedNode>& nodes, const U8StringTable& table, Buffer& out
+);
+
+// pads 'out' to 0x20 bytes after the data of a file
+void padFileData(Buffer& out);
+
+// parses the header at the position of 'data' and checks its validity
+void readHeader(Buffer& data, U8Header* header);
+
+// parses the node at the position of 'filesystem' and appends it to 'out'
+U8Node readNode(Buffer& filesystem, std::vector<U8Node>& out, uint32_t max);
+
+// simply returns the index of the last null character '\0' in table
+uint32_t getMaxStringTableOffset(Buffer& stringTable);
+
+// returns the null terminated string at 'off' in the string table
+std::string readNodeName(Buffer& stringTable, uint32_t off, uint32_t max);
+
+// parses the archive in 'data'; if 'share' is true, the files share the
+// memory of 'data' instead of holding a copy of their contents
+U8Arc readU8Archive(Buffer& data, bool share);
+}
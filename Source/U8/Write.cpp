@@ -5,7 +5,10 @@
 // Refer to the `License.txt` file included.
 //////////////////////////////////////////////////
 
-#include <CTLib/U8.hpp>
+#include "U8/U8RWCommon.hpp"
+
+#include <cstring>
+#include <unordered_map>
 
 namespace CTLib
 {
@@ -13,9 +16,6 @@ namespace CTLib
 // info necessary to create the u8 archive
 struct U8Info
 {
-    // total size of filesystem section (including string table)
-    uint32_t entriesSize;
-
     // offset to file data
     uint32_t dataOff;
 
@@ -24,37 +24,105 @@ struct U8Info
 
     // data offset table
     std::vector<uint32_t> offsets;
+
+    // whether the data of the node shares the data of a previous node
+    std::vector<bool> shared;
 };
 
-// string table in filesystem section of u8 archive
-struct U8StringTable
+uint32_t padNum(uint32_t num, uint8_t pad)
 {
-    // map of <string, offset> of strings in table
-    std::map<std::string, uint32_t> offsets;
+    return (num & ~(pad - 1)) + ((num & (pad - 1)) > 0 ? pad : 0);
+}
 
-    // total size of table in bytes
-    uint32_t size;
-};
+void makeStringTable(const std::vector<std::string_view>& names, U8StringTable* table)
+{
+    // initialize table
+    table->offsets.clear();
+    table->offsets[""] = 0; // root entry
+    table->size = 0;
+
+    for (std::string_view name : names) // first run to order properly
+    {
+        table->offsets[name] = 0;
+    }
+
+    for (auto& pair : table->offsets) // actually calculate offsets
+    {
+        pair.second = table->size;
+        table->size += static_cast<uint32_t>(pair.first.size()) + 1;
+    }
+}
 
-// node in filesystem section
-struct U8PackedNode
+uint32_t getEntriesSize(uint32_t nodeCount, const U8StringTable& table)
 {
-    // index of node
-    uint32_t idx;
+    return (nodeCount * 0xC) + table.size;
+}
 
-    // packed node type and name offset
-    uint32_t tn;
+uint32_t getDataOffset(uint32_t entriesSize)
+{
+    return padNum(entriesSize + 0x30, 0x40);
+}
 
-    // data offset or index to parent directory
-    uint32_t offIdx;
+U8PackedNode makePackedNode(
+    uint32_t idx, bool directory, uint32_t nameOff, uint32_t offIdx, uint32_t size
+)
+{
+    U8PackedNode node;
+    node.idx = idx;
+    node.tn = (directory ? 0x1 << 24 : 0x0 << 24) | (nameOff & 0x00FFFFFF);
+    node.offIdx = offIdx;
+    node.size = size;
+    return node;
+}
 
-    // size of data or index of first node out of directory
-    uint32_t size;
-};
+void writeFilesystem(
+    const std::vector<U8PackedNode>& nodes, const U8StringTable& table, Buffer& out
+)
+{
+    uint32_t entriesSize = getEntriesSize(static_cast<uint32_t>(nodes.size()), table);
+    uint32_t dataOff = getDataOffset(entriesSize);
 
-uint32_t padNum(uint32_t num, uint8_t pad)
+    // header
+    out.putArray((uint8_t*)"U\xAA""8-", 4); // magic
+    out.putInt(0x20); // offset to filesystem section
+    out.putInt(entriesSize); // size of filesystem section
+    out.putInt(dataOff); // offset to data section
+
+    // 4 unused integers
+    for (size_t i = 0; i < 0x10; ++i)
+    {
+        out.put(0);
+    }
+
+    // nodes
+    for (const U8PackedNode& node : nodes)
+    {
+        out.putInt(node.tn);
+        out.putInt(node.offIdx);
+        out.putInt(node.size);
+    }
+
+    // string table
+    for (auto& pair : table.offsets)
+    {
+        out.putArray((uint8_t*)pair.first.data(), pair.first.size());
+        out.put(0);
+    }
+
+    // add padding
+    while (out.position() < dataOff)
+    {
+        out.put(0);
+    }
+}
+
+void padFileData(Buffer& out)
 {
-    return (num & ~(pad - 1)) + ((num & (pad - 1)) > 0 ? pad : 0);
+    size_t padding = 0x20 - (out.position() & 0x1F);
+    while (padding != 0x20 && padding-- > 0)
+    {
+        out.put(0);
+    }
 }
 
 void orderEntries(U8Dir* dir, std::vector<U8Entry*>& out)
@@ -69,33 +137,56 @@ void orderEntries(U8Dir* dir, std::vector<U8Entry*>& out)
     }
 }
 
-void makeStringTable(std::vector<U8Entry*>& entries, U8StringTable* table)
+void makeEntriesStringTable(std::vector<U8Entry*>& entries, U8StringTable* table)
 {
-    // initialize table
-    table->offsets[""] = 0; // root entry
-    table->size = 1;
-
-    for (U8Entry* entry : entries) // first run to order properly
+    std::vector<std::string_view> names;
+    names.reserve(entries.size());
+    for (U8Entry* entry : entries)
     {
-        table->offsets[entry->getName()] = 1; // 1 to differentiate from root
+        names.push_back(entry->getNameView());
     }
+    makeStringTable(names, table);
+}
 
-    for (auto pair : table->offsets) // actually calculate offsets
+// returns the offset of a previously written file with the same data as
+// 'file', or 0 if none
+uint32_t findDuplicate(
+    U8File* file, uint32_t offset, std::unordered_map<uint64_t, std::vector<U8File*>>& hashes,
+    std::map<U8File*, uint32_t>& offsets
+)
+{
+    std::vector<U8File*>& candidates = hashes[file->getHash()];
+    for (U8File* candidate : candidates)
     {
-        if (pair.second == 1) // not root node
+        if (candidate->getDataSize() != file->getDataSize())
+        {
+            continue;
+        }
+
+        // a hash collision is unlikely, but would corrupt the archive
+        Buffer data = file->getData();
+        Buffer other = candidate->getData();
+        if (std::memcmp(*data, *other, data.remaining()) == 0)
         {
-            table->offsets[pair.first] = table->size;
-            table->size += static_cast<uint32_t>(pair.first.size()) + 1;
+            return offsets.at(candidate);
         }
     }
+
+    candidates.push_back(file);
+    offsets.insert(std::map<U8File*, uint32_t>::value_type(file, offset));
+    return 0;
 }
 
-void makeInfo(std::vector<U8Entry*>& entries, U8StringTable* table, U8Info* info)
+void makeInfo(std::vector<U8Entry*>& entries, U8StringTable* table, U8Info* info, bool dedup)
 {
-    info->entriesSize = (static_cast<uint32_t>(entries.size() + 1) * 0xC) + table->size;
-    info->dataOff = padNum(info->entriesSize + 0x30, 0x40);
+    uint32_t nodeCount = static_cast<uint32_t>(entries.size() + 1);
+    info->dataOff = getDataOffset(getEntriesSize(nodeCount, *table));
 
     info->offsets.push_back(0); // for the root node
+    info->shared.push_back(false);
+
+    std::unordered_map<uint64_t, std::vector<U8File*>> hashes;
+    std::map<U8File*, uint32_t> written;
 
     uint32_t dataSize = 0;
     for (U8Entry* entry : entries)
@@ -103,69 +194,41 @@ void makeInfo(std::vector<U8Entry*>& entries, U8StringTable* table, U8Info* info
         if (entry->getType() == U8EntryType::File)
         {
             uint32_t fileSize = entry->asFile()->getDataSize();
-            info->offsets.push_back(fileSize == 0 ? 0 : info->dataOff + dataSize);
-            dataSize += padNum(fileSize, 0x20);
+            uint32_t offset = fileSize == 0 ? 0 : info->dataOff + dataSize;
+
+            uint32_t duplicate = 0;
+            if (dedup && fileSize > 0)
+            {
+                duplicate = findDuplicate(entry->asFile(), offset, hashes, written);
+            }
+
+            info->offsets.push_back(duplicate == 0 ? offset : duplicate);
+            info->shared.push_back(duplicate != 0);
+            dataSize += duplicate == 0 ? padNum(fileSize, 0x20) : 0;
         }
         else
         {
             info->offsets.push_back(0);
+            info->shared.push_back(false);
         }
     }
     info->size = info->dataOff + dataSize;
 }
 
-void writeHeader(U8Info* info, Buffer& out)
-{
-    out.putArray((uint8_t*)"U\xAA""8-", 4); // magic
-    out.putInt(0x20); // offset to filesystem section
-    out.putInt(info->entriesSize); // size of filesystem section
-    out.putInt(info->dataOff); // offset to data section
-
-    // 4 unused integers
-    for (size_t i = 0; i < 0x10; ++i)
-    {
-        out.put(0);
-    }
-}
-
-U8PackedNode makeRootNode(uint32_t size)
-{
-    U8PackedNode node;
-    node.idx = 0;
-    node.tn = 0x1 << 24;
-    node.offIdx = 0;
-    node.size = size;
-    return node;
-}
-
 U8PackedNode makeNode(
     U8Entry* entry, U8PackedNode* parent, U8Info* info, U8StringTable* table, uint32_t idx
 )
 {
-    U8PackedNode node;
-
-    // node index
-    node.idx = idx;
-
-    // name offset in string table
-    node.tn = table->offsets[entry->getName()] & 0x00FFFFFF;
-    
+    uint32_t nameOff = table->offsets[entry->getNameView()];
     if (entry->getType() == U8EntryType::Directory)
     {
-        node.tn |= 0x1 << 24; // entry type
-        node.offIdx = parent->idx;
-        node.size = 0;
+        return makePackedNode(idx, true, nameOff, parent->idx, 0);
     }
-    else if (entry->getType() == U8EntryType::File)
+    else
     {
-        node.tn |= 0x0 << 24; // entry type
-
         U8File* file = entry->asFile();
-        node.offIdx = info->offsets[idx]; // offset to data
-        node.size = file->getDataSize(); // data size
+        return makePackedNode(idx, false, nameOff, info->offsets[idx], file->getDataSize());
     }
-
-    return node;
 }
 
 void getOrderedNodes(
@@ -190,67 +253,47 @@ void writeNodes(const U8Arc& arc, U8Info* info, U8StringTable* table, Buffer& ou
 {
     std::vector<U8PackedNode> nodes;
 
-    U8PackedNode root = makeRootNode(arc.totalCount() + 1);
+    U8PackedNode root = makePackedNode(0, true, 0, 0, arc.totalCount() + 1);
     nodes.push_back(root);
 
     getOrderedNodes(arc.asDirectory(), &root, info, table, nodes);
 
-    for (U8PackedNode& node : nodes)
-    {
-        out.putInt(node.tn);
-        out.putInt(node.offIdx);
-        out.putInt(node.size);
-    }
+    writeFilesystem(nodes, *table, out);
 }
 
-void writeStringTable(U8Info* info, U8StringTable* table, Buffer& out)
+void writeData(std::vector<U8Entry*>& entries, U8Info* info, Buffer& out)
 {
-    // write table
-    for (auto& pair : table->offsets)
+    for (size_t i = 0; i < entries.size(); ++i)
     {
-        out.putArray((uint8_t*)pair.first.c_str(), pair.first.size() + 1);
-    }
-
-    // add padding
-    while (out.position() < info->dataOff)
-    {
-        out.put(0);
-    }
-}
-
-void writeData(std::vector<U8Entry*> entries, Buffer& out)
-{
-    for (U8Entry* entry : entries)
-    {
-        if (entry->getType() == U8EntryType::File)
+        U8Entry* entry = entries[i];
+        if (entry->getType() == U8EntryType::File && !info->shared[i + 1])
         {
-            out.put(entry->asFile()->getData());
-
-            size_t padding = 0x20 - (out.position() & 0x1F);
-            while (padding != 0x20 && padding-- > 0)
-            {
-                out.put(0);
-            }
+            Buffer data = entry->asFile()->getData();
+            out.put(data);
+            padFileData(out);
         }
     }
 }
 
 Buffer U8::write(const U8Arc& arc)
+{
+    return write(arc, false);
+}
+
+Buffer U8::write(const U8Arc& arc, bool deduplicate)
 {
     std::vector<U8Entry*> entries;
     orderEntries(arc.asDirectory(), entries);
 
     U8StringTable table;
-    makeStringTable(entries, &table);
+    makeEntriesStringTable(entries, &table);
 
     U8Info info;
-    makeInfo(entries, &table, &info);
+    makeInfo(entries, &table, &info, deduplicate);
 
     Buffer data(info.size);
-    writeHeader(&info, data);
     writeNodes(arc, &info, &table, data);
-    writeStringTable(&info, &table, data);
-    writeData(entries, data);
+    writeData(entries, &info, data);
 
     return data.clear();
 }
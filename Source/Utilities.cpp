@@ -7,7 +7,13 @@
 
 #include <CTLib/Utilities.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
 #include <fstream>
+#include <mutex>
+#include <thread>
 
 namespace CTLib
 {
@@ -107,6 +113,110 @@ uint8_t* Bytes::findLongestMatch(uint8_t* bytes, size_t bytesSize, uint8_t* find
     return bestLoc;
 }
 
+constexpr uint64_t XXH_PRIME64_1 = 0x9E3779B185EBCA87;
+constexpr uint64_t XXH_PRIME64_2 = 0xC2B2AE3D27D4EB4F;
+constexpr uint64_t XXH_PRIME64_3 = 0x165667B19E3779F9;
+constexpr uint64_t XXH_PRIME64_4 = 0x85EBCA77C2B2AE63;
+constexpr uint64_t XXH_PRIME64_5 = 0x27D4EB2F165667C5;
+
+inline uint64_t xxhRotl(uint64_t x, uint8_t r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+// xxhash is defined on little endian reads regardless of the system order
+inline uint64_t xxhRead64(const uint8_t* p)
+{
+    return static_cast<uint64_t>(p[0]) | (static_cast<uint64_t>(p[1]) << 8)
+        | (static_cast<uint64_t>(p[2]) << 16) | (static_cast<uint64_t>(p[3]) << 24)
+        | (static_cast<uint64_t>(p[4]) << 32) | (static_cast<uint64_t>(p[5]) << 40)
+        | (static_cast<uint64_t>(p[6]) << 48) | (static_cast<uint64_t>(p[7]) << 56);
+}
+
+inline uint32_t xxhRead32(const uint8_t* p)
+{
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8)
+        | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+inline uint64_t xxhRound(uint64_t acc, uint64_t input)
+{
+    acc += input * XXH_PRIME64_2;
+    return xxhRotl(acc, 31) * XXH_PRIME64_1;
+}
+
+inline uint64_t xxhMergeRound(uint64_t acc, uint64_t val)
+{
+    acc ^= xxhRound(0, val);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+uint64_t Bytes::hash(const uint8_t* bytes, size_t count, uint64_t seed)
+{
+    const uint8_t* p = bytes;
+    const uint8_t* end = bytes + count;
+
+    uint64_t h;
+    if (count >= 32)
+    {
+        uint64_t v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+        uint64_t v2 = seed + XXH_PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - XXH_PRIME64_1;
+
+        const uint8_t* limit = end - 32;
+        do // process 32 bytes stripes
+        {
+            v1 = xxhRound(v1, xxhRead64(p));
+            v2 = xxhRound(v2, xxhRead64(p + 8));
+            v3 = xxhRound(v3, xxhRead64(p + 16));
+            v4 = xxhRound(v4, xxhRead64(p + 24));
+            p += 32;
+        }
+        while (p <= limit);
+
+        h = xxhRotl(v1, 1) + xxhRotl(v2, 7) + xxhRotl(v3, 12) + xxhRotl(v4, 18);
+        h = xxhMergeRound(h, v1);
+        h = xxhMergeRound(h, v2);
+        h = xxhMergeRound(h, v3);
+        h = xxhMergeRound(h, v4);
+    }
+    else
+    {
+        h = seed + XXH_PRIME64_5;
+    }
+
+    h += static_cast<uint64_t>(count);
+
+    while (p + 8 <= end)
+    {
+        h ^= xxhRound(0, xxhRead64(p));
+        h = xxhRotl(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+        p += 8;
+    }
+    if (p + 4 <= end)
+    {
+        h ^= static_cast<uint64_t>(xxhRead32(p)) * XXH_PRIME64_1;
+        h = xxhRotl(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+    }
+    while (p < end)
+    {
+        h ^= static_cast<uint64_t>(*p) * XXH_PRIME64_5;
+        h = xxhRotl(h, 11) * XXH_PRIME64_1;
+        ++p;
+    }
+
+    // final avalanche
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+
+    return h;
+}
+
 Buffer IO::readFile(const char* filename, uint32_t* err)
 {
     Buffer buffer;
@@ -156,4 +266,137 @@ bool IO::writeFile(const std::string& filename, Buffer& data)
 {
     return writeFile(filename.c_str(), data);
 }
+
+// size of the memory blocks of string pools
+constexpr size_t STRING_POOL_BLOCK_SIZE = 0x1000;
+
+StringPool::StringPool() :
+    blocks{},
+    used{0},
+    available{0},
+    strings{}
+{
+
+}
+
+StringPool::StringPool(StringPool&& src) noexcept :
+    blocks{std::move(src.blocks)},
+    used{src.used},
+    available{src.available},
+    strings{std::move(src.strings)}
+{
+    src.blocks.clear();
+    src.used = 0;
+    src.available = 0;
+    src.strings.clear();
+}
+
+StringPool::~StringPool() = default;
+
+std::string_view StringPool::intern(std::string_view str)
+{
+    auto it = strings.find(str);
+    if (it != strings.end())
+    {
+        return *it;
+    }
+
+    char* mem = allocate(str.size() + 1);
+    std::memcpy(mem, str.data(), str.size());
+    mem[str.size()] = '\0';
+
+    std::string_view view(mem, str.size());
+    strings.insert(view);
+    return view;
+}
+
+size_t StringPool::count() const
+{
+    return strings.size();
+}
+
+char* StringPool::allocate(size_t size)
+{
+    // large strings get their own block, so that the current one is kept
+    if (size > STRING_POOL_BLOCK_SIZE / 4)
+    {
+        std::unique_ptr<char[]> block(new char[size]);
+        char* mem = block.get();
+        blocks.insert(blocks.empty() ? blocks.end() : blocks.end() - 1, std::move(block));
+        return mem;
+    }
+
+    if (available - used < size)
+    {
+        blocks.push_back(std::unique_ptr<char[]>(new char[STRING_POOL_BLOCK_SIZE]));
+        used = 0;
+        available = STRING_POOL_BLOCK_SIZE;
+    }
+
+    char* mem = blocks.back().get() + used;
+    used += size;
+    return mem;
+}
+
+void Parallel::forEach(
+    size_t count, uint32_t threads, const std::function<void(size_t)>& func
+)
+{
+    forChunks(count, threads, 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            func(i);
+        }
+    });
+}
+
+void Parallel::forChunks(
+    size_t count, uint32_t threads, size_t chunk,
+    const std::function<void(size_t, size_t)>& func
+)
+{
+    if (threads == 0)
+    {
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    std::atomic_size_t next{0};
+    std::exception_ptr error;
+    std::mutex errorMutex;
+    auto work = [&]() {
+        for (size_t begin; (begin = next.fetch_add(chunk)) < count;)
+        {
+            try
+            {
+                func(begin, std::min(begin + chunk, count));
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error)
+                {
+                    error = std::current_exception();
+                }
+            }
+        }
+    };
+
+    // the calling thread is the first worker
+    std::vector<std::thread> workers;
+    const size_t chunks = (count + chunk - 1) / chunk;
+    for (uint32_t i = 1; i < std::min<size_t>(threads, chunks); ++i)
+    {
+        workers.emplace_back(work);
+    }
+    work();
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
 }
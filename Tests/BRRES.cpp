@@ -7,6 +7,9 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <vector>
+
 #include <CTLib/BRRES.hpp>
 
 #include "Tests.hpp"
@@ -850,5 +853,134 @@ TEST(TEX0Tests, GenMipmaps)
     EXPECT_EQ( 20 *  16 * 2, tex0->getMipmapTextureData(4).capacity());
     EXPECT_EQ( 12 *   8 * 2, tex0->getMipmapTextureData(5).capacity());
 
+    // every level is resized from the base image
+    for (uint32_t i = 0; i < 6; ++i)
+    {
+        Buffer expected = ImageCoder::encode(
+            image.resize(tex0->getMipmapWidth(i), tex0->getMipmapHeight(i)), ImageFormat::RGB565
+        );
+        Buffer mipmap = tex0->getMipmapTextureData(i);
+        ASSERT_EQ(expected.capacity(), mipmap.capacity());
+        EXPECT_TRUE(std::equal(*expected, *expected + expected.capacity(), *mipmap))
+            << "Mipmap " << i << " is not resized from the base image";
+    }
+
     EXPECT_THROW(tex0->generateMipmaps(9), BRRESError);
+
+    // an image smaller than the mipmaps is scaled up to them
+    tex0->generateMipmaps(2, Image(40, 30));
+    EXPECT_EQ(2, tex0->getMipmapCount());
+    EXPECT_EQ(320 * 240 * 2, tex0->getMipmapTextureData(0).capacity());
+    EXPECT_EQ(160 * 120 * 2, tex0->getMipmapTextureData(1).capacity());
+}
+
+TEST(TEX0Tests, GenMipmapsOptions)
+{
+    BRRES brres;
+    TEX0* tex0 = brres.add<TEX0>("texture");
+
+    Image image = ImageIO::read(CT_LIB_TESTS_DATA_DIR"/Images/TEX0/Sand.png");
+    tex0->setTextureData(image, ImageFormat::CMPR);
+
+    MipmapOptions options;
+    options.filter = MipmapFilter::Kaiser;
+    options.gammaCorrect = true;
+    tex0->generateMipmaps(5, image, options);
+    std::vector<Buffer> serial;
+    for (uint32_t i = 0; i < 5; ++i)
+    {
+        serial.push_back(tex0->getMipmapTextureData(i));
+    }
+
+    tex0->generateMipmaps(5, image, options, 3);
+    EXPECT_EQ(5, tex0->getMipmapCount());
+    for (uint32_t i = 0; i < 5; ++i)
+    {
+        Buffer parallel = tex0->getMipmapTextureData(i);
+        ASSERT_EQ(serial[i].capacity(), parallel.capacity());
+        EXPECT_TRUE(std::equal(*serial[i], *serial[i] + serial[i].capacity(), *parallel))
+            << "Mipmap " << i << " differs when encoded in parallel";
+    }
+
+    tex0->generateMipmaps(4, options, 2);
+    EXPECT_EQ(4, tex0->getMipmapCount());
+
+    // a sparse cutout keeps its coverage instead of fading out
+    Buffer mask(64 * 64 * 4);
+    uint32_t seed = 1;
+    for (uint32_t i = 0; i < 64 * 64; ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        mask.putInt((seed >> 16) % 10 < 3 ? 0xFFFFFFFF : 0xFFFFFF00);
+    }
+    mask.flip();
+    Image cutout(64, 64, mask);
+    tex0->setTextureData(cutout, ImageFormat::RGBA8);
+    float coverage = cutout.alphaCoverage(0x80);
+
+    options = MipmapOptions();
+    tex0->generateMipmaps(3, cutout, options);
+    Buffer faded = tex0->getMipmapTextureData(1);
+    EXPECT_LT(ImageCoder::decode(faded, 16, 16, ImageFormat::RGBA8).alphaCoverage(0x80),
+        coverage - .1f);
+
+    options.keepCoverage = true;
+    tex0->generateMipmaps(3, cutout, options, 0);
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+        Buffer data = tex0->getMipmapTextureData(i);
+        Image mipmap = ImageCoder::decode(
+            data, tex0->getMipmapWidth(i), tex0->getMipmapHeight(i), ImageFormat::RGBA8
+        );
+        EXPECT_NEAR(coverage, mipmap.alphaCoverage(0x80), .05f);
+    }
+
+    EXPECT_THROW(tex0->generateMipmaps(7, cutout, options, 2), BRRESError);
+}
+
+TEST(TEX0Tests, SelectFormat)
+{
+    BRRES brres;
+    TEX0* tex0 = brres.add<TEX0>("texture");
+
+    Image image = ImageIO::read(CT_LIB_TESTS_DATA_DIR"/Images/TEX0/Sand.png");
+    tex0->setTextureData(image, 20.);
+    EXPECT_EQ(ImageFormat::CMPR, tex0->getFormat());
+    EXPECT_FALSE(brres.has<PLT0>("texture"));
+
+    tex0->setTextureData(Image(32, 32, {0x40, 0x80, 0xC0, 0x80}), 30., true);
+    EXPECT_EQ(ImageFormat::C4, tex0->getFormat());
+    EXPECT_EQ(1, brres.get<PLT0>("texture")->getColourCount());
+}
+
+TEST(PLT0Tests, PaletteTexture)
+{
+    BRRES brres;
+    TEX0* tex0 = brres.add<TEX0>("texture");
+
+    Image image = ImageIO::read(CT_LIB_TESTS_DATA_DIR"/Images/TEX0/Sand.png");
+    EXPECT_THROW(tex0->setTextureData(image, ImageFormat::C8), BRRESError);
+
+    PLT0* plt0 = brres.add<PLT0>("texture");
+    plt0->setPalette(ImageCoder::createPalette(image, ImageFormat::C8, PaletteFormat::RGB565));
+    EXPECT_EQ(PaletteFormat::RGB565, plt0->getFormat());
+    EXPECT_GE(256, plt0->getColourCount());
+
+    tex0->setTextureData(image, ImageFormat::C8);
+    tex0->generateMipmaps(2);
+    EXPECT_EQ(image.getWidth() * image.getHeight(), tex0->getTextureData().capacity());
+    EXPECT_EQ(2, tex0->getMipmapCount());
+
+    Buffer written = BRRES::write(brres);
+    BRRES read = BRRES::read(written);
+    EXPECT_EQ(2, read.getSubfileCount());
+
+    PLT0* readPLT0 = read.get<PLT0>("texture");
+    EXPECT_EQ(PaletteFormat::RGB565, readPLT0->getFormat());
+    EXPECT_EQ(plt0->getPalette().getData(), readPLT0->getPalette().getData());
+
+    TEX0* readTEX0 = read.get<TEX0>("texture");
+    EXPECT_EQ(ImageFormat::C8, readTEX0->getFormat());
+    EXPECT_EQ(tex0->getTextureData(), readTEX0->getTextureData());
+    EXPECT_EQ(2, readTEX0->getMipmapCount());
 }
@@ -7,12 +7,20 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
 #include <CTLib/Image.hpp>
 
 #include <CTLib/Utilities.hpp>
 
+#include <stb_dxt.h>
+
 #include "Tests.hpp"
 
+#include "Image/ImageCoderCommon.hpp"
+
 using namespace CTLib;
 
 TEST(ImageTests, Test)
@@ -34,6 +42,131 @@ TEST(ImageTests, Test)
     EXPECT_TRUE(Bytes::matches(expect, *image, 4 * 4 * 4));
 }
 
+TEST(ImageTests, Downsample)
+{
+    Buffer data(0x40);
+    data.putInt(0xFF0000FF).putInt(0x0000FFFF).putInt(0x00000000).putInt(0x00000000)
+        .putInt(0x00FF00FF).putInt(0x000000FF).putInt(0xFFFFFF00).putInt(0x40404080)
+        .putInt(0x808080FF).putInt(0x808080FF).putInt(0x000000FF).putInt(0x000000FF)
+        .putInt(0x808080FF).putInt(0x808080FF).putInt(0xFFFFFFFF).putInt(0xFFFFFFFF)
+        .flip();
+    Image image(4, 4, data);
+
+    // transparent pixels do not darken visible ones
+    Buffer expect(0x10);
+    expect.putInt(0x404040FF).putInt(0x40404020).putInt(0x808080FF).putInt(0x808080FF).flip();
+    Image box = image.downsample(2, 2);
+    EXPECT_EQ(2, box.getWidth());
+    EXPECT_EQ(2, box.getHeight());
+    EXPECT_EQ(Image(2, 2, expect), box);
+
+    // black and white average to 50% linear light, 188 in sRGB
+    Image gamma = image.downsample(2, 2, MipmapFilter::Box, true);
+    EXPECT_TRUE(Bytes::matches(std::vector<uint8_t>(3, 0xBC).data(), *gamma + 12, 3));
+
+    Image kaiser = Image(8, 6, {0x20, 0x40, 0x60, 0xFF}).downsample(3, 3, MipmapFilter::Kaiser);
+    EXPECT_EQ(Image(3, 3, {0x20, 0x40, 0x60, 0xFF}), kaiser);
+
+    EXPECT_THROW(image.downsample(0, 2), ImageError);
+    EXPECT_THROW(image.downsample(8, 2), ImageError);
+}
+
+TEST(ImageTests, DownsampleInto)
+{
+    Buffer data(16 * 10 * 4);
+    for (uint32_t i = 0; i < 16 * 10 * 4; ++i)
+    {
+        data.put(static_cast<uint8_t>((i * 2654435761u) >> 13));
+    }
+    data.flip();
+    Image image(16, 10, data);
+
+    // halving with the box filter averages each 2x2 block weighted by alpha
+    Image half(8, 5);
+    image.downsample(half);
+    for (uint32_t y = 0; y < 5; ++y)
+    {
+        for (uint32_t x = 0; x < 8; ++x)
+        {
+            const uint8_t* px[4] = {
+                *image + image.offsetFor(x * 2, y * 2), *image + image.offsetFor(x * 2 + 1, y * 2),
+                *image + image.offsetFor(x * 2, y * 2 + 1),
+                *image + image.offsetFor(x * 2 + 1, y * 2 + 1)
+            };
+            uint32_t sumA = px[0][3] + px[1][3] + px[2][3] + px[3][3];
+            const uint8_t* out = *half + half.offsetFor(x, y);
+            for (uint32_t c = 0; c < 3; ++c)
+            {
+                uint32_t sum = px[0][c] * px[0][3] + px[1][c] * px[1][3]
+                    + px[2][c] * px[2][3] + px[3][c] * px[3][3];
+                EXPECT_EQ(sumA == 0 ? 0 : (sum + sumA / 2) / sumA, out[c]);
+            }
+            EXPECT_EQ((sumA + 2) / 4, out[3]);
+        }
+    }
+
+    // the same image can be reused for each call
+    Image odd(5, 3);
+    image.downsample(odd, MipmapFilter::Kaiser);
+    EXPECT_EQ(image.downsample(5, 3, MipmapFilter::Kaiser), odd);
+    image.downsample(odd);
+    EXPECT_EQ(image.downsample(5, 3), odd);
+
+    image.resize(odd);
+    EXPECT_EQ(image.resize(5, 3), odd);
+
+    Image large(32, 4);
+    EXPECT_THROW(image.downsample(large), ImageError);
+
+    // an image cannot be written into itself, nor into an empty one
+    EXPECT_THROW(image.downsample(image), ImageError);
+    EXPECT_THROW(image.resize(image), ImageError);
+    Image empty(0, 3);
+    EXPECT_THROW(image.resize(empty), ImageError);
+    EXPECT_THROW(image.resize(0, 0), ImageError);
+    Image moved(std::move(odd));
+    EXPECT_THROW(image.resize(odd), ImageError);
+    EXPECT_THROW(image.downsample(odd), ImageError);
+}
+
+TEST(ImageTests, DownsampleKernels)
+{
+    // random pixels, with fully transparent and opaque runs
+    const uint32_t w = 24, h = 9;
+    std::vector<uint8_t> src(w * 2 * h * 2 * 4);
+    uint32_t seed = 7;
+    for (size_t i = 0; i < src.size(); ++i)
+    {
+        seed = (seed * 1103515245) + 12345;
+        src[i] = static_cast<uint8_t>(seed >> 16);
+        if (i % 4 == 3 && (i / 64) % 3 != 0)
+        {
+            src[i] = (i / 64) % 3 == 1 ? 0x00 : 0xFF;
+        }
+    }
+
+    // the scalar and SIMD kernels give the same bytes
+    std::vector<uint8_t> scalar(w * h * 4), simd(w * h * 4);
+    boxReduce2x2(src.data(), scalar.data(), w, h, false);
+    boxReduce2x2(src.data(), simd.data(), w, h, true);
+    EXPECT_EQ(scalar, simd);
+}
+
+TEST(ImageTests, AlphaCoverage)
+{
+    Buffer data(0x10);
+    data.putInt(0x000000FF).putInt(0x00000080).putInt(0x00000040).putInt(0x00000000).flip();
+    Image image(4, 1, data);
+
+    EXPECT_FLOAT_EQ(.5f, image.alphaCoverage(0x80));
+    EXPECT_FLOAT_EQ(.25f, image.alphaCoverage(0x81));
+
+    Image scaled = image.scaleAlphaToCoverage(.75f, 0x80);
+    EXPECT_FLOAT_EQ(.75f, scaled.alphaCoverage(0x80));
+    EXPECT_EQ(0xFF, (*scaled)[3]);
+    EXPECT_EQ(0x00, (*scaled)[15]);
+}
+
 TEST(ImageCoderTests, I4)
 {
     Buffer encoded = IO::readFile(CT_LIB_TESTS_DATA_DIR"/Images/Coder/I4.bin");
@@ -111,6 +244,429 @@ TEST(ImageCoderTests, RGBA8)
     EXPECT_EQ(expectImg, decoded);
 }
 
+TEST(ImageCoderTests, Encode)
+{
+    Buffer data(13 * 7 * 4);
+    for (uint32_t i = 0; data.hasRemaining(); ++i)
+    {
+        data.put(static_cast<uint8_t>(i * 37));
+    }
+    data.flip();
+    Image image(13, 7, data);
+
+    // RGBA8 is lossless
+    Buffer rgba8 = ImageCoder::encode(image, ImageFormat::RGBA8);
+    EXPECT_EQ(ImageCoder::sizeFor(13, 7, ImageFormat::RGBA8), rgba8.remaining());
+    EXPECT_EQ(image, ImageCoder::decode(rgba8, 13, 7, ImageFormat::RGBA8));
+
+    // partial CMPR tiles repeat the edge pixels
+    Buffer cmpr = ImageCoder::encode(image, ImageFormat::CMPR);
+    EXPECT_EQ(ImageCoder::sizeFor(13, 7, ImageFormat::CMPR), cmpr.remaining());
+}
+
+TEST(ImageCoderTests, DecodeBuffer)
+{
+    Buffer encoded(ImageCoder::sizeFor(13, 7, ImageFormat::RGB5A3) + 2);
+    encoded.position(2);
+
+    Image decoded = ImageCoder::decode(encoded, 13, 7, ImageFormat::RGB5A3);
+    EXPECT_EQ(13, decoded.getWidth());
+    EXPECT_EQ(7, decoded.getHeight());
+    EXPECT_FALSE(encoded.hasRemaining());
+
+    encoded.position(3);
+    EXPECT_THROW(ImageCoder::decode(encoded, 13, 7, ImageFormat::RGB5A3), ImageError);
+}
+
+// decodes the pixel at ('x', 'y') of the 'format' image 'data' of 'width'
+// pixels, one pixel at a time
+RGBAColour decodeReferencePixel(
+    const uint8_t* data, uint32_t width, ImageFormat format, uint32_t x, uint32_t y
+)
+{
+    FormatInfo info = formatInfo(format);
+    size_t tileSize = tileSizeFor(info);
+    const uint8_t* tile = data + (((y / info.bh) * (width / info.bw)) + (x / info.bw)) * tileSize;
+    uint32_t i = ((y % info.bh) * info.bw) + (x % info.bw);
+
+    uint16_t v = (tile[i * 2] << 8) | tile[(i * 2) + 1];
+    uint8_t nibble = (i & 1) == 0 ? tile[i / 2] >> 4 : tile[i / 2] & 0xF;
+    auto c = [](uint32_t r, uint32_t g, uint32_t b, uint32_t a) {
+        return RGBAColour{
+            static_cast<uint8_t>(r), static_cast<uint8_t>(g),
+            static_cast<uint8_t>(b), static_cast<uint8_t>(a)
+        };
+    };
+    switch (format)
+    {
+    case ImageFormat::I4:
+        return c(nibble * 0x11, nibble * 0x11, nibble * 0x11, 0xFF);
+
+    case ImageFormat::I8:
+        return c(tile[i], tile[i], tile[i], 0xFF);
+
+    case ImageFormat::IA4:
+        return c((tile[i] & 0xF) * 0x11, (tile[i] & 0xF) * 0x11, (tile[i] & 0xF) * 0x11,
+            (tile[i] >> 4) * 0x11);
+
+    case ImageFormat::IA8:
+        return c(tile[(i * 2) + 1], tile[(i * 2) + 1], tile[(i * 2) + 1], tile[i * 2]);
+
+    case ImageFormat::RGB565:
+        return c(((v >> 11) & 0x1F) << 3, ((v >> 5) & 0x3F) << 2, (v & 0x1F) << 3, 0xFF);
+
+    case ImageFormat::RGB5A3:
+        if (v & 0x8000)
+        {
+            return c(((v >> 10) & 0x1F) << 3, ((v >> 5) & 0x1F) << 3, (v & 0x1F) << 3, 0xFF);
+        }
+        return c(((v >> 8) & 0xF) * 0x11, ((v >> 4) & 0xF) * 0x11, (v & 0xF) * 0x11,
+            ((v >> 12) & 0x7) << 5);
+
+    case ImageFormat::RGBA8:
+        return c(tile[(i * 2) + 1], tile[0x20 + (i * 2)], tile[0x20 + (i * 2) + 1], tile[i * 2]);
+
+    default:
+        throw ImageError("No reference decoder for format!");
+    }
+}
+
+TEST(ImageCoderTests, DecodeKernels)
+{
+    const uint32_t width = 32;
+    const uint32_t height = 16;
+    for (ImageFormat format : {
+        ImageFormat::I4, ImageFormat::I8, ImageFormat::IA4, ImageFormat::IA8,
+        ImageFormat::RGB565, ImageFormat::RGB5A3, ImageFormat::RGBA8
+    })
+    {
+        std::vector<uint8_t> data(ImageCoder::sizeFor(width, height, format));
+        uint32_t seed = static_cast<uint32_t>(format) + 1;
+        for (uint8_t& byte : data)
+        {
+            seed = (seed * 1103515245) + 12345;
+            byte = static_cast<uint8_t>(seed >> 16);
+        }
+
+        std::vector<uint8_t> expected;
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                RGBAColour colour = decodeReferencePixel(data.data(), width, format, x, y);
+                expected.insert(expected.end(), {colour.r, colour.g, colour.b, colour.a});
+            }
+        }
+
+        // the scalar and SIMD kernels, on whole tiles
+        FormatInfo info = formatInfo(format);
+        size_t tileSize = tileSizeFor(info);
+        for (bool simd : {false, true})
+        {
+            DecodeTileFunc func = decodeTileFunc(format, simd);
+            std::vector<uint8_t> pixels(expected.size());
+            const uint8_t* in = data.data();
+            for (uint32_t y = 0; y < height; y += info.bh)
+            {
+                for (uint32_t x = 0; x < width; x += info.bw, in += tileSize)
+                {
+                    func(in, pixels.data() + (((y * width) + x) * 4), width * 4);
+                }
+            }
+            EXPECT_EQ(expected, pixels) << static_cast<int>(format) << (simd ? " SIMD" : "");
+        }
+
+        Buffer encoded(data.size());
+        encoded.putArray(data.data(), data.size()).flip();
+        Image decoded = ImageCoder::decode(encoded, width, height, format);
+        EXPECT_TRUE(std::equal(expected.begin(), expected.end(), *decoded))
+            << static_cast<int>(format);
+    }
+}
+
+TEST(ImageCoderTests, Threads)
+{
+    Buffer data(37 * 45 * 4);
+    for (uint32_t i = 0; data.hasRemaining(); ++i)
+    {
+        data.put(static_cast<uint8_t>(i * 53));
+    }
+    data.flip();
+    Image image(37, 45, data);
+
+    for (ImageFormat format : {ImageFormat::I4, ImageFormat::RGB5A3, ImageFormat::CMPR})
+    {
+        Buffer single = ImageCoder::encode(image, format);
+        Buffer multi = ImageCoder::encode(image, format, 4);
+        EXPECT_EQ(single, multi);
+
+        Image decoded = ImageCoder::decode(single, 37, 45, format);
+        EXPECT_EQ(decoded, ImageCoder::decode(multi, 37, 45, format, 3));
+    }
+}
+
+TEST(ImageCoderTests, CMPRQuality)
+{
+    Buffer data(32 * 24 * 4);
+    for (uint32_t y = 0; y < 24; ++y)
+    {
+        for (uint32_t x = 0; x < 32; ++x)
+        {
+            data.put(static_cast<uint8_t>(x * 8)).put(static_cast<uint8_t>(y * 10));
+            data.put(static_cast<uint8_t>((x + y) * 4)).put(x < 4 && y < 4 ? 0x00 : 0xFF);
+        }
+    }
+    data.flip();
+    Image image(32, 24, data);
+
+    double fast = 0;
+    for (CMPRQuality quality : {CMPRQuality::Fast, CMPRQuality::Normal, CMPRQuality::High})
+    {
+        Buffer encoded = ImageCoder::encode(image, ImageFormat::CMPR, quality);
+        EXPECT_EQ(ImageCoder::sizeFor(32, 24, ImageFormat::CMPR), encoded.remaining());
+
+        Image decoded = ImageCoder::decode(encoded, 32, 24, ImageFormat::CMPR);
+        double psnr = ImageCoder::psnr(decoded, image);
+
+        // the transparent block is kept
+        EXPECT_EQ(0x00, (*decoded)[decoded.offsetFor(1, 2) + 3]);
+        EXPECT_EQ(0xFF, (*decoded)[decoded.offsetFor(5, 2) + 3]);
+
+        // Normal keeps the output of stb_dxt, whose dithering can score
+        // lower than the native fits
+        EXPECT_GT(psnr, 30.);
+        if (quality == CMPRQuality::Fast)
+        {
+            fast = psnr;
+        }
+        else if (quality == CMPRQuality::High)
+        {
+            EXPECT_GE(psnr, fast);
+        }
+    }
+}
+
+TEST(ImageCoderTests, CMPRNormalMatchesSTB)
+{
+    // opaque blocks encode to the bytes CMPR has always had: stb_dxt's DXT1
+    // with big endian colours and mirrored index rows
+    Buffer data(16 * 16 * 4);
+    uint32_t seed = 5;
+    for (uint32_t i = 0; i < 16 * 16; ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        uint8_t noise = static_cast<uint8_t>(seed >> 26);
+        data.put(static_cast<uint8_t>(i + noise)).put(static_cast<uint8_t>((i >> 4) * 16));
+        data.put(static_cast<uint8_t>(0xC0 - noise)).put(0xFF);
+    }
+    data.flip();
+    Image image(16, 16, data);
+
+    Buffer encoded = ImageCoder::encode(image, ImageFormat::CMPR, CMPRQuality::Normal);
+    const uint8_t* out = *encoded;
+    for (uint32_t gy = 0; gy < 16; gy += 8)
+    {
+        for (uint32_t gx = 0; gx < 16; gx += 8)
+        {
+            for (uint32_t b = 0; b < 4; ++b, out += 8)
+            {
+                uint8_t block[0x40];
+                for (uint32_t p = 0; p < 16; ++p)
+                {
+                    uint32_t x = gx + ((b & 1) * 4) + (p & 3), y = gy + ((b >> 1) * 4) + (p >> 2);
+                    std::copy_n(*image + image.offsetFor(x, y), 4, block + (p * 4));
+                }
+                uint8_t dxt[8];
+                stb_compress_dxt_block(dxt, block, false, STB_DXT_DITHER | STB_DXT_HIGHQUAL);
+
+                uint8_t expected[8] = {dxt[1], dxt[0], dxt[3], dxt[2]};
+                for (uint32_t r = 0; r < 4; ++r)
+                {
+                    uint8_t row = dxt[4 + r];
+                    expected[4 + r] = static_cast<uint8_t>(((row & 0x03) << 6)
+                        | ((row & 0x0C) << 2) | ((row & 0x30) >> 2) | ((row & 0xC0) >> 6));
+                }
+                EXPECT_TRUE(std::equal(expected, expected + 8, out));
+            }
+        }
+    }
+}
+
+TEST(ImageCoderTests, PSNR)
+{
+    Image image(4, 4);
+    EXPECT_EQ(INFINITY, ImageCoder::psnr(image, image));
+
+    // a single channel off by 255 out of 64
+    Buffer data(1);
+    data.put(0xFF).flip();
+    Image other(4, 4, data);
+    EXPECT_NEAR(10 * std::log10(64.), ImageCoder::psnr(other, image), 1e-9);
+
+    EXPECT_THROW(ImageCoder::psnr(image, Image(4, 2)), ImageError);
+}
+
+TEST(ImageCoderTests, Palette)
+{
+    // colours that are exact in RGB5A3
+    Buffer data(13 * 7 * 4);
+    for (uint32_t i = 0; data.hasRemaining(); ++i)
+    {
+        data.putInt(0x18A0F8FF + ((i % 3) * 0x20000000));
+    }
+    data.flip();
+    Image image(13, 7, data);
+
+    Palette palette = ImageCoder::createPalette(image, ImageFormat::C4, PaletteFormat::RGB5A3);
+    EXPECT_EQ(3, palette.getCount());
+    EXPECT_EQ(PaletteFormat::RGB5A3, palette.getFormat());
+
+    for (ImageFormat format : {ImageFormat::C4, ImageFormat::C8, ImageFormat::C14X2})
+    {
+        Buffer encoded = ImageCoder::encode(image, format, palette);
+        EXPECT_EQ(ImageCoder::sizeFor(13, 7, format), encoded.remaining());
+        EXPECT_EQ(image, ImageCoder::decode(encoded, 13, 7, format, palette));
+        EXPECT_FALSE(encoded.hasRemaining());
+    }
+
+    // the palette is read back from its encoded colours
+    Buffer paletteData = palette.getData();
+    EXPECT_EQ(6, paletteData.remaining());
+    Palette read(PaletteFormat::RGB5A3, paletteData, 3);
+    for (uint16_t i = 0; i < 3; ++i)
+    {
+        RGBAColour a = palette.getColour(i), b = read.getColour(i);
+        EXPECT_EQ(a.r, b.r);
+        EXPECT_EQ(a.g, b.g);
+        EXPECT_EQ(a.b, b.b);
+        EXPECT_EQ(a.a, b.a);
+    }
+
+    EXPECT_THROW(ImageCoder::encode(image, ImageFormat::C8), ImageError);
+    EXPECT_THROW(ImageCoder::encode(image, ImageFormat::RGB565, palette), ImageError);
+    EXPECT_THROW(
+        ImageCoder::encode(image, ImageFormat::C4, Palette(PaletteFormat::IA8)), ImageError
+    );
+    EXPECT_THROW(palette.getColour(3), ImageError);
+}
+
+TEST(ImageCoderTests, PaletteQuantisation)
+{
+    Buffer data(37 * 45 * 4);
+    for (uint32_t y = 0; y < 45; ++y)
+    {
+        for (uint32_t x = 0; x < 37; ++x)
+        {
+            data.put(static_cast<uint8_t>(x * 7)).put(static_cast<uint8_t>(y * 5));
+            data.put(static_cast<uint8_t>((x + y) * 3)).put(0xFF);
+        }
+    }
+    data.flip();
+    Image image(37, 45, data);
+
+    double psnr[3];
+    ImageFormat formats[3] = {ImageFormat::C4, ImageFormat::C8, ImageFormat::C14X2};
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+        Palette palette = ImageCoder::createPalette(image, formats[i], PaletteFormat::RGB565);
+        EXPECT_LE(palette.getCount(), i == 0 ? 16 : i == 1 ? 256 : 16384);
+
+        Buffer single = ImageCoder::encode(image, formats[i], palette);
+        Buffer multi = ImageCoder::encode(image, formats[i], palette, 4);
+        EXPECT_EQ(single, multi);
+
+        Image decoded = ImageCoder::decode(single, 37, 45, formats[i], palette, 3);
+        psnr[i] = ImageCoder::psnr(decoded, image);
+    }
+
+    EXPECT_GT(psnr[0], 20.);
+    EXPECT_GT(psnr[1], psnr[0]);
+
+    // C14X2 keeps all RGB565 colours
+    Buffer rgb565 = ImageCoder::encode(image, ImageFormat::RGB565);
+    Image decoded = ImageCoder::decode(rgb565, 37, 45, ImageFormat::RGB565);
+    EXPECT_EQ(ImageCoder::psnr(decoded, image), psnr[2]);
+}
+
+TEST(ImageCoderTests, Analyse)
+{
+    Buffer data(8 * 8 * 4);
+    for (uint32_t i = 0; data.hasRemaining(); ++i)
+    {
+        uint8_t grey = static_cast<uint8_t>((i % 4) * 0x40);
+        data.put(grey).put(grey).put(grey).put(i < 8 ? 0x00 : 0xFF);
+    }
+    data.flip();
+    Image image(8, 8, data);
+
+    ImageAnalysis analysis = ImageCoder::analyse(image);
+    EXPECT_TRUE(analysis.greyscale);
+    EXPECT_EQ(AlphaUsage::OneBit, analysis.alpha);
+    EXPECT_EQ(8, analysis.colourCount);
+
+    (*image)[4 * 9] = 0x01;
+    (*image)[(4 * 10) + 3] = 0x80;
+    analysis = ImageCoder::analyse(image);
+    EXPECT_FALSE(analysis.greyscale);
+    EXPECT_EQ(AlphaUsage::Full, analysis.alpha);
+    EXPECT_EQ(10, analysis.colourCount);
+
+    analysis = ImageCoder::analyse(Image(4, 4, {0x10, 0x20, 0x30, 0xFF}));
+    EXPECT_FALSE(analysis.greyscale);
+    EXPECT_EQ(AlphaUsage::None, analysis.alpha);
+    EXPECT_EQ(1, analysis.colourCount);
+}
+
+TEST(ImageCoderTests, SelectFormat)
+{
+    // uniform opaque grey is lossless in I4
+    EXPECT_EQ(ImageFormat::I4,
+        ImageCoder::selectFormat(Image(16, 16, {0x88, 0x88, 0x88, 0xFF}), INFINITY)
+    );
+
+    Buffer data(32 * 32 * 4);
+    for (uint32_t y = 0; y < 32; ++y)
+    {
+        for (uint32_t x = 0; x < 32; ++x)
+        {
+            data.put(static_cast<uint8_t>(x * 8)).put(static_cast<uint8_t>(y * 8));
+            data.put(static_cast<uint8_t>((x * y) & 0xFF)).put(0xFF);
+        }
+    }
+    data.flip();
+    Image image(32, 32, data);
+
+    // smooth opaque colours fit in CMPR, and nothing but RGBA8 is lossless
+    EXPECT_EQ(ImageFormat::CMPR, ImageCoder::selectFormat(image, 25.));
+    EXPECT_EQ(ImageFormat::RGBA8, ImageCoder::selectFormat(image, INFINITY));
+
+    // fully transparent pixels are kept by CMPR
+    for (uint32_t y = 0; y < 4; ++y)
+    {
+        for (uint32_t x = 0; x < 4; ++x)
+        {
+            std::fill(*image + image.offsetFor(x, y), *image + image.offsetFor(x, y) + 4, 0x00);
+        }
+    }
+    EXPECT_EQ(ImageFormat::CMPR, ImageCoder::selectFormat(image, 25.));
+
+    // translucent pixels exclude the formats without alpha
+    (*image)[3] = 0x80;
+    EXPECT_EQ(ImageFormat::RGB5A3, ImageCoder::selectFormat(image, 25.));
+
+    // few translucent colours fit in a palette
+    Image fewColours(16, 16, {0x00, 0x80, 0x40, 0x80});
+    for (uint32_t i = 0; i < 16 * 16; ++i)
+    {
+        (*fewColours)[i * 4] = static_cast<uint8_t>((i % 3) * 0x40);
+    }
+    Palette palette;
+    EXPECT_EQ(ImageFormat::RGB5A3, ImageCoder::selectFormat(fewColours, 25.));
+    EXPECT_EQ(ImageFormat::C4, ImageCoder::selectFormat(fewColours, 25., &palette));
+    EXPECT_EQ(PaletteFormat::RGB5A3, palette.getFormat());
+    EXPECT_EQ(3, palette.getCount());
+}
+
 TEST(ImageCoderTests, SizeFor)
 {
     EXPECT_EQ(672, ImageCoder::sizeFor(19, 53, ImageFormat::I4));
@@ -121,6 +677,9 @@ TEST(ImageCoderTests, SizeFor)
     EXPECT_EQ(3520, ImageCoder::sizeFor(41, 38, ImageFormat::RGB5A3));
     EXPECT_EQ(4224, ImageCoder::sizeFor(9, 87, ImageFormat::RGBA8));
     EXPECT_EQ(1120, ImageCoder::sizeFor(55, 39, ImageFormat::CMPR));
+    EXPECT_EQ(672, ImageCoder::sizeFor(19, 53, ImageFormat::C4));
+    EXPECT_EQ(1056, ImageCoder::sizeFor(81, 12, ImageFormat::C8));
+    EXPECT_EQ(2688, ImageCoder::sizeFor(27, 45, ImageFormat::C14X2));
 }
 
 TEST(ImageIOTests, Read)
@@ -147,4 +706,7 @@ TEST(ImageIOTests, Read)
     EXPECT_EQ(4, tga.getWidth());
     EXPECT_EQ(4, tga.getHeight());
     EXPECT_TRUE(Bytes::matches(expectTGA, *tga, 4 * 4 * 4));
+
+    EXPECT_THROW(ImageIO::read(CT_LIB_TESTS_DATA_DIR"/Images/Missing.png"), ImageError);
+    EXPECT_THROW(ImageIO::read(CT_LIB_TESTS_DATA_DIR"/Images/Coder/I4.bin"), ImageError);
 }
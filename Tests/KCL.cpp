@@ -7,11 +7,35 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <map>
+#include <numeric>
+
 #include <CTLib/KCL.hpp>
 
 using namespace CTLib;
 
-TEST(KCLTests, MinPosAndMasks)
+// restores the KCL settings after each test, as tests change them
+class KCLTests : public ::testing::Test
+{
+protected:
+
+    void SetUp() override
+    {
+        settings = KCL::getSettings();
+    }
+
+    void TearDown() override
+    {
+        KCL::setSettings(settings);
+    }
+
+private:
+
+    KCL::Settings settings;
+};
+
+TEST_F(KCLTests, MinPosAndMasks)
 {
     KCL::Settings settings;
     settings.blowFactor = 0.f;
@@ -62,7 +86,7 @@ TEST(KCLTests, MinPosAndMasks)
     EXPECT_EQ(0xFFFFC000, octree2->getMaskZ());
 }
 
-TEST(KCLTests, ShiftsAndSize)
+TEST_F(KCLTests, ShiftsAndSize)
 {
     KCL::Settings settings;
     settings.blowFactor = 0.f;
@@ -116,7 +140,7 @@ TEST(KCLTests, ShiftsAndSize)
     EXPECT_EQ(Vector3f(8192, 8192, 8192), octree2->getBlockSize());
 }
 
-TEST(KCLTests, OctreeErrors)
+TEST_F(KCLTests, OctreeErrors)
 {
     float verts[] = {
         2843.f, -721.f, -23.f,   -1042.f, 284.f, 732.f,   8123.f, -5.f, -8923.f,
@@ -153,7 +177,7 @@ TEST(KCLTests, OctreeErrors)
     EXPECT_NO_THROW(octree->getNode(0));
 }
 
-TEST(KCLTests, FromModelErrors)
+TEST_F(KCLTests, FromModelErrors)
 {
     float verts[] = {
         98.f, 32.f, -243.f,   -162.f, -234.f, 342.f,   2.f, -5523.f, -3.f,
@@ -184,4 +208,692 @@ TEST(KCLTests, FromModelErrors)
     vertices.position(0xC);
     flags.position(0);
     EXPECT_THROW(KCL::fromModel(vertices, flags, 3), KCLError);
+
+    // one triangle more than 16 bit indices allow, 0xFFFF ending lists
+    uint32_t triCount = 0x10000;
+    Buffer manyVertices(triCount * 36);
+    Buffer manyFlags(triCount * 2);
+    for (uint32_t i = 0; i < triCount; ++i)
+    {
+        float x = static_cast<float>(i & 0xFF) * 100.f, z = static_cast<float>(i >> 8) * 100.f;
+        manyVertices.putFloat(x).putFloat(0.f).putFloat(z);
+        manyVertices.putFloat(x).putFloat(0.f).putFloat(z + 50.f);
+        manyVertices.putFloat(x + 50.f).putFloat(0.f).putFloat(z);
+        manyFlags.putShort(0);
+    }
+    manyVertices.flip();
+    manyFlags.flip();
+    EXPECT_THROW(KCL::fromModel(manyVertices, manyFlags), KCLError);
+
+    manyVertices.rewind();
+    manyFlags.rewind();
+    EXPECT_EQ(0xFFFF, KCL::fromModel(manyVertices, manyFlags, 0xFFFF).getTriangles().size());
+}
+
+// returns a KCL with a floor at y=0 (flag 3) and a wall at x=500 facing the
+// negative X-axis (flag 7)
+KCL createQueryTestKCL(KCL::Settings settings = KCL::Settings())
+{
+    settings.maxTriangles = 1;
+    KCL::setSettings(settings);
+
+    float verts[] = {
+        -1000.f, 0.f, -1000.f,   -1000.f, 0.f, 1000.f,   1000.f, 0.f, -1000.f,
+        1000.f, 0.f, -1000.f,   -1000.f, 0.f, 1000.f,   1000.f, 0.f, 1000.f,
+        500.f, 0.f, -1000.f,   500.f, 0.f, 1000.f,   500.f, 1000.f, -1000.f,
+        500.f, 1000.f, -1000.f,   500.f, 0.f, 1000.f,   500.f, 1000.f, 1000.f
+    };
+    uint16_t triFlags[] = {3, 3, 7, 7};
+    uint32_t vertCount = static_cast<uint32_t>(sizeof(verts) / sizeof(float));
+
+    Buffer vertices(vertCount * 4);
+    for (uint32_t i = 0; i < vertCount; ++i)
+    {
+        vertices.putFloat(verts[i]);
+    }
+    vertices.flip();
+
+    Buffer flags(vertCount / 9 * 2);
+    for (uint32_t i = 0; i < vertCount / 9; ++i)
+    {
+        flags.putShort(triFlags[i]);
+    }
+    flags.flip();
+
+    return KCL::fromModel(vertices, flags);
+}
+
+TEST_F(KCLTests, QueryRaycast)
+{
+    KCL kcl = createQueryTestKCL();
+    KCL::Query query(kcl);
+
+    KCL::Query::Hit hit = query.findGround({-200.f, 300.f, 100.f}, 1000.f);
+    ASSERT_NE(KCL::Query::Hit::NONE, hit.triangle);
+    EXPECT_EQ(3, hit.flag);
+    EXPECT_NEAR(300.f, hit.distance, .01f);
+    EXPECT_NEAR(0.f, hit.position[1], .01f);
+    EXPECT_NEAR(1.f, hit.normal[1], .0001f);
+
+    // starting outside of the octree
+    hit = query.findGround({-200.f, 5000.f, 100.f}, 10000.f);
+    EXPECT_EQ(3, hit.flag);
+    EXPECT_NEAR(5000.f, hit.distance, .01f);
+
+    // too short, off the floor and from below the floor
+    EXPECT_EQ(KCL::Query::Hit::NONE, query.findGround({-200.f, 300.f, 100.f}, 200.f).triangle);
+    EXPECT_EQ(KCL::Query::Hit::NONE, query.findGround({-2000.f, 300.f, 100.f}, 1000.f).triangle);
+    hit = query.raycast({-200.f, -300.f, 100.f}, {0.f, 1.f, 0.f}, 1000.f);
+    EXPECT_EQ(KCL::Query::Hit::NONE, hit.triangle);
+
+    // the wall is in front of the floor
+    hit = query.raycast({0.f, 100.f, 0.f}, {2.f, -.1f, 0.f}, 5000.f);
+    EXPECT_EQ(7, hit.flag);
+    EXPECT_NEAR(500.f, hit.position[0], .01f);
+    EXPECT_NEAR(-1.f, hit.normal[0], .0001f);
+
+    // the wall cannot be hit from behind
+    hit = query.raycast({900.f, 300.f, 0.f}, {-1.f, -.5f, 0.f}, 5000.f);
+    EXPECT_EQ(3, hit.flag);
+    EXPECT_NEAR(300.f, hit.position[0], .01f);
+}
+
+TEST_F(KCLTests, QueryLongRaycast)
+{
+    // small cells far along the ray, where a step of a fraction of the cell
+    // size is less than the float spacing of the distance
+    KCL::Settings settings;
+    settings.minNodeSize = 32.f;
+    KCL kcl = createQueryTestKCL(settings);
+    KCL::Query query(kcl);
+
+    KCL::Query::Hit hit = query.raycast({-1000000.f, 50.f, 3.f}, {1.f, -.00005f, .00001f}, 2000000.f);
+    ASSERT_NE(KCL::Query::Hit::NONE, hit.triangle);
+    EXPECT_EQ(3, hit.flag);
+    EXPECT_NEAR(0.f, hit.position[1], .01f);
+    EXPECT_NEAR(0.f, hit.position[0], 10.f);
+
+    // this ray used to stop moving at a cell boundary and never return; it
+    // passes under the floor, so it hits nothing
+    hit = query.raycast(
+        {-1687680.88f, 50.2397194f, 249.858322f}, {1.f, -6.68620705e-05f, -.000237967746f}, 4000000.f
+    );
+    EXPECT_EQ(KCL::Query::Hit::NONE, hit.triangle);
+}
+
+TEST_F(KCLTests, QueryClosestAndSphere)
+{
+    KCL kcl = createQueryTestKCL();
+    KCL::Query query(kcl);
+
+    EXPECT_EQ(KCL::Query::NO_LEAF, query.findLeaf({0.f, 5000.f, 0.f}));
+    uint32_t leaf = query.findLeaf({0.f, 10.f, 0.f});
+    ASSERT_NE(KCL::Query::NO_LEAF, leaf);
+    EXPECT_TRUE(query.getOctree().isLeaf(leaf));
+
+    KCL::Query::Hit hit = query.findClosest({0.f, 100.f, 0.f}, 1000.f);
+    EXPECT_EQ(3, hit.flag);
+    EXPECT_NEAR(100.f, hit.distance, .01f);
+    EXPECT_NEAR(0.f, hit.position[1], .01f);
+
+    hit = query.findClosest({450.f, 100.f, 0.f}, 1000.f);
+    EXPECT_EQ(7, hit.flag);
+    EXPECT_NEAR(50.f, hit.distance, .01f);
+    EXPECT_NEAR(500.f, hit.position[0], .01f);
+
+    EXPECT_EQ(KCL::Query::Hit::NONE, query.findClosest({0.f, 100.f, 0.f}, 50.f).triangle);
+
+    EXPECT_EQ((std::vector<uint16_t>{}), query.findTriangles({0.f, 100.f, 0.f}, 50.f));
+    EXPECT_EQ((std::vector<uint16_t>{0}), query.findTriangles({-500.f, 100.f, -500.f}, 150.f));
+    EXPECT_EQ((std::vector<uint16_t>{0, 1}), query.findTriangles({0.f, 100.f, 0.f}, 150.f));
+    EXPECT_EQ((std::vector<uint16_t>{1, 2}), query.findTriangles({450.f, 0.f, 200.f}, 60.f));
+}
+
+TEST_F(KCLTests, QueryBatch)
+{
+    KCL kcl = createQueryTestKCL();
+    KCL::Query query(kcl);
+
+    std::vector<Vector3f> points;
+    std::vector<KCL::Query::Ray> rays;
+    for (uint32_t i = 0; i < 1000; ++i)
+    {
+        Vector3f p(static_cast<float>(i % 40) * 60.f - 1200.f, 300.f, (i / 40) * 80.f - 1000.f);
+        points.push_back(p);
+        rays.push_back({p, {1.f, -.5f, .2f}, 2000.f});
+    }
+
+    std::vector<KCL::Query::Hit> ground = query.findGround(points, 1000.f, 4);
+    std::vector<KCL::Query::Hit> closest = query.findClosest(points, 1000.f, 0);
+    std::vector<KCL::Query::Hit> hits = query.raycast(rays, 3);
+    ASSERT_EQ(points.size(), ground.size());
+    ASSERT_EQ(points.size(), closest.size());
+    ASSERT_EQ(points.size(), hits.size());
+    for (size_t i = 0; i < points.size(); ++i)
+    {
+        EXPECT_EQ(query.findGround(points[i], 1000.f).triangle, ground[i].triangle);
+        EXPECT_EQ(query.findClosest(points[i], 1000.f).triangle, closest[i].triangle);
+        KCL::Query::Hit hit = query.raycast(rays[i].origin, rays[i].direction, 2000.f);
+        EXPECT_EQ(hit.triangle, hits[i].triangle);
+    }
+
+    // queries give the same results on a KCL read back from its file
+    Buffer data = KCL::write(kcl);
+    KCL read = KCL::read(data);
+    KCL::Query readQuery(read);
+    for (size_t i = 0; i < points.size(); ++i)
+    {
+        EXPECT_EQ(ground[i].triangle, readQuery.findGround(points[i], 1000.f).triangle);
+        KCL::Query::Hit hit = readQuery.raycast(rays[i].origin, rays[i].direction, 2000.f);
+        EXPECT_EQ(hits[i].triangle, hit.triangle);
+    }
+}
+
+TEST_F(KCLTests, QueryTooManyTriangles)
+{
+    // a KCL file may list more triangles than its octree can reference
+    Buffer data = KCL::write(createQueryTestKCL());
+    const uint32_t extra = 0x10000;
+    const uint32_t trisOff = data.getInt(0x8), octreeOff = data.getInt(0xC);
+    Buffer large(data.capacity() + extra * 0x10);
+    large.putArray(*data, octreeOff);
+    for (uint32_t i = 0; i < extra; ++i)
+    {
+        large.putArray(*data + trisOff + 0x10, 0x10);
+    }
+    large.putArray(*data + octreeOff, data.capacity() - octreeOff);
+    large.putInt(0xC, octreeOff + extra * 0x10);
+    large.flip();
+
+    KCL kcl = KCL::read(large);
+    EXPECT_GT(kcl.getTriangles().size(), 0xFFFF);
+    EXPECT_THROW(KCL::Query query(kcl), KCLError);
+    EXPECT_THROW(KCL::profile(kcl, {Vector3f(0.f, 0.f, 0.f)}), KCLError);
+}
+
+// checks that the FlatOctree node at 'flatIdx' has the same content as 'node'
+void expectSameNode(
+    const KCL::FlatOctree& flat, uint32_t flatIdx, const KCL::OctreeNode* node
+)
+{
+    ASSERT_EQ(!node->isSuperNode(), flat.isLeaf(flatIdx));
+    if (node->isSuperNode())
+    {
+        for (uint8_t i = 0; i < 8; ++i)
+        {
+            expectSameNode(flat, flat.getChild(flatIdx, i), node->getChild(i));
+        }
+    }
+    else
+    {
+        EXPECT_EQ(node->getIndices(), flat.getIndices(flatIdx));
+    }
+}
+
+TEST_F(KCLTests, FlatOctree)
+{
+    KCL kcl = createQueryTestKCL();
+    KCL::Octree* octree = kcl.getOctree();
+    KCL::FlatOctree flat(*octree);
+
+    EXPECT_EQ(octree->getMinPos(), flat.getMinPos());
+    EXPECT_EQ(octree->getMasks(), flat.getMasks());
+    EXPECT_EQ(octree->getShift(), flat.getShift());
+    EXPECT_EQ(octree->getShiftY(), flat.getShiftY());
+    EXPECT_EQ(octree->getShiftZ(), flat.getShiftZ());
+    ASSERT_EQ(octree->getRootNodeCount(), flat.getRootNodeCount());
+    EXPECT_EQ(octree->getAllNodes().size(), flat.getNodes().size());
+    for (uint32_t i = 0; i < flat.getRootNodeCount(); ++i)
+    {
+        expectSameNode(flat, i, octree->getNode(i));
+    }
+
+    // all empty leaves share the first list
+    EXPECT_EQ(KCL::FlatOctree::END, flat.getTriangleLists().at(0));
+    EXPECT_LT(flat.getMemoryUsage() * 4, octree->getMemoryUsage());
+
+    EXPECT_THROW(flat.isLeaf(static_cast<uint32_t>(flat.getNodes().size())), KCLError);
+    uint32_t leaf = 0;
+    while (!flat.isLeaf(leaf))
+    {
+        ++leaf;
+    }
+    EXPECT_THROW(flat.getChild(leaf, 0), KCLError);
+
+    Buffer vertices(0), flags(0);
+    KCL empty = KCL::fromModel(vertices, flags);
+    KCL::FlatOctree emptyFlat(*empty.getOctree());
+    EXPECT_EQ(empty.getOctree()->getAllNodes().size(), emptyFlat.getNodes().size());
+}
+
+TEST_F(KCLTests, SharedTriangleLists)
+{
+    KCL kcl = createQueryTestKCL();
+    KCL::Octree* octree = kcl.getOctree();
+    KCL::FlatOctree flat(*octree);
+
+    // leaves with the same triangles share their list
+    std::map<std::vector<uint16_t>, uint32_t> values;
+    size_t unsharedSize = 1;
+    for (uint32_t i = 0; i < flat.getNodes().size(); ++i)
+    {
+        if (!flat.isLeaf(i) || flat.getIndices(i).empty())
+        {
+            continue;
+        }
+        std::vector<uint16_t> indices = flat.getIndices(i);
+        unsharedSize += indices.size() + 1;
+        auto it = values.emplace(indices, flat.getNodes()[i]).first;
+        EXPECT_EQ(it->second, flat.getNodes()[i]);
+    }
+    EXPECT_LT(flat.getTriangleLists().size(), unsharedSize);
+
+    // shared lists are read back once for each leaf
+    Buffer data = KCL::write(kcl);
+    KCL read = KCL::read(data);
+    ASSERT_EQ(octree->getRootNodeCount(), read.getOctree()->getRootNodeCount());
+    for (uint32_t i = 0; i < flat.getRootNodeCount(); ++i)
+    {
+        expectSameNode(flat, i, read.getOctree()->getNode(i));
+    }
+}
+
+TEST_F(KCLTests, ReadOctreeErrors)
+{
+    KCL kcl = createQueryTestKCL();
+    KCL::FlatOctree flat(*kcl.getOctree());
+    Buffer data = KCL::write(kcl);
+    const uint32_t octreeOff = data.getInt(0xC);
+
+    uint32_t superNode = 0;
+    while (flat.isLeaf(superNode))
+    {
+        ++superNode;
+    }
+    ASSERT_LT(superNode, flat.getRootNodeCount());
+
+    // a super node whose children would be itself
+    Buffer looping = KCL::write(kcl);
+    looping.putInt(octreeOff + superNode * 4, 0);
+    EXPECT_THROW(KCL::read(looping), KCLError);
+
+    // a triangle list past the end of the data
+    Buffer outside = KCL::write(kcl);
+    outside.putInt(octreeOff + superNode * 4, 0x80000000 | static_cast<uint32_t>(data.remaining()));
+    EXPECT_THROW(KCL::read(outside), KCLError);
+
+    // a triangle index out of range
+    Buffer badIndex = KCL::write(kcl);
+    const uint32_t listsOff = octreeOff + static_cast<uint32_t>(flat.getNodes().size()) * 4;
+    badIndex.putShort(listsOff, static_cast<uint16_t>(kcl.getTriangles().size() + 1));
+    EXPECT_THROW(KCL::read(badIndex), KCLError);
+
+    EXPECT_NO_THROW(KCL::read(data));
+}
+
+TEST_F(KCLTests, BuildSettings)
+{
+    KCL kcl = createQueryTestKCL();
+    KCL::FlatOctree flat(*kcl.getOctree());
+    KCL::FlatOctree::Stats stats = flat.getStats();
+
+    ASSERT_GT(stats.leavesPerDepth.size(), 2);
+    uint32_t leafCount = 0;
+    for (uint32_t count : stats.leavesPerDepth)
+    {
+        leafCount += count;
+    }
+    EXPECT_EQ(stats.leafCount, leafCount);
+    EXPECT_EQ(flat.getNodes().size(), stats.leafCount + stats.superNodeCount);
+    EXPECT_EQ(flat.getNodes().size() * 4 + flat.getTriangleLists().size() * 2, stats.size);
+    EXPECT_LE(stats.maxTriangles, 4);
+    EXPECT_GT(stats.averageTriangles, 0.f);
+    EXPECT_LT(stats.averageQueryTriangles, stats.averageTriangles);
+
+    KCL::Settings settings;
+    settings.maxDepth = 1;
+    stats = KCL::FlatOctree(*createQueryTestKCL(settings).getOctree()).getStats();
+    EXPECT_EQ(2, stats.leavesPerDepth.size());
+
+    settings = KCL::Settings();
+    settings.minNodeSize = 1000000.f;
+    KCL unsplit = createQueryTestKCL(settings);
+    stats = KCL::FlatOctree(*unsplit.getOctree()).getStats();
+    EXPECT_EQ(0, stats.superNodeCount);
+
+    // no split is worth that much memory, and merged nodes get back the
+    // triangles of their children
+    settings = KCL::Settings();
+    settings.memoryCost = 1000.f;
+    KCL merged = createQueryTestKCL(settings);
+    KCL::Octree* octree = merged.getOctree();
+    ASSERT_EQ(octree->getRootNodeCount(), octree->getAllNodes().size());
+    KCL::FlatOctree mergedFlat(*octree);
+    for (uint32_t i = 0; i < octree->getRootNodeCount(); ++i)
+    {
+        expectSameNode(mergedFlat, i, unsplit.getOctree()->getNode(i));
+    }
+}
+
+TEST_F(KCLTests, Profile)
+{
+    KCL kcl = createQueryTestKCL();
+    KCL::Query query(kcl);
+    const KCL::FlatOctree& flat = query.getOctree();
+
+    // a route along the floor, across the wall, and one point off the course
+    std::vector<Vector3f> samples;
+    for (float x = -900.f; x <= 900.f; x += 50.f)
+    {
+        samples.push_back({x, 10.f, 100.f});
+    }
+    samples.push_back({0.f, 100000.f, 0.f});
+
+    KCL::Profile profile = KCL::profile(kcl, samples, 3);
+
+    Buffer data = KCL::write(kcl);
+    EXPECT_EQ(data.remaining(), profile.sizes.total);
+    EXPECT_EQ(flat.getNodes().size() * 4, profile.sizes.octreeNodes);
+    EXPECT_EQ(flat.getTriangleLists().size() * 2, profile.sizes.triangleLists);
+
+    uint32_t nodeCount = 0, leafCount = 0;
+    for (uint32_t count : profile.stats.nodesPerDepth)
+    {
+        nodeCount += count;
+    }
+    for (uint32_t count : profile.stats.leavesPerTriangleCount)
+    {
+        leafCount += count;
+    }
+    EXPECT_EQ(flat.getNodes().size(), nodeCount);
+    EXPECT_EQ(profile.stats.leafCount, leafCount);
+    EXPECT_EQ(profile.stats.emptyLeafCount, profile.stats.leavesPerTriangleCount[0]);
+
+    uint32_t tests = 0, maxTests = 0;
+    for (size_t i = 0; i + 1 < samples.size(); ++i)
+    {
+        uint32_t count = static_cast<uint32_t>(flat.getIndices(query.findLeaf(samples[i])).size());
+        tests += count;
+        maxTests = std::max(maxTests, count);
+    }
+    EXPECT_EQ(samples.size(), profile.sampleCount);
+    EXPECT_EQ(1, profile.outsideSampleCount);
+    EXPECT_FLOAT_EQ(static_cast<float>(tests) / (samples.size() - 1), profile.averageTests);
+    EXPECT_EQ(maxTests, profile.maxTests);
+
+    ASSERT_EQ(3, profile.worstCells.size());
+    for (uint32_t i = 0; i < 2; ++i)
+    {
+        const KCL::Profile::Cell& cell = profile.worstCells[i];
+        const KCL::Profile::Cell& next = profile.worstCells[i + 1];
+        EXPECT_GE(cell.triangles * cell.samples, next.triangles * next.samples);
+    }
+
+    // the worst cell is where the samples are
+    const KCL::Profile::Cell& worst = profile.worstCells[0];
+    EXPECT_GT(worst.samples, 0);
+    EXPECT_EQ(flat.getIndices(worst.node).size(), worst.triangles);
+    Vector3f centre = worst.min + Vector3f(worst.size, worst.size, worst.size) * .5f;
+    EXPECT_EQ(worst.node, query.findLeaf(centre));
+}
+
+// returns a pseudo-random value in [0, range] and advances 'seed'
+float randomFloat(uint32_t& seed, float range)
+{
+    seed = seed * 1103515245 + 12345;
+    return static_cast<float>((seed >> 8) & 0xFFFF) / 0xFFFF * range;
+}
+
+TEST_F(KCLTests, ParallelBuild)
+{
+    KCL::Settings settings;
+    settings.blowFactor = 400.f;
+    settings.maxTriangles = 4;
+    KCL::setSettings(settings);
+
+    // small triangles scattered over several root blocks
+    uint32_t triCount = 3000;
+    Buffer vertices(triCount * 36);
+    Buffer flags(triCount * 2);
+    uint32_t seed = 1;
+    for (uint32_t i = 0; i < triCount; ++i)
+    {
+        float x = randomFloat(seed, 40000.f);
+        float y = randomFloat(seed, 5000.f);
+        float z = randomFloat(seed, 40000.f);
+        for (uint32_t v = 0; v < 3; ++v)
+        {
+            vertices.putFloat(x + randomFloat(seed, 600.f));
+            vertices.putFloat(y + randomFloat(seed, 600.f));
+            vertices.putFloat(z + randomFloat(seed, 600.f));
+        }
+        flags.putShort(static_cast<uint16_t>(i));
+    }
+    vertices.flip();
+    flags.flip();
+
+    KCL serial = KCL::fromModel(vertices, flags);
+    vertices.rewind();
+    flags.rewind();
+    KCL parallel = KCL::fromModel(vertices, flags, -1, 4);
+
+    ASSERT_GT(serial.getOctree()->getRootNodeCount(), 8);
+    EXPECT_EQ(serial.getOctree()->getAllNodes().size(), parallel.getOctree()->getAllNodes().size());
+    KCL::FlatOctree flat(*parallel.getOctree());
+    for (uint32_t i = 0; i < serial.getOctree()->getRootNodeCount(); ++i)
+    {
+        expectSameNode(flat, i, serial.getOctree()->getNode(i));
+    }
+
+    EXPECT_EQ(KCL::write(serial), KCL::write(parallel));
+}
+
+// checks that 'node' holds, in order, the triangles of 'candidates' which are
+// partly inside it, as when every triangle is tested against every root node
+void expectExhaustiveNode(
+    const KCL::OctreeNode* node, const std::vector<Vector3f>& tris,
+    const std::vector<uint16_t>& candidates
+)
+{
+    std::vector<uint16_t> inside;
+    for (uint16_t idx : candidates)
+    {
+        const Vector3f* t = &tris[idx * 3];
+        if (Math::isPartlyInsideAABB(node->getBounds(), t[0], t[1], t[2]))
+        {
+            inside.push_back(idx);
+        }
+    }
+
+    if (!node->isSuperNode())
+    {
+        EXPECT_EQ(inside, node->getIndices());
+        return;
+    }
+    for (uint8_t i = 0; i < 8; ++i)
+    {
+        expectExhaustiveNode(node->getChild(i), tris, inside);
+    }
+}
+
+TEST_F(KCLTests, BinnedBuild)
+{
+    KCL::Settings settings;
+    settings.blowFactor = 400.f;
+    settings.maxTriangles = 4;
+    KCL::setSettings(settings);
+
+    // the first triangle puts the minimum position at the origin, so that
+    // root cells are bounded by multiples of the block size
+    std::vector<Vector3f> tris = {
+        {400.f, 400.f, 400.f}, {1400.f, 400.f, 400.f}, {400.f, 400.f, 1400.f}
+    };
+
+    // triangles lying on the planes between root cells, through their
+    // corners, and touching their blown up bounds
+    const float block = 8192.f;
+    for (float edge : {block, block * 2.f})
+    {
+        for (float p : {edge - 400.f, edge, edge + 400.f})
+        {
+            for (float q : {3000.f, edge - 500.f})
+            {
+                tris.insert(tris.end(), {{p, q, q}, {p, q + 1000.f, q}, {p, q, q + 1000.f}});
+                tris.insert(tris.end(), {{q, p, q}, {q, p, q + 1000.f}, {q + 1000.f, p, q}});
+                tris.insert(tris.end(), {{q, q, p}, {q + 1000.f, q, p}, {q, q + 1000.f, p}});
+            }
+            tris.insert(tris.end(), {{p, p, p}, {p + 500.f, p, p}, {p, p + 500.f, p}});
+            tris.insert(tris.end(), {{p, p, p}, {p - 500.f, p, p - 500.f}, {p, p - 500.f, p}});
+        }
+    }
+
+    // small triangles scattered over every root cell to split them
+    uint32_t seed = 3;
+    while (tris.size() < 1500 * 3)
+    {
+        Vector3f base(
+            randomFloat(seed, 23000.f) + 500.f, randomFloat(seed, 23000.f) + 500.f,
+            randomFloat(seed, 23000.f) + 500.f
+        );
+        tris.push_back(base);
+        tris.push_back(base + Vector3f(randomFloat(seed, 800.f), 0.f, randomFloat(seed, 800.f)));
+        tris.push_back(base + Vector3f(0.f, randomFloat(seed, 800.f), 800.f));
+    }
+
+    const uint32_t triCount = static_cast<uint32_t>(tris.size() / 3);
+    Buffer vertices(triCount * 36);
+    Buffer flags(triCount * 2);
+    for (uint32_t i = 0; i < triCount; ++i)
+    {
+        for (uint32_t v = 0; v < 3; ++v)
+        {
+            vertices.putFloat(tris[i * 3 + v][0]);
+            vertices.putFloat(tris[i * 3 + v][1]);
+            vertices.putFloat(tris[i * 3 + v][2]);
+        }
+        flags.putShort(0);
+    }
+    vertices.flip();
+    flags.flip();
+
+    std::vector<uint16_t> all(triCount);
+    std::iota(all.begin(), all.end(), 0);
+    for (uint32_t threads : {1u, 4u})
+    {
+        vertices.rewind();
+        flags.rewind();
+        KCL kcl = KCL::fromModel(vertices, flags, -1, threads);
+        ASSERT_EQ(triCount, kcl.getTriangles().size());
+
+        const KCL::Octree* octree = kcl.getOctree();
+        ASSERT_EQ(Vector3f(0.f, 0.f, 0.f), octree->getMinPos());
+        ASSERT_EQ(block, octree->getBlockSize()[0]);
+        ASSERT_EQ(64, octree->getRootNodeCount());
+        for (uint32_t i = 0; i < octree->getRootNodeCount(); ++i)
+        {
+            expectExhaustiveNode(octree->getNode(i), tris, all);
+        }
+    }
+}
+
+TEST_F(KCLTests, NormalEpsilon)
+{
+    // the second triangle is tilted by about 1e-6 radians from the first one
+    float verts[] = {
+        0.f, 0.f, 0.f,   0.f, 0.f, 1000.f,   1000.f, 0.f, 0.f,
+        2000.f, 0.f, 0.f,   2000.f, 0.f, 1000.f,   3000.f, .001f, 0.f,
+        0.f, 0.f, 0.f,   0.f, 0.f, -1000.f,   -1000.f, 0.f, 0.f
+    };
+    uint32_t vertCount = static_cast<uint32_t>(sizeof(verts) / sizeof(float));
+
+    Buffer vertices(vertCount * 4);
+    for (uint32_t i = 0; i < vertCount; ++i)
+    {
+        vertices.putFloat(verts[i]);
+    }
+    vertices.flip();
+
+    Buffer flags(vertCount / 9 * 2);
+    for (uint32_t i = 0; i < vertCount / 9; ++i)
+    {
+        flags.putShort(0);
+    }
+    flags.flip();
+
+    KCL::Settings settings;
+    KCL::setSettings(settings);
+    KCL exact = KCL::fromModel(vertices, flags);
+
+    // the first and last triangles share a vertex, and the same plane
+    EXPECT_EQ(2, exact.getVertices().size());
+    std::vector<KCL::Triangle> tris = exact.getTriangles();
+    EXPECT_EQ(tris[0].position, tris[2].position);
+    EXPECT_EQ(tris[0].direction, tris[2].direction);
+    EXPECT_NE(tris[0].direction, tris[1].direction);
+
+    settings.normalEpsilon = .0001f;
+    KCL::setSettings(settings);
+    vertices.rewind();
+    flags.rewind();
+    KCL merged = KCL::fromModel(vertices, flags);
+
+    tris = merged.getTriangles();
+    EXPECT_EQ(tris[0].direction, tris[1].direction);
+    EXPECT_LT(merged.getNormals().size(), exact.getNormals().size());
+    EXPECT_LT(KCL::write(merged).remaining(), KCL::write(exact).remaining());
+}
+
+TEST_F(KCLTests, PartlyInsideAABBs)
+{
+    // the 8 children of a node, like when splitting it
+    std::vector<AABB> children;
+    const AABB* bounds[8];
+    for (uint32_t i = 0; i < 8; ++i)
+    {
+        Vector3f pos(i & 1 ? 500.f : 0.f, i & 2 ? 500.f : 0.f, i & 4 ? 500.f : 0.f);
+        children.push_back(AABB(pos, pos + Vector3f(500.f, 500.f, 500.f)));
+    }
+    for (uint32_t i = 0; i < 8; ++i)
+    {
+        bounds[i] = &children[i];
+    }
+
+    // only crosses the first child by an edge; none of its vertices are inside
+    Vector3f t0(-100.f, 250.f, 250.f), t1(250.f, -100.f, 250.f), t2(-100.f, -100.f, 250.f);
+    EXPECT_TRUE(Math::isPartlyInsideAABB(children[0], t0, t1, t2));
+    EXPECT_EQ(1, Math::getPartlyInsideAABBs(bounds, 8, t0, t1, t2));
+
+    // overlaps the box on every axis, but its plane passes beyond the corner
+    t0 = Vector3f(700.f, 0.f, 0.f);
+    t1 = Vector3f(0.f, 700.f, 0.f);
+    t2 = Vector3f(0.f, 0.f, 700.f);
+    AABB corner(Vector3f(0.f, 0.f, 0.f), Vector3f(200.f, 200.f, 200.f));
+    EXPECT_FALSE(Math::isPartlyInsideAABB(corner, t0, t1, t2));
+    EXPECT_TRUE(Math::isPartlyInsideAABB(children[0], t0, t1, t2));
+
+    uint32_t seed = 7;
+    for (uint32_t n = 0; n < 2000; ++n)
+    {
+        Vector3f base(
+            randomFloat(seed, 1400.f) - 200.f, randomFloat(seed, 1400.f) - 200.f,
+            randomFloat(seed, 1400.f) - 200.f
+        );
+        t0 = base;
+        t1 = base + Vector3f(
+            randomFloat(seed, 600.f) - 300.f, randomFloat(seed, 600.f) - 300.f,
+            randomFloat(seed, 600.f) - 300.f
+        );
+        t2 = base + Vector3f(
+            randomFloat(seed, 600.f) - 300.f, randomFloat(seed, 600.f) - 300.f,
+            randomFloat(seed, 600.f) - 300.f
+        );
+
+        uint32_t count = n % 8 + 1;
+        uint8_t mask = Math::getPartlyInsideAABBs(bounds, count, t0, t1, t2);
+        for (uint32_t i = 0; i < 8; ++i)
+        {
+            bool expected = i < count && Math::isPartlyInsideAABB(children[i], t0, t1, t2);
+            EXPECT_EQ(expected, ((mask >> i) & 1) != 0);
+        }
+    }
 }
@@ -31,6 +31,36 @@ TEST(BufferTests, CopyCtor)
     EXPECT_EQ(buffer.limit(), copy.limit());
 }
 
+TEST(BufferTests, CopySlice)
+{
+    Buffer buffer(16);
+    for (uint8_t i = 0; i < 16; ++i)
+    {
+        buffer.put(i);
+    }
+
+    Buffer slice = buffer.position(10).slice();
+    slice.position(2);
+
+    Buffer copy{slice};
+    EXPECT_EQ(6, copy.capacity());
+    EXPECT_EQ(2, copy.position());
+    EXPECT_EQ(6, copy.limit());
+    EXPECT_EQ(10, copy[0]);
+    EXPECT_EQ(15, copy[5]);
+
+    Buffer assigned(1);
+    assigned = slice;
+    EXPECT_EQ(6, assigned.capacity());
+    EXPECT_EQ(2, assigned.position());
+    EXPECT_EQ(10, assigned[0]);
+    EXPECT_EQ(15, assigned[5]);
+
+    // the copy does not share memory with the slice
+    copy[0] = 0xFF;
+    EXPECT_EQ(10, slice[0]);
+}
+
 TEST(BufferTests, MoveCtor)
 {
     Buffer buffer(4);
@@ -45,6 +75,30 @@ TEST(BufferTests, MoveCtor)
     EXPECT_EQ(nullptr, *buffer);
 }
 
+TEST(BufferTests, AdoptCtor)
+{
+    uint32_t deleted = 0;
+    uint8_t* data = new uint8_t[8]{0, 1, 2, 3, 4, 5, 6, 7};
+    {
+        Buffer buffer(data, 8, [&deleted](uint8_t* ptr) { delete[] ptr; ++deleted; });
+        EXPECT_EQ(8, buffer.capacity());
+        EXPECT_EQ(0, buffer.position());
+        EXPECT_EQ(8, buffer.limit());
+        EXPECT_EQ(data, *buffer);
+        EXPECT_EQ(0x00010203, buffer.getInt());
+
+        Buffer duplicate = buffer.duplicate();
+        {
+            Buffer moved{std::move(buffer)};
+            EXPECT_EQ(data, *moved);
+        }
+        // the duplicate still shares the adopted memory
+        EXPECT_EQ(0, deleted);
+        EXPECT_EQ(7, duplicate[7]);
+    }
+    EXPECT_EQ(1, deleted);
+}
+
 TEST(BufferTests, PositionLimitAndRemaining)
 {
     Buffer buffer(8);
@@ -0,0 +1,71 @@
+//////////////////////////////////////////////////
+//  Copyright (c) 2020 Nara Hiero
+//
+// This file is licensed under GPLv3+
+// Refer to the `License.txt` file included.
+//////////////////////////////////////////////////
+
+#include <gtest/gtest.h>
+
+#include <CTLib/SZS.hpp>
+
+using namespace CTLib;
+
+TEST(SZSTests, ReadWrite)
+{
+    Buffer kmp(0x44);
+    Buffer blight(0x10);
+    for (size_t i = 0; i < 0x44; ++i)
+    {
+        kmp.put(static_cast<uint8_t>(i * 3));
+    }
+    for (size_t i = 0; i < 0x10; ++i)
+    {
+        blight.put(static_cast<uint8_t>(0x80 | i));
+    }
+    kmp.flip();
+    blight.flip();
+
+    U8Arc arc;
+    arc.addFileAbsolute("./course.kmp")->setData(kmp);
+    arc.addFileAbsolute("./posteffect/posteffect.blight")->setData(blight);
+    arc.addFileAbsolute("./empty.bin");
+
+    Buffer szs = SZS::write(arc);
+    U8Arc read = SZS::read(szs);
+    EXPECT_EQ(arc.totalCount(), read.totalCount());
+
+    U8File* kmpFile = read.getEntryAbsolute("./course.kmp")->asFile();
+    EXPECT_EQ(kmp, kmpFile->getData());
+    EXPECT_EQ(0x44, kmpFile->getDataSize());
+
+    U8File* blightFile = read.getEntryAbsolute("./posteffect/posteffect.blight")->asFile();
+    EXPECT_EQ(blight, blightFile->getData());
+
+    EXPECT_EQ(0, read.getEntryAbsolute("./empty.bin")->asFile()->getDataSize());
+
+    // files read from an SZS archive can be written back
+    Buffer rewritten = SZS::write(read);
+    U8Arc reread = SZS::read(rewritten);
+    EXPECT_EQ(kmp, reread.getEntryAbsolute("./course.kmp")->asFile()->getData());
+}
+
+TEST(SZSTests, Errors)
+{
+    U8Arc arc;
+    arc.addFileAbsolute("./course.kmp");
+
+    // not compressed
+    Buffer u8 = U8::write(arc);
+    EXPECT_THROW(SZS::read(u8), YazError);
+
+    // compressed, but not U8
+    Buffer data(0x20);
+    while (data.hasRemaining())
+    {
+        data.put(0);
+    }
+    data.flip();
+    Buffer compressed = Yaz::compress(data, YazFormat::Yaz0);
+    EXPECT_THROW(SZS::read(compressed), U8Error);
+}
@@ -155,6 +155,36 @@ TEST(U8ArcTests, AbsoluteGet)
     EXPECT_EQ(dossun, dir);
 }
 
+TEST(U8ArcTests, AbsolutePath)
+{
+    U8Arc arc;
+    EXPECT_EQ("", arc.asDirectory()->getAbsolutePath());
+
+    U8File* file = arc.addFileAbsolute("./effect/dossun/rk_dossun.breff");
+    EXPECT_EQ("./effect/dossun/rk_dossun.breff", file->getAbsolutePath());
+    EXPECT_EQ("./effect/dossun/", file->getParent()->getAbsolutePath());
+    EXPECT_EQ("./", arc.getEntry(".")->getAbsolutePath());
+
+    file->getParent()->rename("kuribo");
+    EXPECT_EQ("./effect/kuribo/rk_dossun.breff", file->getAbsolutePath());
+}
+
+TEST(U8ArcTests, NameView)
+{
+    U8Arc arc;
+    U8File* a = arc.addFileAbsolute("./a/course.kmp");
+    U8File* b = arc.addFileAbsolute("./b/course.kmp");
+
+    // equal names are stored once
+    EXPECT_EQ("course.kmp", a->getNameView());
+    EXPECT_EQ(a->getNameView().data(), b->getNameView().data());
+
+    std::string_view old = a->getNameView();
+    a->rename("course_d.kmp");
+    EXPECT_EQ("course_d.kmp", a->getNameView());
+    EXPECT_EQ("course.kmp", old);
+}
+
 TEST(U8ArcTests, AbsoluteAdd)
 {
     U8Arc arc;
@@ -191,3 +221,249 @@ TEST(U8ArcTests, AbsoluteAdd)
     // parent directory is an already existing file
     EXPECT_THROW(arc.addFileAbsolute("./course_model.brres/model.mdl0"), U8Error);
 }
+
+TEST(U8Tests, DeduplicateWrite)
+{
+    Buffer a(0x50);
+    Buffer b(0x50);
+    for (size_t i = 0; i < 0x50; ++i)
+    {
+        a.put(static_cast<uint8_t>(i));
+        b.put(static_cast<uint8_t>(0x50 - i));
+    }
+    a.flip();
+    b.flip();
+
+    U8Arc arc;
+    arc.addFileAbsolute("./first.bin")->setData(a);
+    arc.addFileAbsolute("./dir/second.bin")->setData(a);
+    arc.addFileAbsolute("./other.bin")->setData(b);
+    arc.addFileAbsolute("./empty.bin");
+
+    Buffer plain = U8::write(arc);
+    Buffer dedup = U8::write(arc, true);
+    EXPECT_EQ(plain.remaining() - 0x60, dedup.remaining());
+
+    U8Arc read = U8::read(dedup);
+    EXPECT_EQ(arc.totalCount(), read.totalCount());
+
+    for (const char* path : {"./first.bin", "./dir/second.bin", "./other.bin", "./empty.bin"})
+    {
+        Buffer expected = arc.getEntryAbsolute(path)->asFile()->getData();
+        Buffer actual = read.getEntryAbsolute(path)->asFile()->getData();
+        ASSERT_EQ(expected.remaining(), actual.remaining()) << path;
+        for (size_t i = 0; i < expected.remaining(); ++i)
+        {
+            EXPECT_EQ(expected[i], actual[i]) << path;
+        }
+    }
+}
+
+TEST(U8Tests, Patch)
+{
+    Buffer a(0x30);
+    Buffer b(0x08);
+    for (size_t i = 0; i < 0x30; ++i)
+    {
+        a.put(static_cast<uint8_t>(i));
+    }
+    for (size_t i = 0; i < 0x08; ++i)
+    {
+        b.put(static_cast<uint8_t>(0xF0 | i));
+    }
+    a.flip();
+    b.flip();
+
+    U8Arc arc;
+    arc.addFileAbsolute("./course.kcl")->setData(a);
+    arc.addFileAbsolute("./course.kmp")->setData(a);
+    arc.addFileAbsolute("./course_model.brres")->setData(a);
+    arc.addFileAbsolute("./posteffect/posteffect.blight")->setData(b);
+    arc.addFileAbsolute("./effect/dossun/rk_dossun.breff")->setData(a);
+    Buffer original = U8::write(arc);
+
+    U8Patch patch;
+    EXPECT_TRUE(patch.isEmpty());
+    patch.setFile("./course.kmp", b);
+    patch.setFile("./effect/dossun/rk_dossun.breft", b);
+    patch.remove("./posteffect");
+    EXPECT_FALSE(patch.isEmpty());
+    Buffer patched = U8::patch(original, patch);
+
+    // expected result is identical to a full rewrite
+    U8Arc expectedArc;
+    expectedArc.addFileAbsolute("./course.kcl")->setData(a);
+    expectedArc.addFileAbsolute("./course.kmp")->setData(b);
+    expectedArc.addFileAbsolute("./course_model.brres")->setData(a);
+    expectedArc.addFileAbsolute("./effect/dossun/rk_dossun.breff")->setData(a);
+    expectedArc.addFileAbsolute("./effect/dossun/rk_dossun.breft")->setData(b);
+    Buffer expected = U8::write(expectedArc);
+
+    ASSERT_EQ(expected.remaining(), patched.remaining());
+    for (size_t i = 0; i < expected.remaining(); ++i)
+    {
+        EXPECT_EQ(expected[i], patched[i]) << i;
+    }
+}
+
+TEST(U8Tests, PatchUnaligned)
+{
+    Buffer a(0x10);
+    Buffer b(0x10);
+    for (size_t i = 0; i < 0x10; ++i)
+    {
+        a.put(static_cast<uint8_t>(i));
+        b.put(static_cast<uint8_t>(0xF0 | i));
+    }
+    a.flip();
+    b.flip();
+
+    U8Arc arc;
+    arc.addFileAbsolute("./a.bin")->setData(a);
+    arc.addFileAbsolute("./b.bin")->setData(b);
+    Buffer original = U8::write(arc);
+
+    // move 'a.bin' to 0x10 bytes into the data section, right before 'b.bin'
+    uint32_t dataOff = original.getInt(0xC);
+    for (uint32_t i = 0; i < 0x10; ++i)
+    {
+        original.put(dataOff + 0x10 + i, original[dataOff + i]);
+        original.put(dataOff + i, 0);
+    }
+    original.putInt(0x20 + (2 * 0xC) + 4, dataOff + 0x10); // node after root and '.'
+
+    U8Patch patch;
+    patch.setFile("./c.bin", a);
+    Buffer patched = U8::patch(original, patch);
+
+    U8Arc expectedArc;
+    expectedArc.addFileAbsolute("./a.bin")->setData(a);
+    expectedArc.addFileAbsolute("./b.bin")->setData(b);
+    expectedArc.addFileAbsolute("./c.bin")->setData(a);
+    Buffer expected = U8::write(expectedArc);
+
+    ASSERT_EQ(expected.remaining(), patched.remaining());
+    for (size_t i = 0; i < expected.remaining(); ++i)
+    {
+        EXPECT_EQ(expected[i], patched[i]) << i;
+    }
+}
+
+TEST(U8Tests, PatchErrors)
+{
+    U8Arc arc;
+    arc.addFileAbsolute("./course.kmp");
+    arc.addDirectoryAbsolute("./posteffect");
+    Buffer data = U8::write(arc);
+
+    U8Patch missing;
+    missing.remove("./course.kcl");
+    EXPECT_THROW(U8::patch(data.rewind(), missing), U8Error);
+
+    U8Patch directory;
+    directory.setFile("./posteffect", Buffer(0));
+    EXPECT_THROW(U8::patch(data.rewind(), directory), U8Error);
+
+    U8Patch parentFile;
+    parentFile.setFile("./course.kmp/course.kcl", Buffer(0));
+    EXPECT_THROW(U8::patch(data.rewind(), parentFile), U8Error);
+
+    U8Patch emptyName;
+    emptyName.setFile(".//course.kcl", Buffer(0));
+    EXPECT_THROW(U8::patch(data.rewind(), emptyName), U8Error);
+
+    // a file whose offset plus size wraps around 32 bits
+    Buffer a(0x10);
+    for (size_t i = 0; i < 0x10; ++i)
+    {
+        a.put(static_cast<uint8_t>(i));
+    }
+    a.flip();
+    U8Arc wrapArc;
+    wrapArc.addFileAbsolute("./a.bin")->setData(a);
+    wrapArc.addFileAbsolute("./b.bin")->setData(a);
+    Buffer wrapped = U8::write(wrapArc);
+    uint32_t dataOff = wrapped.getInt(0xC);
+    wrapped.putInt(0x20 + (2 * 0xC) + 4, dataOff + 0x20); // node after root and '.'
+    wrapped.putInt(0x20 + (2 * 0xC) + 8, 0xFFFFFFF0);
+
+    U8Patch added;
+    added.setFile("./c.bin", a);
+    EXPECT_THROW(U8::patch(wrapped, added), U8Error);
+}
+
+TEST(U8Tests, FileHash)
+{
+    Buffer a(0x10);
+    Buffer b(0x10);
+    for (size_t i = 0; i < 0x10; ++i)
+    {
+        a.put(static_cast<uint8_t>(i));
+        b.put(static_cast<uint8_t>(i + 1));
+    }
+    a.flip();
+    b.flip();
+
+    U8Arc arc;
+    U8File* file = arc.addFileAbsolute("./course.kmp");
+    EXPECT_EQ(Bytes::hash(nullptr, 0), file->getHash());
+
+    file->setData(a);
+    uint64_t hashA = file->getHash();
+    EXPECT_EQ(Bytes::hash(*a, 0x10), hashA);
+
+    file->setData(b);
+    EXPECT_NE(hashA, file->getHash());
+
+    file->setDataShared(a);
+    EXPECT_EQ(hashA, file->getHash());
+}
+
+TEST(U8Tests, Manifest)
+{
+    Buffer a(0x10);
+    Buffer b(0x10);
+    for (size_t i = 0; i < 0x10; ++i)
+    {
+        a.put(static_cast<uint8_t>(i));
+        b.put(static_cast<uint8_t>(i + 1));
+    }
+    a.flip();
+    b.flip();
+
+    U8Arc arc;
+    arc.addFileAbsolute("./course.kcl")->setData(a);
+    arc.addFileAbsolute("./course.kmp")->setData(a);
+    arc.addFileAbsolute("./posteffect/posteffect.blight")->setData(b);
+
+    U8Manifest before(arc);
+    EXPECT_EQ(5, before.getEntries().size());
+    EXPECT_EQ(0, before.getEntries().at("./posteffect/"));
+    EXPECT_EQ(before, U8Manifest(arc));
+    EXPECT_EQ(before.getHash(), U8Manifest(arc).getHash());
+    EXPECT_TRUE(before.getChangedPaths(U8Manifest(arc)).empty());
+
+    arc.getEntryAbsolute("./course.kmp")->asFile()->setData(b);
+    arc.addFileAbsolute("./course_model.brres");
+    arc.getEntryAbsolute("./posteffect")->rename("effect");
+
+    U8Manifest after(arc);
+    EXPECT_NE(before, after);
+    EXPECT_NE(before.getHash(), after.getHash());
+
+    std::vector<std::string> changed = before.getChangedPaths(after);
+    std::vector<std::string> expected = {
+        "./course.kmp", "./course_model.brres", "./effect/", "./effect/posteffect.blight",
+        "./posteffect/", "./posteffect/posteffect.blight"
+    };
+    EXPECT_EQ(expected, changed);
+
+    // manifests can be restored from saved entries
+    U8Manifest restored;
+    for (auto& pair : after.getEntries())
+    {
+        restored.setEntry(pair.first, pair.second);
+    }
+    EXPECT_EQ(after, restored);
+    EXPECT_EQ(after.getHash(), restored.getHash());
+}
@@ -105,3 +105,101 @@ TEST(BytesTests, MatchesString)
     EXPECT_TRUE(Bytes::matchesString("blueberries", bytes, 10));
     EXPECT_TRUE(Bytes::matchesString("berries", bytes + 4, 6));
 }
+
+TEST(BytesTests, Hash)
+{
+    EXPECT_EQ(0xEF46DB3751D8E999, Bytes::hash(nullptr, 0));
+    EXPECT_EQ(0x44BC2CF5AD770999, Bytes::hash((const uint8_t*)"abc", 3));
+    EXPECT_EQ(
+        0xFBCEA83C8A378BF1,
+        Bytes::hash((const uint8_t*)"Nobody inspects the spammish repetition", 39)
+    );
+
+    // 32+ bytes to cover the stripe loop, then check that a single changed
+    // byte results in a different hash
+    uint8_t bytes[100];
+    for (uint32_t i = 0; i < 100; ++i)
+    {
+        bytes[i] = static_cast<uint8_t>(i * 7);
+    }
+    uint64_t hash = Bytes::hash(bytes, 100);
+    EXPECT_EQ(hash, Bytes::hash(bytes, 100));
+    EXPECT_NE(hash, Bytes::hash(bytes, 99));
+    EXPECT_NE(hash, Bytes::hash(bytes, 100, 1));
+
+    bytes[63] ^= 1;
+    EXPECT_NE(hash, Bytes::hash(bytes, 100));
+}
+
+TEST(StringPoolTests, Intern)
+{
+    StringPool pool;
+    EXPECT_EQ(0, pool.count());
+
+    std::string name = "course_model.brres";
+    std::string_view a = pool.intern(name);
+    std::string_view b = pool.intern("course_model.brres");
+    std::string_view c = pool.intern("course.kcl");
+    EXPECT_EQ("course_model.brres", a);
+    EXPECT_EQ(a.data(), b.data());
+    EXPECT_NE(a.data(), c.data());
+    EXPECT_EQ('\0', a.data()[a.size()]);
+    EXPECT_EQ(2, pool.count());
+
+    // views do not depend on the interned string
+    name[0] = 'C';
+    EXPECT_EQ("course_model.brres", a);
+
+    // large strings, and many small ones, remain valid
+    std::string large(0x2000, 'x');
+    std::string_view l = pool.intern(large);
+    std::vector<std::string_view> views;
+    for (int i = 0; i < 1000; ++i)
+    {
+        views.push_back(pool.intern(std::to_string(i)));
+    }
+    EXPECT_EQ(large, l);
+    EXPECT_EQ("course.kcl", c);
+    for (int i = 0; i < 1000; ++i)
+    {
+        EXPECT_EQ(std::to_string(i), views[i]);
+    }
+
+    StringPool moved(std::move(pool));
+    EXPECT_EQ(1003, moved.count());
+    EXPECT_EQ(0, pool.count());
+    EXPECT_EQ(a.data(), moved.intern("course_model.brres").data());
+}
+
+TEST(ParallelTests, ForEach)
+{
+    for (uint32_t threads : {0u, 1u, 4u})
+    {
+        std::vector<int> visits(1000, 0);
+        Parallel::forEach(visits.size(), threads, [&](size_t i) { ++visits[i]; });
+        EXPECT_EQ(std::vector<int>(1000, 1), visits);
+
+        std::vector<int> chunks(1000, 0);
+        Parallel::forChunks(chunks.size(), threads, 64, [&](size_t begin, size_t end) {
+            EXPECT_LE(end - begin, 64);
+            for (size_t i = begin; i < end; ++i)
+            {
+                ++chunks[i];
+            }
+        });
+        EXPECT_EQ(std::vector<int>(1000, 1), chunks);
+    }
+
+    // every index is still processed when one throws
+    std::vector<int> visits(100, 0);
+    EXPECT_THROW(Parallel::forEach(visits.size(), 4, [&](size_t i) {
+        ++visits[i];
+        if (i == 10)
+        {
+            throw std::runtime_error("index 10");
+        }
+    }), std::runtime_error);
+    EXPECT_EQ(std::vector<int>(100, 1), visits);
+
+    Parallel::forEach(0, 4, [](size_t) { FAIL(); });
+}